@@ -0,0 +1,70 @@
+//
+// Created by Nathaniel Rupprecht on 10/17/26.
+//
+
+#include <chrono>
+#include <filesystem>
+#include <iostream>
+#include <string>
+
+#include "NeverSQL/data/btree/EntryCreator.h"
+#include "NeverSQL/data/internals/Utility.h"
+#include "NeverSQL/database/DataManager.h"
+
+using namespace neversql;
+
+//! \brief Time reading back medium sized documents, between 300 bytes and 2 KiB, and count how many of them
+//!        had to be read from overflow pages.
+//!
+//! Usage: overflow-benchmark [number of documents] [number of rounds] [database path]
+int main(int argc, char** argv) {
+  const int num_documents = 1 < argc ? std::stoi(argv[1]) : 20000;
+  const int num_rounds = 2 < argc ? std::stoi(argv[2]) : 5;
+  const std::filesystem::path database_path =
+      3 < argc ? std::filesystem::path(argv[3])
+               : std::filesystem::temp_directory_path() / "neversql-overflow-benchmark";
+
+  std::filesystem::remove_all(database_path);
+  DataManager manager(database_path);
+  manager.AddCollection("documents", DataTypeEnum::UInt64);
+
+  // Spread the document sizes over the range, and visit the documents in a scrambled order.
+  auto text_size = [](int i) { return static_cast<std::size_t>(300 + (i * 389) % (2048 - 300)); };
+  auto scrambled = [num_documents](int i) { return (i * 7919) % num_documents; };
+
+  const auto insert_start = std::chrono::steady_clock::now();
+  for (int i = 0; i < num_documents; ++i) {
+    Document document;
+    document.AddElement("number", IntegralValue {i});
+    document.AddElement("text", StringValue {std::string(text_size(i), 'a' + i % 26)});
+    manager.AddValue("documents", document);
+  }
+  const auto insert_time = std::chrono::steady_clock::now() - insert_start;
+
+  std::size_t num_overflow_reads = 0;
+  const auto read_start = std::chrono::steady_clock::now();
+  for (int round = 0; round < num_rounds; ++round) {
+    for (int i = 0; i < num_documents; ++i) {
+      auto result = manager.Retrieve("documents", static_cast<primary_key_t>(scrambled(i)));
+      NOSQL_ASSERT(result.IsFound(), "document " << scrambled(i) << " was not found");
+      num_overflow_reads += !internal::GetIsSinglePageEntry(result.entry_flags)
+          && !internal::GetIsBlobEntry(result.entry_flags);
+      auto document = internal::EntryToDocument(*result.entry);
+      NOSQL_ASSERT(document->TryGetAs<std::string>("text")->size() == text_size(scrambled(i)),
+                   "document " << scrambled(i) << " was not read back");
+    }
+  }
+  const auto read_time = std::chrono::steady_clock::now() - read_start;
+
+  const auto num_reads = static_cast<double>(num_rounds) * num_documents;
+  std::cout << "Documents: " << num_documents << std::endl;
+  std::cout << "Pages: " << manager.GetDataAccessLayer().GetNumPages() << std::endl;
+  std::cout << "Insert: " << std::chrono::duration<double, std::micro>(insert_time).count() / num_documents
+            << " us per document" << std::endl;
+  std::cout << "Read: " << std::chrono::duration<double, std::micro>(read_time).count() / num_reads
+            << " us per document" << std::endl;
+  std::cout << "Overflow reads: " << num_overflow_reads << " of " << num_reads << std::endl;
+
+  std::filesystem::remove_all(database_path);
+  return 0;
+}
@@ -0,0 +1,72 @@
+//
+// Created by Nathaniel Rupprecht on 10/17/26.
+//
+
+#include <chrono>
+#include <filesystem>
+#include <iostream>
+#include <string>
+
+#include "NeverSQL/data/internals/Utility.h"
+#include "NeverSQL/database/DataManager.h"
+
+using namespace neversql;
+
+//! \brief Time point lookups in a collection with integer keys and a collection with string keys.
+//!
+//! Usage: point-lookup-benchmark [number of entries] [number of rounds] [database path]
+int main(int argc, char** argv) {
+  const int num_entries = 1 < argc ? std::stoi(argv[1]) : 20000;
+  const int num_rounds = 2 < argc ? std::stoi(argv[2]) : 5;
+  const std::filesystem::path database_path =
+      3 < argc ? std::filesystem::path(argv[3])
+               : std::filesystem::temp_directory_path() / "neversql-point-lookup-benchmark";
+
+  std::filesystem::remove_all(database_path);
+  DataManager manager(database_path);
+  manager.AddCollection("integers", DataTypeEnum::UInt64);
+  manager.AddCollection("strings", DataTypeEnum::String);
+
+  // Visit the keys in a scrambled order, so consecutive lookups do not hit the same leaf.
+  auto scrambled = [num_entries](int i) { return (i * 7919) % num_entries; };
+  auto string_key = [](int number) { return "user/" + std::to_string(1000000 + number); };
+
+  for (int i = 0; i < num_entries; ++i) {
+    Document document;
+    document.AddElement("number", IntegralValue {i});
+    manager.AddValue("integers", document);
+    manager.AddValue("strings", internal::SpanValue(string_key(scrambled(i))), document);
+  }
+
+  std::vector<std::string> string_keys;
+  string_keys.reserve(num_entries);
+  for (int i = 0; i < num_entries; ++i) {
+    string_keys.push_back(string_key(scrambled(i)));
+  }
+
+  auto time_lookups = [&](auto&& lookup) {
+    std::size_t num_found = 0;
+    const auto start = std::chrono::steady_clock::now();
+    for (int round = 0; round < num_rounds; ++round) {
+      for (int i = 0; i < num_entries; ++i) {
+        num_found += lookup(i);
+      }
+    }
+    const auto elapsed = std::chrono::steady_clock::now() - start;
+    NOSQL_ASSERT(num_found == static_cast<std::size_t>(num_rounds) * num_entries, "not every key was found");
+    return std::chrono::duration<double, std::nano>(elapsed).count() / (num_rounds * num_entries);
+  };
+
+  const auto integer_time = time_lookups([&](int i) {
+    return manager.Retrieve("integers", static_cast<primary_key_t>(scrambled(i))).IsFound();
+  });
+  const auto string_time = time_lookups(
+      [&](int i) { return manager.Retrieve("strings", internal::SpanValue(string_keys[i])).IsFound(); });
+
+  std::cout << "Entries per collection: " << num_entries << std::endl;
+  std::cout << "Integer keys: " << integer_time << " ns per lookup" << std::endl;
+  std::cout << "String keys:  " << string_time << " ns per lookup" << std::endl;
+
+  std::filesystem::remove_all(database_path);
+  return 0;
+}
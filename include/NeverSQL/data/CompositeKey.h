@@ -0,0 +1,74 @@
+//
+// Created by Nathaniel Rupprecht on 10/17/26.
+//
+
+#pragma once
+
+#include <span>
+#include <string_view>
+#include <vector>
+
+#include "NeverSQL/utility/DataTypes.h"
+#include "NeverSQL/utility/Defines.h"
+
+namespace neversql {
+
+//! \brief Builds a key for a collection whose key is a tuple of fields, e.g. (tenant: Int64, timestamp:
+//!        DateTime, id: UInt64), by adding the fields one at a time.
+//!
+//! The fields must be added in the order, and with the types, that the collection was declared with. A key
+//! with only the first few fields can be used as a bound of a range scan, or as the prefix of a prefix scan,
+//! which visits every key that starts with those fields. See KeyEncoding.h for how the key is encoded.
+class CompositeKey {
+public:
+  //! \brief Add a field of some type, given in its native form (see KeyEncoding.h).
+  CompositeKey& Add(DataTypeEnum field_type, std::span<const std::byte> native_field);
+
+  //! \brief Add a UInt64 field.
+  CompositeKey& Add(uint64_t value);
+
+  //! \brief Add an Int64 field.
+  CompositeKey& Add(int64_t value);
+
+  //! \brief Add an Int32 field.
+  CompositeKey& Add(int32_t value);
+
+  //! \brief Add a Double field.
+  CompositeKey& Add(double value);
+
+  //! \brief Add a Boolean field.
+  CompositeKey& Add(bool value);
+
+  //! \brief Add a String field.
+  CompositeKey& Add(std::string_view value);
+
+  //! \brief Add a String field. This overload keeps string literals from being added as Boolean fields.
+  CompositeKey& Add(const char* value) { return Add(std::string_view(value)); }
+
+  //! \brief Add a DateTime field, given as a count of microseconds since the epoch.
+  CompositeKey& AddDateTime(int64_t microseconds);
+
+  //! \brief Add a BinaryData field.
+  CompositeKey& AddBinary(std::span<const std::byte> value);
+
+  //! \brief Get the encoded key.
+  NO_DISCARD std::span<const std::byte> Get() const noexcept { return key_; }
+
+  //! \brief Composite keys can be passed wherever a key is expected.
+  operator std::span<const std::byte>() const noexcept { return Get(); }
+
+  //! \brief Get the types of the fields that were added so far.
+  NO_DISCARD const std::vector<DataTypeEnum>& GetFieldTypes() const noexcept { return field_types_; }
+
+  //! \brief Get the number of fields that were added so far.
+  NO_DISCARD std::size_t GetNumFields() const noexcept { return field_types_.size(); }
+
+private:
+  //! \brief The encoded key.
+  std::vector<std::byte> key_;
+
+  //! \brief The types of the fields in the key.
+  std::vector<DataTypeEnum> field_types_;
+};
+
+}  // namespace neversql
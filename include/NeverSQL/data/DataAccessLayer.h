@@ -37,6 +37,16 @@ public:
   //! \brief Get a new page from the DAL and read its meta data into the provided Page object.
   void GetNewPage(Page& page);
 
+  //! \brief Get a run of num_pages consecutive new pages from the DAL, returning the first page number.
+  NO_DISCARD page_number_t GetNewExtent(page_number_t num_pages);
+
+  //! \brief Release a run of consecutive pages, which was gotten with GetNewExtent, back to the DAL.
+  void ReleaseExtent(page_number_t first_page, page_number_t num_pages);
+
+  //! \brief Read a run of consecutive pages into a buffer with a single read. The buffer must be large
+  //!        enough for all the pages.
+  void ReadPages(page_number_t first_page, page_number_t num_pages, std::span<std::byte> buffer) const;
+
   //! \brief Write a page back to the DAL.
   void WriteBackPage(const Page& page) const;
 
@@ -14,6 +14,7 @@
 #include <unistd.h>
 
 #include "NeverSQL/utility/DataTypes.h"
+#include "internals/SegmentedBuffer.h"
 #include "internals/Utility.h"
 
 namespace neversql {
@@ -29,6 +30,9 @@ public:
 
   void InitializeFromBuffer(std::span<const std::byte>& buffer);
 
+  //! \brief Initialize the document value from a buffer that may be split into several parts.
+  void InitializeFromBuffer(internal::SegmentedBuffer& buffer);
+
   std::size_t CalculateRequiredSize(bool with_enum = true) const;
 
   void PrintToStream(std::ostream& out, std::size_t indent = 0) const;
@@ -54,7 +58,7 @@ protected:
   //! \brief Calculate the size required by the writeData function.
   virtual std::size_t calculateRequiredDataSize() const = 0;
   //! \brief Initialize the document value from a data representation in a buffer.
-  virtual void initializeFromBuffer(std::span<const std::byte>& buffer) = 0;
+  virtual void initializeFromBuffer(internal::SegmentedBuffer& buffer) = 0;
 
   virtual void printToStream(std::ostream& out, std::size_t indent) const = 0;
 
@@ -72,7 +76,7 @@ private:
   std::any getData() const override { return value_; }
   void writeData(lightning::memory::BasicMemoryBuffer<std::byte>& buffer) const override;
   std::size_t calculateRequiredDataSize() const override;
-  void initializeFromBuffer(std::span<const std::byte>& buffer) override;
+  void initializeFromBuffer(internal::SegmentedBuffer& buffer) override;
   void printToStream(std::ostream& out, std::size_t indent) const override;
 
   double value_ {};
@@ -100,9 +104,8 @@ private:
 
   std::size_t calculateRequiredDataSize() const override { return sizeof(Integral_t); }
 
-  void initializeFromBuffer(std::span<const std::byte>& buffer) override {
-    std::memcpy(&value_, buffer.data(), sizeof(Integral_t));
-    buffer = buffer.subspan(sizeof(Integral_t));
+  void initializeFromBuffer(internal::SegmentedBuffer& buffer) override {
+    value_ = buffer.Read<Integral_t>();
   }
 
   void printToStream(std::ostream& out, [[maybe_unused]] std::size_t indent) const override { out << value_; }
@@ -122,7 +125,7 @@ private:
 
   void writeData(lightning::memory::BasicMemoryBuffer<std::byte>& buffer) const override;
   std::size_t calculateRequiredDataSize() const override;
-  void initializeFromBuffer(std::span<const std::byte>& buffer) override;
+  void initializeFromBuffer(internal::SegmentedBuffer& buffer) override;
   void printToStream(std::ostream& out, std::size_t indent) const override;
 
   bool value_ {};
@@ -141,7 +144,7 @@ private:
 
   void writeData(lightning::memory::BasicMemoryBuffer<std::byte>& buffer) const override;
   std::size_t calculateRequiredDataSize() const override;
-  void initializeFromBuffer(std::span<const std::byte>& buffer) override;
+  void initializeFromBuffer(internal::SegmentedBuffer& buffer) override;
   void printToStream(std::ostream& out, std::size_t indent) const override;
 
   std::string value_;
@@ -162,12 +165,15 @@ public:
 
   const DocumentValue& GetElement(std::size_t index) const;
 
+  //! \brief Get the number of elements in the array.
+  std::size_t GetNumElements() const noexcept { return values_.size(); }
+
 private:
   std::any getData() const override { NOSQL_FAIL("ArrayValue has no GetData"); }
 
   void writeData(lightning::memory::BasicMemoryBuffer<std::byte>& buffer) const override;
   std::size_t calculateRequiredDataSize() const override;
-  void initializeFromBuffer(std::span<const std::byte>& buffer) override;
+  void initializeFromBuffer(internal::SegmentedBuffer& buffer) override;
   void printToStream(std::ostream& out, std::size_t indent) const override;
 
   DataTypeEnum element_type_;
@@ -212,11 +218,16 @@ public:
 
   DataTypeEnum GetFieldType(std::size_t index) const;
 
+  //! \brief Write a document that has only some of the fields of this document to a buffer, in the same form
+  //!        as WriteToBuffer. Fields that this document does not have are left out.
+  void WriteFieldsToBuffer(lightning::memory::BasicMemoryBuffer<std::byte>& buffer,
+                           std::span<const std::string> field_names) const;
+
 protected:
   std::any getData() const override { NOSQL_FAIL("ArrayValue has no GetData"); }
   void writeData(lightning::memory::BasicMemoryBuffer<std::byte>& buffer) const override;
   std::size_t calculateRequiredDataSize() const override;
-  void initializeFromBuffer(std::span<const std::byte>& buffer) override;
+  void initializeFromBuffer(internal::SegmentedBuffer& buffer) override;
   void printToStream(std::ostream& out, std::size_t indent) const override;
 
   std::vector<std::pair<std::string, std::unique_ptr<DocumentValue>>> elements_;
@@ -232,6 +243,10 @@ std::unique_ptr<DocumentValue> ReadFromBuffer(std::span<const std::byte> buffer)
 //! \brief Read a document from a buffer.
 std::unique_ptr<Document> ReadDocumentFromBuffer(std::span<const std::byte> buffer, bool expect_enum = true);
 
+//! \brief Read a document from a buffer that may be split into several parts, e.g. the parts of an entry that
+//!        is stored across overflow pages, without copying the parts into one buffer.
+std::unique_ptr<Document> ReadDocumentFromBuffer(internal::SegmentedBuffer& buffer, bool expect_enum = true);
+
 void PrettyPrint(const Document& document, std::ostream& out);
 std::string PrettyPrint(const Document& document);
 
@@ -5,6 +5,7 @@
 #pragma once
 
 #include <deque>
+#include <map>
 
 #include "NeverSQL/utility/Defines.h"
 
@@ -31,6 +32,14 @@ public:
   //!        if the page was not acquired in the first place.
   bool ReleasePage(page_number_t page_number);
 
+  //! \brief Get the first page of a run of num_pages consecutive pages. Uses the smallest freed run that is
+  //!        large enough, otherwise allocates new pages. Returns nullopt if no run can be found or allocated.
+  NO_DISCARD std::optional<page_number_t> GetNextExtent(page_number_t num_pages);
+
+  //! \brief Release a run of consecutive pages back to the free list. The run is kept together, and merged
+  //!        with freed runs that it borders, so it can be handed out as a run again.
+  void ReleaseExtent(page_number_t first_page, page_number_t num_pages);
+
   //! \brief Get the number of allocated pages.
   NO_DISCARD page_number_t GetNumAllocatedPages() const;
 
@@ -50,6 +59,9 @@ private:
   //! \brief Deque of freed pages.
   std::deque<page_number_t> freed_pages_;
 
+  //! \brief Freed runs of consecutive pages, from the first page of each run to the number of pages in it.
+  std::map<page_number_t, page_number_t> freed_extents_;
+
   //! \brief The total number of allocated pages, also, the next page number to be allocated.
   page_number_t next_page_number_ = 0;
 
@@ -4,6 +4,9 @@
 
 #pragma once
 
+#include <atomic>
+#include <map>
+#include <mutex>
 #include <unordered_map>
 #include <vector>
 
@@ -13,8 +16,27 @@
 
 namespace neversql {
 
+//! \brief At most this fraction of a page cache's slots can be pinned, so there are always slots left to load
+//!        other pages into.
+inline constexpr std::size_t MAX_PINNED_PAGES_DIVISOR = 4;
+
+//! \brief Something that pins pages in a page cache, e.g. a B-tree. The pages that can be pinned are shared
+//!        evenly between the owners that are registered with the cache, and an owner that has more than its
+//!        share is asked to give pages back when another owner needs them.
+class PinOwner {
+public:
+  virtual ~PinOwner() = default;
+
+  //! \brief Give pinned pages back, with UnpinPage, until at most a number of pages are pinned. Pages that
+  //!        are still in use can be given back later. Called with the page cache locked.
+  virtual void ReleasePins(std::size_t max_pinned_pages) const = 0;
+};
+
 //! \brief Class that keeps a cache of pages in memory. This is useful for reducing the number of reads and
 //!        writes to the disk, pages that are frequently used can be kept in memory.
+//!
+//! The cache can be used from several threads. Handing out and releasing pages is synchronized, what threads
+//! do with the contents of the pages is up to them.
 class PageCache {
 public:
   //! \brief Construct a new page cache with a prescribed cache size operating over a particular data access
@@ -32,12 +54,57 @@ public:
   //! \brief Get a new page from the page cache.
   std::unique_ptr<Page> GetNewPage();
 
+  //! \brief Get a run of num_pages consecutive new pages, returning the first page number. The pages are
+  //!        not loaded into the cache, use GetBlankPage to write them.
+  page_number_t GetNewExtent(page_number_t num_pages);
+
+  //! \brief Get a page of an extent that was gotten from GetNewExtent, without reading the page from the
+  //!        disk. The page's contents are undefined until they are written.
+  std::unique_ptr<Page> GetBlankPage(page_number_t page_number);
+
+  //! \brief Load a run of consecutive pages into the cache, reading the pages that are not already in the
+  //!        cache with a single read. At most a MAX_PINNED_PAGES_DIVISOR-th of the cache is loaded at once,
+  //!        the rest of the pages are read when they are requested.
+  void LoadExtent(page_number_t first_page, page_number_t num_pages);
+
+  //! \brief Release a run of consecutive pages that was gotten from GetNewExtent. Cached copies of the pages
+  //!        are dropped without being written back.
+  void ReleaseExtent(page_number_t first_page, page_number_t num_pages);
+
+  //! \brief Register an owner of pinned pages, see PinOwner.
+  void AddPinOwner(const PinOwner& owner);
+
+  //! \brief Unregister an owner of pinned pages. The owner must have given back all its pages.
+  void RemovePinOwner(const PinOwner& owner);
+
+  //! \brief Request a page that stays in the cache until it is given back with UnpinPage. Returns null if the
+  //!        owner already has its share of the pages that can be pinned, or if no more pages can be pinned.
+  //!        In the second case, owners that have more than their share are asked to give pages back, so a
+  //!        later request can succeed.
+  std::unique_ptr<Page> PinPage(page_number_t page_number, const PinOwner& owner);
+
+  //! \brief Give back a page that was pinned with PinPage.
+  void UnpinPage(std::unique_ptr<Page> page, const PinOwner& owner);
+
+  //! \brief Check whether an owner has fewer pinned pages than its share, so its requests that fail now
+  //!        can succeed later, once other owners gave pages back.
+  bool IsBelowPinShare(const PinOwner& owner) const;
+
+  //! \brief Get the number of pages that are pinned in the cache.
+  std::size_t GetNumPinnedPages() const {
+    std::lock_guard guard(cache_lock_);
+    return num_pinned_pages_;
+  }
+
   //! \brief Release a page back to the page cache.
   void ReleasePage(page_number_t page_number);
 
   //! \brief Indicates that data has been written to the page in a particular slot.
   void SetDirty(std::size_t slot);
 
+  //! \brief Get the size of the pages in the cache.
+  page_size_t GetPageSize() const { return data_access_layer_->GetPageSize(); }
+
   //! \brief Get the write ahead log.
   WriteAheadLog& GetWAL() { return wal_; }
 
@@ -55,7 +122,8 @@ private:
     //! V: Valid bit, 1 if an actual page is stored here.
     //! C: Second chance bit, set to 1 whenever the page is referenced, set to 0 whenever the clock hand
     //! passes by it.
-    uint8_t flags {};
+    //! The flags are atomic, so writers can mark their pages as dirty without locking the cache.
+    std::atomic<uint8_t> flags {};
 
     NO_DISCARD bool IsValid() const noexcept { return (flags & 0x1) != 0; }
     NO_DISCARD bool IsDirty() const noexcept { return (flags & 0x2) != 0; }
@@ -97,6 +165,9 @@ private:
     }
   };
 
+  //! \brief Request a page from the page cache. The cache must be locked.
+  std::unique_ptr<Page> getPage(page_number_t page_number);
+
   //! \brief Flush a page to the disk.
   void flushPage(const Page& page);
 
@@ -124,10 +195,17 @@ private:
   //! \brief Choose the next "victim" to evict from the cache and release it from the page cache.
   std::size_t evictNextVictim();
 
+  //! \brief Get the number of pages that each owner of pinned pages can pin. The cache must be locked.
+  std::size_t getPinShare() const;
+
   // =================================================================================================
   //  Private members.
   // =================================================================================================
 
+  //! \brief Lock for the cache's bookkeeping. It is recursive, since releasing a page handle while the cache
+  //!        is locked, e.g. when a page is evicted, calls back into the cache.
+  mutable std::recursive_mutex cache_lock_;
+
   //! \brief The write ahead logging manager.
   WriteAheadLog wal_;
 
@@ -152,6 +230,12 @@ private:
   //! \brief Free list for the cache.
   FreeList cache_free_list_;
 
+  //! \brief The number of pages that were pinned with PinPage and not yet unpinned.
+  std::size_t num_pinned_pages_ = 0;
+
+  //! \brief The owners of pinned pages, and how many pages each of them has pinned.
+  std::map<const PinOwner*, std::size_t> pin_owners_;
+
   // TEMPORARY.
   std::size_t next_victim_ = 0;
 };
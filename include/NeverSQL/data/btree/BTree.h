@@ -4,9 +4,16 @@
 
 #pragma once
 
+#include <array>
+#include <atomic>
+#include <functional>
 #include <memory>
+#include <mutex>
+#include <optional>
+#include <shared_mutex>
 #include <span>
 #include <stack>
+#include <unordered_map>
 #include <variant>
 #include <vector>
 
@@ -14,6 +21,8 @@
 #include "NeverSQL/data/PageCache.h"
 #include "NeverSQL/data/btree/BTreeNodeMap.h"
 #include "NeverSQL/data/btree/EntryCreator.h"
+#include "NeverSQL/data/btree/OptimisticLatch.h"
+#include "NeverSQL/data/btree/OverflowSpaceMap.h"
 #include "NeverSQL/data/internals/DatabaseEntry.h"
 #include "NeverSQL/utility/DataTypes.h"
 
@@ -21,10 +30,63 @@ namespace neversql {
 
 namespace internal {
 // Forward declare friends of BTreeManager.
+class BlobEntry;
 class EntryCreator;
 class OverflowEntry;
 }  // namespace internal
 
+namespace query {
+class BTreeQueryIterator;
+}  // namespace query
+
+//! \brief The number of nodes whose recent inserts a B-tree remembers, to choose where to split them.
+inline constexpr std::size_t INSERT_HISTORY_SIZE = 64;
+
+//! \brief How many inserts in a row have to go right after (or right before) the previous insert into a node
+//!        for the inserts to count as sequential when the node is split.
+inline constexpr int32_t SEQUENTIAL_INSERT_RUN = 4;
+
+//! \brief How many entries are added to a B-tree between adjustments of its maximum entry size to the sizes
+//!        of the entries that were added.
+inline constexpr std::size_t TUNING_SAMPLE_INTERVAL = 1024;
+
+//! \brief The number of entry size classes a B-tree tracks. Entries in class i are at most 2^i bytes, larger
+//!        entries are counted in the last class.
+inline constexpr std::size_t NUM_ENTRY_SIZE_CLASSES = 17;
+
+//! \brief The number of latches that guard the nodes of a B-tree. Nodes are assigned to latches by page
+//!        number, so nodes that share a latch only cause each other's readers to restart spuriously.
+inline constexpr std::size_t NUM_NODE_LATCHES = 1024;
+
+//! \brief Limits on the entries of a B-tree, which decide when an entry is moved to overflow pages and when
+//!        a page is split.
+//!
+//! The limits are derived from the page size when a tree is created, and are stored in the tree's root page.
+//! The maximum entry size is adjusted to the sizes of the entries that are added to the tree.
+struct BTreeTuning {
+  //! \brief The maximum entry size, in bytes, before an overflow page is needed.
+  page_size_t max_entry_size {};
+
+  //! \brief The minimum amount of space, in bytes, to have to allow an entry to be added to a page.
+  page_size_t min_space_for_entry {};
+
+  //! \brief The maximum number of entries per page.
+  page_size_t max_entries_per_page {};
+
+  //! \brief The tuning of a new B-tree whose pages have the given size.
+  static BTreeTuning ForPageSize(page_size_t page_size) noexcept;
+
+  //! \brief The smallest maximum entry size for pages of the given size. Entries this large can always be
+  //!        stored in a page.
+  static page_size_t SmallestMaxEntrySize(page_size_t page_size) noexcept { return page_size / 16; }
+
+  //! \brief The largest maximum entry size for pages of the given size. This leaves room for at least two
+  //!        entries and their keys in a leaf, so splitting a leaf always leaves entries on both sides.
+  static page_size_t LargestMaxEntrySize(page_size_t page_size) noexcept { return page_size / 3; }
+
+  bool operator==(const BTreeTuning&) const = default;
+};
+
 //! \brief Structure used to represent a position in the B-tree.
 //!
 //! Represents the page, and the index of the cell in the page.
@@ -37,6 +99,13 @@ struct SearchResult {
   TreePosition path;
   std::optional<BTreeNodeMap> node;
 
+  //! \brief Whether the node that was found is the rightmost leaf of the tree, i.e. every pointer followed on
+  //!        the way down was the rightmost pointer of its page.
+  bool is_rightmost_leaf = false;
+
+  //! \brief The version of the found node's latch when the node was searched.
+  uint64_t leaf_version {};
+
   //! \brief Get how many layers had to be searched to find the node.
   std::size_t GetSearchDepth() const noexcept { return path.Size(); }
 
@@ -49,9 +118,34 @@ struct RetrievalResult {
 
   std::unique_ptr<internal::DatabaseEntry> entry;
 
+  //! \brief The flags of the entry's cell, which tell how the entry is stored, e.g. in overflow or blob
+  //!        pages. The entry itself is always a copy.
+  std::byte entry_flags {};
+
   bool IsFound() const noexcept { return search_result.IsFound(); }
 };
 
+//! \brief A range of keys in a B-tree. A bound that is not set means the range is unbounded on that side.
+struct KeyRange {
+  //! \brief The smallest key in the range.
+  std::optional<GeneralKey> lower {};
+
+  //! \brief The largest key in the range.
+  std::optional<GeneralKey> upper {};
+
+  //! \brief Whether a key equal to the lower bound is in the range.
+  bool lower_inclusive = true;
+
+  //! \brief Whether a key equal to the upper bound is in the range.
+  bool upper_inclusive = true;
+};
+
+//! \brief The order in which an iterator visits the entries of a B-tree.
+enum class ScanDirection : uint8_t {
+  Ascending,
+  Descending,
+};
+
 //! \brief Convenient structure for packing up data to store in a B-tree.
 struct StoreData {
   //! \brief The key is some collection of bytes. It is context dependent how to compare different keys.
@@ -67,6 +161,10 @@ struct StoreData {
 
   //! \brief Whether to serialize the size of the data.
   bool serialize_data_size = true;
+
+  //! \brief If set, the index of the first key in the node that is not less than the key, as found by the
+  //!        search that found the node. Saves searching the node again to find where the key goes.
+  std::optional<page_size_t> lower_bound {};
 };
 
 //! \brief Structure that represents the result of splitting a page.
@@ -76,26 +174,55 @@ struct SplitPage {
 
   lightning::memory::MemoryBuffer<std::byte> split_key {};
 
+  //! \brief The number of entries in the subtree of the left page.
+  uint64_t left_num_entries {};
+
   void SetKey(GeneralKey key) { split_key.Append(key); }
 };
 
 //! \brief An object that manages a B-tree structure for the NeverSQL database.
 //!
 //! Technically, a B+ tree, since all data is stored in leaf nodes.
-class BTreeManager {
+//!
+//! The tree can be searched and written to from several threads, using optimistic lock coupling. Every node
+//! has a version latch. Searches take no locks, they check that the version of each node they read did not
+//! change while they read it, and restart if it did. Lookups copy the entry they found out of its page and
+//! validate the leaf again, so they never return data that a writer tore.
+//!
+//! Writers search the same way, then lock the latch of the leaf they found, which fails if the leaf changed
+//! since the search, in which case they search again. A write that splits the leaf also locks the leaf's left
+//! neighbor, the parent, and every ancestor that the split may split too, and restarts if another writer
+//! holds any of them. Writes to different leaves run concurrently. The state that all writers share has
+//! small locks of its own: the entry counts in the interior nodes, which every insert and remove updates,
+//! the overflow pages and their space map, and the insert history. The key counter and the tuning are
+//! atomic. Iterators take no locks, they remember the version of their leaf, and find their key again if a
+//! writer changed the leaf.
+class BTreeManager : private PinOwner {
   friend class DataManager;
 
   friend class internal::EntryCreator;
 
   friend class internal::OverflowEntry;
 
+  friend class internal::BlobEntry;
+
+  friend class query::BTreeQueryIterator;
+
 public:
   explicit BTreeManager(page_number_t root_page, PageCache& page_cache);
 
+  //! \brief Checkpoints any state that is only held in memory back to the root page.
+  ~BTreeManager() override;
+
   //! \brief Set up a new B-tree, returning the root page.
   static std::unique_ptr<BTreeManager> CreateNewBTree(PageCache& page_cache, DataTypeEnum key_type);
 
-  //! \brief Add a value with a specified key to the BTree.
+  //! \brief Set up a new B-tree whose keys are composite keys with the given field types (see CompositeKey).
+  static std::unique_ptr<BTreeManager> CreateNewBTree(PageCache& page_cache,
+                                                      std::span<const DataTypeEnum> key_fields);
+
+  //! \brief Add a value with a specified key to the BTree. The key is given in its native form, see
+  //!        KeyEncoding.h.
   void AddValue(GeneralKey key, internal::EntryCreator& entry_creator);
 
   //! \brief Add a value with an auto-incrementing key to the B-tree.
@@ -103,18 +230,69 @@ public:
   //! Only works if the B-tree is configured to generate auto-incrementing keys.
   //!
   //! \param entry_creator The entry creator that knows how to create an entry in the btree.
-  void AddValue(internal::EntryCreator& entry_creator);
+  //! \return The key that the value was added with.
+  primary_key_t AddValue(internal::EntryCreator& entry_creator);
+
+  //! \brief Add a value whose key is larger than every key in the B-tree, e.g. when loading entries that were
+  //!        sorted beforehand. The value goes directly to the rightmost leaf, without a search from the root,
+  //!        and the leaves are filled completely before they are split.
+  void AppendValue(GeneralKey key, internal::EntryCreator& entry_creator);
+
+  //! \brief Visit the entries whose (normalized) keys come after a key, or all entries if no key is given,
+  //!        in key order, stopping after a number of entries. Each entry is copied out of the tree before it
+  //!        is visited, writers can change the tree during the batch. Returns the number of entries that were
+  //!        visited.
+  std::size_t ScanBatch(std::optional<GeneralKey> after,
+                        std::size_t max_entries,
+                        const std::function<void(GeneralKey, internal::DatabaseEntry&)>& visitor) const;
+
+  //! \brief Remove the value with a key from the B-tree. The key is given in its native form. Returns false
+  //!        if there is no value with the key.
+  //!
+  //! The space of the removed cell is kept in the page's freeblock list, to be reused by later inserts.
+  //! Pages are not merged when they become empty. If the value was stored in overflow pages, its parts are
+  //! removed from them and their space is reused by later overflow entries. If it was stored in blob pages,
+  //! the run of blob pages is freed.
+  bool RemoveValue(GeneralKey key);
+
+  //! \brief Set how full a node is left when it is split during a run of sequential inserts, as a fraction
+  //!        of the entries in the node. The default, 1, keeps every entry before the insert point, which
+  //!        packs pages completely when keys are appended. Lower values leave room for later inserts between
+  //!        the keys. Nodes that see random inserts are always split in half.
+  void SetSplitFillFactor(double fill_factor);
+
+  //! \brief Get the fill factor for nodes that are split during a run of sequential inserts.
+  double GetSplitFillFactor() const noexcept { return split_fill_factor_.load(std::memory_order_relaxed); }
+
+  //! \brief Get the entry size limits that the B-tree currently uses.
+  BTreeTuning GetTuning() const noexcept;
+
+  //! \brief Check that the node a search found was not changed since the search.
+  //!
+  //! Retrieved entries are copied out of their leaf while the leaf is unchanged, so they are always whole. A
+  //! reader can check this afterwards to find out whether the entry may already be out of date.
+  bool Validate(const SearchResult& result) const noexcept;
 
   //! \brief Get the root page number of the B-tree.
   page_number_t GetRootPageNumber() const noexcept { return root_page_; }
 
+  //! \brief Write any B-tree state that is kept in memory, e.g. the auto-incrementing key counter and the
+  //!        tuning, back to the root page, and the overflow space map back to its page.
+  void Checkpoint();
+
+  //! \brief An iterator over the entries of the B-tree, in key order.
+  //!
+  //! The iterator takes no locks. It remembers the key of its entry and the version of its leaf, and if a
+  //! writer changed the leaf since its last operation, it finds the key again. If the entry was removed, the
+  //! iterator moves on to the entry after it in the direction of iteration. Operations that read a leaf while
+  //! a writer changes it are restarted. Dereferencing the iterator copies the entry out of the tree.
   class Iterator {
   public:
     using difference_type = std::ptrdiff_t;
     using value_type = std::unique_ptr<internal::DatabaseEntry>;
     using pointer = value_type*;
     using reference = value_type&;
-    using iterator_category = std::forward_iterator_tag;
+    using iterator_category = std::bidirectional_iterator_tag;
 
     Iterator() = default;
 
@@ -123,56 +301,319 @@ public:
     Iterator& operator=(const Iterator& other) = default;
     Iterator& operator=(Iterator&& other) = default;
 
-    //! \brief Create a begin iterator for the B-tree.
-    explicit Iterator(const BTreeManager& manager);
-
-    //! \brief Create a specific B-tree iterator.
-    Iterator(const BTreeManager& manager, FixedStack<std::pair<page_number_t, page_size_t>> progress);
+    //! \brief Create a begin iterator for the B-tree. For descending iteration, the iterator starts at the
+    //!        last entry and incrementing it moves towards the first entry.
+    explicit Iterator(const BTreeManager& manager, ScanDirection direction = ScanDirection::Ascending);
 
     //! \brief Create an end B-Tree iterator
     Iterator(const BTreeManager& manager, [[maybe_unused]] bool);
 
-    //! \brief Pre-incrementation operator.
+    //! \brief Pre-incrementation operator. Moves to the next entry in the direction of iteration.
     Iterator& operator++();
 
     //! \brief Post-incrementation operator.
     Iterator operator++(int);
 
+    //! \brief Pre-decrementation operator. Moves to the previous entry in the direction of iteration.
+    //!
+    //! Decrementing an end iterator moves it to the last entry in the direction of iteration. The stop bound
+    //! of a range scan only applies when incrementing.
+    Iterator& operator--();
+
+    //! \brief Post-decrementation operator.
+    Iterator operator--(int);
+
+    //! \brief Get a copy of the current entry. Null for an end iterator, or if the entry was removed and no
+    //!        entries are left after it.
     std::unique_ptr<internal::DatabaseEntry> operator*() const;
+
+    //! \brief Get the (normalized) key of the current entry, or an empty key for an end iterator.
+    std::vector<std::byte> GetKey() const;
+
     bool operator==(const Iterator& other) const;
     bool operator!=(const Iterator& other) const;
 
     bool IsEnd() const noexcept { return done(); }
 
+    //! \brief Get the direction in which the iterator moves when it is incremented.
+    ScanDirection GetDirection() const noexcept { return direction_; }
+
   private:
+    friend class BTreeManager;
+
     //! \brief Check if the iterator is at the end.
     bool done() const noexcept;
 
-    //! \brief Descend to the leftmost node in the tree given the page and pointer cell to start at.
-    void descend(const BTreeNodeMap& page, page_size_t index);
+    // The functions below that move the iterator return false if a leaf they read was changed by a writer,
+    // in which case the position is not valid, and the operation has to be restarted (see retry).
+
+    //! \brief Run an operation that moves the iterator, restarting it from the iterator's position until no
+    //!        leaf it read was changed by a writer. The operation records the key of the new position in its
+    //!        argument, which starts out as the current key.
+    void retry(const std::function<bool(std::vector<std::byte>&)>& operation) const;
+
+    //! \brief Move to the entry after the current one, in key order.
+    bool stepForward() const;
+
+    //! \brief Move to the entry before the current one, in key order.
+    bool stepBackward() const;
+
+    //! \brief Move to the first entry of the tree, in key order.
+    bool moveToFirst() const;
+
+    //! \brief Move to the last entry of the tree, in key order.
+    bool moveToLast() const;
+
+    //! \brief If the iterator is past the last cell of its leaf, move it to the first cell of the next leaf
+    //!        (following the right sibling pointers), or to the end if there are no more leaves.
+    bool settle() const;
+
+    //! \brief Make this an end iterator if a key, the key of the current entry, is past the stop bound.
+    void checkStopBound(GeneralKey key) const;
+
+    //! \brief Read the key of the current entry.
+    bool recordPosition(std::vector<std::byte>& key) const;
+
+    //! \brief If a writer changed the leaf since the iterator was positioned, find the current key again.
+    //!        Returns whether the key's entry was removed, in which case the iterator moved on to the entry
+    //!        after it, in the direction of iteration, and its key was recorded. Returns nothing if a leaf
+    //!        was changed while the key was found.
+    std::optional<bool> reposition(std::vector<std::byte>& key) const;
 
     //! \brief Reference to the B-tree being traversed.
     const BTreeManager* manager_{};
 
-    //! \brief The current progress at every level of the tree.
-    TreePosition progress_;
+    // The position is found again after writes to the tree, which const operations like dereferencing do
+    // too, so the members that describe it are mutable.
+
+    //! \brief The leaf page that the iterator is currently in. Zero (which is never a B-tree page) for an end
+    //!        iterator.
+    mutable page_number_t page_number_ {};
+
+    //! \brief The index of the current cell in the leaf page.
+    mutable page_size_t index_ {};
+
+    //! \brief The (normalized) key of the current entry.
+    mutable std::vector<std::byte> key_;
+
+    //! \brief The version of the leaf's latch at which the position was found.
+    mutable uint64_t version_ {};
+
+    //! \brief The direction the iterator moves in when it is incremented.
+    ScanDirection direction_ = ScanDirection::Ascending;
+
+    //! \brief If set, the iterator ends when it reaches a key past this key, in the direction of iteration.
+    std::optional<std::vector<std::byte>> stop_bound_;
+
+    //! \brief Whether the stop bound itself is part of the iteration.
+    bool stop_inclusive_ = true;
   };
 
   Iterator begin() const { return Iterator(*this); }
   Iterator end() const { return Iterator(*this, true); }
 
+  //! \brief Get an iterator that starts at the last entry of the tree and moves towards the first.
+  Iterator rbegin() const { return Iterator(*this, ScanDirection::Descending); }
+  Iterator rend() const { return Iterator(*this, true); }
+
+  //! \brief Get an iterator over all entries whose keys are in a range, in ascending or descending key order.
+  //!        The bounds are given in their native form.
+  //!
+  //! The iterator starts by searching for the bound it starts from (the lower bound for ascending scans, the
+  //! upper bound for descending scans), and becomes an end iterator once it reaches a key past the other
+  //! bound, without reading any of the entries past it.
+  Iterator Scan(const KeyRange& range, ScanDirection direction = ScanDirection::Ascending) const;
+
+  //! \brief Get an iterator over all entries whose keys start with a prefix, in ascending or descending key
+  //!        order. Only works for key types whose keys have variable size, e.g. strings, or composite keys,
+  //!        where the prefix is a composite key with only the first few fields.
+  Iterator ScanPrefix(GeneralKey prefix, ScanDirection direction = ScanDirection::Ascending) const;
+
+  //! \brief Count the entries in the B-tree.
+  //!
+  //! Every pointer cell in an interior node stores the number of entries in the subtree it points to, so this
+  //! only reads the nodes on the path to the rightmost leaf.
+  uint64_t Count() const;
+
+  //! \brief Count the entries whose keys are in a range, by finding the positions of the range's bounds.
+  uint64_t Count(const KeyRange& range) const;
+
+  //! \brief Get the number of interior nodes that are currently pinned in the page cache.
+  std::size_t GetNumPinnedNodes() const;
+
+  //! \brief Get an iterator that starts a number of entries into the B-tree, from the first entry for
+  //!        ascending iteration, or from the last entry for descending iteration. Used for offset based
+  //!        pagination.
+  //!
+  //! The entry counts in the interior nodes are used to find the leaf the entry is in, so the entries before
+  //! it are not visited. If the B-tree has no more entries than the offset, the iterator is an end iterator.
+  Iterator Skip(uint64_t offset, ScanDirection direction = ScanDirection::Ascending) const;
+
+  //! \brief Get the types of the fields of the B-tree's keys, if it has composite keys, or an empty span.
+  std::span<const DataTypeEnum> GetKeyFields() const noexcept { return key_fields_; }
+
 private:
+  //! \brief Set up a new B-tree with a key type, and the field types if the keys are composite keys.
+  static std::unique_ptr<BTreeManager> createNewBTree(PageCache& page_cache,
+                                                      DataTypeEnum key_type,
+                                                      std::span<const DataTypeEnum> key_fields);
+
   //! \brief Initialize the B-tree manager object from the data in its root page.
   void initialize();
 
+  //! \brief Normalize a key of the B-tree's key type, given in its native form. Keys are normalized once,
+  //!        when they enter the B-tree, and every function below works with normalized keys.
+  //!
+  //! Composite keys may have only their first few fields, unless is_complete is true.
+  internal::NormalizedKey normalizeKey(GeneralKey key, bool is_complete = false) const;
+
+  //! \brief Get an iterator over the entries whose keys are in a range whose bounds are normalized keys.
+  Iterator scan(const KeyRange& range, ScanDirection direction) const;
+
+  //! \brief Add a value with a normalized key to the B-tree.
+  void addValue(GeneralKey key, internal::EntryCreator& entry_creator);
+
   //! \brief Get the next primary key.
-  primary_key_t getNextPrimaryKey() const;
+  //!
+  //! The counter is kept in memory, and only written back to the root page by Checkpoint.
+  primary_key_t getNextPrimaryKey();
 
-  //! \brief Get a new page on which overflow entries can be written.
-  page_number_t getNextOverflowPage();
+  //! \brief Restore the auto-incrementing key counter when the tree is loaded. The counter is set past both
+  //!        the last checkpointed value and the largest key in the tree, so keys are never reused even if
+  //!        the last counter value was not checkpointed.
+  void recoverPrimaryKeyCounter();
 
-  //! \brief Get the current overflow page.
-  page_number_t getCurrentOverflowPage();
+  //! \brief Get the offset in the root page where the auto-incrementing key counter is stored.
+  page_size_t getPrimaryKeyCounterOffset(BTreeNodeMap& root) const;
+
+  //! \brief Get the offset in the root page where the tuning is stored.
+  page_size_t getTuningOffset(BTreeNodeMap& root) const;
+
+  //! \brief Count the size of an entry that is added to a leaf, and adjust the maximum entry size every
+  //!        TUNING_SAMPLE_INTERVAL entries.
+  void recordEntrySize(std::size_t entry_size);
+
+  //! \brief Set the maximum entry size so that 90% of the recently added entries are stored in their leaves,
+  //!        and start a new sample.
+  void adjustMaxEntrySize();
+
+  //! \brief The latches that a write to the tree holds. A write locks the latch of every node it changes
+  //!        before it changes the node, and the guard unlocks them when the write is done, or restarts.
+  //!
+  //! The guard of the write that the current thread is making is found through GetCurrent, so that the
+  //! functions that change nodes can check that the write holds their latches.
+  class WriteGuard {
+  public:
+    explicit WriteGuard(const BTreeManager& manager);
+    ~WriteGuard();
+
+    WriteGuard(const WriteGuard&) = delete;
+    WriteGuard& operator=(const WriteGuard&) = delete;
+
+    //! \brief Lock the latch of a node, if no writer changed the node since its version was read. Returns
+    //!        false otherwise.
+    bool TryLock(page_number_t page_number, uint64_t version);
+
+    //! \brief Lock the latch of a node, if no other writer holds it. Returns false otherwise.
+    bool TryLock(page_number_t page_number);
+
+    //! \brief Hold the entry count lock exclusively until the write is done.
+    void LockEntryCounts();
+
+    //! \brief Check whether the write holds the latch of a node, or created the node.
+    bool CanChange(page_number_t page_number) const noexcept;
+
+    //! \brief Record that the write created a node. No other thread reaches the node before the write links
+    //!        it into the tree, which changes nodes whose latches the write holds.
+    void AddNewNode(page_number_t page_number);
+
+    //! \brief Get the tuning as of the start of the write. Other writers can change the maximum entry size
+    //!        while the write runs, which would change how much space an entry needs halfway through adding
+    //!        it.
+    const BTreeTuning& GetTuning() const noexcept { return tuning_; }
+
+    //! \brief Get the write that the current thread is making to a B-tree, or null if there is none.
+    static WriteGuard* GetCurrent(const BTreeManager& manager) noexcept;
+
+  private:
+    //! \brief The innermost write that the current thread is making.
+    static WriteGuard*& current() noexcept;
+
+    const BTreeManager& manager_;
+
+    //! \brief The tuning as of the start of the write.
+    const BTreeTuning tuning_;
+
+    //! \brief The latches that the write locked, by index.
+    std::vector<std::size_t> latches_;
+
+    //! \brief The nodes that the write created.
+    std::vector<page_number_t> new_nodes_;
+
+    //! \brief Holds the entry count lock, if the write took it.
+    std::unique_lock<std::shared_mutex> entry_count_guard_;
+
+    //! \brief The write that was current when this one started.
+    WriteGuard* previous_ {};
+  };
+
+  //! \brief Try to add a value directly to the cached rightmost leaf, without searching from the root.
+  //!
+  //! Succeeds only if the rightmost leaf is cached, the key is greater than every key in the leaf, and no
+  //! other writer changes the leaf before its latch is locked.
+  bool appendToRightmostLeaf(GeneralKey key, internal::EntryCreator& entry_creator);
+
+  //! \brief Add a value to the leaf node found by a search, splitting the node if necessary. The write must
+  //!        hold the leaf's latch. Returns false, without changing the tree, if the nodes that a split
+  //!        changes could not all be locked, in which case the write has to restart.
+  bool insertIntoLeaf(GeneralKey key,
+                      internal::EntryCreator& entry_creator,
+                      SearchResult& result,
+                      WriteGuard& guard);
+
+  //! \brief Lock everything that splitting a leaf changes, given the key that is added to it, and find the
+  //!        path to the leaf: the left neighbor of the leaf, the entry counts, and the ancestors up to the
+  //!        first one that has room for another pointer. Returns false if another writer holds one of them.
+  bool lockForSplit(GeneralKey key, const BTreeNodeMap& leaf, WriteGuard& guard, TreePosition& path) const;
+
+  //! \brief Find the path from the root to the leaf that holds a key. The entry count lock must be held,
+  //!        which keeps the interior nodes from changing.
+  TreePosition findPath(GeneralKey key) const;
+
+  //! \brief Check whether an interior node can take one more pointer cell, whose key has at most a number of
+  //!        bytes, without being split.
+  bool hasRoomForPointer(const BTreeNodeMap& node, std::size_t max_key_size) const;
+
+  //! \brief Get the size of the longest (full) key in a node.
+  std::size_t getLongestKeySize(const BTreeNodeMap& node) const;
+
+  //! \brief Get an overflow page on which a part of an overflow entry can be written. This is the tracked
+  //!        page whose entry space fits entry_space best. If no tracked page has enough space, it is the page
+  //!        with the most space, or a new page if no page is tracked.
+  //!
+  //! The page is no longer tracked, the caller records its space with updateOverflowSpace once it has
+  //! written to it. Like every function that uses the overflow pages, the overflow lock must be held.
+  page_number_t acquireOverflowPage(std::size_t entry_space);
+
+  //! \brief Record the entry space that is left in an overflow page in the overflow space map.
+  void updateOverflowSpace(const BTreeNodeMap& overflow_page);
+
+  //! \brief Get the largest entry that one more cell in an overflow page could hold.
+  page_size_t getOverflowEntrySpace(const BTreeNodeMap& overflow_page) const;
+
+  //! \brief Remove every part of an overflow entry from its overflow pages, giving their space back to the
+  //!        overflow space map.
+  void removeOverflowEntry(primary_key_t overflow_key, page_number_t first_page_number);
+
+  //! \brief Load the overflow space map from the page stored in the root, if the tree has one.
+  void loadOverflowSpaceMap(BTreeNodeMap& root);
+
+  //! \brief Get a page for the overflow space map, write the map to it, and store its page number in the
+  //!        root.
+  void setOverflowSpaceMapPage();
+
+  //! \brief Write the overflow space map to its page.
+  void checkpointOverflowSpaceMap();
 
   //! \brief Get the next overflow entry number.
   primary_key_t getNextOverflowEntryNumber();
@@ -181,6 +622,96 @@ private:
 
   std::optional<BTreeNodeMap> loadNodePage(page_number_t page_number) const;
 
+  //! \brief Check that a page is a node page of this tree, and wrap it as a node.
+  BTreeNodeMap makeNode(std::unique_ptr<Page> page, page_number_t page_number) const;
+
+  //! \brief An interior node that is pinned in the page cache, with direct references to the pinned nodes
+  //!        that its pointers lead to.
+  //!
+  //! Searches follow the references without going through the page cache. A reference is only used if the
+  //! pointer in the page still leads to the referenced page, so references stay correct when the node
+  //! changes. References are updated while searches from other threads read them, so they are atomic.
+  //!
+  //! When the page cache asks the tree to give pages back (see ReleasePins), the deepest pinned nodes are
+  //! unpinned first. The references to them are cleared, and they are retired. Searches that started before
+  //! may still read a retired node, so its page is only given back once no search is running.
+  struct PinnedNode {
+    //! \brief A reference to a child of a pinned node.
+    struct ChildReference {
+      //! \brief The child, if it is pinned.
+      std::atomic<PinnedNode*> node {};
+
+      //! \brief The page number of a child that is not pinned, a leaf or a node that could not be pinned.
+      std::atomic<page_number_t> unpinned_page_number {};
+    };
+
+    PinnedNode(BTreeNodeMap&& node, std::size_t max_pointers, std::size_t depth)
+        : node(std::move(node))
+        , children(max_pointers + 1)
+        , depth(depth) {}
+
+    //! \brief The node. Its page handle keeps it pinned.
+    BTreeNodeMap node;
+
+    //! \brief References to the node's children, by pointer index, the last one for the rightmost pointer.
+    //!        There is one for every pointer the node could hold, so the vector never reallocates.
+    std::vector<ChildReference> children;
+
+    //! \brief The depth of the node in the tree when it was pinned, zero for the root.
+    std::size_t depth;
+  };
+
+  //! \brief Get the pinned node for a page, pinning it if it is an interior node and the page cache has room
+  //!        for another pinned page, and point a reference at it. If the node is not pinned, it is loaded
+  //!        into `loaded` instead.
+  PinnedNode* getPinnedNode(PinnedNode::ChildReference& reference,
+                            page_number_t page_number,
+                            std::size_t depth,
+                            std::optional<BTreeNodeMap>& loaded) const;
+
+  //! \brief Follow a reference to a node. Returns the node if it is pinned, otherwise loads it into `loaded`
+  //!        and returns null.
+  PinnedNode* followReference(PinnedNode::ChildReference& reference,
+                              page_number_t page_number,
+                              std::size_t depth,
+                              std::optional<BTreeNodeMap>& loaded) const;
+
+  //! \brief Follow a pointer of a pinned node. Returns the child if it is pinned, otherwise loads it into
+  //!        `loaded` and returns null.
+  PinnedNode* followPointer(PinnedNode& parent,
+                            page_index_t index,
+                            page_number_t child_page_number,
+                            std::optional<BTreeNodeMap>& loaded) const;
+
+  //! \brief Unpin the deepest pinned nodes until at most a number of nodes are pinned. See PinOwner.
+  void ReleasePins(std::size_t max_pinned_pages) const override;
+
+  //! \brief Clear the references to a pinned node and retire it. The pin lock must be held.
+  void retireNode(PinnedNode& node) const;
+
+  //! \brief Give the pages of the retired nodes back to the page cache, if no search is running.
+  void releaseRetiredNodes() const;
+
+  //! \brief Give every pinned page back to the page cache.
+  void unpinNodes();
+
+  //! \brief Copy the entry of a cell in a leaf out of its pages, if the leaf is still at a version. Returns
+  //!        nothing if a writer changed the leaf.
+  std::optional<std::unique_ptr<internal::DatabaseEntry>> tryCopyEntry(const BTreeNodeMap& leaf,
+                                                                       page_size_t index,
+                                                                       uint64_t version) const;
+
+  //! \brief Get the latch that guards a node.
+  OptimisticLatch& getLatch(page_number_t page_number) const noexcept;
+
+  //! \brief Check that the current write may change a node, i.e. it holds the node's latch or created it.
+  void checkCanChange(page_number_t page_number) const;
+
+  //! \brief Search for a key, or for the end of the rightmost leaf if no key is given, validating each node
+  //!        against its latch. Returns nothing if a node was changed by a writer during the search, and the
+  //!        search has to be restarted.
+  std::optional<SearchResult> trySearch(std::optional<GeneralKey> key) const;
+
   //! \brief Add an element to the node. Returns false if there is not enough space to add the element.
   //!
   //! \param node_map The node to which the data should be added.
@@ -200,30 +731,147 @@ private:
   //! \brief Special case for splitting the root node, which causes the height of the tree to increase by one.
   void splitRoot(std::optional<std::reference_wrapper<StoreData>> data);
 
-  //! \brief Vacuums the node, removing any fragmented space.
+  //! \brief What is known about the recent inserts into a node.
+  struct InsertHistory {
+    //! \brief The node the history is for. Zero if the entry is not in use.
+    page_number_t page_number {};
+
+    //! \brief The index in the node at which the last key was inserted.
+    page_size_t last_index {};
+
+    //! \brief The number of inserts in a row that went right after the previous insert (positive, an
+    //!        ascending run) or at the same index as the previous insert, that is, right before it (negative,
+    //!        a descending run).
+    int32_t run {};
+  };
+
+  //! \brief An entry of the insert history. Nodes that different writers insert into can share an entry, so
+  //!        each entry has its own lock.
+  struct InsertHistoryEntry {
+    std::mutex lock;
+    InsertHistory history;
+  };
+
+  //! \brief Get the insert history of a node, which is empty if the node has none.
+  InsertHistory getInsertHistory(page_number_t page_number) const;
+
+  //! \brief Set the insert history of the node that a history is for.
+  void setInsertHistory(const InsertHistory& history);
+
+  //! \brief Record that a key was inserted at an index in a node, extending or ending the node's run of
+  //!        sequential inserts.
+  void recordInsert(page_number_t page_number, page_size_t index);
+
+  //! \brief Let the node that receives the incoming key after a split continue the insert run of the node
+  //!        that was split, so that a run of sequential inserts is not broken by the split.
+  void continueInsertRun(page_number_t split_page_number, BTreeNodeMap& receiving_node, GeneralKey key);
+
+  //! \brief Choose how many of the entries of a full node go to the left node when it is split. If the last
+  //!        few inserts into the node were sequential, the node is split at the incoming key, so that the
+  //!        side that the inserts move away from is left full (up to the split fill factor). Otherwise, the
+  //!        node is split in half. The result is between 1 and the number of entries minus 1.
+  page_size_t chooseSplitPoint(const BTreeNodeMap& node, std::optional<GeneralKey> incoming_key) const;
+
+  //! \brief Add to the entry counts of the pointer cells along a path from the root to a leaf, after an entry
+  //!        was added to or removed from the leaf. Rightmost pointers do not have entry counts. The entry
+  //!        count lock must be held exclusively.
+  void addToEntryCounts(const TreePosition& path, int64_t delta);
+
+  //! \brief Set the entry count of the pointer cell at an index in an interior node. The entry count lock
+  //!        must be held exclusively.
+  void setEntryCount(BTreeNodeMap& node, page_size_t index, uint64_t num_entries) const;
+
+  //! \brief Count the entries in a node's subtree. For interior nodes, the number of entries in the subtree
+  //!        of the rightmost pointer has to be given, since the node does not store it.
+  uint64_t countEntries(const BTreeNodeMap& node, uint64_t rightmost_num_entries) const;
+
+  // The functions below read the entry counts, and must be called with the entry count lock held shared. A
+  // writer may hold the latch of the leaf they read while it waits for the entry count lock, so they do not
+  // wait for leaf latches. They return nothing if a writer holds or changed the leaf, and the caller has to
+  // release the lock and try again.
+
+  //! \brief Count the entries in the B-tree.
+  std::optional<uint64_t> tryCount() const;
+
+  //! \brief Count the entries whose keys are less than a key, or less than or equal to it.
+  std::optional<uint64_t> tryCountBefore(GeneralKey key, bool inclusive) const;
+
+  //! \brief Get an iterator that starts a number of entries into the B-tree, see Skip.
+  std::optional<Iterator> trySkip(uint64_t offset, ScanDirection direction) const;
+
+  //! \brief Vacuums the node, packing its cells together so all its free space, including freeblocks and
+  //!        fragments, is de-fragmented.
   void vacuum(BTreeNodeMap& node) const;
 
+  //! \brief Choose the key to separate a left and right leaf in their parent, given the largest key in the
+  //!        left leaf and the smallest key in the right leaf. If separators can be truncated, this is the
+  //!        shortest key that sorts between them, otherwise, it is the largest key in the left leaf.
+  std::vector<std::byte> chooseSeparator(GeneralKey left_max, GeneralKey right_min) const;
+
+  //! \brief Choose the key prefix for a node that will hold the keys of num_cells consecutive cells of a
+  //!        node, starting at first_index, and, if given, an incoming key. This is the longest prefix that
+  //!        all these keys share, or empty if key prefix compression is disabled.
+  std::vector<std::byte> chooseKeyPrefix(const BTreeNodeMap& node,
+                                         page_size_t first_index,
+                                         page_size_t num_cells,
+                                         std::optional<GeneralKey> incoming_key) const;
+
+  //! \brief Choose the key prefix for one of the nodes that a node is split into, which gets num_cells
+  //!        consecutive cells of the node, and the incoming key, if given. After a run of sequential inserts,
+  //!        the node that gets the incoming key is likely to get the rest of the run too, so it only gets the
+  //!        prefix that every key in the split node shares, which later keys are more likely to start with.
+  std::vector<std::byte> chooseSplitPrefix(const BTreeNodeMap& node,
+                                           page_size_t first_index,
+                                           page_size_t num_cells,
+                                           std::optional<GeneralKey> incoming_key) const;
+
+  //! \brief If key prefix compression is enabled, set the node's key prefix to the longest prefix shared by
+  //!        all its keys and, if given, a key that is about to be added to it. Returns whether the node was
+  //!        rewritten, in which case it is also vacuumed.
+  bool compressKeys(BTreeNodeMap& node, std::optional<GeneralKey> incoming_key = {}) const;
+
+  //! \brief Rewrite a node with a new key prefix, which every key in the node must start with. The cells
+  //!        are packed at the end of the page, so this also vacuums the node.
+  void rebuildWithPrefix(BTreeNodeMap& node, GeneralKey prefix) const;
+
+  //! \brief Replace the cells of a target node with num_cells consecutive cells of a source node, starting at
+  //!        first_index, giving the target a new key prefix, which all the copied keys must start with. The
+  //!        source and the target can be the same node.
+  //!
+  //! The target is built in a scratch page, copying each cell with a memcpy (and re-writing its key if the
+  //! prefix changes), and written back with one write for the header and pointers and one for the cells,
+  //! instead of adding the cells one at a time. The target keeps its header fields, like its siblings and
+  //! rightmost pointer, and its reserved space.
+  void copyCells(const BTreeNodeMap& source,
+                 page_size_t first_index,
+                 page_size_t num_cells,
+                 BTreeNodeMap& target,
+                 GeneralKey prefix) const;
+
   //! \brief Look for the leaf node where a key should be inserted or can be found.
   SearchResult search(GeneralKey key) const;
 
-  //! \brief Try to retrieve data from a B-tree.
+  //! \brief Find the end of the rightmost leaf.
+  SearchResult searchLast() const;
+
+  //! \brief Try to retrieve data from a B-tree. The entry is a copy, which was read while no writer changed
+  //!        its leaf.
   RetrievalResult retrieve(GeneralKey key) const;
 
   //! \brief Checks if the key is less than or equal to the other key.
   //!
-  //! Uses the lt comparison provided, uses std::ranges::equal to check if the keys are equal.
+  //! Uses the normalized key comparison, uses std::ranges::equal to check if the keys are equal.
   bool lte(GeneralKey key1, GeneralKey key2) const;
 
-  //! \brief Debug function that returns a string representation of a key.
-  //!
-  //! Uses the debug_key_func_ if it is available, otherwise, string-ize the bytes.
+  //! \brief Debug function that returns a string representation of a normalized key, using the key type.
   //!
   //! \param key The key to convert to a string.
   //! \return Returns a string representation of the key, implementation defined.
   std::string debugKey(GeneralKey key) const;
 
-  //! \brief Check whether a key is already present in a btree node.
-  bool isUniqueKey(BTreeNodeMap& node_map, const StoreData& data) const noexcept;
+  //! \brief Check whether a key is not already present in a btree node, given the index of the first key in
+  //!        the node that is not less than it.
+  bool isUniqueKey(const BTreeNodeMap& node_map, GeneralKey key, page_size_t lower_bound) const noexcept;
 
   //! \brief Write flags to an page as part of creating a data entry.
   static page_size_t writeFlags(Page& page,
@@ -231,6 +879,9 @@ private:
                                 internal::EntryCreator& entry_creator,
                                 page_size_t offset) noexcept;
 
+  //! \brief Write a pointer, the cell offset and key hint, to a page. Returns the offset after the pointer.
+  static page_size_t writeSlot(Page& page, page_size_t offset, Slot slot) noexcept;
+
   //! \brief Write the key to a page as part of creating a data entry.
   static page_size_t writeKey(Page& page,
                               BTreePageHeader& header,
@@ -247,33 +898,106 @@ private:
   //! \brief The page on which the B-tree index starts. Will be 0 if unassigned.
   page_number_t root_page_ {};
 
-  //! \brief The current page available for overflow entries. Zero if no page is being used.
-  page_number_t current_overflow_page_number_ {};
+  //! \brief The interior nodes that are pinned in the page cache, by page number.
+  mutable std::unordered_map<page_number_t, std::unique_ptr<PinnedNode>> pinned_nodes_;
+
+  //! \brief The reference to the root node, once it is an interior node and is pinned.
+  mutable PinnedNode::ChildReference root_reference_ {};
+
+  //! \brief Pinned nodes that were unpinned, but may still be read by searches that started before.
+  mutable std::vector<std::unique_ptr<PinnedNode>> retired_nodes_;
+
+  //! \brief The number of retired nodes, so searches can check for them without taking the pin lock.
+  mutable std::atomic<std::size_t> num_retired_nodes_ {};
+
+  //! \brief The number of searches that are running. Retired nodes are given back when there are none.
+  mutable std::atomic<std::size_t> num_searches_ {};
+
+  //! \brief Lock for pinning nodes and updating the references between pinned nodes. The page cache is never
+  //!        called with this lock held, since the cache calls ReleasePins with its own lock held.
+  mutable std::mutex pin_lock_;
+
+  //! \brief The latches of the nodes.
+  mutable std::array<OptimisticLatch, NUM_NODE_LATCHES> node_latches_ {};
+
+  //! \brief Lock for the entry counts in the pointer cells. Writers hold it exclusively while they update the
+  //!        counts along a path, and while they split nodes, which moves counts between cells, so the
+  //!        interior nodes only change while it is held exclusively. Counting holds it shared.
+  mutable std::shared_mutex entry_count_lock_;
+
+  //! \brief Lock for the overflow pages, the overflow space map, and the overflow entry counter. Writers that
+  //!        add or remove overflow entries, or free blob pages, hold it exclusively. Readers hold it shared
+  //!        while they copy entries that are not stored in their leaf.
+  mutable std::shared_mutex overflow_lock_;
+
+  //! \brief Lock that keeps checkpoints from running concurrently.
+  std::mutex checkpoint_lock_;
+
+  //! \brief The page that the overflow space map is stored in. Zero if the map has not been written yet.
+  page_number_t overflow_space_map_page_ {};
+
+  //! \brief The space left in the tree's overflow pages.
+  OverflowSpaceMap overflow_space_map_;
 
   //! \brief The next primary key to use for overflow entries.
   primary_key_t next_overflow_entry_number_ {};
 
-  //! \brief Whether the key's size needs to be serialized. TODO: Get this from the key type.
-  bool serialize_key_size_ = false;
+  //! \brief The next key to hand out for auto-incrementing keys.
+  std::atomic<primary_key_t> next_primary_key_ {};
+
+  //! \brief The value of the auto-incrementing key counter that is currently written in the root page.
+  primary_key_t checkpointed_primary_key_ {};
 
-  //! \brief The type of the primary key used for this tree.
+  //! \brief The rightmost leaf of the tree, or zero if it is not known yet. Appends with increasing keys go
+  //!        directly to this leaf. Splits add new leaves to the left of the leaf they split, so the rightmost
+  //!        leaf stays the rightmost leaf, unless it is the root.
+  std::atomic<page_number_t> rightmost_leaf_ {};
+
+  //! \brief Whether the key's size needs to be serialized.
+  bool serialize_key_size_ = true;
+
+  //! \brief Whether pages store the common prefix of their keys once, in the page header. This requires
+  //!        keys that are compared lexicographically, byte by byte, which normalized keys are, and whose
+  //!        sizes are serialized.
+  bool compress_key_prefixes_ = true;
+
+  //! \brief Whether the keys pushed up to interior nodes by leaf splits can be shortened to the shortest key
+  //!        that separates the leaves. This requires keys that are compared lexicographically, byte by byte.
+  bool truncate_separators_ = true;
+
+  //! \brief The type of the primary key used for this tree. Array for composite keys.
   DataTypeEnum key_type_ = DataTypeEnum::UInt64;
 
-  //! \brief Function for comparing keys.
-  CmpFunc cmp_;
+  //! \brief The types of the fields of composite keys. Empty unless the key type is Array.
+  std::vector<DataTypeEnum> key_fields_;
 
-  //! \brief Optionally, a function that can serialize a key to a string for debugging purposes.
-  DebugKeyFunc debug_key_func_;
+  //! \brief Recent insert history of the nodes that were inserted into most recently. Nodes are mapped to
+  //!        entries by page number, a node's history is forgotten when another node maps to the same entry.
+  mutable std::array<InsertHistoryEntry, INSERT_HISTORY_SIZE> insert_history_ {};
 
-  //! \brief The maximum entry size, in bytes, before an overflow page is needed
-  page_size_t max_entry_size_ = 256;
+  //! \brief How full a node is left, as a fraction of its entries, when it is split during a run of
+  //!        sequential inserts. Atomic, since it can be set while writers split nodes.
+  std::atomic<double> split_fill_factor_ = 1.;
 
-  //! \brief The minimum amount of space, in bytes, to have to allow an entry to be added to a page.
-  page_size_t min_space_for_entry_ = 128;
+  //! \brief The entry size limits of the tree, loaded from the root page. Only the maximum entry size changes
+  //!        afterwards, which is kept in max_entry_size_.
+  BTreeTuning tuning_ {};
 
-  //! \brief The maximum number of entries per page.
-  //! NOTE(Nate): I am adding this for now to make testing easier.
-  page_size_t max_entries_per_page_ = 10000;
+  //! \brief The maximum entry size. Atomic, since it is adjusted while other writers use it.
+  std::atomic<page_size_t> max_entry_size_ {};
+
+  //! \brief The tuning that is currently written in the root page.
+  BTreeTuning checkpointed_tuning_ {};
+
+  // The sample of entry sizes is counted by every writer. Entries that are added while a writer adjusts the
+  // maximum entry size can be counted in either sample, which only matters for the statistics.
+
+  //! \brief The number of entries in each size class that were added since the maximum entry size was last
+  //!        adjusted.
+  std::array<std::atomic<uint32_t>, NUM_ENTRY_SIZE_CLASSES> entry_size_counts_ {};
+
+  //! \brief The number of entries that were added since the maximum entry size was last adjusted.
+  std::atomic<std::size_t> num_sampled_entries_ {};
 };
 
 }  // namespace neversql
\ No newline at end of file
@@ -4,24 +4,21 @@
 
 #pragma once
 
+#include <compare>
 #include <span>
 
 #include "EntryCreator.h"
 #include "NeverSQL/data/Page.h"
 #include "NeverSQL/data/btree/BTreePageHeader.h"
 #include "NeverSQL/data/internals/DatabaseEntry.h"
+#include "NeverSQL/data/internals/KeyComparison.h"
+#include "NeverSQL/data/internals/KeyEncoding.h"
 #include "NeverSQL/data/internals/KeyPrinting.h"
 
 namespace neversql {
 
-//! \brief A comparison function knows how to interpret and compare keys, represented as spans of bytes.
-using CmpFunc = std::function<bool(std::span<const std::byte>, std::span<const std::byte>)>;
-
-//! \brief A function that can serialize a key to a string for debugging purposes.
-using DebugKeyFunc = std::function<std::string(std::span<const std::byte>)>;
-
 //! \brief A general key, represented as a span of bytes. How these bytes are interpreted and compares is
-//! determined by the comparison function.
+//! determined by the B-tree's key type, see KeyEncoding.h.
 using GeneralKey = std::span<const std::byte>;
 
 //! \brief Helper structure that represents a cell in a leaf node.
@@ -47,7 +44,7 @@ struct DataNodeCell {
         // The key.
         + key.size()
         // Potentially, the entry size.
-        + (internal::GetIsEntrySizeSerialized(flags) ? sizeof(entry_size_t) : 0)
+        + (internal::GetIsEntrySizeSerialized(flags) ? sizeof(page_size_t) : 0)
         // The entry.
         + data.size());
   }
@@ -63,9 +60,12 @@ struct PointersNodeCell {
 
   //! \brief The pointer value.
   //!
-  //! \note The data of a pointers node cell (the entry) is just the page number.
+  //! \note The data of a pointers node cell (the entry) is the page number, followed by the entry count.
   const page_number_t page_number;
 
+  //! \brief The number of entries in the subtree that the pointer points to.
+  const uint64_t num_entries;
+
   //! \brief Get the size of the cell.
   NO_DISCARD page_size_t GetCellSize() const noexcept {
     return static_cast<page_size_t>(
@@ -75,12 +75,12 @@ struct PointersNodeCell {
         + (internal::GetKeySizeIsSerialized(flags) ? 2 : 0)
         // The key.
         + key.size()
-        // The page number (pointer value).
-        + sizeof(page_number_t));
+        // The page number (pointer value) and the entry count.
+        + GetDataSize());
   }
 
   //! \brief Get the size of the data payload of the cell.
-  NO_DISCARD static page_size_t GetDataSize() noexcept { return sizeof(page_number_t); }
+  NO_DISCARD static page_size_t GetDataSize() noexcept { return sizeof(page_number_t) + sizeof(uint64_t); }
 };
 
 //! \brief Structure that represents the space requirements for adding a new entry to a node.
@@ -91,10 +91,71 @@ struct SpaceRequirement {
   //! \brief The amount of space that the cell header needs.
   page_size_t cell_header_space;
 
+  //! \brief The amount of space that the other cells would grow by if the page's key prefix has to be
+  //!        shortened because the key does not start with it.
+  page_size_t prefix_shrink_space;
+
   //! \brief The maximum amount of space that would be available for storing an entry.
   page_size_t max_entry_space;
 };
 
+//! \brief A pointer in a B-tree node: the offset of a cell, and the hint for the cell's key.
+struct Slot {
+  page_size_t cell_offset;
+  uint32_t key_hint;
+};
+
+//! \brief A view of the pointers section of a B-tree node.
+//!
+//! Indexing the view gives the cell offsets, like an array of offsets would. The key hints stored next to the
+//! offsets let searches narrow down which cells can hold a key without reading any of the cells.
+class SlotArray {
+public:
+  explicit SlotArray(std::span<const std::byte> bytes) noexcept
+      : bytes_(bytes) {}
+
+  NO_DISCARD page_size_t size() const noexcept {
+    return static_cast<page_size_t>(bytes_.size() / POINTER_SLOT_SIZE);
+  }
+
+  NO_DISCARD bool empty() const noexcept { return bytes_.empty(); }
+
+  //! \brief Get the offset of the cell that the index-th pointer points to.
+  NO_DISCARD page_size_t operator[](page_size_t index) const noexcept {
+    return read<page_size_t>(index * POINTER_SLOT_SIZE);
+  }
+
+  NO_DISCARD page_size_t front() const noexcept { return (*this)[0]; }
+
+  NO_DISCARD page_size_t back() const noexcept { return (*this)[static_cast<page_size_t>(size() - 1)]; }
+
+  //! \brief Get the key hint of the index-th pointer.
+  NO_DISCARD uint32_t GetKeyHint(page_size_t index) const noexcept {
+    return read<uint32_t>(index * POINTER_SLOT_SIZE + sizeof(page_size_t));
+  }
+
+  NO_DISCARD Slot GetSlot(page_size_t index) const noexcept { return {(*this)[index], GetKeyHint(index)}; }
+
+  //! \brief Get the raw bytes of count slots, starting with the first-th slot.
+  NO_DISCARD std::span<const std::byte> GetBytes(page_size_t first, page_size_t count) const noexcept {
+    return bytes_.subspan(first * POINTER_SLOT_SIZE, count * POINTER_SLOT_SIZE);
+  }
+
+  //! \brief Get the index of the first pointer in [first, last) whose key hint is not less than the hint, or
+  //!        last if there is no such pointer. The key hints must be sorted.
+  NO_DISCARD page_size_t LowerBoundByHint(uint32_t hint, page_size_t first, page_size_t last) const noexcept;
+
+private:
+  template<typename T>
+  NO_DISCARD T read(std::size_t offset) const noexcept {
+    T value;
+    std::memcpy(&value, bytes_.data() + offset, sizeof(T));
+    return value;
+  }
+
+  std::span<const std::byte> bytes_;
+};
+
 namespace utility {
 class PageInspector;
 }  // namespace utility
@@ -137,6 +198,10 @@ public:
   //! \return The amount of free space in the node, in the free space section.
   NO_DISCARD page_size_t GetDefragmentedFreeSpace() const;
 
+  //! \brief Get the total amount of free space in the node, including the space in holes left by cells that
+  //!        were erased. This is how much space the node would have after it is vacuumed.
+  NO_DISCARD page_size_t GetTotalFreeSpace() const;
+
   //! \brief Calculate the space requirements for adding a new entry to a node, given the key.
   //!
   //! This calculates the amount of space needed for the pointer, the cell, and the maximum amount of space
@@ -144,7 +209,7 @@ public:
   NO_DISCARD SpaceRequirement CalculateSpaceRequirements(GeneralKey key) const;
 
   //! \brief Get the largest key of any element in the node. If there are no keys, returns nullopt.
-  NO_DISCARD std::optional<GeneralKey> GetLargestKey() const;
+  NO_DISCARD std::optional<std::vector<std::byte>> GetLargestKey() const;
 
   //! \brief Check whether this page is a pointers page, that is, whether it only stores pointers to other
   //!        pages instead of storing data.
@@ -194,18 +259,41 @@ private:
   //! \error If this is not a pointers page, raises and error.
   std::pair<page_number_t, page_index_t> searchForNextPageInPointersPage(GeneralKey key) const;
 
-  //! \brief Get a span of the offsets in the node.
-  std::span<const page_size_t> getPointers() const;
+  //! \brief Get a view of the pointers in the node.
+  SlotArray getPointers() const;
 
   //! \brief Get the offset to the start of the free space in the node.
   page_size_t getCellOffsetByIndex(page_size_t cell_index) const;
 
   //! \brief Get the primary key from a cell, given the cell offset.
+  //!
+  //! \note This is the key as stored in the cell, that is, without the page's key prefix.
   GeneralKey getKeyForCell(page_size_t cell_offset) const;
 
   //! \brief Get the primary key from a cell, given the cell's index.
+  //!
+  //! \note This is the key as stored in the cell, that is, without the page's key prefix.
   GeneralKey getKeyForNthCell(page_size_t cell_index) const;
 
+  //! \brief Get the full primary key of a cell, including the page's key prefix, given the cell offset.
+  std::vector<std::byte> getFullKeyForCell(page_size_t cell_offset) const;
+
+  //! \brief Get the full primary key of a cell, including the page's key prefix, given the cell's index.
+  std::vector<std::byte> getFullKeyForNthCell(page_size_t cell_index) const;
+
+  //! \brief Get the key prefix that all keys in the page share.
+  GeneralKey getKeyPrefix() const;
+
+  //! \brief Get the length of the longest common prefix of a key and the page's key prefix.
+  page_size_t getSharedPrefixSize(GeneralKey key) const;
+
+  //! \brief Compare a (full) key to the key of the N-th cell.
+  std::weak_ordering compareToNthKey(GeneralKey key, page_size_t cell_index) const;
+
+  //! \brief Get the hint for a key, as stored in the key's pointer. This is computed from the key without the
+  //!        page's key prefix.
+  uint32_t getKeyHint(GeneralKey key_suffix) const;
+
   //! \brief Get the cell at the given offset, as a structure. If the node is a leaf node, LeafNodeCell is
   //!        returned. If the node is an interior node, InteriorNodeCell is returned.
   std::variant<DataNodeCell, PointersNodeCell> getCell(page_size_t cell_offset) const;
@@ -214,12 +302,28 @@ private:
   //!        returned. If the node is an interior node, InteriorNodeCell is returned.
   std::variant<DataNodeCell, PointersNodeCell> getNthCell(page_size_t cell_number) const;
 
-  //! \brief Sort the keys in the node by the primary key they refer to.
-  void sortKeys();
+  //! \brief Insert a pointer at an index, moving the pointers after it one slot to the right. The pointers
+  //!        section grows by one slot, into the free space, which must have room for it.
+  void insertSlot(page_size_t index, Slot slot);
 
-  //! \brief Debug function that returns a string representation of a key.
+  //! \brief Remove the pointer at an index, moving the pointers after it one slot to the left. The cell that
+  //!        the pointer pointed to is not freed, see freeCell.
+  void removeSlot(page_size_t index);
+
+  //! \brief Find space for a cell of the given size in the page's freeblocks, using the first freeblock that
+  //!        is large enough. Returns the offset of the space, or nullopt if no freeblock is large enough.
   //!
-  //! Uses the debug_key_func_ if it is available, otherwise, string-ize the bytes.
+  //! A cell is taken from the end of the freeblock, so the rest of the freeblock stays where it is. If what
+  //! would be left is too small to be a freeblock, the whole freeblock is removed from the list and the rest
+  //! becomes a fragment.
+  std::optional<page_size_t> allocateFromFreeblocks(page_size_t size);
+
+  //! \brief Return the space used by a cell to the page. A cell at the free space end is added back to the
+  //!        de-fragmented free space, otherwise, the cell becomes a freeblock (merged with any neighboring
+  //!        freeblocks) or, if it is too small, a fragment.
+  void freeCell(page_size_t offset, page_size_t size);
+
+  //! \brief Debug function that returns a string representation of a key, using the key type.
   //!
   //! \param key
   //! \return string representation of the key, implementation defined.
@@ -232,11 +336,8 @@ private:
   //! \brief The underlying page, that this class interprets as a B-tree node.
   std::unique_ptr<Page> page_;
 
-  //! \brief The key comparison function.
-  CmpFunc cmp_;
-
-  //! \brief Optionally, a function that can serialize a key to a string for debugging purposes.
-  DebugKeyFunc debug_key_func_;
+  //! \brief The type of the keys, used to print keys. This is a B-tree property, not stored in the page.
+  DataTypeEnum key_type_ = DataTypeEnum::UInt64;
 };
 
 }  // namespace neversql
\ No newline at end of file
@@ -21,6 +21,14 @@ inline constexpr uint8_t ROOT_PAGE_FLAG = 0x2;
 inline constexpr uint8_t KEY_SIZES_SERIALIZED_FLAG = 0x4;
 inline constexpr uint8_t OVERFLOW_PAGE_FLAG = 0x8;
 
+//! \brief The size of a pointer in the pointers section of a B-tree page, a 2 byte cell offset followed by a
+//!        4 byte key hint.
+inline constexpr page_size_t POINTER_SLOT_SIZE = sizeof(page_size_t) + sizeof(uint32_t);
+
+//! \brief The smallest hole in a B-tree page that is kept in the page's freeblock list, enough for the offset
+//!        of the next freeblock and the size of the freeblock.
+inline constexpr page_size_t MIN_FREEBLOCK_SIZE = 2 * sizeof(page_size_t);
+
 // clang-format off
 //! \brief The header for a B-tree page.
 //!
@@ -41,8 +49,30 @@ inline constexpr uint8_t OVERFLOW_PAGE_FLAG = 0x8;
 //! | Reserved start  | 2 bytes | 13     |
 //! | Page number     | 8 bytes | 15     |
 //! | Additional data | 8 bytes | 23     |
+//! | Left sibling    | 8 bytes | 31     |
+//! | Right sibling   | 8 bytes | 39     |
+//! | First freeblock | 2 bytes | 47     |
+//! | Fragmented free | 2 bytes | 49     |
+//! | Key prefix size | 2 bytes | 51     |
+//! | Key prefix      | *       | 53     |
+//!
+//! Pointers start right after the key prefix, at offset 53 + key prefix size. Each pointer is a slot of
+//! POINTER_SLOT_SIZE bytes, the offset of the cell it points to, followed by a hint about the cell's key (see
+//! KeyComparison.h). The hint is computed from the key without the key prefix.
 //!
-//! Pointers start at offset 31.
+//! For pointers pages, the additional data is the rightmost pointer. For leaf pages, the left and right
+//! sibling are the page numbers of the neighboring leaves, in key order, or zero if there is no neighbor on
+//! that side. This lets iteration move from leaf to leaf without going back through the interior nodes.
+//!
+//! The key prefix is a sequence of bytes that every key on the page starts with. It is stored once, in the
+//! header, and the cells only store the rest of their keys (the suffixes). Pages whose keys are not compared
+//! lexicographically, or whose key sizes are not serialized, always have an empty key prefix.
+//!
+//! Cells that are removed leave holes in the stored data section. Holes of at least MIN_FREEBLOCK_SIZE bytes
+//! are freeblocks, which form a linked list, ordered by offset, that starts at the first freeblock (zero if
+//! there are none). A freeblock starts with the offset of the next freeblock (2 bytes, zero for the last
+//! one) and its own size (2 bytes). Smaller holes are fragments, which can only be reclaimed by vacuuming
+//! the page. The fragmented free space is the total size of all holes, freeblocks and fragments.
 //!
 //! Flag definitions:
 //!
@@ -64,6 +94,14 @@ public:
   NO_DISCARD page_size_t GetReservedStart() const noexcept { return page_->Read<page_size_t>(13); }
   NO_DISCARD page_number_t GetPageNumber() const noexcept { return page_->Read<page_number_t>(15); }
   NO_DISCARD page_number_t GetAdditionalData() const noexcept { return page_->Read<page_number_t>(23); }
+  NO_DISCARD page_number_t GetLeftSibling() const noexcept { return page_->Read<page_number_t>(31); }
+  NO_DISCARD page_number_t GetRightSibling() const noexcept { return page_->Read<page_number_t>(39); }
+  NO_DISCARD page_size_t GetFirstFreeblock() const noexcept { return page_->Read<page_size_t>(47); }
+  NO_DISCARD page_size_t GetFragmentedFreeSpace() const noexcept { return page_->Read<page_size_t>(49); }
+  NO_DISCARD page_size_t GetKeyPrefixSize() const noexcept { return page_->Read<page_size_t>(51); }
+  NO_DISCARD std::span<const std::byte> GetKeyPrefix() const noexcept {
+    return page_->GetSpan(53, GetKeyPrefixSize());
+  }
   NO_DISCARD page_size_t GetPageSize() const noexcept { return page_->GetPageSize(); }
 
   void SetMagicNumber(uint64_t magic_number) { page_->WriteToPage(0, magic_number); }
@@ -73,8 +111,24 @@ public:
   void SetReservedStart(page_size_t reserved_start) { page_->WriteToPage(13, reserved_start); }
   void SetPageNumber(page_number_t page_number) { page_->WriteToPage(15, page_number); }
   void SetAdditionalData(page_number_t data) { page_->WriteToPage(23, data); }
+  void SetLeftSibling(page_number_t page_number) { page_->WriteToPage(31, page_number); }
+  void SetRightSibling(page_number_t page_number) { page_->WriteToPage(39, page_number); }
+  void SetFirstFreeblock(page_size_t offset) { page_->WriteToPage(47, offset); }
+  void SetFragmentedFreeSpace(page_size_t size) { page_->WriteToPage(49, size); }
+
+  //! \brief Set the key prefix. Since the pointers start after the key prefix, this can only be done when
+  //!        there are no pointers in the page. The free start is moved to the new start of the pointers.
+  void SetKeyPrefix(std::span<const std::byte> prefix) {
+    NOSQL_REQUIRE(GetFreeStart() <= GetPointersStart(),
+                  "cannot set the key prefix of a page that has pointers");
+    page_->WriteToPage(51, static_cast<page_size_t>(prefix.size()));
+    page_->WriteToPage(53, prefix);
+    SetFreeBegin(GetPointersStart());
+  }
 
-  NO_DISCARD page_size_t GetPointersStart() const noexcept { return 31; }
+  NO_DISCARD page_size_t GetPointersStart() const noexcept {
+    return static_cast<page_size_t>(53 + GetKeyPrefixSize());
+  }
 
   // =========================================================================================
   //  Other helper functions.
@@ -84,6 +138,12 @@ public:
     SetMagicNumber(ToUInt64("NOSQLBTR"));
     SetPageNumber(page_number);
     SetFlags(static_cast<uint8_t>(type));
+    SetAdditionalData(0);
+    SetLeftSibling(0);
+    SetRightSibling(0);
+    SetFirstFreeblock(0);
+    SetFragmentedFreeSpace(0);
+    page_->WriteToPage(51, page_size_t {0});
     const auto reserved_start = static_cast<page_size_t>(GetPageSize() - reserved_size);
     SetReservedStart(reserved_start);
     SetFreeEnd(reserved_start);
@@ -94,6 +154,12 @@ public:
     SetMagicNumber(ToUInt64("OVERFLOW"));
     SetPageNumber(page_number);
     SetFlags(OVERFLOW_PAGE_FLAG);
+    SetAdditionalData(0);
+    SetLeftSibling(0);
+    SetRightSibling(0);
+    SetFirstFreeblock(0);
+    SetFragmentedFreeSpace(0);
+    page_->WriteToPage(51, page_size_t {0});
 
     const auto reserved_start = GetPageSize();
     SetReservedStart(reserved_start);
@@ -103,12 +169,18 @@ public:
 
   //! \brief Get the number of pointers on the page.
   NO_DISCARD page_size_t GetNumPointers() const noexcept {
-    return (GetFreeStart() - GetPointersStart()) / sizeof(page_size_t);
+    return (GetFreeStart() - GetPointersStart()) / POINTER_SLOT_SIZE;
   }
 
   //! \brief Get the amount of de-fragmented free space on the page.
   NO_DISCARD page_size_t GetDefragmentedFreeSpace() const { return GetFreeEnd() - GetFreeStart(); }
 
+  //! \brief Get the total amount of free space on the page, the de-fragmented free space and the holes left
+  //!        by removed cells. All of it can be used after vacuuming the page.
+  NO_DISCARD page_size_t GetTotalFreeSpace() const {
+    return static_cast<page_size_t>(GetDefragmentedFreeSpace() + GetFragmentedFreeSpace());
+  }
+
   //! \brief Check whether this page is a pointers page, that is, whether it only stores pointers to other
   //!        pages instead of storing data.
   NO_DISCARD bool IsPointersPage() const noexcept { return (GetFlags() & 0b1) != 0; }
@@ -4,6 +4,8 @@
 
 #pragma once
 
+#include <limits>
+
 #include "NeverSQL/data/internals/EntryPayloadSerializer.h"
 #include "NeverSQL/utility/Defines.h"
 
@@ -19,6 +21,7 @@ enum EntryFlags : uint8_t {
   IsActive = 0b1000'0000,
   KeySizeIsSerialized = 0b0100'0000,
   // ...
+  IsBlobEntry = 0b0100,
   NoteFlag = 0b0010,
   IsSinglePageEntry = 0b0001
 };
@@ -39,6 +42,10 @@ inline bool GetIsSinglePageEntry(std::byte flags) {
   return (static_cast<uint8_t>(flags) & static_cast<uint8_t>(EntryFlags::IsSinglePageEntry)) != 0;
 }
 
+inline bool GetIsBlobEntry(std::byte flags) {
+  return (static_cast<uint8_t>(flags) & static_cast<uint8_t>(EntryFlags::IsBlobEntry)) != 0;
+}
+
 inline bool GetNextOverflowPageIsPresent(std::byte flags) {
   return IsNoteFlagTrue(flags) && !GetIsSinglePageEntry(flags);
 }
@@ -74,6 +81,13 @@ inline bool GetIsEntrySizeSerialized(std::byte flags) {
 //! \note Whether the next overflow page is present is determined by the flags byte.
 //! \note Whether the entry size is serialized is determined by the flags byte.
 //!
+//! Blob entry layout (data cell):
+// clang-format off
+//! [flags: 1 byte] [key_size: 2 bytes]? [key: 8 bytes | variable] + [entry_size: 8 bytes] [first blob page number: 8 bytes]
+// clang-format on
+//! \note The entry data is stored in a run of consecutive pages that starts at the first blob page, and fills
+//!       each of the pages except maybe the last, so the run has ceil(entry_size / page_size) pages.
+//!
 //! Tombstone entry layout (data cell, not created by an EntryCreator, but listed here for now):
 // clang-format off
 //! [flags: 1 byte] [cell_size: 2 bytes] [cell contents (freed space): cell_size bytes]
@@ -85,17 +99,18 @@ inline bool GetIsEntrySizeSerialized(std::byte flags) {
 //! cell has been freed
 //!
 //! Flags:
-//! 0b DK00 00NT
+//! 0b DK00 0BNT
 //!  * D: Deleted flag: 1 if the entry is active, 0 if it is a tombstone (deleted space).
 //!  * K: Key flag: 1 if the key size is serialized, 0 if the key size is not serialized.
 //!  ... unused flags...
+//!  * B: Blob flag: 1 if the entry data is stored in a run of blob pages. Only set if T == 0.
 //!  * N: Note flag: Depends on whether the entry is a single page entry or an overflow entry (currently not
 //!       used for single page entries):
 //!      * If T == 0: 1 if the next overflow page is present, 0 if the next overflow page is not present.
 //!      * If T == 1: 1 if the entry size is serialized, 0 if the entry size is not serialized.
 //!  * T: Type flag: 1 if the entry is a single page entry, 0 if the entry is an overflow entry.
 //! \note The B-tree is responsible for setting the D and K flags, while the EntryCreator is responsible for
-//!       setting the N and T flags.
+//!       setting the B, N and T flags.
 //!
 class EntryCreator {
 public:
@@ -110,8 +125,14 @@ public:
   //! \brief Get how much space the EntryCreator wants in the initial page.
   //!
   //! The EntryCreator may change its internal stage, e.g., store the amount of space it decided on, or store
-  //! whether an overflow page is necessary, when this function is called.
-  page_size_t GetRequestedSize(page_size_t maximum_entry_size);
+  //! whether an overflow page is necessary, when this function is called. Entries that do not fit and whose
+  //! data takes up at least blob_size bytes are stored in blob pages instead of in overflow pages.
+  page_size_t GetRequestedSize(page_size_t maximum_entry_size,
+                               std::size_t blob_size = std::numeric_limits<std::size_t>::max());
+
+  //! \brief The space the entry takes up if it is stored entirely in the initial page, including the
+  //!        serialized entry size.
+  std::size_t GetSinglePageEntrySize() const;
 
   //! \brief Generate the EntryCreator's part of the flags.
   //!
@@ -127,25 +148,29 @@ public:
   //! \brief Return whether the EntryCreator is going to create overflow pages.
   bool GetNeedsOverflow() const noexcept { return overflow_page_needed_ && next_overflow_entry_size_ == 0; }
 
+  //! \brief Return whether the EntryCreator is going to store the entry data in blob pages.
+  bool GetIsBlob() const noexcept { return is_blob_; }
+
 protected:
   page_size_t createOverflowEntry(page_size_t starting_offset, Page* page, BTreeManager* btree_manager);
   page_size_t createSinglePageEntry(page_size_t starting_offset, Page* page);
   page_size_t createOverflowDataEntry(page_size_t starting_offset, Page* page);
 
-  //! \brief Load the current overflow page, switching to the next page if the current page does not have
-  //!        the minimum allowed amount of space.
-  static page_number_t loadOverflowPage(primary_key_t overflow_key, BTreeManager* btree_manager);
+  //! \brief Write the entry data to a new run of blob pages, filling one page at a time, and write the blob
+  //!        entry's size and first page to the primary page.
+  page_size_t createBlobEntry(page_size_t starting_offset, Page* page, BTreeManager* btree_manager);
 
+  //! \brief Write the entry data to overflow pages, one part per page, starting with the given page.
   void writeOverflowData(primary_key_t overflow_key,
                          page_number_t overflow_page_number,
                          BTreeManager* btree_manager);
 
-  //! \brief To keep the overflow page from getting too small, if there is not either enough space for the
-  //!        entire remaining data to fit in, or at least this much space, we go to the next overflow page
-  //!        even if there is a little bit pf space left on the page.
-  constexpr static page_size_t min_overflow_entry_capacity_ = 16;
+  //! \brief The space in an overflow data entry that is not data, the next overflow page number and the
+  //!        entry size.
+  constexpr static page_size_t overflow_header_size_ = sizeof(primary_key_t) + sizeof(entry_size_t);
 
   bool overflow_page_needed_ = false;
+  bool is_blob_ = false;
   bool serialize_size_ = true;
 
   primary_key_t next_overflow_page_ {};
@@ -0,0 +1,80 @@
+//
+// Created by Nathaniel Rupprecht on 10/17/26.
+//
+
+#pragma once
+
+#include <atomic>
+#include <cstdint>
+#include <optional>
+#include <thread>
+
+namespace neversql {
+
+//! \brief A version-based latch, used for optimistic lock coupling.
+//!
+//! Readers never write to the latch. They read its version before reading the data the latch protects, and
+//! validate afterwards that the version is unchanged. If it changed, a writer may have changed the data while
+//! it was being read, and the reader has to restart. Writers lock the latch, which makes the version odd, and
+//! unlocking it moves it to the next even version, so every read that overlapped with the write fails to
+//! validate.
+class OptimisticLatch {
+public:
+  //! \brief Get the version that a read has to be validated against, waiting while a writer holds the latch.
+  uint64_t ReadLock() const noexcept {
+    for (;;) {
+      const auto version = version_.load(std::memory_order_acquire);
+      if (!isLocked(version)) {
+        return version;
+      }
+      std::this_thread::yield();
+    }
+  }
+
+  //! \brief Get the version that a read has to be validated against, or nothing if a writer holds the latch.
+  //!        For readers that must not wait for writers, e.g. because they hold a lock the writer waits for.
+  std::optional<uint64_t> TryReadLock() const noexcept {
+    if (const auto version = version_.load(std::memory_order_acquire); !isLocked(version)) {
+      return version;
+    }
+    return {};
+  }
+
+  //! \brief Check that no writer locked the latch since its version was read with ReadLock.
+  bool Validate(uint64_t version) const noexcept {
+    std::atomic_thread_fence(std::memory_order_acquire);
+    return version_.load(std::memory_order_relaxed) == version;
+  }
+
+  //! \brief Lock the latch for writing, waiting while another writer holds it.
+  void Lock() noexcept {
+    for (;;) {
+      if (auto version = ReadLock(); version_.compare_exchange_weak(version, version + 1)) {
+        return;
+      }
+    }
+  }
+
+  //! \brief Lock the latch for writing if it is still at a version that was read with ReadLock, i.e. no
+  //!        writer changed the data since it was read. Returns false otherwise.
+  bool TryLock(uint64_t version) noexcept {
+    return !isLocked(version) && version_.compare_exchange_strong(version, version + 1);
+  }
+
+  //! \brief Lock the latch for writing if no writer holds it. Returns false otherwise.
+  bool TryLock() noexcept { return TryLock(version_.load(std::memory_order_relaxed)); }
+
+  //! \brief Unlock the latch, moving it to a new version.
+  void Unlock() noexcept { version_.fetch_add(1, std::memory_order_release); }
+
+  //! \brief Check whether a writer holds the latch.
+  bool IsLocked() const noexcept { return isLocked(version_.load(std::memory_order_relaxed)); }
+
+private:
+  static bool isLocked(uint64_t version) noexcept { return (version & 1) != 0; }
+
+  //! \brief The version of the data the latch protects. Odd while a writer holds the latch.
+  std::atomic<uint64_t> version_ {};
+};
+
+}  // namespace neversql
@@ -0,0 +1,76 @@
+//
+// Created by Nathaniel Rupprecht on 10/17/26.
+//
+
+#pragma once
+
+#include <map>
+#include <optional>
+#include <set>
+
+#include "NeverSQL/data/Page.h"
+
+namespace neversql {
+
+//! \brief Overflow pages with less entry space than this are not tracked, too little of an entry would fit.
+inline constexpr page_size_t MIN_TRACKED_OVERFLOW_SPACE = 64;
+
+//! \brief A map of how much space is left in the overflow pages of a B-tree, so each part of an overflow
+//!        entry can be put on the page whose space fits it best.
+//!
+//! The space of a page is its entry space, the largest entry that one more cell in the page could hold. The
+//! map is stored in a single page, so it tracks at most as many pages as fit. When it is full, the page with
+//! the least space is the one that is not tracked.
+//!
+//! Space map page layout:
+//! [magic number: 8 bytes] [number of pages: 2 bytes] ([page number: 8 bytes] [entry space: 2 bytes])*
+class OverflowSpaceMap {
+public:
+  //! \brief Create an empty space map for pages of the given size.
+  explicit OverflowSpaceMap(page_size_t page_size);
+
+  //! \brief Get the page with the least entry space that is at least entry_space, if any page has enough.
+  NO_DISCARD std::optional<page_number_t> FindBestFit(page_size_t entry_space) const;
+
+  //! \brief Get the page with the most entry space, if any page is tracked.
+  NO_DISCARD std::optional<page_number_t> FindMostSpace() const;
+
+  //! \brief Get the entry space of a page, if it is tracked.
+  NO_DISCARD std::optional<page_size_t> GetEntrySpace(page_number_t page_number) const;
+
+  //! \brief Set the entry space of a page, adding the page to the map if it is not tracked.
+  void Update(page_number_t page_number, page_size_t entry_space);
+
+  //! \brief Stop tracking a page.
+  void Remove(page_number_t page_number);
+
+  //! \brief Get the number of pages that are tracked.
+  NO_DISCARD std::size_t GetNumPages() const noexcept { return entry_space_.size(); }
+
+  //! \brief Check whether the map has changed since it was last written to or read from a page.
+  NO_DISCARD bool IsDirty() const noexcept { return is_dirty_; }
+
+  //! \brief Write the map to a page.
+  void WriteToPage(Page& page);
+
+  //! \brief Read the map from a page, replacing what is in the map.
+  void ReadFromPage(const Page& page);
+
+  //! \brief Check whether a page holds a space map.
+  NO_DISCARD static bool IsSpaceMapPage(const Page& page);
+
+private:
+  //! \brief The entry space of each tracked page.
+  std::map<page_number_t, page_size_t> entry_space_;
+
+  //! \brief The tracked pages, ordered by their entry space.
+  std::set<std::pair<page_size_t, page_number_t>> pages_by_space_;
+
+  //! \brief The number of pages that fit in a space map page.
+  std::size_t capacity_;
+
+  //! \brief Whether the map changed since it was last written or read.
+  bool is_dirty_ = false;
+};
+
+}  // namespace neversql
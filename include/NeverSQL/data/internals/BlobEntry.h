@@ -0,0 +1,56 @@
+//
+// Created by Nathaniel Rupprecht on 10/17/26.
+//
+
+#pragma once
+
+#include "NeverSQL/data/internals/DatabaseEntry.h"
+
+namespace neversql::internal {
+
+//! \brief The number of blob pages that a BlobEntry reads from the disk at once.
+inline constexpr page_number_t BLOB_READ_AHEAD_PAGES = 16;
+
+//! \brief The number of blob pages that an entry of the given size takes up.
+inline page_number_t GetNumBlobPages(uint64_t entry_size, page_size_t page_size) {
+  return static_cast<page_number_t>((entry_size + page_size - 1) / page_size);
+}
+
+//! \brief Represents an entry whose data is stored in a run of consecutive blob pages.
+//!
+//! Each part of the entry is one blob page. The pages are read into the page cache BLOB_READ_AHEAD_PAGES at a
+//! time, with one read each, so reading a large entry takes a few sequential reads.
+class BlobEntry final : public DatabaseEntry {
+public:
+  BlobEntry(std::span<const std::byte> entry_header, const BTreeManager* btree_manager);
+
+  std::span<const std::byte> GetData() const noexcept override;
+
+  bool Advance() override;
+
+  bool IsValid() const override;
+
+private:
+  //! \brief Load the current blob page, reading the next run of pages into the cache if necessary.
+  void loadPage();
+
+  //! \brief The total size of the entry data.
+  uint64_t entry_size_ = 0;
+
+  //! \brief The first page of the run of blob pages.
+  page_number_t first_page_ = 0;
+
+  //! \brief The number of pages in the run of blob pages.
+  page_number_t num_pages_ = 0;
+
+  //! \brief The index of the current page within the run of blob pages.
+  page_number_t page_index_ = 0;
+
+  //! \brief A tree manager, which lets the entry load the blob pages.
+  const BTreeManager* btree_manager_;
+
+  //! \brief The current blob page.
+  std::unique_ptr<const Page> page_;
+};
+
+}  // namespace neversql::internal
@@ -0,0 +1,37 @@
+//
+// Created by Nathaniel Rupprecht on 10/17/26.
+//
+
+#pragma once
+
+#include <vector>
+
+#include "NeverSQL/data/internals/DatabaseEntry.h"
+
+namespace neversql::internal {
+
+//! \brief An entry whose data was copied out of its pages, so it stays valid when writers change the pages.
+class CopiedEntry : public DatabaseEntry {
+public:
+  //! \brief Copy all the parts of an entry.
+  explicit CopiedEntry(DatabaseEntry& entry) {
+    do {
+      const auto data = entry.GetData();
+      data_.insert(data_.end(), data.begin(), data.end());
+    } while (entry.Advance());
+  }
+
+  //! \brief Get the data. All the data is in one buffer.
+  std::span<const std::byte> GetData() const noexcept override { return data_; }
+
+  //! \brief There is no further part to advance to.
+  bool Advance() override { return false; }
+
+  //! \brief A copied entry is always valid.
+  bool IsValid() const override { return true; }
+
+private:
+  std::vector<std::byte> data_;
+};
+
+}  // namespace neversql::internal
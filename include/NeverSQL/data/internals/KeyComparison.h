@@ -8,18 +8,34 @@
 
 namespace neversql::internal {
 
-template<typename Value_t>
-requires std::is_trivially_copyable_v<Value_t>
-bool CompareTrivial(std::span<const std::byte> lhs, std::span<const std::byte> rhs) {
-  Value_t lhs_value;
-  Value_t rhs_value;
-  std::memcpy(&lhs_value, lhs.data(), sizeof(uint64_t));
-  std::memcpy(&rhs_value, rhs.data(), sizeof(uint64_t));
-  return lhs_value < rhs_value;
+//! \brief Compare two normalized keys (see KeyEncoding.h). Normalized keys compare byte by byte, as unsigned
+//!        bytes, and a key that is a prefix of another key is less than it.
+inline bool CompareKeys(std::span<const std::byte> lhs, std::span<const std::byte> rhs) noexcept {
+  if (const auto common_size = std::min(lhs.size(), rhs.size()); common_size != 0) {
+    if (const auto cmp = std::memcmp(lhs.data(), rhs.data(), common_size); cmp != 0) {
+      return cmp < 0;
+    }
+  }
+  return lhs.size() < rhs.size();
 }
 
-inline bool CompareString(std::span<const std::byte> lhs, std::span<const std::byte> rhs) {
-  return std::ranges::lexicographical_compare(lhs, rhs);
+// =================================================================================================
+//  Key hints.
+//
+//  A key hint is a 32 bit number computed from a key, which is stored next to the key's pointer in a B-tree
+//  node. Hints must be consistent with the key comparison: if one key is less than another, its hint must be
+//  less than or equal to the other key's hint. Then, keys whose hints differ can be ordered by their hints
+//  alone.
+// =================================================================================================
+
+//! \brief Key hint for normalized keys, the first four bytes of the key, read as a big endian number. Keys
+//!        shorter than four bytes are padded with zeros.
+inline uint32_t HintKey(std::span<const std::byte> key) noexcept {
+  uint32_t hint = 0;
+  for (std::size_t i = 0; i < 4; ++i) {
+    hint = (hint << 8) | (i < key.size() ? static_cast<uint32_t>(key[i]) : 0u);
+  }
+  return hint;
 }
 
-}  // namespace neversql::internal
\ No newline at end of file
+}  // namespace neversql::internal
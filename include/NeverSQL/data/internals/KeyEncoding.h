@@ -0,0 +1,180 @@
+//
+// Created by Nathaniel Rupprecht on 10/17/26.
+//
+
+#pragma once
+
+#include <array>
+#include <bit>
+#include <optional>
+#include <span>
+#include <vector>
+
+#include "NeverSQL/utility/DataTypes.h"
+#include "NeverSQL/utility/Defines.h"
+
+namespace neversql::internal {
+
+// =================================================================================================
+//  Normalized keys.
+//
+//  B-trees store their keys in a normalized form, in which comparing two keys byte by byte (as memcmp does)
+//  gives the same order as comparing the values they represent. This way, one comparison function works for
+//  every key type, and optimizations that rely on byte-wise comparison, like key prefix compression,
+//  separator truncation, and key hints, work for every key type too.
+//
+//  Keys are given to the B-tree in their native form, and normalized when they enter it:
+//    * UInt64, Int64, Int32: the integer, in host byte order. Stored big endian, signed integers with their
+//      sign bit flipped, so negative numbers sort before positive ones.
+//    * DateTime: an int64_t count of microseconds since the epoch, normalized like an Int64.
+//    * Double: the double. Stored as its IEEE-754 bits, big endian, with the sign bit flipped for positive
+//      numbers and every bit flipped for negative numbers. Negative zero is stored as zero.
+//    * Boolean: a bool, stored as one byte, 0 or 1.
+//    * String, BinaryData: the bytes themselves, which already compare lexicographically.
+// =================================================================================================
+
+//! \brief Write an unsigned integer in big endian byte order.
+template<typename Integer_t>
+  requires std::is_unsigned_v<Integer_t>
+void StoreBigEndian(Integer_t value, std::byte* out) noexcept {
+  for (std::size_t i = 0; i < sizeof(Integer_t); ++i) {
+    out[i] = static_cast<std::byte>(value >> (8 * (sizeof(Integer_t) - 1 - i)));
+  }
+}
+
+//! \brief Read an unsigned integer that was written in big endian byte order.
+template<typename Integer_t>
+  requires std::is_unsigned_v<Integer_t>
+Integer_t LoadBigEndian(const std::byte* in) noexcept {
+  Integer_t value = 0;
+  for (std::size_t i = 0; i < sizeof(Integer_t); ++i) {
+    value = static_cast<Integer_t>((value << 8) | static_cast<Integer_t>(in[i]));
+  }
+  return value;
+}
+
+//! \brief Map a signed integer to an unsigned integer with the same order.
+template<typename Integer_t>
+  requires std::is_signed_v<Integer_t> && std::is_integral_v<Integer_t>
+std::make_unsigned_t<Integer_t> OrderedBits(Integer_t value) noexcept {
+  using Unsigned_t = std::make_unsigned_t<Integer_t>;
+  return static_cast<Unsigned_t>(value) ^ (Unsigned_t {1} << (8 * sizeof(Integer_t) - 1));
+}
+
+//! \brief Invert OrderedBits for signed integers.
+template<typename Integer_t>
+  requires std::is_signed_v<Integer_t> && std::is_integral_v<Integer_t>
+Integer_t FromOrderedBits(std::make_unsigned_t<Integer_t> bits) noexcept {
+  using Unsigned_t = std::make_unsigned_t<Integer_t>;
+  return static_cast<Integer_t>(bits ^ (Unsigned_t {1} << (8 * sizeof(Integer_t) - 1)));
+}
+
+//! \brief Map a double to an unsigned integer with the same order. Negative zero maps to the same value as
+//!        zero. NaNs with the sign bit set sort before every number, other NaNs sort after every number.
+inline uint64_t OrderedBits(double value) noexcept {
+  const auto bits = std::bit_cast<uint64_t>(value == 0. ? 0. : value);
+  constexpr auto sign_bit = uint64_t {1} << 63;
+  return (bits & sign_bit) != 0 ? ~bits : bits | sign_bit;
+}
+
+//! \brief Invert OrderedBits for doubles.
+inline double DoubleFromOrderedBits(uint64_t bits) noexcept {
+  constexpr auto sign_bit = uint64_t {1} << 63;
+  return std::bit_cast<double>((bits & sign_bit) != 0 ? bits ^ sign_bit : ~bits);
+}
+
+//! \brief Get the size of the keys of a key type whose keys all have the same size, or zero if keys of the
+//!        type can have any size (including composite keys). Raises an error for types that cannot be used as
+//!        keys.
+std::size_t GetFixedKeySize(DataTypeEnum key_type);
+
+//! \brief Check whether a data type can be used as the key type of a B-tree, or as a field of a composite
+//!        key.
+bool IsValidKeyType(DataTypeEnum key_type) noexcept;
+
+//! \brief A key, normalized so that keys compare byte by byte in the same order as their values.
+//!
+//! Fixed size keys are encoded into a buffer inside the object. Keys whose native form is already normalized
+//! (strings and binary data) are referenced, not copied, so the native key must outlive the normalized key.
+class NormalizedKey {
+public:
+  //! \brief Normalize a key of some key type, given in its native form.
+  NormalizedKey(DataTypeEnum key_type, std::span<const std::byte> native_key);
+
+  //! \brief Get the normalized key.
+  NO_DISCARD std::span<const std::byte> Get() const noexcept {
+    return is_encoded_ ? std::span<const std::byte>(buffer_.data(), size_) : native_key_;
+  }
+
+private:
+  //! \brief Buffer that holds an encoded fixed size key.
+  std::array<std::byte, sizeof(uint64_t)> buffer_ {};
+
+  //! \brief The size of the encoded key in the buffer.
+  std::size_t size_ {};
+
+  //! \brief Whether the key was encoded into the buffer. If not, the native key is already normalized.
+  bool is_encoded_ = false;
+
+  //! \brief The native key, if it is already normalized.
+  std::span<const std::byte> native_key_;
+};
+
+//! \brief Normalize a primary key (e.g. an auto-incrementing key, or an overflow entry number).
+inline std::array<std::byte, sizeof(primary_key_t)> NormalizePrimaryKey(primary_key_t key) noexcept {
+  std::array<std::byte, sizeof(primary_key_t)> normalized;
+  StoreBigEndian(key, normalized.data());
+  return normalized;
+}
+
+//! \brief Get the value of a normalized primary key.
+inline primary_key_t DenormalizePrimaryKey(std::span<const std::byte> normalized_key) noexcept {
+  return LoadBigEndian<primary_key_t>(normalized_key.data());
+}
+
+//! \brief Print a normalized key of some key type. Keys that do not have the size that keys of the type must
+//!        have, like separator keys that were truncated, are hex dumped.
+std::string PrintNormalizedKey(DataTypeEnum key_type, std::span<const std::byte> normalized_key);
+
+// =================================================================================================
+//  Composite keys.
+//
+//  A composite key is a tuple of fields, e.g. (tenant: Int64, timestamp: DateTime, id: UInt64), each of which
+//  has one of the key types above. B-trees with composite keys have the key type Array, and store the types
+//  of the fields in their root page.
+//
+//  The normalized key is the concatenation of the normalized fields, so keys compare field by field. Fixed
+//  size fields are normalized as above. Variable size fields (String, BinaryData) are escaped, writing every
+//  zero byte as 0x00 0xFF, and terminated by 0x00 0x00. This keeps the fields' order, and makes it possible
+//  to tell where each field ends.
+//
+//  A key made of the first few fields of a composite key is a prefix of every key that starts with those
+//  fields, so all keys that start with the same fields are one contiguous range of the B-tree. Composite keys
+//  are given to the B-tree already normalized, built with a CompositeKey.
+// =================================================================================================
+
+//! \brief The maximum number of fields in a composite key.
+inline constexpr std::size_t MAX_COMPOSITE_KEY_FIELDS = 16;
+
+//! \brief Check whether a list of field types can be the fields of a composite key.
+bool IsValidCompositeKey(std::span<const DataTypeEnum> field_types) noexcept;
+
+//! \brief Normalize a field, given in its native form, and append it to a composite key.
+void AppendCompositeKeyField(DataTypeEnum field_type,
+                             std::span<const std::byte> native_field,
+                             std::vector<std::byte>& key);
+
+//! \brief Count the fields in a normalized composite key, which may have fewer fields than the key type.
+//!        Raises an error if the key is not a valid composite key of the given field types.
+std::size_t CountCompositeKeyFields(std::span<const DataTypeEnum> field_types,
+                                    std::span<const std::byte> key);
+
+//! \brief Print a normalized composite key, e.g. "(5, 1700000000000000, 12)". Whatever is left after the last
+//!        complete field (e.g. of a truncated separator key) is hex dumped.
+std::string PrintCompositeKey(std::span<const DataTypeEnum> field_types, std::span<const std::byte> key);
+
+//! \brief Get the smallest key that is greater than every key that starts with a prefix, or nullopt if there
+//!        is no such key (the prefix is empty or all 0xFF bytes).
+std::optional<std::vector<std::byte>> PrefixSuccessor(std::span<const std::byte> prefix);
+
+}  // namespace neversql::internal
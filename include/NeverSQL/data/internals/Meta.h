@@ -29,6 +29,10 @@ public:
 
   NO_DISCARD page_number_t GetIndexPage() const noexcept { return index_page_; }
 
+  //! \brief The version of the on-disk format that this build reads and writes. This must be incremented
+  //!        whenever the layout of pages changes, files with a different version cannot be opened.
+  static constexpr uint32_t FORMAT_VERSION = 1;
+
 private:
   //! \brief The magic sequence for the database.
   static inline uint64_t meta_magic_number_ = ToUInt64("NeverSQL");  // Null terminated.
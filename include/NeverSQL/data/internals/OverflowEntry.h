@@ -10,6 +10,10 @@
 namespace neversql::internal {
 
 //! \brief Represents an entry that is stored across one or more overflow pages.
+//!
+//! Each part of the entry is found in its overflow page once, when the entry moves to the page, and the page
+//! that holds the next part is requested at the same time, so it is in the page cache by the time the entry
+//! advances to it. Together with a SegmentedBuffer, this lets the parts be read in place.
 class OverflowEntry final : public DatabaseEntry {
 public:
   OverflowEntry(std::span<const std::byte> entry_header,
@@ -22,7 +26,7 @@ public:
   bool IsValid() const override;
 
 private:
-  //! \brief Set up the data for the current overflow page.
+  //! \brief Set up the data for the current overflow page, and request the page with the next part.
   void setup();
 
   //! \brief The overflow key for the overflow entry.
@@ -37,6 +41,12 @@ private:
 
   //! \brief The current node that the overflow entry is on.
   std::optional<BTreeNodeMap> node_;
+
+  //! \brief The node with the next part of the overflow entry, if there is one.
+  std::optional<BTreeNodeMap> next_node_;
+
+  //! \brief The part of the entry that is in the current node.
+  std::span<const std::byte> data_;
 };
 
 }  // namespace neversql::internal
\ No newline at end of file
@@ -0,0 +1,82 @@
+//
+// Created by Nathaniel Rupprecht on 10/17/26.
+//
+
+#pragma once
+
+#include <algorithm>
+#include <span>
+#include <string>
+
+#include "NeverSQL/utility/Defines.h"
+
+namespace neversql::internal {
+
+class DatabaseEntry;
+
+//! \brief Reads a sequence of byte spans as if they were one contiguous buffer.
+//!
+//! The spans are either a single buffer, or the parts of a database entry, each of which is only requested
+//! from the entry once the part before it has been read. Reads that cross from one part to the next are
+//! copied piece by piece, so an entry stored across several overflow pages is never assembled into one
+//! buffer.
+class SegmentedBuffer {
+public:
+  //! \brief Read from a single buffer.
+  explicit SegmentedBuffer(std::span<const std::byte> buffer) noexcept
+      : segment_(buffer) {}
+
+  //! \brief Read the parts of a database entry, starting with its current part.
+  explicit SegmentedBuffer(DatabaseEntry& entry);
+
+  //! \brief Copy the next bytes of the buffer to a destination.
+  void Read(std::span<std::byte> destination) {
+    if (destination.size() <= segment_.size()) {
+      std::ranges::copy(segment_.first(destination.size()), destination.begin());
+      consume(destination.size());
+      return;
+    }
+    readAcrossSegments(destination);
+  }
+
+  //! \brief Read a value of a trivially copyable type from the next bytes of the buffer.
+  template<typename Value_t> requires std::is_trivially_copyable_v<Value_t>
+  Value_t Read() {
+    Value_t value;
+    Read(std::as_writable_bytes(std::span(&value, 1)));
+    return value;
+  }
+
+  //! \brief Read a string of a given size from the next bytes of the buffer.
+  std::string ReadString(std::size_t size);
+
+  //! \brief Check whether there are no more bytes to read.
+  bool IsEmpty();
+
+  //! \brief Get the number of bytes that have been read.
+  std::size_t GetNumConsumed() const noexcept { return num_consumed_; }
+
+private:
+  //! \brief Move past bytes in the current part.
+  void consume(std::size_t size) noexcept {
+    segment_ = segment_.subspan(size);
+    num_consumed_ += size;
+  }
+
+  //! \brief Move to the next non-empty part of the entry. Returns false if there are no more parts.
+  bool nextSegment();
+
+  //! \brief Read bytes that continue into the next parts of the entry.
+  void readAcrossSegments(std::span<std::byte> destination);
+
+  //! \brief The unread bytes of the current part.
+  std::span<const std::byte> segment_;
+
+  //! \brief The entry whose parts are read, if reading an entry.
+  DatabaseEntry* entry_ {};
+
+  //! \brief The number of bytes that have been read.
+  std::size_t num_consumed_ {};
+};
+
+}  // namespace neversql::internal
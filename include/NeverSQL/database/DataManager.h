@@ -4,9 +4,15 @@
 
 #pragma once
 
+#include <shared_mutex>
+
+#include "NeverSQL/data/CompositeKey.h"
 #include "NeverSQL/data/Document.h"
 #include "NeverSQL/data/PageCache.h"
 #include "NeverSQL/data/btree/BTree.h"
+#include "NeverSQL/database/IndexBuilder.h"
+#include "NeverSQL/database/Query.h"
+#include "NeverSQL/database/SecondaryIndex.h"
 #include "NeverSQL/utility/HexDump.h"
 
 namespace neversql {
@@ -14,6 +20,10 @@ namespace neversql {
 struct CollectionInfo {
   std::string collection_name;
   DataTypeEnum key_type;
+
+  //! \brief If not empty, the collection's keys are composite keys with these field types, and the key type
+  //!        is ignored.
+  std::vector<DataTypeEnum> key_fields {};
 };
 
 //! \brief Object that manages the data in the database, e.g. setting up B-trees and indices within the
@@ -25,6 +35,10 @@ public:
   //! \brief Add a collection to the database.
   void AddCollection(const std::string& collection_name, DataTypeEnum key_type);
 
+  //! \brief Add a collection whose keys are composite keys, tuples of fields with the given types, in order.
+  //!        Keys for the collection are built with a CompositeKey.
+  void AddCollection(const std::string& collection_name, const std::vector<DataTypeEnum>& key_fields);
+
   void AddCollection(const CollectionInfo& info);
 
   // ========================================
@@ -41,6 +55,14 @@ public:
   //! \brief Retrieve a value from the database along with data about the retrieval.
   RetrievalResult Retrieve(const std::string& collection_name, GeneralKey key) const;
 
+  //! \brief Check that the entry of a retrieval was not changed since it was retrieved. The retrieved entry
+  //!        is a copy, so it is always whole, but it may be out of date if the check fails.
+  bool Validate(const std::string& collection_name, const RetrievalResult& result) const;
+
+  //! \brief Remove the value with a key from a collection. Returns false if there is no value with the key.
+  //!        The document's entries in the collection's secondary indexes are removed as well.
+  bool Remove(const std::string& collection_name, GeneralKey key);
+
   // ========================================
   //  Primary key methods
   // ========================================
@@ -60,6 +82,14 @@ public:
   //! \brief Retrieve a value from the database along with data about the retrieval.
   RetrievalResult Retrieve(const std::string& collection_name, primary_key_t key) const;
 
+  //! \brief Remove the value with a primary key from a collection. Returns false if there is no value with
+  //!        the key.
+  bool Remove(const std::string& collection_name, primary_key_t key);
+
+  //! \brief Write any state that the collections keep in memory back to their pages. This also happens
+  //!        automatically when the data manager is destroyed.
+  void Checkpoint();
+
   //! \brief Get the names of all collections.
   std::set<std::string> GetCollectionNames() const;
 
@@ -70,6 +100,113 @@ public:
   BTreeManager::Iterator Begin(const std::string& collection_name) const;
   BTreeManager::Iterator End(const std::string& collection_name) const;
 
+  //! \brief Get an iterator that goes through a collection from its largest key to its smallest.
+  BTreeManager::Iterator RBegin(const std::string& collection_name) const;
+
+  // ========================================
+  //  Range scans.
+  // ========================================
+
+  //! \brief Get an iterator over the entries in a collection whose keys are in a range, in key order, or in
+  //!        reverse key order if the direction is descending.
+  BTreeManager::Iterator Scan(const std::string& collection_name,
+                              const KeyRange& range,
+                              ScanDirection direction = ScanDirection::Ascending) const;
+
+  //! \brief Get an iterator over the entries in a collection whose keys are between a lower and an upper
+  //!        bound. A bound that is not given means the range is unbounded on that side.
+  BTreeManager::Iterator Scan(const std::string& collection_name,
+                              std::optional<GeneralKey> lower,
+                              std::optional<GeneralKey> upper,
+                              bool lower_inclusive = true,
+                              bool upper_inclusive = true,
+                              ScanDirection direction = ScanDirection::Ascending) const;
+
+  //! \brief Get an iterator over the entries in a collection whose keys start with a prefix. For collections
+  //!        with composite keys, the prefix is a composite key with only the first few fields, e.g. all the
+  //!        entries for one tenant. For collections with string keys, the prefix is a string.
+  BTreeManager::Iterator ScanPrefix(const std::string& collection_name,
+                                    GeneralKey prefix,
+                                    ScanDirection direction = ScanDirection::Ascending) const;
+
+  //! \brief Get an iterator over the entries in a collection with primary keys between a lower and an upper
+  //!        bound.
+  BTreeManager::Iterator Scan(const std::string& collection_name,
+                              primary_key_t lower,
+                              primary_key_t upper,
+                              bool lower_inclusive = true,
+                              bool upper_inclusive = true,
+                              ScanDirection direction = ScanDirection::Ascending) const;
+
+  // ========================================
+  //  Counting and pagination.
+  // ========================================
+
+  //! \brief Count the entries in a collection, without visiting them.
+  uint64_t Count(const std::string& collection_name) const;
+
+  //! \brief Count the entries in a collection whose keys are in a range, without visiting them.
+  uint64_t Count(const std::string& collection_name, const KeyRange& range) const;
+
+  //! \brief Get an iterator that starts a number of entries into a collection, from its first entry, or from
+  //!        its last entry if the direction is descending. The entries that are skipped are not visited.
+  BTreeManager::Iterator Skip(const std::string& collection_name,
+                              uint64_t offset,
+                              ScanDirection direction = ScanDirection::Ascending) const;
+
+  // ========================================
+  //  Secondary indexes.
+  // ========================================
+
+  //! \brief Create a secondary index on a field of the documents in a collection, adding an entry for every
+  //!        document that is already in the collection. The index is kept up to date by AddValue and Remove.
+  //!        Waits until the index is built, raising an error if the build fails.
+  //!
+  //! If the index is unique, adding a document whose field has the same value as the field of a document that
+  //! is already in the collection fails.
+  void CreateIndex(const std::string& collection_name, const std::string& field_name, bool is_unique = false);
+
+  //! \brief Create a secondary index, which may be a covering index (see IndexInfo::included_fields) or a
+  //!        multikey index (see IndexInfo::is_multikey).
+  void CreateIndex(const IndexInfo& info);
+
+  //! \brief Start building a secondary index on a field of the documents in a collection in the background,
+  //!        see IndexBuilder. Documents can be added to and removed from the collection while the index is
+  //!        built. The index is used once it is built.
+  //!
+  //! The pages of an index whose build fails, e.g. because a unique index found two documents with the same
+  //! value, are not reclaimed.
+  void StartIndexBuild(const std::string& collection_name,
+                       const std::string& field_name,
+                       bool is_unique = false);
+
+  //! \brief Start building a secondary index, which may be a covering or multikey index, in the background.
+  void StartIndexBuild(const IndexInfo& info);
+
+  //! \brief Get the progress of the last build of an index, or nullopt if the index was not built since the
+  //!        database was opened.
+  std::optional<IndexBuildStats> GetIndexBuildStats(const std::string& collection_name,
+                                                    const std::string& field_name) const;
+
+  //! \brief Wait for the build of an index to finish, and get its final stats.
+  IndexBuildStats WaitForIndexBuild(const std::string& collection_name, const std::string& field_name);
+
+  //! \brief Check whether a collection has a secondary index on a field.
+  bool HasIndex(const std::string& collection_name, const std::string& field_name) const;
+
+  //! \brief Get an iterator over the documents in a collection that meet a condition. If the condition is an
+  //!        equality on a field that the collection has an index on, or an "array contains" condition on a
+  //!        field that the collection has a multikey index on, the documents are found with a seek in the
+  //!        index. Otherwise, every document in the collection is read and tested.
+  query::BTreeQueryIterator Find(const std::string& collection_name, const query::Condition& condition) const;
+
+  //! \brief Get an iterator over some fields of the documents in a collection that meet a condition. If the
+  //!        condition is an equality on a field that has a covering index, which stores all the fields, the
+  //!        fields are read from the index alone. Otherwise, the documents are found like Find finds them.
+  query::ProjectionIterator FindFields(const std::string& collection_name,
+                                       const query::Condition& condition,
+                                       std::vector<std::string> field_names) const;
+
   // ========================================
   // Debugging and Diagnostic Functions
   // ========================================
@@ -93,8 +230,74 @@ private:
   //! \brief Cache the collection index.
   std::unique_ptr<BTreeManager> collection_index_ {};
 
+  //! \brief Register a new collection, whose B-tree was just created, in the collection index.
+  void addCollection(const std::string& collection_name, std::unique_ptr<BTreeManager> btree);
+
+  //! \brief Get the collection's B-tree, raising an error if there is no such collection.
+  BTreeManager& getCollection(const std::string& collection_name) const;
+
+  //! \brief Get the index on a field of a collection, or null if there is no such index.
+  const SecondaryIndex* findIndex(const std::string& collection_name, const std::string& field_name) const;
+
+  //! \brief Get the index of a collection that can answer an equality, or null if there is no such index.
+  const SecondaryIndex* findIndex(const std::string& collection_name,
+                                  const query::FieldEquality& equality) const;
+
+  //! \brief Add a document, which was just added to a collection with a normalized primary key, to the
+  //!        collection's indexes.
+  void addToIndexes(const std::string& collection_name,
+                    const Document& document,
+                    std::span<const std::byte> primary_key);
+
+  //! \brief Get the build of an index on a collection, or null if the index was not built.
+  std::shared_ptr<IndexBuilder> findIndexBuild(const std::string& collection_name,
+                                               const std::string& field_name) const;
+
+  //! \brief Lock the write logs of the index builds that are running on a collection, so that a write to the
+  //!        collection and its records in the logs are made together.
+  std::vector<std::unique_lock<std::mutex>> lockIndexBuilds(const std::string& collection_name) const;
+
+  //! \brief Record a write to a collection in the write logs of the index builds that are running on it. The
+  //!        logs must be locked.
+  void recordWrite(const std::string& collection_name,
+                   const Document& document,
+                   std::span<const std::byte> primary_key,
+                   bool is_insert) const;
+
+  //! \brief Apply the last writes that were made during an index build, and make the index visible. Called by
+  //!        the build thread.
+  void publishIndex(IndexBuilder& builder);
+
+  //! \brief Register an index in the collection index, so it is loaded with the database.
+  void registerIndex(const IndexInfo& info, page_number_t page_number);
+
+  //! \brief Lock the uniqueness checks of a collection that has unique indexes, so that a document is checked
+  //!        and added to the indexes before another document is checked. Returns an empty lock if the
+  //!        collection has no unique indexes.
+  std::unique_lock<std::mutex> lockUniqueChecks(const std::string& collection_name) const;
+
+  //! \brief Check that a document can be added to a collection without breaking the uniqueness of any of the
+  //!        collection's indexes.
+  void checkUniqueness(const std::string& collection_name, const Document& document) const;
+
   //! \brief Cache the collections that are in the database.
   std::map<std::string, std::unique_ptr<BTreeManager>> collections_;
+
+  //! \brief Guards the indexes and index builds. Writes to collections hold it shared, an index build holds
+  //!        it exclusively while it makes its index visible.
+  mutable std::shared_mutex index_lock_;
+
+  //! \brief A lock for each collection with unique indexes, held while a document is added to the collection.
+  //!        Guarded by index_lock_, like the indexes.
+  mutable std::map<std::string, std::mutex> unique_check_locks_;
+
+  //! \brief The secondary indexes of each collection.
+  std::map<std::string, std::vector<std::unique_ptr<SecondaryIndex>>> indexes_;
+
+  //! \brief The index builds of each collection, running or finished. These are destroyed first, which stops
+  //!        running builds. They are shared with the threads that wait for them, since a finished build can
+  //!        be replaced by a new build of the same index while a thread still waits for it.
+  std::map<std::string, std::vector<std::shared_ptr<IndexBuilder>>> index_builds_;
 };
 
 }  // namespace neversql
\ No newline at end of file
@@ -0,0 +1,242 @@
+//
+// Created by Nathaniel Rupprecht on 10/17/26.
+//
+
+#pragma once
+
+#include <atomic>
+#include <chrono>
+#include <filesystem>
+#include <functional>
+#include <mutex>
+#include <thread>
+
+#include "NeverSQL/database/SecondaryIndex.h"
+
+namespace neversql {
+
+//! \brief How many documents an index build reads from the collection at a time. Writes to the collection
+//!        wait while a batch is read, and can be made between batches.
+inline constexpr std::size_t INDEX_BUILD_SCAN_BATCH = 256;
+
+//! \brief How many bytes of index entries an index build sorts in memory before it writes them to a sorted
+//!        run on disk, to be merged with the other runs.
+inline constexpr std::size_t INDEX_BUILD_RUN_BYTES = 8 << 20;
+
+//! \brief How many writes to the collection an index build may still have to catch up on when it stops
+//!        writes to the collection, to catch up on the rest and make the index visible.
+inline constexpr std::size_t INDEX_BUILD_FINAL_CATCH_UP = 256;
+
+//! \brief The phases of an index build, in order.
+enum class IndexBuildPhase : uint8_t {
+  //! \brief Reading the documents in the collection, and sorting their index entries into runs.
+  Scanning,
+  //! \brief Merging the sorted runs and appending the entries to the index.
+  Loading,
+  //! \brief Applying the writes that were made to the collection while the index was built.
+  CatchingUp,
+  //! \brief The index is built and visible.
+  Done,
+  //! \brief The build failed, see the error.
+  Failed,
+};
+
+std::string to_string(IndexBuildPhase phase);
+
+//! \brief The progress of an index build.
+struct IndexBuildStats {
+  //! \brief The phase that the build is in.
+  IndexBuildPhase phase = IndexBuildPhase::Scanning;
+
+  //! \brief The number of documents in the collection when the build started.
+  uint64_t total_documents {};
+
+  //! \brief The number of documents that were read from the collection.
+  uint64_t documents_scanned {};
+
+  //! \brief The number of index entries that the scanned documents produced.
+  uint64_t entries_sorted {};
+
+  //! \brief The number of sorted runs that were written to disk. Zero if the entries were sorted in memory.
+  uint64_t sorted_runs {};
+
+  //! \brief The number of entries that were appended to the index.
+  uint64_t entries_loaded {};
+
+  //! \brief The number of writes to the collection, made during the build, that were applied to the index.
+  uint64_t writes_caught_up {};
+
+  //! \brief How long the build has been running, or ran for.
+  std::chrono::duration<double> elapsed {};
+
+  //! \brief Why the build failed, if it failed.
+  std::string error;
+
+  //! \brief Estimate the fraction of the build that is done, between zero and one.
+  double GetProgress() const noexcept;
+
+  //! \brief Get the number of documents read from the collection per second.
+  double GetDocumentsPerSecond() const noexcept;
+
+  //! \brief Get the number of entries appended to the index per second.
+  double GetEntriesPerSecond() const noexcept;
+};
+
+//! \brief Builds a secondary index on a collection in a background thread, while documents are added to and
+//!        removed from the collection.
+//!
+//! The builder reads the collection in key order, in batches, and sorts the index entries of the documents
+//! with an external merge sort: entries are sorted in memory, and written to sorted runs on disk when there
+//! are too many of them, which are merged at the end. The sorted entries are appended to a new index B-tree,
+//! which fills its leaves completely.
+//!
+//! Writes to the collection that are made during the build are recorded by the data manager (see
+//! RecordWrite), and applied to the index once it is loaded. Writes to documents that the scan had not read
+//! yet are seen twice, so applying a write is idempotent. When few writes are left, the data manager stops
+//! writes to the collection, the rest of the writes are applied, and the index becomes visible.
+class IndexBuilder {
+public:
+  //! \brief Called by the build thread with the builder, once the index is loaded, to apply the last writes
+  //!        (see FinishCatchUp) and make the index visible.
+  using PublishCallback = std::function<void(IndexBuilder&)>;
+
+  IndexBuilder(std::unique_ptr<SecondaryIndex> index,
+               BTreeManager& collection,
+               std::filesystem::path run_directory,
+               PublishCallback publish);
+
+  //! \brief Stops the build, if it is still running.
+  ~IndexBuilder();
+
+  //! \brief Start the build in a background thread.
+  void Start();
+
+  //! \brief Wait for the build to finish, and get its final stats.
+  IndexBuildStats Wait();
+
+  //! \brief Get the progress of the build.
+  IndexBuildStats GetStats() const;
+
+  //! \brief Get the description of the index that is built.
+  const IndexInfo& GetInfo() const noexcept { return info_; }
+
+  //! \brief Check whether writes to the collection still have to be recorded.
+  bool IsActive() const noexcept { return is_active_; }
+
+  //! \brief Get the lock that a writer holds while it writes to the collection and records the write, so that
+  //!        writes are recorded in the order they were made.
+  std::mutex& GetWriteLogLock() noexcept { return write_log_lock_; }
+
+  //! \brief Record a write to the collection. The write log lock must be held.
+  void RecordWrite(const Document& document, std::span<const std::byte> primary_key, bool is_insert);
+
+  //! \brief Apply the last recorded writes, and take the index from the builder. Called by the publish
+  //!        callback, while no writes to the collection can be made.
+  std::unique_ptr<SecondaryIndex> FinishCatchUp();
+
+private:
+  //! \brief A write to the collection that was made during the build.
+  struct RecordedWrite {
+    bool is_insert;
+    std::vector<std::byte> encoded_value;
+    std::vector<std::byte> primary_key;
+    //! \brief The value of the index entry, for inserts.
+    std::vector<std::byte> entry_value;
+  };
+
+  //! \brief An index entry that is sorted by the build.
+  struct SortedEntry {
+    //! \brief The full index key.
+    std::vector<std::byte> key;
+    //! \brief The value of the index entry.
+    std::vector<std::byte> value;
+    //! \brief The size of the encoded field value at the start of the key.
+    uint32_t encoded_value_size {};
+  };
+
+  //! \brief Run the build. This is the body of the build thread.
+  void run();
+
+  //! \brief Read the collection, sorting the entries in memory and writing sorted runs.
+  void scan();
+
+  //! \brief Sort the entries that are in memory, and write them to a new sorted run.
+  void writeRun();
+
+  //! \brief Merge the sorted runs (or the entries in memory, if there are no runs) into the index.
+  void load();
+
+  //! \brief Append one entry, in key order, to the index. Checks the index's uniqueness.
+  void appendEntry(const SortedEntry& entry);
+
+  //! \brief Apply recorded writes until few are left.
+  void catchUp();
+
+  //! \brief Apply some recorded writes to the index.
+  void applyWrites(const std::vector<RecordedWrite>& writes);
+
+  //! \brief Raise an error if the build was stopped.
+  void checkStopped() const;
+
+  //! \brief Update the stats, under the stats lock.
+  void updateStats(const std::function<void(IndexBuildStats&)>& update);
+
+  //! \brief The description of the index that is built.
+  IndexInfo info_;
+
+  //! \brief The index that is built.
+  std::unique_ptr<SecondaryIndex> index_;
+
+  //! \brief The collection that the index is on.
+  BTreeManager& collection_;
+
+  //! \brief The directory that the sorted runs are written to.
+  std::filesystem::path run_directory_;
+
+  //! \brief Makes the index visible, see PublishCallback.
+  PublishCallback publish_;
+
+  //! \brief The index entries that are sorted in memory.
+  std::vector<SortedEntry> entries_;
+
+  //! \brief The number of bytes of index entries that are in memory.
+  std::size_t entries_size_ {};
+
+  //! \brief The files of the sorted runs.
+  std::vector<std::filesystem::path> runs_;
+
+  //! \brief The encoded value of the last entry that was appended, to check uniqueness.
+  std::vector<std::byte> last_value_;
+
+  //! \brief Whether an entry was appended yet.
+  bool has_last_value_ = false;
+
+  //! \brief The number of entries that were appended to the index.
+  uint64_t num_loaded_ {};
+
+  //! \brief Guards the write log.
+  std::mutex write_log_lock_;
+
+  //! \brief The writes that were made to the collection during the build, and were not applied yet.
+  std::vector<RecordedWrite> write_log_;
+
+  //! \brief Whether writes still have to be recorded.
+  std::atomic<bool> is_active_ = true;
+
+  //! \brief Set to stop the build.
+  std::atomic<bool> is_stopped_ = false;
+
+  //! \brief Guards the stats.
+  mutable std::mutex stats_lock_;
+
+  //! \brief The progress of the build.
+  IndexBuildStats stats_;
+
+  //! \brief When the build started.
+  std::chrono::steady_clock::time_point start_time_;
+
+  //! \brief The build thread.
+  std::thread thread_;
+};
+
+}  // namespace neversql
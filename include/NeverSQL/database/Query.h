@@ -8,9 +8,41 @@
 
 #include "NeverSQL/data/Document.h"
 #include "NeverSQL/data/btree/BTree.h"
+#include "NeverSQL/database/SecondaryIndex.h"
 
 namespace neversql::query {
 
+//! \brief A condition that a field of a document, or an element of an array field, is equal to a value, which
+//!        can be answered by a seek in an index on the field instead of a scan of the collection.
+struct FieldEquality {
+  //! \brief The name of the field.
+  std::string field_name;
+
+  //! \brief The type of the value. Fields with values of other types are not equal to the value.
+  DataTypeEnum type;
+
+  //! \brief The value, in its native form (see KeyEncoding.h).
+  std::vector<std::byte> value;
+
+  //! \brief If true, the field is an array, one of whose elements is equal to the value. Answered by a
+  //!        multikey index.
+  bool is_element = false;
+};
+
+//! \brief Make the equality of a field, or of an element of an array field, with a value, if values of the
+//!        type can be indexed.
+template<typename Data_t>
+std::optional<FieldEquality> MakeFieldEquality(const std::string& field_name,
+                                               const Data_t& value,
+                                               bool is_element = false) {
+  if constexpr (std::is_same_v<Data_t, std::string> || std::is_arithmetic_v<Data_t>) {
+    const auto native_value = internal::SpanValue(value);
+    return FieldEquality {
+        field_name, GetDataTypeEnum<Data_t>(), {native_value.begin(), native_value.end()}, is_element};
+  }
+  return {};
+}
+
 class Condition : public lightning::ImplBase {
   friend class ImplBase;
 
@@ -19,6 +51,10 @@ protected:
   public:
     virtual bool Test(const Document& reader) const = 0;
     virtual std::shared_ptr<Impl> Copy() const = 0;
+
+    //! \brief If the condition is exactly an equality on one field, or on an element of an array field, get
+    //!        the equality.
+    virtual std::optional<FieldEquality> GetEquality() const { return {}; }
   };
 
   explicit Condition(const std::shared_ptr<Impl>& impl)
@@ -27,6 +63,10 @@ protected:
 public:
   bool operator()(const Document& reader) const { return impl<Condition>()->Test(reader); }
   Condition Copy() const { return Condition(impl<Condition>()->Copy()); }
+
+  //! \brief If the condition is exactly an equality on one field, or on an element of an array field, get the
+  //!        equality, so the condition can be answered with an index on the field.
+  std::optional<FieldEquality> GetEquality() const { return impl<Condition>()->GetEquality(); }
 };
 
 //! \brief A condition that always evaluates to true, used as a placeholder.
@@ -68,6 +108,13 @@ protected:
       return std::make_shared<Impl>(field_name_, value_);
     }
 
+    std::optional<FieldEquality> GetEquality() const override {
+      if constexpr (std::is_same_v<Predicate_t, std::equal_to<Data_t>>) {
+        return MakeFieldEquality(field_name_, value_);
+      }
+      return {};
+    }
+
   private:
     std::string field_name_;
     Data_t value_;
@@ -138,9 +185,58 @@ public:
       : Condition(std::make_shared<Impl>(field_name, type)) {}
 };
 
+//! \brief A condition that a field of a document is an array, one of whose elements is equal to a value. Can
+//!        be answered by a multikey index on the field.
+template<typename Data_t>
+class Contains : public Condition {
+  friend class ImplBase;
+
+protected:
+  class Impl final : public Condition::Impl {
+  public:
+    Impl(std::string field_name, Data_t value)
+        : field_name_(std::move(field_name))
+        , value_(std::move(value)) {}
+
+    bool Test(const Document& document) const override {
+      auto field = document.GetElement(field_name_);
+      if (!field || field->get().GetDataType() != DataTypeEnum::Array) {
+        return false;
+      }
+      auto& array = dynamic_cast<const ArrayValue&>(field->get());
+      for (std::size_t i = 0; i < array.GetNumElements(); ++i) {
+        if (array.GetElement(i).TryGetAs<Data_t>() == value_) {
+          return true;
+        }
+      }
+      return false;
+    }
+
+    std::shared_ptr<Condition::Impl> Copy() const override {
+      return std::make_shared<Impl>(field_name_, value_);
+    }
+
+    std::optional<FieldEquality> GetEquality() const override {
+      return MakeFieldEquality(field_name_, value_, true);
+    }
+
+  private:
+    std::string field_name_;
+    Data_t value_;
+  };
+
+public:
+  Contains(const std::string& field_name, Data_t value)
+      : Condition(std::make_shared<Impl>(field_name, std::move(value))) {}
+};
+
 //! \brief A query iterator. This wraps an ordinary BTreeManager::Iterator and filters the results based on a
 //!        condition. This allows us to iterate though a collection, only counting documents that meet a
 //!        certain condition.
+//!
+//! The iterator can instead go through the entries that a seek found in a secondary index, each of which
+//! holds the primary key of a document that meets the condition. Then, the documents are looked up in the
+//! collection, and are not decoded to test the condition again.
 class BTreeQueryIterator {
 public:
   using difference_type = std::ptrdiff_t;
@@ -154,11 +250,15 @@ public:
 
   BTreeQueryIterator(const BTreeQueryIterator& other)
       : iterator_(other.iterator_)
-      , condition_(other.condition_.Copy()) {}
+      , condition_(other.condition_.Copy())
+      , index_(other.index_)
+      , collection_(other.collection_) {}
 
   BTreeQueryIterator(BTreeQueryIterator&& other) noexcept
       : iterator_(std::move(other.iterator_))
-      , condition_(std::move(other.condition_)) {}
+      , condition_(std::move(other.condition_))
+      , index_(other.index_)
+      , collection_(other.collection_) {}
 
   BTreeQueryIterator(BTreeManager::Iterator iterator, Condition condition)
       : iterator_(std::move(iterator))
@@ -166,19 +266,39 @@ public:
     advance();
   }
 
+  //! \brief Create an iterator over the documents of the entries of a seek in a secondary index of the
+  //!        collection.
+  BTreeQueryIterator(BTreeManager::Iterator index_iterator,
+                     const SecondaryIndex& index,
+                     const BTreeManager& collection)
+      : iterator_(std::move(index_iterator))
+      , condition_(AlwaysTrue {})
+      , index_(&index)
+      , collection_(&collection) {}
+
   BTreeQueryIterator& operator=(const BTreeQueryIterator& other) {
     iterator_ = other.iterator_;
     condition_ = other.condition_.Copy();
+    index_ = other.index_;
+    collection_ = other.collection_;
     return *this;
   }
 
   BTreeQueryIterator& operator=(BTreeQueryIterator&& other) {
     iterator_ = std::move(other.iterator_);
     condition_ = std::move(other.condition_);
+    index_ = other.index_;
+    collection_ = other.collection_;
     return *this;
   }
 
-  std::unique_ptr<internal::DatabaseEntry> operator*() const { return *iterator_; }
+  std::unique_ptr<internal::DatabaseEntry> operator*() const {
+    if (!collection_ || iterator_.IsEnd()) {
+      return *iterator_;
+    }
+    const auto index_entry = *iterator_;
+    return collection_->retrieve(index_->ReadPrimaryKey(*index_entry)).entry;
+  }
 
   //! \brief Pre-incrementation operator.
   BTreeQueryIterator& operator++() {
@@ -202,6 +322,10 @@ public:
 
 private:
   void advance() {
+    if (collection_) {
+      // Every document found by an index seek meets the condition.
+      return;
+    }
     // Find the next valid iterator.
     for (; !iterator_.IsEnd(); ++iterator_) {
       auto entry = *iterator_;
@@ -214,6 +338,72 @@ private:
 
   BTreeManager::Iterator iterator_;
   Condition condition_;
+
+  //! \brief If not null, the iterator goes through the entries of a seek in this index.
+  const SecondaryIndex* index_ {};
+
+  //! \brief The collection that the index is on, if the iterator goes through the entries of an index seek.
+  const BTreeManager* collection_ {};
+};
+
+//! \brief An iterator over some fields of the documents that a query finds. Each document that it produces
+//!        has only the requested fields that the found document has.
+//!
+//! If a covering index stores all the requested fields, the fields are read from the entries of a seek in the
+//! index, and the collection is never read. Otherwise, each found document is read from the collection and
+//! projected onto the fields.
+class ProjectionIterator {
+public:
+  //! \brief Create an iterator that projects the documents found by a query iterator onto fields.
+  ProjectionIterator(BTreeQueryIterator iterator, std::vector<std::string> field_names)
+      : query_iterator_(std::move(iterator))
+      , field_names_(std::move(field_names)) {}
+
+  //! \brief Create an iterator that reads the fields from the entries of a seek in a covering index, which
+  //!        must store all the fields.
+  ProjectionIterator(BTreeManager::Iterator index_iterator,
+                     const SecondaryIndex& index,
+                     std::vector<std::string> field_names)
+      : field_names_(std::move(field_names))
+      , index_iterator_(std::move(index_iterator))
+      , index_(&index) {}
+
+  std::unique_ptr<Document> operator*() const {
+    const auto document =
+        index_ ? index_->ReadIncludedFields(**index_iterator_) : EntryToDocument(**query_iterator_);
+    lightning::memory::MemoryBuffer<std::byte> buffer;
+    document->WriteFieldsToBuffer(buffer, field_names_);
+    return ReadDocumentFromBuffer(std::span(buffer.Data(), buffer.Size()));
+  }
+
+  //! \brief Pre-incrementation operator.
+  ProjectionIterator& operator++() {
+    if (index_) {
+      ++index_iterator_;
+    }
+    else {
+      ++query_iterator_;
+    }
+    return *this;
+  }
+
+  bool IsEnd() const noexcept { return index_ ? index_iterator_.IsEnd() : query_iterator_.IsEnd(); }
+
+  //! \brief Check whether the fields are read from a covering index alone.
+  bool IsIndexOnly() const noexcept { return index_ != nullptr; }
+
+private:
+  //! \brief The query whose documents are projected, if the fields are not read from an index.
+  BTreeQueryIterator query_iterator_;
+
+  //! \brief The fields to project the documents onto.
+  std::vector<std::string> field_names_;
+
+  //! \brief The seek in the covering index, if the fields are read from an index.
+  BTreeManager::Iterator index_iterator_;
+
+  //! \brief The covering index, or null.
+  const SecondaryIndex* index_ {};
 };
 
 }  // namespace neversql::query
\ No newline at end of file
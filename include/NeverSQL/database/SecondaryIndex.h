@@ -0,0 +1,147 @@
+//
+// Created by Nathaniel Rupprecht on 10/17/26.
+//
+
+#pragma once
+
+#include <optional>
+#include <string>
+#include <vector>
+
+#include "NeverSQL/data/Document.h"
+#include "NeverSQL/data/btree/BTree.h"
+
+namespace neversql {
+
+// =================================================================================================
+//  Secondary indexes.
+//
+//  A secondary index on a field of a collection is a B-tree with BinaryData keys. Every document that has the
+//  field, with a value of a type that can be a key (see KeyEncoding.h), has one entry in the index, whose key
+//  is
+//    * one byte, the type of the field's value,
+//    * the value, normalized like a field of a composite key,
+//    * the normalized primary key of the document,
+//  and whose value is the normalized primary key of the document. The key starts with the value, so all the
+//  documents whose field has some value are one contiguous range of the index, found with a prefix scan. The
+//  primary key makes the keys of documents with the same value distinct.
+//
+//  A multikey index is on a field whose values are arrays. A document has one entry for each distinct element
+//  of the array, keyed like the entry of a field with the element's value, so the documents whose array
+//  contains a value are found with a prefix scan too. Documents whose field is not an array have no entries.
+//
+//  A covering index also stores the values of some other fields of the documents, its included fields, so
+//  queries that only need those fields are answered from the index alone. The value of an entry of a covering
+//  index is
+//    * the size of the normalized primary key, two bytes,
+//    * the normalized primary key of the document,
+//    * a document with the indexed field and the included fields of the document, serialized like any
+//      document.
+// =================================================================================================
+
+//! \brief Describes a secondary index on a field of a collection.
+struct IndexInfo {
+  //! \brief The collection that the index is on.
+  std::string collection_name;
+
+  //! \brief The name of the indexed field.
+  std::string field_name;
+
+  //! \brief If true, no two documents in the collection may have the same value for the field.
+  bool is_unique = false;
+
+  //! \brief If true, the index is a multikey index, which indexes the elements of array values of the field,
+  //!        and answers "array contains" conditions instead of equalities.
+  bool is_multikey = false;
+
+  //! \brief Fields whose values are stored in the index along with the indexed field, making it a covering
+  //!        index for queries that only need these fields.
+  std::vector<std::string> included_fields {};
+};
+
+//! \brief A secondary index, which maps the values of a field of the documents in a collection to the primary
+//!        keys of the documents.
+class SecondaryIndex {
+public:
+  SecondaryIndex(IndexInfo info, std::unique_ptr<BTreeManager> btree);
+
+  //! \brief Encode a field value, given in its native form, as the prefix that the keys of all index entries
+  //!        for the value start with. Returns nullopt if values of the type cannot be indexed.
+  static std::optional<std::vector<std::byte>> EncodeValue(DataTypeEnum type,
+                                                           std::span<const std::byte> native_value);
+
+  //! \brief Encode the value of a document field as the prefix of the keys of the index entries for the
+  //!        value. Returns nullopt if values of the type cannot be indexed.
+  static std::optional<std::vector<std::byte>> EncodeValue(const DocumentValue& value);
+
+  //! \brief Get the distinct encoded values that a document has entries in the index for. This is at most one
+  //!        value, unless the index is a multikey index.
+  std::vector<std::vector<std::byte>> GetIndexedValues(const Document& document) const;
+
+  //! \brief Get the value of the index entry for a document, given the document's normalized primary key.
+  std::vector<std::byte> MakeEntryValue(const Document& document,
+                                        std::span<const std::byte> primary_key) const;
+
+  //! \brief Read the normalized primary key of the document of an index entry.
+  std::vector<std::byte> ReadPrimaryKey(internal::DatabaseEntry& entry) const;
+
+  //! \brief Read the indexed field and the included fields of the document of an entry of a covering index,
+  //!        without reading the document from the collection.
+  std::unique_ptr<Document> ReadIncludedFields(internal::DatabaseEntry& entry) const;
+
+  //! \brief Check whether the index stores the values of fields, so they can be read from the index alone.
+  bool Covers(std::span<const std::string> field_names) const;
+
+  //! \brief Check whether the index stores the values of included fields.
+  bool IsCovering() const noexcept { return !info_.included_fields.empty(); }
+
+  //! \brief Check whether the index indexes the elements of array values.
+  bool IsMultikey() const noexcept { return info_.is_multikey; }
+
+  //! \brief Check whether a document could be added to the collection without breaking the index's
+  //!        uniqueness.
+  bool CanInsert(const Document& document) const;
+
+  //! \brief Add the entries for a document, given the document's normalized primary key.
+  void Insert(const Document& document, std::span<const std::byte> primary_key);
+
+  //! \brief Remove the entries for a document, given the document's normalized primary key.
+  void Remove(const Document& document, std::span<const std::byte> primary_key);
+
+  //! \brief Add the entry for an encoded value and a normalized primary key, with the entry's value (see
+  //!        MakeEntryValue), if the index does not have it already. Returns whether the entry was added.
+  bool InsertEntry(std::span<const std::byte> encoded_value,
+                   std::span<const std::byte> primary_key,
+                   std::span<const std::byte> entry_value);
+
+  //! \brief Remove the entry for an encoded value and a normalized primary key, if the index has it.
+  void RemoveEntry(std::span<const std::byte> encoded_value, std::span<const std::byte> primary_key);
+
+  //! \brief Get an iterator over the entries of the documents whose field has an encoded value, in primary
+  //!        key order. Read the primary key of an entry's document with ReadPrimaryKey.
+  BTreeManager::Iterator Seek(std::span<const std::byte> encoded_value) const;
+
+  //! \brief Count the documents whose field has an encoded value, without visiting them.
+  uint64_t Count(std::span<const std::byte> encoded_value) const;
+
+  //! \brief Get the description of the index.
+  const IndexInfo& GetInfo() const noexcept { return info_; }
+
+  //! \brief Get the B-tree that stores the index.
+  BTreeManager& GetBTree() noexcept { return *btree_; }
+
+  //! \brief Get the key of the index entry for an encoded value and a normalized primary key.
+  static std::vector<std::byte> MakeKey(std::span<const std::byte> encoded_value,
+                                        std::span<const std::byte> primary_key);
+
+private:
+  IndexInfo info_;
+
+  //! \brief The fields whose values an entry of a covering index stores, the indexed field and the included
+  //!        fields.
+  std::vector<std::string> stored_fields_;
+
+  std::unique_ptr<BTreeManager> btree_;
+};
+
+}  // namespace neversql
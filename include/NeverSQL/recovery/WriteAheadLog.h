@@ -4,6 +4,7 @@
 
 #pragma once
 
+#include <mutex>
 #include <span>
 #include <filesystem>
 
@@ -55,6 +56,9 @@ private:
     buffer_usage_ += sizeof(data);
   }
 
+  //! \brief Lock for the log, records from different threads are written one at a time.
+  std::mutex log_lock_;
+
   //! \brief The directory in which to write WAL files.
   std::filesystem::path log_dir_path_;
 
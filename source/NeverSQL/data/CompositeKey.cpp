@@ -0,0 +1,54 @@
+//
+// Created by Nathaniel Rupprecht on 10/17/26.
+//
+
+#include "NeverSQL/data/CompositeKey.h"
+// Other files.
+#include "NeverSQL/data/internals/KeyEncoding.h"
+#include "NeverSQL/data/internals/Utility.h"
+
+namespace neversql {
+
+CompositeKey& CompositeKey::Add(DataTypeEnum field_type, std::span<const std::byte> native_field) {
+  NOSQL_REQUIRE(internal::IsValidKeyType(field_type),
+                "data type " << to_string(field_type) << " cannot be a field of a composite key");
+  NOSQL_REQUIRE(field_types_.size() < internal::MAX_COMPOSITE_KEY_FIELDS,
+                "composite keys can have at most " << internal::MAX_COMPOSITE_KEY_FIELDS << " fields");
+  internal::AppendCompositeKeyField(field_type, native_field, key_);
+  field_types_.push_back(field_type);
+  return *this;
+}
+
+CompositeKey& CompositeKey::Add(uint64_t value) {
+  return Add(DataTypeEnum::UInt64, internal::SpanValue(value));
+}
+
+CompositeKey& CompositeKey::Add(int64_t value) {
+  return Add(DataTypeEnum::Int64, internal::SpanValue(value));
+}
+
+CompositeKey& CompositeKey::Add(int32_t value) {
+  return Add(DataTypeEnum::Int32, internal::SpanValue(value));
+}
+
+CompositeKey& CompositeKey::Add(double value) {
+  return Add(DataTypeEnum::Double, internal::SpanValue(value));
+}
+
+CompositeKey& CompositeKey::Add(bool value) {
+  return Add(DataTypeEnum::Boolean, internal::SpanValue(value));
+}
+
+CompositeKey& CompositeKey::Add(std::string_view value) {
+  return Add(DataTypeEnum::String, std::as_bytes(std::span(value)));
+}
+
+CompositeKey& CompositeKey::AddDateTime(int64_t microseconds) {
+  return Add(DataTypeEnum::DateTime, internal::SpanValue(microseconds));
+}
+
+CompositeKey& CompositeKey::AddBinary(std::span<const std::byte> value) {
+  return Add(DataTypeEnum::BinaryData, value);
+}
+
+}  // namespace neversql
@@ -57,6 +57,40 @@ void DataAccessLayer::GetNewPage(Page& page) {
   page.page_size_ = GetPageSize();
 }
 
+page_number_t DataAccessLayer::GetNewExtent(page_number_t num_pages) {
+  std::unique_lock guard(read_write_lock_);
+
+  // Note: since this free list can allocate new pages, the return will never be a nullopt.
+  auto first_page = *free_list_.GetNextExtent(num_pages);
+  if (first_page + num_pages == getNumAllocatedPages()) {
+    auto file_size = GetPageSize() * getNumAllocatedPages();
+    std::filesystem::resize_file(file_path_, file_size);
+    LOG_SEV(Debug) << "Getting new extent of " << num_pages << " pages starting at page " << first_page
+                   << ", resizing file " << file_path_ << " to size " << file_size << ".";
+  }
+  return first_page;
+}
+
+void DataAccessLayer::ReleaseExtent(page_number_t first_page, page_number_t num_pages) {
+  std::unique_lock guard(read_write_lock_);
+  free_list_.ReleaseExtent(first_page, num_pages);
+}
+
+void DataAccessLayer::ReadPages(page_number_t first_page,
+                                page_number_t num_pages,
+                                std::span<std::byte> buffer) const {
+  std::shared_lock guard(read_write_lock_);
+
+  NOSQL_REQUIRE(first_page + num_pages <= getNumAllocatedPages(),
+                "pages out of bounds, last page was " << first_page + num_pages - 1
+                                                      << ", max page number is " << getNumAllocatedPages());
+  NOSQL_REQUIRE(num_pages * GetPageSize() <= buffer.size(),
+                "buffer of " << buffer.size() << " bytes is too small for " << num_pages << " pages");
+  std::ifstream fin(file_path_, std::ios::binary);
+  fin.seekg(static_cast<std::streamoff>(first_page * GetPageSize()));
+  fin.read(reinterpret_cast<char*>(buffer.data()), static_cast<std::streamsize>(num_pages * GetPageSize()));
+}
+
 void DataAccessLayer::WriteBackPage(const Page& page) const {
   std::unique_lock guard(read_write_lock_);
   // Load the page from the file.
@@ -241,6 +275,12 @@ void DataAccessLayer::serialize(Page& page, const FreeList& free_list) {
   for (auto page_number : free_list.freed_pages_) {
     offset = page.WriteToPage(offset, page_number);
   }
+  // Freed runs of pages come after the freed pages.
+  offset = page.WriteToPage(offset, free_list.freed_extents_.size());
+  for (auto [first_page, num_pages] : free_list.freed_extents_) {
+    offset = page.WriteToPage(offset, first_page);
+    offset = page.WriteToPage(offset, num_pages);
+  }
 }
 
 void DataAccessLayer::deserialize(const Page& page, FreeList& free_list) {
@@ -254,10 +294,18 @@ void DataAccessLayer::deserialize(const Page& page, FreeList& free_list) {
     read(buffer, page_number);
     free_list.freed_pages_.push_back(page_number);
   }
+  read(buffer, size);
+  for (std::size_t i = 0; i < size; ++i) {
+    page_number_t first_page, num_pages;
+    read(buffer, first_page);
+    read(buffer, num_pages);
+    free_list.freed_extents_.emplace(first_page, num_pages);
+  }
 }
 
 void DataAccessLayer::serialize(Page& page, const Meta& meta) {
   auto offset = page.WriteToPage(0, Meta::meta_magic_number_);
+  offset = page.WriteToPage(offset, Meta::FORMAT_VERSION);
   offset = page.WriteToPage(offset, meta.page_size_power_);
   offset = page.WriteToPage(offset, meta.free_list_page_);
   page.WriteToPage(offset, meta.index_page_);
@@ -273,6 +321,13 @@ void DataAccessLayer::deserialize(const Page& page, Meta& meta) {
       check_sequence == Meta::meta_magic_number_,
       "magic number mismatch, expected '" << Meta::meta_magic_number_ << "', got '" << check_sequence << "'");
 
+  uint32_t format_version;
+  read(buffer, format_version);
+  NOSQL_REQUIRE(format_version == Meta::FORMAT_VERSION,
+                "database file has on-disk format version "
+                    << format_version << ", but this build of NeverSQL only reads format version "
+                    << Meta::FORMAT_VERSION);
+
   read(buffer, meta.page_size_power_);
   // Set the page size.
   meta.page_size_ = static_cast<page_size_t>(1 << meta.page_size_power_);
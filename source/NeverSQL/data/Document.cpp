@@ -18,8 +18,8 @@ std::unique_ptr<DocumentValue> makeDocumentValue(DataTypeEnum data_type) {
       return std::make_unique<IntegralValue<int64_t>>();
     case DataTypeEnum::UInt64:
       return std::make_unique<IntegralValue<uint64_t>>();
-    // case DataTypeEnum::Double:
-    //   return std::make_unique<IntegralValue<double>>();
+    case DataTypeEnum::Double:
+      return std::make_unique<DoubleValue>();
     case DataTypeEnum::Boolean:
       return std::make_unique<BooleanValue>();
     // case DataTypeEnum::DateTime:
@@ -57,6 +57,12 @@ void DocumentValue::WriteToBuffer(lightning::memory::BasicMemoryBuffer<std::byte
 }
 
 void DocumentValue::InitializeFromBuffer(std::span<const std::byte>& buffer) {
+  internal::SegmentedBuffer segmented_buffer(buffer);
+  initializeFromBuffer(segmented_buffer);
+  buffer = buffer.subspan(segmented_buffer.GetNumConsumed());
+}
+
+void DocumentValue::InitializeFromBuffer(internal::SegmentedBuffer& buffer) {
   initializeFromBuffer(buffer);
 }
 
@@ -96,9 +102,8 @@ std::size_t DoubleValue::calculateRequiredDataSize() const {
   return sizeof(double);
 }
 
-void DoubleValue::initializeFromBuffer(std::span<const std::byte>& buffer) {
-  std::memcpy(&value_, buffer.data(), sizeof(double));
-  buffer = buffer.subspan(sizeof(double));
+void DoubleValue::initializeFromBuffer(internal::SegmentedBuffer& buffer) {
+  value_ = buffer.Read<double>();
 }
 
 void DoubleValue::printToStream(std::ostream& out, [[maybe_unused]] std::size_t indent) const {
@@ -133,9 +138,8 @@ std::size_t BooleanValue::calculateRequiredDataSize() const {
   return 1;
 }
 
-void BooleanValue::initializeFromBuffer(std::span<const std::byte>& buffer) {
-  std::memcpy(&value_, buffer.data(), 1);
-  buffer = buffer.subspan(1);
+void BooleanValue::initializeFromBuffer(internal::SegmentedBuffer& buffer) {
+  value_ = buffer.Read<bool>();
 }
 
 void BooleanValue::printToStream(std::ostream& out, [[maybe_unused]] std::size_t indent) const {
@@ -170,15 +174,12 @@ std::size_t StringValue::calculateRequiredDataSize() const {
   return sizeof(uint32_t) + value_.size();
 }
 
-void StringValue::initializeFromBuffer(std::span<const std::byte>& buffer) {
+void StringValue::initializeFromBuffer(internal::SegmentedBuffer& buffer) {
   // Read the string length.
-  uint32_t str_length {};
-  std::memcpy(&str_length, buffer.data(), sizeof(str_length));
-  buffer = buffer.subspan(sizeof(str_length));  // Shrink.
+  const auto str_length = buffer.Read<uint32_t>();
 
   // Read the string data.
-  value_ = std::string(reinterpret_cast<const char*>(buffer.data()), str_length);
-  buffer = buffer.subspan(str_length);  // Shrink.
+  value_ = buffer.ReadString(str_length);
 }
 
 void StringValue::printToStream(std::ostream& out, [[maybe_unused]] std::size_t indent) const {
@@ -228,15 +229,12 @@ std::size_t ArrayValue::calculateRequiredDataSize() const {
              }));
 }
 
-void ArrayValue::initializeFromBuffer(std::span<const std::byte>& buffer) {
+void ArrayValue::initializeFromBuffer(internal::SegmentedBuffer& buffer) {
   // Read the element type.
-  std::memcpy(&element_type_, buffer.data(), 1);
-  buffer = buffer.subspan(1);  // Shrink.
+  element_type_ = buffer.Read<DataTypeEnum>();
 
   // Get the number of elements in the array.
-  uint32_t num_elements {};
-  std::memcpy(&num_elements, buffer.data(), 4);
-  buffer = buffer.subspan(4);  // Shrink.
+  const auto num_elements = buffer.Read<uint32_t>();
 
   for (std::size_t i = 0; i < num_elements; ++i) {
     auto value = makeDocumentValue(element_type_);
@@ -290,6 +288,28 @@ DataTypeEnum Document::GetFieldType(std::size_t index) const {
   return elements_[index].second->GetDataType();
 }
 
+void Document::WriteFieldsToBuffer(lightning::memory::BasicMemoryBuffer<std::byte>& buffer,
+                                  std::span<const std::string> field_names) const {
+  buffer.PushBack(std::bit_cast<std::byte>(type_));
+
+  std::vector<const std::pair<std::string, std::unique_ptr<DocumentValue>>*> fields;
+  for (const auto& element : elements_) {
+    if (std::ranges::find(field_names, element.first) != field_names.end()) {
+      fields.push_back(&element);
+    }
+  }
+
+  // Number of fields, then each field, as in writeData.
+  const uint64_t num_elements = fields.size();
+  buffer.Append(internal::SpanValue(num_elements));
+  for (const auto* field : fields) {
+    auto name_length = static_cast<uint16_t>(field->first.size());
+    buffer.Append(internal::SpanValue(name_length));
+    buffer.Append(internal::SpanValue(field->first));
+    field->second->WriteToBuffer(buffer);
+  }
+}
+
 void Document::writeData(lightning::memory::BasicMemoryBuffer<std::byte>& buffer) const {
   // Write the number of fields in the document to the buffer.
   const auto num_elements = elements_.size();
@@ -316,26 +336,19 @@ std::size_t Document::calculateRequiredDataSize() const {
   return size;
 }
 
-void Document::initializeFromBuffer(std::span<const std::byte>& buffer) {
+void Document::initializeFromBuffer(internal::SegmentedBuffer& buffer) {
   // Read the number of elements in the document.
-  uint64_t num_elements {};
-  std::memcpy(&num_elements, buffer.data(), 8);
-  buffer = buffer.subspan(8);  // Shrink.
+  const auto num_elements = buffer.Read<uint64_t>();
 
   for (std::size_t i = 0; i < num_elements; ++i) {
     // Read the length of the field name.
-    uint16_t name_size {};
-    std::memcpy(&name_size, buffer.data(), 2);
-    buffer = buffer.subspan(2);  // Shrink.
+    const auto name_size = buffer.Read<uint16_t>();
 
     // Read the field name.
-    std::string field_name(reinterpret_cast<const char*>(buffer.data()), name_size);
-    buffer = buffer.subspan(name_size);  // Shrink.
+    auto field_name = buffer.ReadString(name_size);
 
     // Read the type of the field.
-    DataTypeEnum type;
-    std::memcpy(&type, buffer.data(), 1);
-    buffer = buffer.subspan(1);  // Shrink.
+    const auto type = buffer.Read<DataTypeEnum>();
 
     // Read the data.
     auto value = makeDocumentValue(type);
@@ -374,17 +387,19 @@ std::unique_ptr<DocumentValue> ReadFromBuffer(std::span<const std::byte> buffer)
 }
 
 std::unique_ptr<Document> ReadDocumentFromBuffer(std::span<const std::byte> buffer, bool expect_enum) {
-  if (buffer.empty()) {
+  internal::SegmentedBuffer segmented_buffer(buffer);
+  return ReadDocumentFromBuffer(segmented_buffer, expect_enum);
+}
+
+std::unique_ptr<Document> ReadDocumentFromBuffer(internal::SegmentedBuffer& buffer, bool expect_enum) {
+  if (buffer.IsEmpty()) {
     return {};
   }
   if (expect_enum) {
     // Read the enum.
-    DataTypeEnum enum_value;
-    std::memcpy(&enum_value, buffer.data(), 1);
-    buffer = buffer.subspan(1);  // Shrink.
+    const auto enum_value = buffer.Read<DataTypeEnum>();
     NOSQL_ASSERT(enum_value == DataTypeEnum::Document,
-                 "expected DataTypeEnum::Document, value is " << to_string(enum_value) << ", buffer size was "
-                                                              << buffer.size());
+                 "expected DataTypeEnum::Document, value is " << to_string(enum_value));
   }
   auto document = std::make_unique<Document>();
   document->InitializeFromBuffer(buffer);
@@ -21,6 +21,15 @@ std::optional<page_number_t> FreeList::GetNextPage() {
     freed_pages_.pop_front();
     return next_page;
   }
+  // Take a page from the start of a freed run of pages.
+  if (!freed_extents_.empty()) {
+    auto [first_page, num_pages] = *freed_extents_.begin();
+    freed_extents_.erase(freed_extents_.begin());
+    if (1 < num_pages) {
+      freed_extents_.emplace(first_page + 1, num_pages - 1);
+    }
+    return first_page;
+  }
   if (!can_allocate_) {
     return {};
   }
@@ -28,6 +37,60 @@ std::optional<page_number_t> FreeList::GetNextPage() {
   return next_page_number_++;
 }
 
+std::optional<page_number_t> FreeList::GetNextExtent(page_number_t num_pages) {
+  NOSQL_REQUIRE(0 < num_pages, "cannot get an extent of zero pages");
+  is_dirty_ = true;
+
+  // Best fit: the smallest freed run that has enough pages.
+  auto best = freed_extents_.end();
+  for (auto it = freed_extents_.begin(); it != freed_extents_.end(); ++it) {
+    if (num_pages <= it->second && (best == freed_extents_.end() || it->second < best->second)) {
+      best = it;
+    }
+  }
+  if (best != freed_extents_.end()) {
+    auto [first_page, run_size] = *best;
+    freed_extents_.erase(best);
+    if (num_pages < run_size) {
+      freed_extents_.emplace(first_page + num_pages, run_size - num_pages);
+    }
+    return first_page;
+  }
+
+  if (!can_allocate_) {
+    return {};
+  }
+  // Allocate new pages at the end.
+  auto first_page = next_page_number_;
+  next_page_number_ += num_pages;
+  return first_page;
+}
+
+void FreeList::ReleaseExtent(page_number_t first_page, page_number_t num_pages) {
+  NOSQL_REQUIRE(first_page + num_pages <= next_page_number_,
+                "invalid extent, maximum page number is " << next_page_number_ - 1 << ", extent ends at page "
+                                                          << first_page + num_pages - 1);
+  if (num_pages == 0) {
+    return;
+  }
+  is_dirty_ = true;
+
+  // Merge with the run that ends where this one starts, and the run that starts where this one ends.
+  auto next = freed_extents_.lower_bound(first_page);
+  if (next != freed_extents_.begin()) {
+    if (auto previous = std::prev(next); previous->first + previous->second == first_page) {
+      first_page = previous->first;
+      num_pages += previous->second;
+      freed_extents_.erase(previous);
+    }
+  }
+  if (next != freed_extents_.end() && next->first == first_page + num_pages) {
+    num_pages += next->second;
+    freed_extents_.erase(next);
+  }
+  freed_extents_.emplace(first_page, num_pages);
+}
+
 bool FreeList::ReleasePage(page_number_t page_number) {
   NOSQL_REQUIRE(
       page_number < next_page_number_,
@@ -47,10 +110,19 @@ page_number_t FreeList::GetNumAllocatedPages() const {
 }
 
 NO_DISCARD page_number_t FreeList::GetNumFreePages() const {
-  return freed_pages_.size();
+  page_number_t num_free_pages = freed_pages_.size();
+  for (auto [first_page, num_pages] : freed_extents_) {
+    num_free_pages += num_pages;
+  }
+  return num_free_pages;
 }
 
 bool FreeList::IsPageValid(page_number_t page_number) const {
+  if (auto it = freed_extents_.upper_bound(page_number); it != freed_extents_.begin()) {
+    if (it = std::prev(it); page_number < it->first + it->second) {
+      return false;
+    }
+  }
   return page_number <= next_page_number_ && std::ranges::count(freed_pages_, page_number) == 0;
 }
 
@@ -4,6 +4,7 @@
 
 #include "NeverSQL/data/PageCache.h"
 // Other files.
+#include <algorithm>
 
 namespace neversql {
 
@@ -30,6 +31,11 @@ PageCache::~PageCache() {
 }
 
 std::unique_ptr<Page> PageCache::GetPage(page_number_t page_number) {
+  std::lock_guard guard(cache_lock_);
+  return getPage(page_number);
+}
+
+std::unique_ptr<Page> PageCache::getPage(page_number_t page_number) {
   // Check if the page is in the cache.
   if (auto it = page_number_to_slot_.find(page_number); it != page_number_to_slot_.end()) {
     // If the page is in the cache, we can just return it.
@@ -53,18 +59,142 @@ std::unique_ptr<Page> PageCache::GetPage(page_number_t page_number) {
 }
 
 std::unique_ptr<Page> PageCache::GetNewPage() {
+  std::lock_guard guard(cache_lock_);
   auto slot = getSlot();
 
   auto page = mapPageFromSlot(slot);
   data_access_layer_->GetNewPage(*page);
 
-  // Set up descriptor.
+  // Set up descriptor. The returned handle counts as a use of the page, like handles from GetPage.
   initializePage(slot, page->GetPageNumber());
+  ++page_descriptors_[slot].usage_count;
+
+  return page;
+}
+
+page_number_t PageCache::GetNewExtent(page_number_t num_pages) {
+  std::lock_guard guard(cache_lock_);
+  return data_access_layer_->GetNewExtent(num_pages);
+}
+
+std::unique_ptr<Page> PageCache::GetBlankPage(page_number_t page_number) {
+  std::lock_guard guard(cache_lock_);
+  if (auto it = page_number_to_slot_.find(page_number); it != page_number_to_slot_.end()) {
+    return getPageFromSlot(it->second);
+  }
+  auto slot = getSlot();
+  initializePage(slot, page_number);
+  return getPageFromSlot(slot);
+}
+
+void PageCache::LoadExtent(page_number_t first_page, page_number_t num_pages) {
+  std::lock_guard guard(cache_lock_);
+  num_pages = std::min<page_number_t>(num_pages, cache_size_ / MAX_PINNED_PAGES_DIVISOR);
+
+  // Only read the part of the extent from its first to its last page that is not in the cache.
+  while (0 < num_pages && page_number_to_slot_.contains(first_page)) {
+    ++first_page, --num_pages;
+  }
+  while (0 < num_pages && page_number_to_slot_.contains(first_page + num_pages - 1)) {
+    --num_pages;
+  }
+  if (num_pages == 0) {
+    return;
+  }
+
+  const auto page_size = data_access_layer_->GetPageSize();
+  std::vector<std::byte> buffer(num_pages * page_size);
+  data_access_layer_->ReadPages(first_page, num_pages, buffer);
+  LOG_SEV(Debug) << "Read " << num_pages << " pages starting at page " << first_page << " into the cache.";
+
+  for (page_number_t i = 0; i < num_pages; ++i) {
+    // A page in the cache may have been written since it was read from the disk.
+    if (page_number_to_slot_.contains(first_page + i)) {
+      continue;
+    }
+    auto slot = getSlot();
+    initializePage(slot, first_page + i);
+    // The page should not be evicted while the rest of the extent is loaded.
+    page_descriptors_[slot].SetSecondChance(true);
+    std::memcpy(page_cache_.get() + slot * page_size, buffer.data() + i * page_size, page_size);
+  }
+}
 
+void PageCache::ReleaseExtent(page_number_t first_page, page_number_t num_pages) {
+  std::lock_guard guard(cache_lock_);
+  for (auto page_number = first_page; page_number < first_page + num_pages; ++page_number) {
+    auto it = page_number_to_slot_.find(page_number);
+    if (it == page_number_to_slot_.end()) {
+      continue;
+    }
+    // The contents of the page do not need to be written back.
+    auto& descriptor = page_descriptors_[it->second];
+    descriptor.SetIsDirty(false);
+    if (descriptor.usage_count == 0) {
+      tryReleasePage(it->second);
+    }
+  }
+  data_access_layer_->ReleaseExtent(first_page, num_pages);
+}
+
+void PageCache::AddPinOwner(const PinOwner& owner) {
+  std::lock_guard guard(cache_lock_);
+  pin_owners_.emplace(&owner, 0);
+}
+
+void PageCache::RemovePinOwner(const PinOwner& owner) {
+  std::lock_guard guard(cache_lock_);
+  auto it = pin_owners_.find(&owner);
+  NOSQL_REQUIRE(it != pin_owners_.end() && it->second == 0,
+                "only a registered owner without pinned pages can be removed");
+  pin_owners_.erase(it);
+}
+
+std::unique_ptr<Page> PageCache::PinPage(page_number_t page_number, const PinOwner& owner) {
+  std::lock_guard guard(cache_lock_);
+  auto it = pin_owners_.find(&owner);
+  NOSQL_REQUIRE(it != pin_owners_.end(), "pages can only be pinned by a registered owner");
+  const auto share = getPinShare();
+  if (share <= it->second) {
+    return nullptr;
+  }
+  if (cache_size_ / MAX_PINNED_PAGES_DIVISOR <= num_pinned_pages_) {
+    // The owner has less than its share, so others have more than theirs, e.g. because they pinned pages
+    // before the owner was registered.
+    for (auto& [other, num_pinned] : pin_owners_) {
+      if (share < num_pinned) {
+        other->ReleasePins(share);
+      }
+    }
+    if (cache_size_ / MAX_PINNED_PAGES_DIVISOR <= num_pinned_pages_) {
+      return nullptr;
+    }
+  }
+  // The page's handle keeps its usage count up, so the page is not evicted until the handle is released.
+  auto page = getPage(page_number);
+  ++num_pinned_pages_;
+  ++it->second;
+  LOG_SEV(Debug) << "Pinned page " << page_number << ", " << num_pinned_pages_ << " pages are pinned.";
   return page;
 }
 
+void PageCache::UnpinPage(std::unique_ptr<Page> page, const PinOwner& owner) {
+  std::lock_guard guard(cache_lock_);
+  auto it = pin_owners_.find(&owner);
+  NOSQL_REQUIRE(page && it != pin_owners_.end() && 0 < it->second, "no pinned page to unpin");
+  --num_pinned_pages_;
+  --it->second;
+  LOG_SEV(Debug) << "Unpinned page " << page->GetPageNumber() << ".";
+}
+
+bool PageCache::IsBelowPinShare(const PinOwner& owner) const {
+  std::lock_guard guard(cache_lock_);
+  auto it = pin_owners_.find(&owner);
+  return it != pin_owners_.end() && it->second < getPinShare();
+}
+
 void PageCache::ReleasePage(page_number_t page_number) {
+  std::lock_guard guard(cache_lock_);
   // Find the page in the cache.
   if (auto it = page_number_to_slot_.find(page_number); it != page_number_to_slot_.end()) {
     decrementUsage(it->second);
@@ -220,18 +350,23 @@ bool PageCache::tryReleasePage(std::size_t slot) {
 std::size_t PageCache::evictNextVictim() {
   LOG_SEV(Debug) << "Finding victim to evict.";
 
-  // Clock page replacement.
+  // Clock page replacement. Pages that are in use, including pinned pages, are passed over. After two turns
+  // of the clock, every second chance bit has been reset, so if no victim was found, every page is in use.
+  // That means callers hold more page handles at once than the cache has slots.
   std::size_t count = 0;
-  while (page_descriptors_[next_victim_].HasSecondChance()) {
-    // Reset the second chance bit.
-    page_descriptors_[next_victim_].SetSecondChance(false);
-
-    next_victim_ = (next_victim_ + 1) % cache_size_;
-    ++count;
-    if (count == cache_size_) {
-      LOG_SEV(Trace) << "All pages had second chances, made it back to the start, " << next_victim_ << ".";
+  for (;; next_victim_ = (next_victim_ + 1) % cache_size_) {
+    auto& descriptor = page_descriptors_[next_victim_];
+    NOSQL_REQUIRE(count++ < 2 * cache_size_,
+                  "cannot load another page, all " << cache_size_
+                                                   << " slots of the page cache hold pages that are in use");
+    if (0 < descriptor.usage_count) {
+      continue;
+    }
+    if (!descriptor.HasSecondChance()) {
       break;
     }
+    // Reset the second chance bit.
+    descriptor.SetSecondChance(false);
   }
 
   LOG_SEV(Trace) << "Victim chosen, slot " << next_victim_ << ".";
@@ -243,4 +378,10 @@ std::size_t PageCache::evictNextVictim() {
   return next_victim;
 }
 
+std::size_t PageCache::getPinShare() const {
+  // Every owner can pin at least one page, e.g. the root of a B-tree.
+  const auto num_owners = std::max<std::size_t>(1, pin_owners_.size());
+  return std::max<std::size_t>(1, cache_size_ / MAX_PINNED_PAGES_DIVISOR / num_owners);
+}
+
 }  // namespace neversql
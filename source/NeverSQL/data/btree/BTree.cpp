@@ -4,33 +4,45 @@
 
 #include "NeverSQL/data/btree/BTree.h"
 // Other files.
-#include "NeverSQL/data/btree/EntryCopier.h"
+#include <algorithm>
+#include <array>
+#include <bit>
+#include <cmath>
+
+#include "NeverSQL/data/internals/BlobEntry.h"
+#include "NeverSQL/data/internals/CopiedEntry.h"
 #include "NeverSQL/data/internals/DatabaseEntry.h"
 #include "NeverSQL/data/internals/KeyComparison.h"
 #include "NeverSQL/data/internals/KeyPrinting.h"
+#include "NeverSQL/data/internals/OverflowEntry.h"
 #include "NeverSQL/data/internals/SpanPayloadSerializer.h"
 #include "NeverSQL/data/internals/Utility.h"
 
 namespace neversql {
 
 // ================================================================================================
-//  BTreeManager::Iterator.
+//  BTreeTuning.
 // ================================================================================================
 
-BTreeManager::Iterator::Iterator(const BTreeManager& manager)
-    : manager_(&manager) {
-  auto root = manager_->loadNodePage(manager.GetRootPageNumber());
-  // If the tree is empty, begin is end.
-  if (root->GetNumPointers() != 0) {
-    progress_.Push({manager.GetRootPageNumber(), 0});
-    descend(*root, 0);
-  }
+BTreeTuning BTreeTuning::ForPageSize(page_size_t page_size) noexcept {
+  // Until the sizes of the entries are known, entries of up to a third of a page are stored in the leaves.
+  // No page can hold more pointers than fit in the whole page.
+  return BTreeTuning {.max_entry_size = LargestMaxEntrySize(page_size),
+                      .min_space_for_entry = static_cast<page_size_t>(page_size / 32),
+                      .max_entries_per_page = static_cast<page_size_t>(page_size / POINTER_SLOT_SIZE)};
 }
 
-BTreeManager::Iterator::Iterator(const BTreeManager& manager,
-                                 FixedStack<std::pair<page_number_t, page_size_t>> progress)
+// ================================================================================================
+//  BTreeManager::Iterator.
+// ================================================================================================
+
+BTreeManager::Iterator::Iterator(const BTreeManager& manager, ScanDirection direction)
     : manager_(&manager)
-    , progress_(std::move(progress)) {}
+    , direction_(direction) {
+  retry([this](std::vector<std::byte>& key) {
+    return (direction_ == ScanDirection::Ascending ? moveToFirst() : moveToLast()) && recordPosition(key);
+  });
+}
 
 //! \brief Create an end B-Tree iterator
 BTreeManager::Iterator::Iterator(const BTreeManager& manager, [[maybe_unused]] bool)
@@ -41,25 +53,21 @@ BTreeManager::Iterator& BTreeManager::Iterator::operator++() {
     return *this;
   }
 
-  auto& [current_page_number, current_index] = progress_.Top()->get();
-  auto current_page = *manager_->loadNodePage(current_page_number);
-  current_index++;
-  // There is no more data in the current data page.
-  if (current_page.GetNumPointers() <= current_index) {
-    progress_.Pop();
-
-    while (!done()) {
-      auto& [page_number, index] = progress_.Top()->get();
-      auto page = *manager_->loadNodePage(page_number);
-      ++index;
-      // Note: index can be == num pointers, since this means go to the "rightmost page."
-      if (index <= page.GetNumPointers()) {
-        descend(page, index);
-        break;
-      }
-      progress_.Pop();
+  retry([this](std::vector<std::byte>& key) {
+    // If the current entry was removed, the iterator is already on the next entry.
+    const auto was_removed = reposition(key);
+    if (!was_removed) {
+      return false;
     }
-  }
+    if (*was_removed) {
+      return true;
+    }
+    if (!(direction_ == ScanDirection::Ascending ? stepForward() : stepBackward()) || !recordPosition(key)) {
+      return false;
+    }
+    checkStopBound(key);
+    return true;
+  });
   return *this;
 }
 
@@ -69,24 +77,70 @@ BTreeManager::Iterator BTreeManager::Iterator::operator++(int) {
   return it;
 }
 
+BTreeManager::Iterator& BTreeManager::Iterator::operator--() {
+  if (!manager_) {
+    return *this;
+  }
+
+  retry([this](std::vector<std::byte>& key) {
+    // If the current entry was removed, the iterator moves to the entry after it, so the entry before that is
+    // the one before the removed entry.
+    if (!reposition(key)) {
+      return false;
+    }
+
+    // Decrementing the end iterator goes to the last entry in the direction of iteration.
+    const bool ascending = direction_ == ScanDirection::Ascending;
+    const auto moved = done() ? (ascending ? moveToLast() : moveToFirst())
+                              : (ascending ? stepBackward() : stepForward());
+    return moved && recordPosition(key);
+  });
+  return *this;
+}
+
+BTreeManager::Iterator BTreeManager::Iterator::operator--(int) {
+  auto it = *this;
+  --(*this);
+  return it;
+}
+
 std::unique_ptr<internal::DatabaseEntry> BTreeManager::Iterator::operator*() const {
   if (done()) {
     return {};
   }
 
-  auto [page_number, cell_index] = progress_.Top()->get();
-  auto node = *manager_->loadNodePage(page_number);
-  auto cell = node.getNthCell(cell_index);
-  // Should be a data cell.
-  NOSQL_ASSERT(std::holds_alternative<DataNodeCell>(cell), "Cell is not a data cell.");
-
-  const auto cell_offset = node.getCellOffsetByIndex(cell_index);
+  std::unique_ptr<internal::DatabaseEntry> entry;
+  retry([&](std::vector<std::byte>& key) {
+    if (!reposition(key)) {
+      return false;
+    }
+    if (done()) {
+      return true;
+    }
+    auto copy = manager_->tryCopyEntry(*manager_->loadNodePage(page_number_), index_, version_);
+    if (!copy) {
+      return false;
+    }
+    entry = std::move(*copy);
+    return true;
+  });
+  return entry;
+}
 
-  return internal::ReadEntry(cell_offset, std::move(node.GetPage()), manager_);
+std::vector<std::byte> BTreeManager::Iterator::GetKey() const {
+  if (done()) {
+    return {};
+  }
+  retry([this](std::vector<std::byte>& key) { return reposition(key).has_value(); });
+  return done() ? std::vector<std::byte> {} : key_;
 }
 
 bool BTreeManager::Iterator::operator==(const Iterator& other) const {
-  return progress_ == other.progress_ || (done() && other.done());
+  if (done() || other.done()) {
+    return done() && other.done();
+  }
+  // Positions can be stale after writes to the tree, keys cannot.
+  return key_ == other.key_;
 }
 
 bool BTreeManager::Iterator::operator!=(const Iterator& other) const {
@@ -94,32 +148,163 @@ bool BTreeManager::Iterator::operator!=(const Iterator& other) const {
 }
 
 bool BTreeManager::Iterator::done() const noexcept {
-  return !manager_ || progress_.Empty();
+  return !manager_ || page_number_ == 0;
+}
+
+void BTreeManager::Iterator::retry(const std::function<bool(std::vector<std::byte>&)>& operation) const {
+  const auto page_number = page_number_;
+  const auto index = index_;
+  const auto version = version_;
+  for (;;) {
+    auto key = key_;
+    if (operation(key)) {
+      key_ = std::move(key);
+      return;
+    }
+    LOG_SEV(Trace) << "A leaf was changed while an iterator moved, restarting.";
+    page_number_ = page_number;
+    index_ = index;
+    version_ = version;
+  }
+}
+
+bool BTreeManager::Iterator::stepForward() const {
+  ++index_;
+  return settle();
 }
 
-void BTreeManager::Iterator::descend(const BTreeNodeMap& page, page_size_t index) {
-  if (!page.IsPointersPage()) {
+bool BTreeManager::Iterator::stepBackward() const {
+  if (0 < index_) {
+    --index_;
+    return true;
+  }
+  // Move to the last cell of the previous leaf. Leaves are never empty unless the root is an empty leaf, but
+  // there is no harm in skipping empty leaves. Splits add the new leaf to the left of the leaf they split, so
+  // a leaf's left neighbor only changes when the leaf itself changes.
+  while (!done()) {
+    const auto left_sibling = manager_->loadNodePage(page_number_)->getHeader().GetLeftSibling();
+    const auto left_version = left_sibling == 0 ? 0 : manager_->getLatch(left_sibling).ReadLock();
+    if (!manager_->getLatch(page_number_).Validate(version_)) {
+      return false;
+    }
+    page_number_ = left_sibling;
+    version_ = left_version;
+    if (done()) {
+      break;
+    }
+    if (auto num_pointers = manager_->loadNodePage(page_number_)->GetNumPointers(); num_pointers != 0) {
+      index_ = num_pointers - 1;
+      return true;
+    }
+  }
+  return true;
+}
+
+bool BTreeManager::Iterator::moveToFirst() const {
+  // The empty key sorts before every key.
+  const auto result = manager_->search({});
+  std::tie(page_number_, index_) = result.path.Top()->get();
+  version_ = result.leaf_version;
+  // If the tree is empty, begin is end.
+  return settle();
+}
+
+bool BTreeManager::Iterator::moveToLast() const {
+  const auto result = manager_->searchLast();
+  std::tie(page_number_, index_) = result.path.Top()->get();
+  version_ = result.leaf_version;
+  // Moving backwards from the end of the rightmost leaf lands on its last cell.
+  return stepBackward();
+}
+
+bool BTreeManager::Iterator::settle() const {
+  while (!done()) {
+    const auto node = *manager_->loadNodePage(page_number_);
+    const auto& latch = manager_->getLatch(page_number_);
+    if (index_ < node.GetNumPointers()) {
+      return latch.Validate(version_);
+    }
+    // There is no more data in the current leaf, move to the next one. Leaves are never empty unless the
+    // root is an empty leaf, but there is no harm in skipping empty leaves. Lock coupling: the next leaf's
+    // version is read before the current leaf is validated, so a split of the next leaf, which changes the
+    // current leaf's right sibling, is always noticed.
+    const auto right_sibling = node.getHeader().GetRightSibling();
+    const auto right_version = right_sibling == 0 ? 0 : manager_->getLatch(right_sibling).ReadLock();
+    if (!latch.Validate(version_)) {
+      return false;
+    }
+    page_number_ = right_sibling;
+    index_ = 0;
+    version_ = right_version;
+  }
+  return true;
+}
+
+void BTreeManager::Iterator::checkStopBound(GeneralKey key) const {
+  if (done() || !stop_bound_) {
     return;
   }
 
-  // if the index is == num_pointers, go to the "rightmost" page.
-  page_number_t next_page_number {};
-  if (index == page.GetNumPointers()) {
-    next_page_number = page.getHeader().GetAdditionalData();
+  const bool is_past = direction_ == ScanDirection::Ascending ? internal::CompareKeys(*stop_bound_, key)
+                                                              : internal::CompareKeys(key, *stop_bound_);
+  if (is_past || (!stop_inclusive_ && std::ranges::equal(key, *stop_bound_))) {
+    // Past the end of the range.
+    page_number_ = 0;
   }
-  else {
-    next_page_number = std::get<PointersNodeCell>(page.getNthCell(index)).page_number;
+}
+
+bool BTreeManager::Iterator::recordPosition(std::vector<std::byte>& key) const {
+  if (done()) {
+    key.clear();
+    return true;
+  }
+  const auto& latch = manager_->getLatch(page_number_);
+  try {
+    key = manager_->loadNodePage(page_number_)->getFullKeyForNthCell(index_);
+  } catch (const std::exception&) {
+    // A leaf that is read while a writer changes it can look corrupt.
+    if (latch.Validate(version_)) {
+      throw;
+    }
+    return false;
+  }
+  return latch.Validate(version_);
+}
+
+std::optional<bool> BTreeManager::Iterator::reposition(std::vector<std::byte>& key) const {
+  if (done() || manager_->getLatch(page_number_).Validate(version_)) {
+    return false;
   }
 
-  auto descending_page = *manager_->loadNodePage(next_page_number);
-  index = 0;
+  // The leaf may have been split or changed, search for the key again. The search ends at the key, or where
+  // the key would be if its entry was removed.
+  const auto result = manager_->search(key_);
+  std::tie(page_number_, index_) = result.path.Top()->get();
+  version_ = result.leaf_version;
+  bool is_present = false;
+  try {
+    const auto& node = *result.node;
+    is_present = index_ < node.GetNumPointers()
+        && node.compareToNthKey(key_, index_) == std::weak_ordering::equivalent;
+  } catch (const std::exception&) {
+    if (manager_->Validate(result)) {
+      throw;
+    }
+    return {};
+  }
+  if (!manager_->Validate(result)) {
+    return {};
+  }
+  if (is_present) {
+    return false;
+  }
 
-  progress_.Push({next_page_number, index});
-  while (descending_page.IsPointersPage()) {
-    next_page_number = std::get<PointersNodeCell>(descending_page.getNthCell(index)).page_number;
-    descending_page = *manager_->loadNodePage(next_page_number);
-    progress_.Push({next_page_number, index});
+  // The entry was removed. The search ended at the first key after it.
+  if (!(direction_ == ScanDirection::Ascending ? settle() : stepBackward()) || !recordPosition(key)) {
+    return {};
   }
+  checkStopBound(key);
+  return true;
 }
 
 // ================================================================================================
@@ -129,37 +314,62 @@ void BTreeManager::Iterator::descend(const BTreeNodeMap& page, page_size_t index
 BTreeManager::BTreeManager(page_number_t root_page, PageCache& page_cache)
     : page_cache_(page_cache)
     , root_page_(root_page)
-    , cmp_(internal::CompareTrivial<primary_key_t>)
-    , debug_key_func_(internal::PrintUInt64) {
-  // Initialize the tree from its root page.
-  initialize();
+    , overflow_space_map_(page_cache.GetPageSize()) {
+  // Initializing the tree can search it, which pins nodes, so the tree has to be a pin owner first.
+  page_cache_.AddPinOwner(*this);
+  try {
+    // Initialize the tree from its root page.
+    initialize();
+  } catch (...) {
+    unpinNodes();
+    page_cache_.RemovePinOwner(*this);
+    throw;
+  }
 }
 
 std::unique_ptr<BTreeManager> BTreeManager::CreateNewBTree(PageCache& page_cache, DataTypeEnum key_type) {
-  BTreeNodeMap root_node(page_cache.GetNewPage());
+  NOSQL_REQUIRE(internal::IsValidKeyType(key_type), "unsupported key type " << to_string(key_type));
+  return createNewBTree(page_cache, key_type, {});
+}
 
-  // Set the comparison and string debug functions. These are a B-tree property, not stored per-page.
+std::unique_ptr<BTreeManager> BTreeManager::CreateNewBTree(PageCache& page_cache,
+                                                           std::span<const DataTypeEnum> key_fields) {
+  NOSQL_REQUIRE(internal::IsValidCompositeKey(key_fields),
+                "composite keys need 1 to " << internal::MAX_COMPOSITE_KEY_FIELDS
+                                            << " fields, each of a valid key type");
+  return createNewBTree(page_cache, DataTypeEnum::Array, key_fields);
+}
+
+std::unique_ptr<BTreeManager> BTreeManager::createNewBTree(PageCache& page_cache,
+                                                           DataTypeEnum key_type,
+                                                           std::span<const DataTypeEnum> key_fields) {
+  BTreeNodeMap root_node(page_cache.GetNewPage());
 
   // === Reserved space. =================================================================================
   // 1 byte [Key type enum] int8_t
   // 1 byte [Flags] uint8_t
-  // 8 byte Current overflow page number
+  // 8 byte Overflow space map page number
   // 8 byte Next overflow page key
+  // 2 byte [Max entry size] page_size_t
+  // 2 byte [Min space for entry] page_size_t
+  // 2 byte [Max entries per page] page_size_t
   // === If using auto-incrementing keys, space for the key. This is only possible with primary_key_t. ===
   // 8 byte (optional) [Auto-incrementing key] primary_key_t
-  page_size_t reserved_space = 2 + 2 * sizeof(primary_key_t);
+  // === If using composite keys, the types of the key's fields. ========================================
+  // 1 byte (optional) [Number of fields] uint8_t
+  // N bytes (optional) [Field types] int8_t
+  page_size_t reserved_space = 2 + 2 * sizeof(primary_key_t) + 3 * sizeof(page_size_t);
   if (key_type == DataTypeEnum::UInt64) {
     reserved_space += sizeof(primary_key_t);
   }
+  if (key_type == DataTypeEnum::Array) {
+    reserved_space += static_cast<page_size_t>(1 + key_fields.size());
+  }
 
   auto header = root_node.GetHeader();
   header.InitializePage(root_node.GetPageNumber(), BTreePageType::RootLeaf, reserved_space);
-  // TODO: Right now, we only support string and uint64_t keys, and so assume that key size is specified if
-  //       the key type is a string.
-  if (key_type == DataTypeEnum::String) {
-    const auto flags = header.GetFlags();
-    header.SetFlags(flags | 0b100);
-  }
+  // Key sizes are serialized for every key type, since the page's key prefix is removed from the keys.
+  header.SetFlags(header.GetFlags() | KEY_SIZES_SERIALIZED_FLAG);
 
   LOG_SEV(Trace) << "Root page allocated to be page " << root_node.GetPageNumber() << ".";
 
@@ -167,73 +377,463 @@ std::unique_ptr<BTreeManager> BTreeManager::CreateNewBTree(PageCache& page_cache
   auto offset = root_node.GetHeader().GetReservedStart();
   offset = root_node.GetPage()->WriteToPage<int8_t>(offset, static_cast<int8_t>(key_type));
   offset = root_node.GetPage()->WriteToPage<uint8_t>(offset, 0);
+  offset = root_node.GetPage()->WriteToPage<page_number_t>(offset, 0);
+  offset = root_node.GetPage()->WriteToPage<primary_key_t>(offset, 0);
+  const auto tuning = BTreeTuning::ForPageSize(root_node.GetPage()->GetPageSize());
+  offset = root_node.GetPage()->WriteToPage(
+      offset, std::array {tuning.max_entry_size, tuning.min_space_for_entry, tuning.max_entries_per_page});
   if (key_type == DataTypeEnum::UInt64) {
     root_node.GetPage()->WriteToPage<primary_key_t>(offset, 0);
   }
+  if (key_type == DataTypeEnum::Array) {
+    offset = root_node.GetPage()->WriteToPage<uint8_t>(offset, static_cast<uint8_t>(key_fields.size()));
+    for (auto field_type : key_fields) {
+      offset = root_node.GetPage()->WriteToPage<int8_t>(offset, static_cast<int8_t>(field_type));
+    }
+  }
 
   return std::make_unique<BTreeManager>(root_node.GetPageNumber(), page_cache);
 }
 
+BTreeManager::~BTreeManager() {
+  try {
+    Checkpoint();
+  } catch (const std::exception& ex) {
+    LOG_SEV(Error) << "Error checkpointing B-tree with root page " << root_page_
+                   << " on destruction:" << lightning::NewLineIndent << ex.what();
+  }
+  unpinNodes();
+  page_cache_.RemovePinOwner(*this);
+}
+
 void BTreeManager::AddValue(GeneralKey key, internal::EntryCreator& entry_creator) {
+  addValue(normalizeKey(key, true).Get(), entry_creator);
+}
+
+void BTreeManager::AppendValue(GeneralKey key, internal::EntryCreator& entry_creator) {
+  const auto normalized_key = normalizeKey(key, true);
+  if (!appendToRightmostLeaf(normalized_key.Get(), entry_creator)) {
+    addValue(normalized_key.Get(), entry_creator);
+  }
+}
+
+std::size_t BTreeManager::ScanBatch(
+    std::optional<GeneralKey> after,
+    std::size_t max_entries,
+    const std::function<void(GeneralKey, internal::DatabaseEntry&)>& visitor) const {
+  auto it = after ? scan(KeyRange {.lower = *after, .lower_inclusive = false}, ScanDirection::Ascending)
+                  : begin();
+  std::size_t num_visited = 0;
+  for (; num_visited < max_entries && !it.IsEnd(); ++it, ++num_visited) {
+    // Copying the entry finds its key again if its leaf changed, and moves past the key if the entry was
+    // removed, so the key is read afterwards, from the position the entry was copied at.
+    const auto entry = *it;
+    if (!entry) {
+      break;
+    }
+    visitor(it.key_, *entry);
+  }
+  return num_visited;
+}
+
+void BTreeManager::addValue(GeneralKey key, internal::EntryCreator& entry_creator) {
   LOG_SEV(Debug) << "Adding value with key " << debugKey(key) << " to the B-tree.";
 
-  // Search for the leaf node where the key should be inserted.
-  auto result = search(key);
-  NOSQL_ASSERT(result.node, "could not find node to add element to");
+  for (;;) {
+    // Search for the leaf node where the key should be inserted.
+    auto result = search(key);
+    NOSQL_ASSERT(result.node, "could not find node to add element to");
+
+    if (auto handler = LOG_HANDLER_FOR(lightning::Global::GetLogger(), Trace)) {
+      handler << "Search path (root is " << root_page_ << "):";
+      for (std::size_t i = 0; i < result.path.Size(); ++i) {
+        handler << lightning::NewLineIndent << "  * Page " << result.path[i]->first << ", index "
+                << result.path[i]->second << ".";
+      }
+      if (result.node) {
+        handler << lightning::NewLineIndent << "Found node is " << result.node->GetPageNumber() << ".";
+      }
+    }
+
+    // Lock the leaf, unless another writer changed it since the search.
+    WriteGuard guard(*this);
+    if (guard.TryLock(result.node->GetPageNumber(), result.leaf_version)
+        && insertIntoLeaf(key, entry_creator, result, guard))
+    {
+      return;
+    }
+    LOG_SEV(Trace) << "Another writer changed the nodes for key " << debugKey(key) << ", restarting.";
+    std::this_thread::yield();
+  }
+}
+
+bool BTreeManager::RemoveValue(GeneralKey key) {
+  const auto normalized_key = normalizeKey(key, true);
+  LOG_SEV(Debug) << "Removing value with key " << debugKey(normalized_key.Get()) << " from the B-tree.";
+
+  // Find the leaf, and lock it, unless another writer changed it since the search.
+  WriteGuard guard(*this);
+  auto result = search(normalized_key.Get());
+  while (!guard.TryLock(result.node->GetPageNumber(), result.leaf_version)) {
+    std::this_thread::yield();
+    result = search(normalized_key.Get());
+  }
+  auto& node = *result.node;
+  const auto index = result.path.Top()->get().second;
+  if (index == node.GetNumPointers()
+      || node.compareToNthKey(normalized_key.Get(), index) != std::weak_ordering::equivalent)
+  {
+    return false;
+  }
+
+  // Remove the pointer, then return the cell's space to the page.
+  const auto cell_offset = node.getCellOffsetByIndex(index);
+  const auto cell = node.getCell(cell_offset);
+  const auto cell_size = std::visit([](auto&& cell) { return cell.GetCellSize(); }, cell);
+  // The pages of a blob entry are released as one run. The parts of an overflow entry are removed from their
+  // overflow pages, so the space can be used by other overflow entries.
+  if (const auto& data_cell = std::get<DataNodeCell>(cell); internal::GetIsBlobEntry(data_cell.flags)) {
+    uint64_t entry_size;
+    page_number_t first_page;
+    std::memcpy(&entry_size, data_cell.data.data(), sizeof(entry_size));
+    std::memcpy(&first_page, data_cell.data.data() + sizeof(entry_size), sizeof(first_page));
+    const auto page_size = node.GetPage()->GetPageSize();
+    // Readers may be copying the entry, holding the overflow lock shared.
+    std::lock_guard overflow_guard(overflow_lock_);
+    page_cache_.ReleaseExtent(first_page, internal::GetNumBlobPages(entry_size, page_size));
+  }
+  else if (!internal::GetIsSinglePageEntry(data_cell.flags)) {
+    primary_key_t overflow_key;
+    page_number_t first_page;
+    std::memcpy(&overflow_key, data_cell.data.data(), sizeof(overflow_key));
+    std::memcpy(&first_page, data_cell.data.data() + sizeof(overflow_key), sizeof(first_page));
+    std::lock_guard overflow_guard(overflow_lock_);
+    removeOverflowEntry(overflow_key, first_page);
+  }
+  node.removeSlot(index);
+  node.freeCell(cell_offset, cell_size);
+  // The rightmost leaf is only reached through rightmost pointers, which have no entry counts.
+  if (node.getHeader().GetRightSibling() != 0) {
+    std::lock_guard count_guard(entry_count_lock_);
+    addToEntryCounts(findPath(normalized_key.Get()), -1);
+  }
+
+  LOG_SEV(Trace) << "Removed cell of " << cell_size << " bytes at offset " << cell_offset << " from page "
+                 << node.GetPageNumber() << ", which has " << node.GetTotalFreeSpace()
+                 << " bytes of free space.";
+  return true;
+}
+
+primary_key_t BTreeManager::AddValue(internal::EntryCreator& entry_creator) {
+  NOSQL_REQUIRE(key_type_ == DataTypeEnum::UInt64,
+                "cannot add value with auto-incrementing key to B-tree with non-uint64_t key type");
+
+  LOG_SEV(Debug) << "Adding value to the B-tree with auto-incrementing key.";
+
+  // Get the next primary key.
+  const auto primary_key = getNextPrimaryKey();
+  const auto next_key = internal::NormalizePrimaryKey(primary_key);
+  const GeneralKey key_span = next_key;
+
+  // Auto-incrementing keys are always the largest key in the tree, so they can usually be appended directly
+  // to the rightmost leaf.
+  if (!appendToRightmostLeaf(key_span, entry_creator)) {
+    // Add the value with the next primary key.
+    addValue(key_span, entry_creator);
+  }
+  return primary_key;
+}
+
+void BTreeManager::SetSplitFillFactor(double fill_factor) {
+  NOSQL_REQUIRE(0.5 <= fill_factor && fill_factor <= 1.,
+                "split fill factor must be between 0.5 and 1, not " << fill_factor);
+  split_fill_factor_.store(fill_factor, std::memory_order_relaxed);
+}
+
+BTreeTuning BTreeManager::GetTuning() const noexcept {
+  auto tuning = tuning_;
+  tuning.max_entry_size = max_entry_size_.load(std::memory_order_relaxed);
+  return tuning;
+}
+
+void BTreeManager::Checkpoint() {
+  std::lock_guard guard(checkpoint_lock_);
+  // Writers keep changing the counter and the tuning, the values that are written are the current ones.
+  const auto next_primary_key = next_primary_key_.load();
+  const auto tuning = GetTuning();
+  const auto counter_changed =
+      key_type_ == DataTypeEnum::UInt64 && next_primary_key != checkpointed_primary_key_;
+  const auto tuning_changed = tuning != checkpointed_tuning_;
+  {
+    std::lock_guard overflow_guard(overflow_lock_);
+    if (overflow_space_map_.IsDirty()) {
+      checkpointOverflowSpaceMap();
+    }
+  }
+  if (!counter_changed && !tuning_changed) {
+    return;
+  }
+  // The counter and the tuning are in the root's reserved space, which writers that change the root do not
+  // write to.
+  auto root = loadNodePage(root_page_);
+
+  if (counter_changed) {
+    root->GetPage()->WriteToPage(getPrimaryKeyCounterOffset(*root), next_primary_key);
+    checkpointed_primary_key_ = next_primary_key;
+
+    LOG_SEV(Debug) << "Checkpointed auto-incrementing key counter " << next_primary_key
+                   << " for B-tree with root " << root_page_ << ".";
+  }
+  if (tuning_changed) {
+    root->GetPage()->WriteToPage(
+        getTuningOffset(*root),
+        std::array {tuning.max_entry_size, tuning.min_space_for_entry, tuning.max_entries_per_page});
+    checkpointed_tuning_ = tuning;
+
+    LOG_SEV(Debug) << "Checkpointed tuning for B-tree with root " << root_page_ << ".";
+  }
+}
+
+void BTreeManager::initialize() {
+  auto root = loadNodePage(root_page_);
+
+  // Get the key type from the root page.
+  key_type_ = static_cast<DataTypeEnum>(root->GetPage()->Read<int8_t>(root->GetHeader().GetReservedStart()));
+
+  auto tuning_offset = getTuningOffset(*root);
+  tuning_.max_entry_size = root->GetPage()->Read<page_size_t>(tuning_offset);
+  tuning_.min_space_for_entry = root->GetPage()->Read<page_size_t>(tuning_offset + sizeof(page_size_t));
+  tuning_.max_entries_per_page = root->GetPage()->Read<page_size_t>(tuning_offset + 2 * sizeof(page_size_t));
+  checkpointed_tuning_ = tuning_;
+  max_entry_size_ = tuning_.max_entry_size;
+
+  // The overflow information is stored after the key type and flags.
+  next_overflow_entry_number_ =
+      root->GetPage()->Read<primary_key_t>(root->GetHeader().GetReservedStart() + 2 + sizeof(page_number_t));
+  loadOverflowSpaceMap(*root);
+
+  if (key_type_ == DataTypeEnum::Array) {
+    // Composite keys. The field types are stored after the key type, flags, overflow page information, and
+    // tuning.
+    auto offset = static_cast<page_size_t>(tuning_offset + 3 * sizeof(page_size_t));
+    const auto num_fields = root->GetPage()->Read<uint8_t>(offset++);
+    key_fields_.resize(num_fields);
+    for (auto& field_type : key_fields_) {
+      field_type = static_cast<DataTypeEnum>(root->GetPage()->Read<int8_t>(offset++));
+    }
+    NOSQL_REQUIRE(internal::IsValidCompositeKey(key_fields_),
+                  "invalid composite key in B-tree " << root_page_);
+  }
+  else {
+    NOSQL_REQUIRE(internal::IsValidKeyType(key_type_), "unsupported key type " << to_string(key_type_));
+  }
+
+  // Keys of every type are normalized, so they are all compared byte by byte, and pages can store the common
+  // prefix of their keys once.
+  if (key_type_ == DataTypeEnum::UInt64) {
+    recoverPrimaryKeyCounter();
+  }
+}
+
+primary_key_t BTreeManager::getNextPrimaryKey() {
+  // Only possible if the key type is uint64_t.
+  NOSQL_ASSERT(key_type_ == DataTypeEnum::UInt64, "cannot get next primary key for non-uint64_t key type");
+
+  auto pk = next_primary_key_.fetch_add(1);
+  LOG_SEV(Trace) << "Next primary key is " << pk << ".";
+  return pk;
+}
+
+void BTreeManager::recoverPrimaryKeyCounter() {
+  auto root = loadNodePage(root_page_);
+  checkpointed_primary_key_ = root->GetPage()->Read<primary_key_t>(getPrimaryKeyCounterOffset(*root));
+  auto next_primary_key = checkpointed_primary_key_;
+
+  // The counter may not have been checkpointed since the last keys were added, so check the largest key in
+  // the tree. Finding it also finds the rightmost leaf, so remember it.
+  auto result = searchLast();
+  if (auto largest_key = result.node->GetLargestKey()) {
+    const auto largest = internal::DenormalizePrimaryKey(*largest_key);
+    if (next_primary_key <= largest) {
+      LOG_SEV(Warning) << "Auto-incrementing key counter for B-tree with root " << root_page_ << " was "
+                       << next_primary_key << ", but the largest key is " << largest
+                       << ", advancing counter.";
+      next_primary_key = largest + 1;
+    }
+  }
+  next_primary_key_ = next_primary_key;
+  rightmost_leaf_ = result.node->GetPageNumber();
+}
+
+page_size_t BTreeManager::getPrimaryKeyCounterOffset(BTreeNodeMap& root) const {
+  // The counter is stored after the key type, flags, overflow page information, and tuning.
+  return static_cast<page_size_t>(getTuningOffset(root) + 3 * sizeof(page_size_t));
+}
+
+page_size_t BTreeManager::getTuningOffset(BTreeNodeMap& root) const {
+  // The tuning is stored after the key type, flags, current overflow page, and next overflow entry number.
+  return static_cast<page_size_t>(root.GetHeader().GetReservedStart() + 2 + 2 * sizeof(primary_key_t));
+}
+
+void BTreeManager::recordEntrySize(std::size_t entry_size) {
+  const auto size_class = std::min<std::size_t>(std::bit_width(entry_size - 1), NUM_ENTRY_SIZE_CLASSES - 1);
+  entry_size_counts_[size_class].fetch_add(1, std::memory_order_relaxed);
+  // The writer that completes the sample adjusts the maximum entry size.
+  if (num_sampled_entries_.fetch_add(1, std::memory_order_relaxed) + 1 == TUNING_SAMPLE_INTERVAL) {
+    adjustMaxEntrySize();
+  }
+}
+
+void BTreeManager::adjustMaxEntrySize() {
+  // Take the sample, and start a new one.
+  std::array<uint32_t, NUM_ENTRY_SIZE_CLASSES> counts {};
+  std::size_t num_sampled_entries = 0;
+  for (std::size_t i = 0; i < NUM_ENTRY_SIZE_CLASSES; ++i) {
+    counts[i] = entry_size_counts_[i].exchange(0, std::memory_order_relaxed);
+    num_sampled_entries += counts[i];
+  }
+  num_sampled_entries_.fetch_sub(TUNING_SAMPLE_INTERVAL, std::memory_order_relaxed);
 
-  if (auto handler = LOG_HANDLER_FOR(lightning::Global::GetLogger(), Trace)) {
-    handler << "Search path (root is " << root_page_ << "):";
-    for (std::size_t i = 0; i < result.path.Size(); ++i) {
-      handler << lightning::NewLineIndent << "  * Page " << result.path[i]->first << ", index "
-              << result.path[i]->second << ".";
+  // Find the smallest size class that holds 90% of the sampled entries.
+  const auto target = (9 * num_sampled_entries + 9) / 10;
+  std::size_t size_class = 0, count = counts[0];
+  while (count < target) {
+    count += counts[++size_class];
+  }
+
+  // Storing large entries in the leaves keeps them from being split across overflow pages, but leaves less
+  // room for other entries, so the limit only goes as high as the entries need.
+  const auto page_size = page_cache_.GetPageSize();
+  const auto max_entry_size = static_cast<page_size_t>(
+      std::clamp<std::size_t>(std::size_t {1} << size_class,
+                              BTreeTuning::SmallestMaxEntrySize(page_size),
+                              BTreeTuning::LargestMaxEntrySize(page_size)));
+  max_entry_size_.store(max_entry_size, std::memory_order_relaxed);
+
+  LOG_SEV(Debug) << "Maximum entry size for B-tree with root " << root_page_ << " is now " << max_entry_size
+                 << " bytes.";
+}
+
+bool BTreeManager::appendToRightmostLeaf(GeneralKey key, internal::EntryCreator& entry_creator) {
+  const auto page_number = rightmost_leaf_.load(std::memory_order_relaxed);
+  if (page_number == 0) {
+    return false;
+  }
+  const auto& latch = getLatch(page_number);
+  const auto version = latch.ReadLock();
+  auto leaf = loadNodePage(page_number);
+  // Only append if the key sorts after every key in the leaf, otherwise, fall back to a normal search. If
+  // every key in the leaf was removed, the key may belong in an earlier leaf, so search for it too. Once the
+  // root is split, it is no longer a leaf. Splits add new leaves to the left of the leaf they split, so the
+  // rightmost leaf stays the rightmost leaf, but check anyway.
+  try {
+    if (auto num_pointers = leaf->GetNumPointers(); leaf->IsPointersPage() || num_pointers == 0
+        || leaf->getHeader().GetRightSibling() != 0
+        || leaf->compareToNthKey(key, num_pointers - 1) != std::weak_ordering::greater)
+    {
+      return false;
     }
-    if (result.node) {
-      handler << lightning::NewLineIndent << "Found node is " << result.node->GetPageNumber() << ".";
+  } catch (const std::exception&) {
+    // A leaf that is read while a writer changes it can look corrupt.
+    if (latch.Validate(version)) {
+      throw;
     }
+    return false;
   }
 
+  // The leaf was read without its latch, so only append if no other writer changed it since.
+  WriteGuard guard(*this);
+  if (!guard.TryLock(page_number, version)) {
+    return false;
+  }
+  LOG_SEV(Debug) << "Appending key " << debugKey(key) << " to the rightmost leaf, page " << page_number
+                 << ".";
+
+  SearchResult result;
+  result.path.Emplace(page_number, leaf->GetNumPointers());
+  result.node = std::move(leaf);
+  result.is_rightmost_leaf = true;
+  result.leaf_version = version;
+  return insertIntoLeaf(key, entry_creator, result, guard);
+}
+
+bool BTreeManager::insertIntoLeaf(GeneralKey key,
+                                  internal::EntryCreator& entry_creator,
+                                  SearchResult& result,
+                                  WriteGuard& guard) {
+  // The entry counts along the path are updated before the entry is added, since splits move the counts along
+  // with the cells. So the key has to be checked for uniqueness first.
+  NOSQL_REQUIRE(isUniqueKey(*result.node, key, result.path.Top()->get().second),
+                "key " << debugKey(key) << " is already in the B-tree");
+
   // Check if we can add the element to the node (without re-balancing).
 
   // TODO: Use GetSpaceRequirements
 
-  // For now, don't do anything fancy, just check if there is enough de-fragmented space to add the
-  // element.
-  // TODO: More complex strategies could include vacuuming, looking for fragmented free space, etc.
-  auto space_available = result.node->GetDefragmentedFreeSpace();
-  // Cell offset, entry size, and the entry itself.
-  auto necessary_space = sizeof(page_size_t) + entry_creator.GetMinimumEntrySize();
-  if (!entry_creator.GetNeedsOverflow()) {
+  // Check if there is enough free space to add the element. Space in holes left by removed cells counts, the
+  // node is vacuumed if the cell does not fit anywhere else.
+  const auto& tuning = guard.GetTuning();
+  auto space_available = result.node->GetTotalFreeSpace();
+  // Cell offset, entry size, and the entry itself. An entry that is small enough to be stored in the leaf has
+  // to fit in this page, otherwise the page is split. It is not moved to overflow pages because this page
+  // happens to be full.
+  const auto entry_size = entry_creator.GetSinglePageEntrySize();
+  const auto minimum_entry_size = entry_creator.GetMinimumEntrySize();
+  auto necessary_space = POINTER_SLOT_SIZE + minimum_entry_size;
+  if (entry_size <= tuning.max_entry_size) {
+    // The entry creator needs room for an overflow header even if the entry is smaller than that.
+    necessary_space = POINTER_SLOT_SIZE + std::max<page_size_t>(static_cast<page_size_t>(entry_size),
+                                                                minimum_entry_size);
+  }
+  else if (!entry_creator.GetNeedsOverflow()) {
     // Serialize entry size.
     necessary_space += sizeof(entry_size_t);
   }
-  // Space required for the key.
-  if (serialize_key_size_) {
-    necessary_space += sizeof(uint16_t);
-  }
-  necessary_space += key.size();
+  // Space required for the flags and the key, and for the other keys if the page's key prefix has to be
+  // shortened.
+  auto requirements = result.node->CalculateSpaceRequirements(key);
+  necessary_space += requirements.cell_header_space + requirements.prefix_shrink_space;
 
   auto num_elements = result.node->GetNumPointers();
   LOG_SEV(Trace) << "Free space in node " << result.node->GetPageNumber() << " is " << space_available
                  << " bytes. Number of elements is " << num_elements << ". Total size of this entry is "
                  << necessary_space << " bytes.";
 
+  // The rightmost leaf is only reached through rightmost pointers, which have no entry counts.
+  const auto is_rightmost_leaf = result.node->getHeader().GetRightSibling() == 0;
+
   // We must have at least `space_available` space to add an entry to this page.
-  if (min_space_for_entry_ <= space_available && necessary_space <= space_available
-      && num_elements + 1 <= max_entries_per_page_)
+  if (tuning.min_space_for_entry <= space_available && necessary_space <= space_available
+      && num_elements + 1 <= tuning.max_entries_per_page)
   {
+    if (!is_rightmost_leaf) {
+      std::lock_guard count_guard(entry_count_lock_);
+      addToEntryCounts(findPath(key), 1);
+    }
+
     // TODO: Return expected type, or some more detailed info, generally, this will fail b/c of key
     //  uniqueness violations.
     StoreData store_data {.key = key,
                           .entry_creator = &entry_creator,
                           .serialize_key_size = serialize_key_size_,
-                          .serialize_data_size = true};
+                          .serialize_data_size = true,
+                          .lower_bound = result.path.Top()->get().second};
     NOSQL_ASSERT(addElementToNode(*result.node, store_data),
                  "could not add element to node " << result.node->GetPageNumber() << " with pk "
                                                   << debugKey(key) << ", but this should be possible");
+
+    // If this is the rightmost leaf, later appends can go directly to it.
+    if (is_rightmost_leaf) {
+      rightmost_leaf_.store(result.node->GetPageNumber(), std::memory_order_relaxed);
+    }
   }
   else {
     // Else, we have to split the node and re-balance the tree.
     LOG_SEV(Trace) << "Not enough free space, node " << result.node->GetPageNumber() << " must be split.";
+    if (!lockForSplit(key, *result.node, guard, result.path)) {
+      return false;
+    }
+    addToEntryCounts(result.path, 1);
 
     StoreData store_data {.key = key, .entry_creator = &entry_creator};
     splitNode(*result.node, result, store_data);
@@ -244,143 +844,614 @@ void BTreeManager::AddValue(GeneralKey key, internal::EntryCreator& entry_creato
                  "page " << result.node->GetPageNumber()
                          << " is a pointers page with no additional data, there must be a right pointer");
   }
+  recordEntrySize(entry_size);
+  return true;
 }
 
-void BTreeManager::AddValue(internal::EntryCreator& entry_creator) {
-  NOSQL_REQUIRE(key_type_ == DataTypeEnum::UInt64,
-                "cannot add value with auto-incrementing key to B-tree with non-uint64_t key type");
+bool BTreeManager::lockForSplit(GeneralKey key,
+                                const BTreeNodeMap& leaf,
+                                WriteGuard& guard,
+                                TreePosition& path) const {
+  // The new leaf goes between the leaf and its left neighbor, whose right sibling pointer changes. Another
+  // writer that holds the neighbor may be waiting for a node this write holds, so do not wait for it.
+  if (const auto left_neighbor = leaf.getHeader().GetLeftSibling();
+      left_neighbor != 0 && !guard.TryLock(left_neighbor))
+  {
+    return false;
+  }
 
-  LOG_SEV(Debug) << "Adding value to the B-tree with auto-incrementing key.";
+  // No other writer changes the interior nodes while the entry count lock is held, so the path to the leaf
+  // stays the same until the split is done.
+  guard.LockEntryCounts();
+  path = findPath(key);
+  NOSQL_ASSERT(path.Top()->get().first == leaf.GetPageNumber(),
+               "key " << debugKey(key) << " leads to page " << path.Top()->get().first << ", not to page "
+                      << leaf.GetPageNumber() << ", whose latch is held");
+
+  // The parent gets a pointer to the new node. If it has no room for it, it is split too, and its parent
+  // gets a pointer, and so on. The keys that are pushed up are keys from the nodes below, or the new key.
+  auto max_key_size = std::max(key.size(), getLongestKeySize(leaf));
+  for (auto level = path.Size() - 1; 0 < level; --level) {
+    const auto page_number = path[level - 1]->first;
+    if (!guard.TryLock(page_number)) {
+      return false;
+    }
+    const auto node = loadNodePage(page_number);
+    if (hasRoomForPointer(*node, max_key_size)) {
+      break;
+    }
+    max_key_size = std::max(max_key_size, getLongestKeySize(*node));
+  }
+  return true;
+}
 
-  // Get the next primary key.
-  auto next_key = getNextPrimaryKey();
-  auto key_span = internal::SpanValue(next_key);
+TreePosition BTreeManager::findPath(GeneralKey key) const {
+  TreePosition path;
+  auto node = *loadNodePage(root_page_);
+  while (node.IsPointersPage()) {
+    const auto [next_page_number, index] = node.searchForNextPageInPointersPage(key);
+    path.Push({node.GetPageNumber(), index});
+    node = *loadNodePage(next_page_number);
+  }
+  // Only the leaf's page is needed, the leaf can change while the entry count lock is held.
+  path.Push({node.GetPageNumber(), 0});
+  return path;
+}
 
-  // Add the value with the next primary key.
-  AddValue(key_span, entry_creator);
+bool BTreeManager::hasRoomForPointer(const BTreeNodeMap& node, std::size_t max_key_size) const {
+  // A pointer cell is a pointer slot, flags, the key size, the key, the page number, and the entry count. The
+  // key may not share the node's key prefix, in which case every other key grows by the prefix.
+  const auto& header = node.getHeader();
+  const auto required_space = POINTER_SLOT_SIZE + sizeof(uint8_t) + sizeof(uint16_t) + max_key_size
+      + 2 * sizeof(uint64_t) + std::size_t {header.GetKeyPrefixSize()} * header.GetNumPointers();
+  return header.GetNumPointers() < GetTuning().max_entries_per_page
+      && required_space <= header.GetTotalFreeSpace();
 }
 
-void BTreeManager::initialize() {
+std::size_t BTreeManager::getLongestKeySize(const BTreeNodeMap& node) const {
+  std::size_t longest_suffix = 0;
+  for (page_size_t i = 0; i < node.GetNumPointers(); ++i) {
+    longest_suffix = std::max(longest_suffix, node.getKeyForCell(node.getCellOffsetByIndex(i)).size());
+  }
+  return node.getHeader().GetKeyPrefixSize() + longest_suffix;
+}
+
+page_number_t BTreeManager::acquireOverflowPage(std::size_t entry_space) {
+  // Space that is larger than any page can hold is asked for by parts that fill a whole new page.
+  const auto requested_space = static_cast<page_size_t>(
+      std::min<std::size_t>(entry_space, std::numeric_limits<page_size_t>::max()));
+  // If no page has room for all of it, the page with the most room is filled before a new page is used.
+  // The map may be out of date, e.g. if it was not checkpointed before the database was closed, so check
+  // the space in the page itself.
+  for (;;) {
+    auto page_number = overflow_space_map_.FindBestFit(requested_space);
+    if (!page_number) {
+      page_number = overflow_space_map_.FindMostSpace();
+    }
+    if (!page_number) {
+      break;
+    }
+    const auto overflow_page = loadNodePage(*page_number);
+    const auto actual_space = getOverflowEntrySpace(*overflow_page);
+    const auto expected_space = overflow_space_map_.GetEntrySpace(*page_number);
+    overflow_space_map_.Remove(*page_number);
+    if (actual_space == expected_space) {
+      LOG_SEV(Trace) << "Using overflow page " << *page_number << ", which has " << actual_space
+                     << " bytes of entry space, for " << entry_space << " bytes.";
+      return *page_number;
+    }
+    overflow_space_map_.Update(*page_number, actual_space);
+  }
+
+  // The space map gets its page along with the tree's first overflow page.
+  if (overflow_space_map_page_ == 0) {
+    setOverflowSpaceMapPage();
+  }
+  const auto new_page = newNodePage(BTreePageType::OverflowPage, 0);
+  LOG_SEV(Trace) << "No overflow page has " << entry_space << " bytes of entry space, using new page "
+                 << new_page.GetPageNumber() << ".";
+  return new_page.GetPageNumber();
+}
+
+void BTreeManager::updateOverflowSpace(const BTreeNodeMap& overflow_page) {
+  overflow_space_map_.Update(overflow_page.GetPageNumber(), getOverflowEntrySpace(overflow_page));
+}
+
+page_size_t BTreeManager::getOverflowEntrySpace(const BTreeNodeMap& overflow_page) const {
+  // Overflow keys all have the same size, and overflow pages have no key prefix.
+  const auto overflow_key = internal::NormalizePrimaryKey(0);
+  return overflow_page.CalculateSpaceRequirements(overflow_key).max_entry_space;
+}
+
+void BTreeManager::removeOverflowEntry(primary_key_t overflow_key, page_number_t first_page_number) {
+  const auto normalized_key = internal::NormalizePrimaryKey(overflow_key);
+  const GeneralKey key = normalized_key;
+
+  // Each part of the entry starts with the page number of the next part, zero for the last part.
+  for (auto page_number = first_page_number; page_number != 0;) {
+    auto overflow_page = loadNodePage(page_number);
+    const auto lower_bound = overflow_page->getCellLowerBoundByPK(key);
+    const auto found = lower_bound
+        && overflow_page->compareToNthKey(key, lower_bound->second) == std::weak_ordering::equivalent;
+    NOSQL_ASSERT(found,
+                 "could not find overflow key " << overflow_key << " in overflow page " << page_number);
+    const auto [cell_offset, index] = *lower_bound;
+    const auto cell = std::get<DataNodeCell>(overflow_page->getCell(cell_offset));
+    page_number = *reinterpret_cast<const page_number_t*>(cell.data.data());
+
+    overflow_page->removeSlot(index);
+    overflow_page->freeCell(cell_offset, cell.GetCellSize());
+    updateOverflowSpace(*overflow_page);
+  }
+}
+
+void BTreeManager::loadOverflowSpaceMap(BTreeNodeMap& root) {
+  const auto page_number = root.GetPage()->Read<page_number_t>(root.GetHeader().GetReservedStart() + 2);
+  if (page_number == 0) {
+    return;
+  }
+  overflow_space_map_.ReadFromPage(*page_cache_.GetPage(page_number));
+  overflow_space_map_page_ = page_number;
+  LOG_SEV(Debug) << "Loaded overflow space map of B-tree with root " << root_page_ << " from page "
+                 << page_number << ", it tracks " << overflow_space_map_.GetNumPages() << " pages.";
+}
+
+void BTreeManager::setOverflowSpaceMapPage() {
+  // Write the map to its page right away, so the page holds a valid map even if the tree is never
+  // checkpointed.
+  const auto page = page_cache_.GetNewPage();
+  overflow_space_map_.WriteToPage(*page);
+  overflow_space_map_page_ = page->GetPageNumber();
   auto root = loadNodePage(root_page_);
+  root->GetPage()->WriteToPage<page_number_t>(root->GetHeader().GetReservedStart() + 2,
+                                              overflow_space_map_page_);
+}
 
-  // Get the key type from the root page.
-  key_type_ = static_cast<DataTypeEnum>(root->GetPage()->Read<int8_t>(root->GetHeader().GetReservedStart()));
+void BTreeManager::checkpointOverflowSpaceMap() {
+  overflow_space_map_.WriteToPage(*page_cache_.GetPage(overflow_space_map_page_));
 
-  serialize_key_size_ = key_type_ == DataTypeEnum::String;
+  LOG_SEV(Debug) << "Checkpointed overflow space map of B-tree with root " << root_page_ << " to page "
+                 << overflow_space_map_page_ << ", it tracks " << overflow_space_map_.GetNumPages()
+                 << " pages.";
+}
 
-  // Get default key comparison and debug functions.
-  if (key_type_ == DataTypeEnum::UInt64) {
-    cmp_ = internal::CompareTrivial<primary_key_t>;
-    debug_key_func_ = internal::PrintUInt64;
+primary_key_t BTreeManager::getNextOverflowEntryNumber() {
+  auto root = loadNodePage(root_page_);
+
+  ++next_overflow_entry_number_;
+
+  // Next overflow entry is stored right after the flags.
+  auto offset = 2 + sizeof(primary_key_t);
+  const auto counter_offset = static_cast<page_size_t>(root->GetHeader().GetReservedStart() + offset);
+  root->GetPage()->WriteToPage<page_number_t>(counter_offset, next_overflow_entry_number_);
+
+  return next_overflow_entry_number_ - 1;
+}
+
+BTreeManager::Iterator BTreeManager::Scan(const KeyRange& range, ScanDirection direction) const {
+  // Normalize the bounds.
+  std::optional<internal::NormalizedKey> lower, upper;
+  auto normalized_range = range;
+  if (range.lower) {
+    normalized_range.lower = lower.emplace(normalizeKey(*range.lower)).Get();
   }
-  else if (key_type_ == DataTypeEnum::String) {
-    cmp_ = internal::CompareString;
-    debug_key_func_ = internal::PrintString;
+  if (range.upper) {
+    normalized_range.upper = upper.emplace(normalizeKey(*range.upper)).Get();
+  }
+  return scan(normalized_range, direction);
+}
+
+BTreeManager::Iterator BTreeManager::ScanPrefix(GeneralKey prefix, ScanDirection direction) const {
+  NOSQL_REQUIRE(internal::GetFixedKeySize(key_type_) == 0,
+                "prefix scans need keys of variable size, not " << to_string(key_type_));
+  const auto normalized_prefix = normalizeKey(prefix);
+
+  // Every key that starts with the prefix is at least the prefix, and less than its successor.
+  const auto successor = internal::PrefixSuccessor(normalized_prefix.Get());
+  KeyRange range {.lower = normalized_prefix.Get(), .lower_inclusive = true, .upper_inclusive = false};
+  if (successor) {
+    range.upper = *successor;
+  }
+  return scan(range, direction);
+}
+
+uint64_t BTreeManager::Count() const {
+  for (;;) {
+    {
+      std::shared_lock guard(entry_count_lock_);
+      if (const auto num_entries = tryCount()) {
+        return *num_entries;
+      }
+    }
+    std::this_thread::yield();
+  }
+}
+
+std::size_t BTreeManager::GetNumPinnedNodes() const {
+  std::lock_guard guard(pin_lock_);
+  return pinned_nodes_.size();
+}
+
+uint64_t BTreeManager::Count(const KeyRange& range) const {
+  std::optional<internal::NormalizedKey> lower, upper;
+  if (range.lower) {
+    lower.emplace(normalizeKey(*range.lower));
+  }
+  if (range.upper) {
+    upper.emplace(normalizeKey(*range.upper));
+  }
+  for (;;) {
+    {
+      // Both bounds are counted while the entry counts do not change.
+      std::shared_lock guard(entry_count_lock_);
+      const auto upper_count = upper ? tryCountBefore(upper->Get(), range.upper_inclusive) : tryCount();
+      const auto lower_count =
+          lower ? tryCountBefore(lower->Get(), !range.lower_inclusive) : std::optional<uint64_t> {0};
+      if (upper_count && lower_count) {
+        return *lower_count < *upper_count ? *upper_count - *lower_count : 0;
+      }
+    }
+    std::this_thread::yield();
+  }
+}
+
+BTreeManager::Iterator BTreeManager::Skip(uint64_t offset, ScanDirection direction) const {
+  for (;;) {
+    {
+      std::shared_lock guard(entry_count_lock_);
+      if (auto it = trySkip(offset, direction)) {
+        return std::move(*it);
+      }
+    }
+    std::this_thread::yield();
+  }
+}
+
+BTreeManager::Iterator BTreeManager::scan(const KeyRange& range, ScanDirection direction) const {
+  const auto& lower_key = range.lower;
+  const auto& upper_key = range.upper;
+
+  const bool ascending = direction == ScanDirection::Ascending;
+  const auto& start_bound = ascending ? lower_key : upper_key;
+  const auto start_inclusive = ascending ? range.lower_inclusive : range.upper_inclusive;
+  const auto& stop_bound = ascending ? upper_key : lower_key;
+
+  Iterator it(*this, true);
+  it.direction_ = direction;
+  if (stop_bound) {
+    it.stop_bound_ = std::vector<std::byte>(stop_bound->begin(), stop_bound->end());
+    it.stop_inclusive_ = ascending ? range.upper_inclusive : range.lower_inclusive;
+  }
+
+  it.retry([&](std::vector<std::byte>& key) {
+    if (!start_bound) {
+      if (!(ascending ? it.moveToFirst() : it.moveToLast()) || !it.recordPosition(key)) {
+        return false;
+      }
+      it.checkStopBound(key);
+      return true;
+    }
+
+    // The search ends at the first key in the leaf that is greater than or equal to the start bound. That can
+    // be one past the last cell in the leaf, in which case settling moves the iterator to the next leaf.
+    const auto result = search(*start_bound);
+    std::tie(it.page_number_, it.index_) = result.path.Top()->get();
+    it.version_ = result.leaf_version;
+    if (!it.settle() || !it.recordPosition(key)) {
+      return false;
+    }
+
+    // Check whether the iterator is on a key equal to the start bound.
+    const auto is_on_bound = !it.done() && std::ranges::equal(key, *start_bound);
+    if (ascending) {
+      if (!start_inclusive && is_on_bound && (!it.stepForward() || !it.recordPosition(key))) {
+        return false;
+      }
+    }
+    // For descending scans, the iterator needs to be on the last key that is less than the start bound, or
+    // equal to it if the bound is inclusive. If every key is less than the bound, that is the last key.
+    else if (!(start_inclusive && is_on_bound)) {
+      if (!(it.done() ? it.moveToLast() : it.stepBackward()) || !it.recordPosition(key)) {
+        return false;
+      }
+    }
+    it.checkStopBound(key);
+    return true;
+  });
+  return it;
+}
+
+BTreeNodeMap BTreeManager::newNodePage(BTreePageType type, page_size_t reserved_space) const {
+  BTreeNodeMap node(page_cache_.GetNewPage());
+  if (auto write = WriteGuard::GetCurrent(*this)) {
+    write->AddNewNode(node.GetPageNumber());
+  }
+  // Set the key type. This is a B-tree property, not stored per-page.
+  node.key_type_ = key_type_;
+
+  if (type == BTreePageType::OverflowPage) {
+    node.GetHeader().InitializeOverflowPage(node.GetPageNumber());
   }
   else {
-    // TODO: Implement for other key types.
-    NOSQL_FAIL("unsupported key type");
+    node.GetHeader().InitializePage(node.GetPageNumber(), type, reserved_space);
+    if (serialize_key_size_) {
+      auto header = node.GetHeader();
+      header.SetFlags(header.GetFlags() | KEY_SIZES_SERIALIZED_FLAG);
+    }
   }
+  return node;
 }
 
-primary_key_t BTreeManager::getNextPrimaryKey() const {
-  // Only possible if the key type is uint64_t.
-  NOSQL_ASSERT(key_type_ == DataTypeEnum::UInt64, "cannot get next primary key for non-uint64_t key type");
+std::optional<BTreeNodeMap> BTreeManager::loadNodePage(page_number_t page_number) const {
+  return makeNode(page_cache_.GetPage(page_number), page_number);
+}
 
-  auto root = loadNodePage(root_page_);
-  primary_key_t pk {};
+BTreeNodeMap BTreeManager::makeNode(std::unique_ptr<Page> page, page_number_t page_number) const {
+  BTreeNodeMap node(std::move(page));
 
-  auto offset = 2 + 2 * sizeof(primary_key_t);
-  auto counter_offset = static_cast<page_size_t>(root->GetHeader().GetReservedStart() + offset);
-  pk = root->GetPage()->Read<primary_key_t>(counter_offset);
+  // Set the key type. This is a B-tree property, not stored per-page.
+  node.key_type_ = key_type_;
 
-  primary_key_t next_primary_key = pk + 1;
-  root->GetPage()->WriteToPage(counter_offset, next_primary_key);
+  auto&& header = node.GetHeader();
 
-  LOG_SEV(Trace) << "Next primary key is " << pk << ".";
-  return pk;
+  // Make sure the magic number is correct. This is an assert, because if it's not correct, something is
+  // very wrong with the database itself.
+  NOSQL_ASSERT(
+      header.GetMagicNumber() == ToUInt64("NOSQLBTR") || header.GetMagicNumber() == ToUInt64("OVERFLOW"),
+      "invalid magic number in page " << page_number << " expected " << ToUInt64("NOSQLBTR") << ", got "
+                                      << header.GetMagicNumber());
+  // Another sanity check.
+  NOSQL_ASSERT(header.GetPageNumber() == page_number,
+               "page number mismatch, expected " << page_number << ", got " << header.GetPageNumber());
+  NOSQL_ASSERT(
+      !header.IsPointersPage() || header.GetAdditionalData() != 0,
+      "page " << page_number << " is a pointers page with no additional data, there must be a right pointer");
+
+  return node;
 }
 
-page_number_t BTreeManager::getNextOverflowPage() {
-  auto root = loadNodePage(root_page_);
+BTreeManager::PinnedNode* BTreeManager::getPinnedNode(PinnedNode::ChildReference& reference,
+                                                      page_number_t page_number,
+                                                      std::size_t depth,
+                                                      std::optional<BTreeNodeMap>& loaded) const {
+  {
+    std::lock_guard guard(pin_lock_);
+    if (auto it = pinned_nodes_.find(page_number); it != pinned_nodes_.end()) {
+      reference.node.store(it->second.get(), std::memory_order_release);
+      return it->second.get();
+    }
+  }
+  // Only interior nodes are pinned. They are few, and every search goes through them.
+  loaded = loadNodePage(page_number);
+  if (!loaded->IsPointersPage()) {
+    reference.unpinned_page_number.store(page_number, std::memory_order_release);
+    return nullptr;
+  }
+
+  // The pin lock is not held while pinning, since the page cache may ask this tree to give pages back.
+  auto page = page_cache_.PinPage(page_number, *this);
+  if (!page) {
+    // If the tree has less than its share of pinned pages, other trees are giving pages back, so the node is
+    // pinned by a later search.
+    if (!page_cache_.IsBelowPinShare(*this)) {
+      reference.unpinned_page_number.store(page_number, std::memory_order_release);
+    }
+    return nullptr;
+  }
+
+  const auto max_pointers = page->GetPageSize() / POINTER_SLOT_SIZE;
+  auto new_node = std::make_unique<PinnedNode>(makeNode(std::move(page), page_number), max_pointers, depth);
+  PinnedNode* node {};
+  {
+    std::lock_guard guard(pin_lock_);
+    auto& pinned = pinned_nodes_[page_number];
+    // Another search may have pinned the node in the meantime.
+    if (!pinned) {
+      pinned = std::move(new_node);
+      LOG_SEV(Debug) << "Pinned node " << page_number << " of B-tree with root " << root_page_ << ".";
+    }
+    node = pinned.get();
+    reference.node.store(node, std::memory_order_release);
+  }
+  if (new_node) {
+    page_cache_.UnpinPage(std::move(new_node->node.GetPage()), *this);
+  }
+  loaded.reset();
+  return node;
+}
+
+BTreeManager::PinnedNode* BTreeManager::followReference(PinnedNode::ChildReference& reference,
+                                                        page_number_t page_number,
+                                                        std::size_t depth,
+                                                        std::optional<BTreeNodeMap>& loaded) const {
+  // A pinned node's page number never changes, so a reference can be checked against the pointer in the page
+  // even if another search is updating it.
+  if (auto node = reference.node.load(std::memory_order_acquire);
+      node && node->node.GetPageNumber() == page_number)
+  {
+    return node;
+  }
+  if (reference.unpinned_page_number.load(std::memory_order_acquire) == page_number) {
+    loaded = loadNodePage(page_number);
+    return nullptr;
+  }
+  // The reference was not followed before, leads to a different page since the node changed, or its node
+  // was unpinned.
+  return getPinnedNode(reference, page_number, depth, loaded);
+}
+
+BTreeManager::PinnedNode* BTreeManager::followPointer(PinnedNode& parent,
+                                                      page_index_t index,
+                                                      page_number_t child_page_number,
+                                                      std::optional<BTreeNodeMap>& loaded) const {
+  NOSQL_ASSERT(index < parent.children.size(),
+               "pointer index " << index << " is out of range for node " << parent.node.GetPageNumber());
+  return followReference(parent.children[index], child_page_number, parent.depth + 1, loaded);
+}
+
+void BTreeManager::ReleasePins(std::size_t max_pinned_pages) const {
+  {
+    std::lock_guard guard(pin_lock_);
+    if (max_pinned_pages < pinned_nodes_.size()) {
+      // More searches go through the nodes closer to the root, so the deepest nodes are unpinned first.
+      std::vector<PinnedNode*> nodes;
+      for (auto& [page_number, pinned] : pinned_nodes_) {
+        nodes.push_back(pinned.get());
+      }
+      std::ranges::sort(nodes, std::ranges::greater {}, &PinnedNode::depth);
+      nodes.resize(nodes.size() - max_pinned_pages);
+      for (auto node : nodes) {
+        retireNode(*node);
+      }
+    }
+  }
+  releaseRetiredNodes();
+}
 
-  // Get a new page.
-  const auto new_page = newNodePage(BTreePageType::OverflowPage, 0);
-  // TODO: Any setup needed for the page to be an overflow page? Set some flags?
+void BTreeManager::retireNode(PinnedNode& node) const {
+  auto clear = [&node](PinnedNode::ChildReference& reference) {
+    if (reference.node.load(std::memory_order_relaxed) == &node) {
+      reference.node.store(nullptr);
+      reference.unpinned_page_number.store(0);
+    }
+  };
+  clear(root_reference_);
+  for (auto& [page_number, pinned] : pinned_nodes_) {
+    std::ranges::for_each(pinned->children, clear);
+  }
+  for (auto& retired : retired_nodes_) {
+    std::ranges::for_each(retired->children, clear);
+  }
 
-  current_overflow_page_number_ = new_page.GetPageNumber();
+  const auto page_number = node.node.GetPageNumber();
+  auto it = pinned_nodes_.find(page_number);
+  retired_nodes_.push_back(std::move(it->second));
+  pinned_nodes_.erase(it);
+  num_retired_nodes_.store(retired_nodes_.size());
+  LOG_SEV(Debug) << "Unpinned node " << page_number << " of B-tree with root " << root_page_ << ".";
+}
 
-  auto offset = 2;
-  const auto counter_offset = static_cast<page_size_t>(root->GetHeader().GetReservedStart() + offset);
-  root->GetPage()->WriteToPage<page_number_t>(counter_offset, current_overflow_page_number_);
+void BTreeManager::releaseRetiredNodes() const {
+  std::vector<std::unique_ptr<PinnedNode>> released;
+  {
+    std::lock_guard guard(pin_lock_);
+    // The references to the retired nodes were cleared before, so searches that start now cannot reach them.
+    // Once no search is running, no search can be reading them.
+    if (num_searches_.load() != 0) {
+      return;
+    }
+    released = std::move(retired_nodes_);
+    retired_nodes_.clear();
+    num_retired_nodes_.store(0);
+  }
+  for (auto& retired : released) {
+    page_cache_.UnpinPage(std::move(retired->node.GetPage()), *this);
+  }
+}
 
-  return current_overflow_page_number_;
+BTreeManager::WriteGuard::WriteGuard(const BTreeManager& manager)
+    : manager_(manager)
+    , tuning_(manager.GetTuning())
+    , previous_(current()) {
+  current() = this;
 }
 
-page_number_t BTreeManager::getCurrentOverflowPage() {
-  if (current_overflow_page_number_ == 0) {
-    // No overflow page was created yet, get a new one.
-    current_overflow_page_number_ = getNextOverflowPage();
+BTreeManager::WriteGuard::~WriteGuard() {
+  // Unlocking moves the latches to new versions, so searches that read the nodes during the write restart.
+  for (auto index : latches_) {
+    manager_.node_latches_[index].Unlock();
   }
-  return current_overflow_page_number_;
+  current() = previous_;
 }
 
-primary_key_t BTreeManager::getNextOverflowEntryNumber() {
-  auto root = loadNodePage(root_page_);
+bool BTreeManager::WriteGuard::TryLock(page_number_t page_number, uint64_t version) {
+  const auto index = page_number % NUM_NODE_LATCHES;
+  if (std::ranges::find(latches_, index) != latches_.end()) {
+    // The write changed the latch's version itself, so the version cannot be checked. Nodes are only locked
+    // at a version before any other node is locked.
+    return true;
+  }
+  if (!manager_.node_latches_[index].TryLock(version)) {
+    return false;
+  }
+  latches_.push_back(index);
+  return true;
+}
 
-  ++next_overflow_entry_number_;
+bool BTreeManager::WriteGuard::TryLock(page_number_t page_number) {
+  const auto index = page_number % NUM_NODE_LATCHES;
+  if (std::ranges::find(latches_, index) != latches_.end()) {
+    return true;
+  }
+  if (!manager_.node_latches_[index].TryLock()) {
+    return false;
+  }
+  latches_.push_back(index);
+  return true;
+}
 
-  // Next overflow entry is stored right after the flags.
-  auto offset = 2 + sizeof(primary_key_t);
-  const auto counter_offset = static_cast<page_size_t>(root->GetHeader().GetReservedStart() + offset);
-  root->GetPage()->WriteToPage<page_number_t>(counter_offset, next_overflow_entry_number_);
+void BTreeManager::WriteGuard::LockEntryCounts() {
+  entry_count_guard_ = std::unique_lock(manager_.entry_count_lock_);
+}
 
-  return next_overflow_entry_number_ - 1;
+bool BTreeManager::WriteGuard::CanChange(page_number_t page_number) const noexcept {
+  return std::ranges::find(latches_, page_number % NUM_NODE_LATCHES) != latches_.end()
+      || std::ranges::find(new_nodes_, page_number) != new_nodes_.end();
 }
 
-BTreeNodeMap BTreeManager::newNodePage(BTreePageType type, page_size_t reserved_space) const {
-  BTreeNodeMap node(page_cache_.GetNewPage());
-  // Set the comparison and string debug functions. These are a B-tree property, not stored per-page.
-  node.cmp_ = cmp_;
-  node.debug_key_func_ = debug_key_func_;
+void BTreeManager::WriteGuard::AddNewNode(page_number_t page_number) {
+  new_nodes_.push_back(page_number);
+}
 
-  if (type == BTreePageType::OverflowPage) {
-    node.GetHeader().InitializeOverflowPage(node.GetPageNumber());
-  }
-  else {
-    node.GetHeader().InitializePage(node.GetPageNumber(), type, reserved_space);
+BTreeManager::WriteGuard* BTreeManager::WriteGuard::GetCurrent(const BTreeManager& manager) noexcept {
+  auto write = current();
+  while (write && &write->manager_ != &manager) {
+    write = write->previous_;
   }
-  return node;
+  return write;
 }
 
-std::optional<BTreeNodeMap> BTreeManager::loadNodePage(page_number_t page_number) const {
-  BTreeNodeMap node(page_cache_.GetPage(page_number));
-
-  // Set the comparison and string debug functions. These are a B-tree property, not stored per-page.
-  node.cmp_ = cmp_;
-  node.debug_key_func_ = debug_key_func_;
+BTreeManager::WriteGuard*& BTreeManager::WriteGuard::current() noexcept {
+  thread_local WriteGuard* current_write = nullptr;
+  return current_write;
+}
 
-  auto&& header = node.GetHeader();
+OptimisticLatch& BTreeManager::getLatch(page_number_t page_number) const noexcept {
+  return node_latches_[page_number % NUM_NODE_LATCHES];
+}
 
-  // Make sure the magic number is correct. This is an assert, because if it's not correct, something is
-  // very wrong with the database itself.
-  NOSQL_ASSERT(
-      header.GetMagicNumber() == ToUInt64("NOSQLBTR") || header.GetMagicNumber() == ToUInt64("OVERFLOW"),
-      "invalid magic number in page " << page_number << " expected " << ToUInt64("NOSQLBTR") << ", got "
-                                      << header.GetMagicNumber());
-  // Another sanity check.
-  NOSQL_ASSERT(header.GetPageNumber() == page_number,
-               "page number mismatch, expected " << page_number << ", got " << header.GetPageNumber());
-  NOSQL_ASSERT(
-      !header.IsPointersPage() || header.GetAdditionalData() != 0,
-      "page " << page_number << " is a pointers page with no additional data, there must be a right pointer");
+void BTreeManager::checkCanChange(page_number_t page_number) const {
+  const auto write = WriteGuard::GetCurrent(*this);
+  NOSQL_ASSERT(write && write->CanChange(page_number),
+               "node " << page_number << " can only be changed by a write that holds its latch");
+}
 
-  return node;
+void BTreeManager::unpinNodes() {
+  // No searches run while the tree is destroyed.
+  std::vector<std::unique_ptr<PinnedNode>> nodes;
+  {
+    std::lock_guard guard(pin_lock_);
+    root_reference_.node = nullptr;
+    nodes = std::move(retired_nodes_);
+    retired_nodes_.clear();
+    num_retired_nodes_ = 0;
+    for (auto& [page_number, pinned] : pinned_nodes_) {
+      nodes.push_back(std::move(pinned));
+    }
+    pinned_nodes_.clear();
+  }
+  for (auto& node : nodes) {
+    page_cache_.UnpinPage(std::move(node->node.GetPage()), *this);
+  }
 }
 
 bool BTreeManager::addElementToNode(BTreeNodeMap& node_map, const StoreData& data, bool unique_keys) {
   auto header = node_map.GetHeader();
   auto is_overflow_page = header.IsOverflowPage();
+  // Overflow pages are guarded by the overflow lock instead of their latches.
+  if (!is_overflow_page) {
+    checkCanChange(node_map.GetPageNumber());
+  }
   LOG_SEV(Debug) << "Adding element with pk = " << debugKey(data.key) << " to page "
                  << node_map.GetPageNumber() << ", unique-keys = " << unique_keys << ".";
 
@@ -390,7 +1461,7 @@ bool BTreeManager::addElementToNode(BTreeNodeMap& node_map, const StoreData& dat
   // Check if there is enough free space to add the data.
   // Must store:
   // ============ Pointer space ============
-  // Offset to value: sizeof(page_size_t)
+  // Offset to value and key hint: POINTER_SLOT_SIZE
   // ============   Cell space  ============
   // [flags: 1 byte]
   // [Key size: 2 bytes]? [Key: 8 bytes | variable]
@@ -399,21 +1470,26 @@ bool BTreeManager::addElementToNode(BTreeNodeMap& node_map, const StoreData& dat
   // [Entry data: Entry size bytes]
   // =======================================
 
-  if (unique_keys && !isUniqueKey(node_map, data)) {
+  // Find the index where the new pointer goes, unless the search that found the node already did.
+  const auto insertion_index = data.lower_bound ? *data.lower_bound : [&] {
+    const auto lower_bound = node_map.getCellLowerBoundByPK(data.key);
+    return lower_bound ? lower_bound->second : node_map.GetNumPointers();
+  }();
+  if (unique_keys && !isUniqueKey(node_map, data.key, insertion_index)) {
     return false;
   }
 
-  // Store the current greatest key, so after we add a key, we can check if we need to sort the page.
-  auto greatest_pk = node_map.GetLargestKey();
-
   // Given the current free space and the space needed for the pointer and the other parts of the cell, what
   // is the maximum amount of space available for the entry (not counting any page entry space restrictions).
   auto space_requirements = node_map.CalculateSpaceRequirements(data.key);
   auto maximum_available_space_for_entry = space_requirements.max_entry_space;
   // If this is an overflow page, there is no maximum entry size.
-  auto page_max_entry_size = is_overflow_page ? std::numeric_limits<page_size_t>::max() : max_entry_size_;
+  auto page_max_entry_size =
+      is_overflow_page ? std::numeric_limits<page_size_t>::max()
+                       : WriteGuard::GetCurrent(*this)->GetTuning().max_entry_size;
   auto maximum_entry_size = std::min(page_max_entry_size, maximum_available_space_for_entry);
-  auto entry_size = entry_creator.GetRequestedSize(maximum_entry_size);
+  // Entries that would fill at least a page of overflow pages are stored in blob pages.
+  auto entry_size = entry_creator.GetRequestedSize(maximum_entry_size, node_map.GetPage()->GetPageSize());
 
   LOG_SEV(Trace) << "Entry creator requested " << entry_size
                  << " bytes of space, maximum available space was " << maximum_available_space_for_entry
@@ -425,20 +1501,45 @@ bool BTreeManager::addElementToNode(BTreeNodeMap& node_map, const StoreData& dat
   LOG_SEV(Trace) << "Entry will take up " << pointer_space << " bytes of pointer space and " << cell_space
                  << " bytes of cell space, for a total of " << required_space << " bytes.";
 
-  // Sanity check.
-  if (auto defragmented_space = header.GetDefragmentedFreeSpace(); defragmented_space < required_space) {
+  // Sanity check. Space in holes counts, since the node can be vacuumed.
+  if (auto free_space = header.GetTotalFreeSpace();
+      free_space < required_space + space_requirements.prefix_shrink_space)
+  {
     LOG_SEV(Trace) << "Not enough space to add element to node " << node_map.GetPageNumber()
-                   << ", required space was " << required_space << ", defragmented space was "
-                   << defragmented_space << "." << lightning::NewLineIndent
-                   << "Page number: " << header.GetPageNumber();
+                   << ", required space was " << required_space << ", free space was " << free_space << "."
+                   << lightning::NewLineIndent << "Page number: " << header.GetPageNumber();
     return false;
   }
 
-  auto entry_end_offset = header.GetFreeEnd();
+  // If the key does not start with the page's key prefix, shorten the prefix to the part the key shares.
+  if (const auto shared_prefix_size = node_map.getSharedPrefixSize(data.key);
+      shared_prefix_size < header.GetKeyPrefixSize())
+  {
+    LOG_SEV(Trace) << "Key does not start with the key prefix of page " << node_map.GetPageNumber()
+                   << ", shortening the prefix from " << header.GetKeyPrefixSize() << " to "
+                   << shared_prefix_size << " bytes.";
+    rebuildWithPrefix(node_map, data.key.first(shared_prefix_size));
+  }
+
+  // Find space for the cell. Use the de-fragmented free space if it has room, then the freeblocks (as long as
+  // there is still room for the pointer). If neither has room, vacuum the node to make all the free space
+  // contiguous.
+  std::optional<page_size_t> freeblock_offset;
+  if (header.GetDefragmentedFreeSpace() < required_space) {
+    if (pointer_space <= header.GetDefragmentedFreeSpace()) {
+      freeblock_offset = node_map.allocateFromFreeblocks(static_cast<page_size_t>(cell_space));
+    }
+    if (!freeblock_offset) {
+      vacuum(node_map);
+    }
+  }
+
   // Cell needs cell_space bytes.
-  auto entry_start_offset = entry_end_offset - cell_space;
+  const auto entry_start_offset =
+      freeblock_offset ? *freeblock_offset : static_cast<page_size_t>(header.GetFreeEnd() - cell_space);
+  auto entry_end_offset = entry_start_offset + cell_space;
 
-  auto offset = static_cast<page_size_t>(entry_start_offset);
+  auto offset = entry_start_offset;
   LOG_SEV(Trace) << "Starting to write cell at offset " << offset << ".";
 
   // =======================================
@@ -450,8 +1551,9 @@ bool BTreeManager::addElementToNode(BTreeNodeMap& node_map, const StoreData& dat
   // Write the flags.
   offset = writeFlags(*page, header, entry_creator, offset);
 
-  // Write the key.
-  offset = writeKey(*page, header, offset, data.key);
+  // Write the key, without the page's key prefix.
+  const auto key_suffix = data.key.subspan(header.GetKeyPrefixSize());
+  offset = writeKey(*page, header, offset, key_suffix);
 
   // Ask the EntryCreator to create the entry itself at the given offset.
   LOG_SEV(Trace) << "Creating entry at offset " << offset << " on page " << page->GetPageNumber() << ".";
@@ -463,18 +1565,13 @@ bool BTreeManager::addElementToNode(BTreeNodeMap& node_map, const StoreData& dat
                    << header.GetPageNumber() << ", expected " << cell_space << " bytes, wrote "
                    << (offset - entry_start_offset) << " bytes");
 
-  // The cell has been added, update the page header to indicate that the cell is there.
-  header.SetFreeEnd(static_cast<page_size_t>(header.GetFreeEnd() - cell_space));
-  page->WriteToPage(header.GetFreeStart(), header.GetFreeEnd());
-  header.SetFreeBegin(header.GetFreeStart() + sizeof(page_size_t));
-
-  // Make sure keys are all in ascending order. Only need to do this if the keys are not already sorted
-  // (i.e. this was not a rightmost append).
-  if (greatest_pk && cmp_(data.key, *greatest_pk)) {
-    LOG_SEV(Debug) << "New key is not the largest key, sorting keys in node " << header.GetPageNumber()
-                   << ".";
-    node_map.sortKeys();
+  // The cell has been added, update the page header to indicate that the cell is there, and add the pointer
+  // in key order.
+  if (!freeblock_offset) {
+    header.SetFreeEnd(entry_start_offset);
   }
+  node_map.insertSlot(insertion_index, {entry_start_offset, node_map.getKeyHint(key_suffix)});
+  recordInsert(node_map.GetPageNumber(), insertion_index);
 
   return true;
 }
@@ -483,6 +1580,8 @@ void BTreeManager::splitNode(BTreeNodeMap& node,
                              SearchResult& result,
                              std::optional<std::reference_wrapper<StoreData>> data) {
   LOG_SEV(Debug) << "Splitting node on page " << node.GetPageNumber() << ".";
+  checkCanChange(node.GetPageNumber());
+
   if (node.GetHeader().IsRootPage()) {
     LOG_SEV(Trace) << "  * Splitting root node.";
     splitRoot(data);
@@ -503,23 +1602,35 @@ void BTreeManager::splitNode(BTreeNodeMap& node,
   auto parent = loadNodePage(parent_page_number);
   NOSQL_ASSERT(parent, "could not find parent node");
 
+  // The node's pointer in the parent now only leads to the entries that stayed in the node. If it is the
+  // parent's rightmost pointer, it has no entry count.
+  if (const auto index = result.path.Top()->get().second; index < parent->GetNumPointers()) {
+    const auto cell = std::get<PointersNodeCell>(parent->getNthCell(index));
+    NOSQL_ASSERT(cell.page_number == node.GetPageNumber(),
+                 "pointer " << index << " in page " << parent_page_number << " should point to page "
+                            << node.GetPageNumber() << ", not page " << cell.page_number);
+    setEntryCount(*parent, index, cell.num_entries - split_data.left_num_entries);
+  }
+
   // Create the data store specification.
 
-  auto entry_creator = internal::MakeSizelessCreator<internal::SpanPayloadSerializer>(
-      internal::SpanValue(split_data.left_page));
+  const std::array<uint64_t, 2> pointer_value {split_data.left_page, split_data.left_num_entries};
+  auto entry_creator =
+      internal::MakeSizelessCreator<internal::SpanPayloadSerializer>(internal::SpanValue(pointer_value));
   StoreData store_data {.key = split_data.split_key,
                         .entry_creator = &entry_creator,
                         .serialize_key_size = serialize_key_size_,
                         .serialize_data_size = false};
 
   // Need to make sure there is enough space in the parent node.
+  const auto& tuning = WriteGuard::GetCurrent(*this)->GetTuning();
   const auto space_requirements = parent->CalculateSpaceRequirements(store_data.key);
-  auto maximum_entry_size = std::min(max_entry_size_, space_requirements.max_entry_space);
+  auto maximum_entry_size = std::min(tuning.max_entry_size, space_requirements.max_entry_space);
 
-  if (max_entries_per_page_ <= parent->GetHeader().GetNumPointers()) {
+  if (tuning.max_entries_per_page <= parent->GetHeader().GetNumPointers()) {
     // If the entry is too large to fit in the parent, we have to split the parent.
     LOG_SEV(Trace) << "  * Parent node " << parent_page_number
-                   << " cannot store another entry (has max allowed, " << max_entries_per_page_
+                   << " cannot store another entry (has max allowed, " << tuning.max_entries_per_page
                    << "), splitting.";
     splitNode(*parent, result, store_data);
   }
@@ -541,14 +1652,6 @@ void BTreeManager::splitNode(BTreeNodeMap& node,
 
 SplitPage BTreeManager::splitSingleNode(BTreeNodeMap& node,
                                         std::optional<std::reference_wrapper<StoreData>> data) {
-  // Balanced split: create a new page, move half of the elements to the new page.
-  // Unbalanced split: move all, or almost all, elements to the new page. Most efficient for adding
-  //                   consecutive keys.
-
-  // If the key type is UInt64, we are using auto-incrementing primary keys (this is the assumption for now,
-  // at least), so we should not do a balanced split.
-  bool do_balanced_split = key_type_ != DataTypeEnum::UInt64;
-
   auto&& header = node.GetHeader();
   LOG_SEV(Debug) << "Splitting node on page " << node.GetPageNumber() << " with " << node.GetNumPointers()
                  << " pointers.";
@@ -558,83 +1661,79 @@ SplitPage BTreeManager::splitSingleNode(BTreeNodeMap& node,
 
   SplitPage return_data {.left_page = new_node.GetPageNumber(), .right_page = node.GetPageNumber()};
 
+  // The new (left) leaf goes in between the original leaf and its left neighbor in the sibling links.
+  if (!node.IsPointersPage()) {
+    const auto left_neighbor = header.GetLeftSibling();
+    auto new_header = new_node.GetHeader();
+    new_header.SetLeftSibling(left_neighbor);
+    new_header.SetRightSibling(node.GetPageNumber());
+    header.SetLeftSibling(new_node.GetPageNumber());
+    if (left_neighbor != 0) {
+      checkCanChange(left_neighbor);
+      loadNodePage(left_neighbor)->GetHeader().SetRightSibling(new_node.GetPageNumber());
+    }
+  }
+
   // Divide elements between the two nodes.
   page_size_t num_elements = node.GetNumPointers();
-  page_size_t num_elements_to_move = do_balanced_split ? num_elements / 2 : num_elements - 1;
-
-  // Interior node.
-  auto pointers = node.getPointers();
+  const auto incoming_key = data ? std::make_optional(data->get().key) : std::nullopt;
+  page_size_t num_elements_to_move = chooseSplitPoint(node, incoming_key);
+  // If the incoming key does not start with the node's key prefix, it is smaller or larger than every key in
+  // the node. Split right next to it, so the node it goes to only holds one other key, and the other node
+  // keeps (at least) the original key prefix.
+  if (data && 2 <= num_elements && node.getSharedPrefixSize(data->get().key) < header.GetKeyPrefixSize()) {
+    num_elements_to_move =
+        node.compareToNthKey(data->get().key, 0) == std::weak_ordering::less ? 1 : num_elements - 1;
+  }
 
   // Get the split key.
+  uint64_t rightmost_num_entries = 0;
   if (node.IsPointersPage()) {
     // New rightmost pointer for the left cell is the rightmost pointer. This used to be in a cell, now we
     // move it to be the rightmost pointer. The value that this cell corresponded to will be bubbled up to be
     // the split value in the parent.
-    auto pointers_cell =
-        std::get<PointersNodeCell>(node.getCell(pointers[static_cast<uint64_t>(num_elements_to_move - 1)]));
+    auto pointers_cell = std::get<PointersNodeCell>(node.getNthCell(num_elements_to_move - 1));
     new_node.GetHeader().SetAdditionalData(pointers_cell.page_number);  // TODO: WriteToPage.
-
-    return_data.SetKey(pointers_cell.key);
+    rightmost_num_entries = pointers_cell.num_entries;
+  }
+  if (node.IsPointersPage()) {
+    // The key of the cell whose pointer became the rightmost pointer is already a separator, and the smallest
+    // key in the right subtree is not known, so it has to be pushed up as is.
+    return_data.SetKey(node.getFullKeyForNthCell(num_elements_to_move - 1));
   }
   else {
-    auto data_cell =
-        std::get<DataNodeCell>(node.getCell(pointers[static_cast<uint64_t>(num_elements_to_move - 1)]));
-    return_data.SetKey(data_cell.key);
+    return_data.SetKey(chooseSeparator(node.getFullKeyForNthCell(num_elements_to_move - 1),
+                                       node.getFullKeyForNthCell(num_elements_to_move)));
   }
   LOG_SEV(Trace) << "Split key will be " << debugKey(return_data.split_key) << ".";
 
-  // Move the low nodes to the new node.
-  // That way, we can just add the new node with the split key as a single cell to the parent.
-  // We do not have to do anything special about the right page, because if it was the rightmost page, it
-  // stays the rightmost page, and otherwise, it's cell is still valid.
-  for (auto i = 0; i < num_elements_to_move; ++i) {
-    auto cell = node.getCell(pointers[static_cast<uint64_t>(i)]);
-
-    std::visit(
-        [&new_node, this]<typename Node_t>(const Node_t& cell) {
-          using T = std::decay_t<Node_t>;
-          StoreData store_data {.key = cell.key, .serialize_key_size = serialize_key_size_};
-          if constexpr (std::is_same_v<T, PointersNodeCell>) {
-            auto creator = internal::MakeSizelessCreator<internal::SpanPayloadSerializer>(
-                internal::SpanValue(cell.page_number));
-            store_data.entry_creator = &creator;
-            store_data.serialize_data_size = false;
-            addElementToNode(new_node, store_data);
-          }
-          else if constexpr (std::is_same_v<T, DataNodeCell>) {
-            // Note: We only need to copy literally the entry in the page. In particular, it does not matter
-            //       if the entry is the header for an overflow page.
-            //       Use the entry copier, so we copy the correct flags.
-            internal::EntryCopier creator(cell.flags, cell.SpanValue());
-            store_data.entry_creator = &creator;
-
-            store_data.serialize_data_size = true;
-            addElementToNode(new_node, store_data);
-          }
-          else {
-            static_assert(lightning::typetraits::always_false_v<T>, "unhandled case");
-          }
-        },
-        cell);
-  }
-
-  // =======================================
-  //  Compress the pointers in the original node.
-  // =======================================
-
-  // Span of the offsets to elements that were not moved to the next page.
-
-  std::span remaining_pointers(pointers.data() + num_elements_to_move,
-                               pointers.size() - num_elements_to_move);
-  std::vector<page_size_t> pointers_copy(remaining_pointers.size());
-  std::ranges::copy(remaining_pointers, pointers_copy.begin());
-  // Span for the vector
-  remaining_pointers = pointers_copy;
-  node.GetPage()->WriteToPage(header.GetPointersStart(), remaining_pointers);
-
-  // "Free" the rightmost num_elements_to_move pointers in the original node.
-  // TODO: Create a linked list of blocks of newly freed space?
-  header.SetFreeBegin(header.GetFreeStart() - (num_elements_to_move * sizeof(page_size_t)));
+  // For interior nodes, the pointer of the last cell that moves became the new node's rightmost pointer.
+  const page_size_t num_cells_to_move =
+      node.IsPointersPage() ? num_elements_to_move - 1 : num_elements_to_move;
+  const bool add_data_to_new_node = data && lte(data->get().key, return_data.split_key);
+
+  // Move the low cells to the new node, giving it the longest key prefix its keys (and the incoming key, if
+  // it goes there) share. That way, we can just add the new node with the split key as a single cell to the
+  // parent. We do not have to do anything special about the right page, because if it was the rightmost page,
+  // it stays the rightmost page, and otherwise, it's cell is still valid.
+  copyCells(node,
+            0,
+            num_cells_to_move,
+            new_node,
+            chooseSplitPrefix(
+                node, 0, num_cells_to_move, add_data_to_new_node ? incoming_key : std::nullopt));
+
+  // Rewrite the original node with only the cells that were not moved. Its key prefix has to account for the
+  // data that will be added to it, if any. This also compacts the node.
+  const auto num_remaining = static_cast<page_size_t>(num_elements - num_elements_to_move);
+  copyCells(node,
+            num_elements_to_move,
+            num_remaining,
+            node,
+            chooseSplitPrefix(node,
+                              num_elements_to_move,
+                              num_remaining,
+                              add_data_to_new_node ? std::nullopt : incoming_key));
 
   // =======================================
   // Potentially add data.
@@ -643,15 +1742,16 @@ SplitPage BTreeManager::splitSingleNode(BTreeNodeMap& node,
   if (data) {
     auto& data_ref = data->get();
     LOG_SEV(Trace) << "Data requested to be added to a node, pk = " << debugKey(data_ref.key) << ".";
-    auto& node_to_add_to = lte(data_ref.key, return_data.split_key) ? new_node : node;
-    addElementToNode(node_to_add_to, *data);
+    auto& node_to_add_to = add_data_to_new_node ? new_node : node;
+    continueInsertRun(node.GetPageNumber(), node_to_add_to, data_ref.key);
+    // The entry counts along the path already include this entry, so it has to fit in the split node.
+    const bool added = addElementToNode(node_to_add_to, *data);
+    NOSQL_REQUIRE(added,
+                  "could not add element with pk " << debugKey(data_ref.key) << " to node "
+                                                   << node_to_add_to.GetPageNumber()
+                                                   << " after splitting it");
   }
-
-  // =======================================
-  // Write back node and new node.
-  // =======================================
-
-  vacuum(node);
+  return_data.left_num_entries = countEntries(new_node, rightmost_num_entries);
 
   LOG_SEV(Trace) << "  * After split, original node (on page " << node.GetPageNumber() << ") has "
                  << node.GetDefragmentedFreeSpace() << " bytes of de-fragmented free space.";
@@ -676,10 +1776,7 @@ SplitPage BTreeManager::splitSingleNode(BTreeNodeMap& node,
 
 void BTreeManager::splitRoot(std::optional<std::reference_wrapper<StoreData>> data) {
   LOG_SEV(Debug) << "Splitting root node.";
-
-  // If the key type is UInt64, we are using auto-incrementing primary keys (this is the assumption for now,
-  // at least), so we should not do a balanced split.
-  bool do_balanced_split = key_type_ != DataTypeEnum::UInt64;
+  checkCanChange(root_page_);
 
   // Create two child pages, spit the nodes between them.
   auto root = loadNodePage(root_page_);
@@ -698,52 +1795,63 @@ void BTreeManager::splitRoot(std::optional<std::reference_wrapper<StoreData>> da
   LOG_SEV(Trace) << "Created left and right children with page numbers " << left_page_number << " and "
                  << right_page_number << ".";
 
-  // Balanced or unbalanced split.
-  page_size_t num_for_left = do_balanced_split ? root->GetNumPointers() / 2 : root->GetNumPointers() - 1;
-  auto split_key = root->getKeyForNthCell(num_for_left);
+  // Link the children if they are leaves. The root has no siblings, so they have no other neighbors.
+  if (child_type == BTreePageType::Leaf) {
+    left_child.GetHeader().SetRightSibling(right_page_number);
+    right_child.GetHeader().SetLeftSibling(left_page_number);
+  }
+
+  // The left child gets the cells before the split point (for interior nodes, the last of them becomes its
+  // rightmost pointer).
+  const page_size_t num_elements = root->GetNumPointers();
+  const auto incoming_key = data ? std::make_optional(data->get().key) : std::nullopt;
+  page_size_t num_for_left = chooseSplitPoint(*root, incoming_key) - 1;
+  // If the incoming key does not start with the root's key prefix, it is smaller or larger than every key in
+  // the root. Split right next to it, like in splitSingleNode.
+  if (data && 2 <= num_elements
+      && root->getSharedPrefixSize(data->get().key) < root_header.GetKeyPrefixSize())
+  {
+    num_for_left =
+        root->compareToNthKey(data->get().key, 0) == std::weak_ordering::less ? 0 : num_elements - 2;
+  }
+  // Copy the split key, since the root page will be cleared.
+  auto split_key = root->getFullKeyForNthCell(num_for_left);
+  // If the children are leaves, any key between the largest key of the left child and the smallest key of
+  // the right child can be the split key.
+  if (!root->IsPointersPage() && num_for_left + 1 < num_elements) {
+    split_key = chooseSeparator(split_key, root->getFullKeyForNthCell(num_for_left + 1));
+  }
   LOG_SEV(Trace) << "Split key will be " << debugKey(split_key) << ".";
 
-  for (page_size_t i = 0; i < root->GetNumPointers(); ++i) {
-    auto nth_cell = root->getNthCell(i);
-    auto& node_to_add_to = i <= num_for_left ? left_child : right_child;
-    std::visit(
-        [&]<typename Cell_t>(Cell_t&& cell) {
-          StoreData store_data {.key = cell.key, .serialize_key_size = serialize_key_size_};
-
-          using T = std::decay_t<Cell_t>;
-          if constexpr (std::is_same_v<T, PointersNodeCell>) {
-            if (i == num_for_left) {
-              // Add this page as the rightmost pointer.
-              node_to_add_to.GetHeader().SetAdditionalData(cell.page_number);
-              LOG_SEV(Trace) << "Setting the rightmost pointer in the right child (P"
-                             << node_to_add_to.GetPageNumber() << ") to " << cell.page_number << ".";
-            }
-            else {
-              auto creator = internal::MakeSizelessCreator<internal::SpanPayloadSerializer>(
-                  internal::SpanValue(cell.page_number));
-              store_data.entry_creator = &creator;
-              store_data.serialize_data_size = false;
-              NOSQL_ASSERT(addElementToNode(node_to_add_to, store_data),
-                           "we should be able to add to this cell");
-            }
-          }
-          else if constexpr (std::is_same_v<T, DataNodeCell>) {
-            // Note: We only need to copy literally the entry in the page. In particular, it does not matter
-            //       if the entry is the header for an overflow page.
-            //       Use the entry copier, so we copy the correct flags.
-            auto creator = internal::EntryCopier(cell.flags, cell.SpanValue());
-            store_data.entry_creator = &creator;
-            store_data.serialize_data_size = true;
-            NOSQL_ASSERT(addElementToNode(node_to_add_to, store_data),
-                         "we should be able to add to this cell");
-          }
-          else {
-            static_assert(lightning::typetraits::always_false_v<T>, "unhandled case");
-          }
-        },
-        nth_cell);
+  // For interior nodes, the pointer of the split cell becomes the left child's rightmost pointer.
+  const page_size_t num_cells_for_left = root->IsPointersPage() ? num_for_left : num_for_left + 1;
+  uint64_t left_rightmost_num_entries = 0;
+  if (root->IsPointersPage()) {
+    const auto split_cell = std::get<PointersNodeCell>(root->getNthCell(num_for_left));
+    left_child.GetHeader().SetAdditionalData(split_cell.page_number);
+    left_rightmost_num_entries = split_cell.num_entries;
+    LOG_SEV(Trace) << "Setting the rightmost pointer in the left child (P" << left_page_number << ") to "
+                   << split_cell.page_number << ".";
   }
 
+  // Copy the cells to the children, giving each the longest key prefix its keys share, accounting for the
+  // data that will be added to them, if any.
+  const bool add_data_to_left = data && lte(data->get().key, split_key);
+  const auto num_cells_for_right = static_cast<page_size_t>(num_elements - num_for_left - 1);
+  copyCells(*root,
+            0,
+            num_cells_for_left,
+            left_child,
+            chooseSplitPrefix(*root, 0, num_cells_for_left, add_data_to_left ? incoming_key : std::nullopt));
+  copyCells(*root,
+            num_for_left + 1,
+            num_cells_for_right,
+            right_child,
+            chooseSplitPrefix(*root,
+                              num_for_left + 1,
+                              num_cells_for_right,
+                              add_data_to_left ? std::nullopt : incoming_key));
+
   // If the root was a pointers page, we need to set the rightmost pointer in the root to the right child.
   if (root_header.IsPointersPage()) {
     right_child.GetHeader().SetAdditionalData(root_header.GetAdditionalData());
@@ -755,161 +1863,672 @@ void BTreeManager::splitRoot(std::optional<std::reference_wrapper<StoreData>> da
   if (data) {
     const auto& data_ref = data->get();
     LOG_SEV(Trace) << "Data requested to be added to a node, pk = " << debugKey(data_ref.key) << ".";
-    auto& node_to_add_to = lte(data_ref.key, split_key) ? left_child : right_child;
+    auto& node_to_add_to = add_data_to_left ? left_child : right_child;
+    continueInsertRun(root_page_, node_to_add_to, data_ref.key);
     // Only store the size of the root was NOT a pointers page (meaning we expect data to be stored, not
     // pointers).
-    addElementToNode(node_to_add_to, *data, !root->IsPointersPage());
+    const bool added = addElementToNode(node_to_add_to, *data, !root->IsPointersPage());
+    NOSQL_REQUIRE(added,
+                  "could not add element with pk " << debugKey(data_ref.key) << " to node "
+                                                   << node_to_add_to.GetPageNumber()
+                                                   << " after splitting the root");
     LOG_SEV(Debug) << "Added the data to node on page " << node_to_add_to.GetPageNumber() << ".";
   }
+  const auto left_num_entries = countEntries(left_child, left_rightmost_num_entries);
 
   // Clear the entire root page.
   root_header.SetFreeBegin(root_header.GetPointersStart());
+  root_header.SetKeyPrefix({});
   root_header.SetFreeEnd(root_header.GetReservedStart());
+  root_header.SetFirstFreeblock(0);
+  root_header.SetFragmentedFreeSpace(0);
 
-  // Set the root page to be a pointers page.
+  // Set the root page to be a pointers page. Its insert history was for its old entries.
   root_header.SetFlags(root_header.GetFlags() | 0b1);
+  setInsertHistory({.page_number = root_page_});
 
   // Add the two child pages to the root page, which is a pointers page (so we don't serialize the data size).
+  const std::array<uint64_t, 2> pointer_value {left_page_number, left_num_entries};
   auto entry_creator =
-      internal::MakeSizelessCreator<internal::SpanPayloadSerializer>(internal::SpanValue(left_page_number));
+      internal::MakeSizelessCreator<internal::SpanPayloadSerializer>(internal::SpanValue(pointer_value));
   StoreData store_data {.key = split_key,
                         .entry_creator = &entry_creator,
                         .serialize_key_size = serialize_key_size_,
                         .serialize_data_size = false};
-  addElementToNode(*root, store_data);
+  const bool added = addElementToNode(*root, store_data);
+  NOSQL_REQUIRE(added, "could not add the pointer to the left child to the root, page " << root_page_);
   // The right page is the "rightmost" pointer.
   root_header.SetAdditionalData(right_page_number);
   LOG_SEV(Trace) << "Set the rightmost pointer in the root node to " << right_page_number << ".";
 }
 
-void BTreeManager::vacuum(BTreeNodeMap& node) const {
-  // TODO: This is not actually a hard requirement, but I need to write the fallback.
-  NOSQL_REQUIRE(node.GetNumPointers() < 256,
-                "vacuuming not implemented for nodes with more than 256 pointers");
+void BTreeManager::addToEntryCounts(const TreePosition& path, int64_t delta) {
+  // The top of the path is the leaf.
+  for (std::size_t i = 0; i + 1 < path.Size(); ++i) {
+    const auto [page_number, index] = *path[i];
+    auto node = loadNodePage(page_number);
+    if (index < node->GetNumPointers()) {
+      const auto cell = std::get<PointersNodeCell>(node->getNthCell(index));
+      setEntryCount(*node, index, cell.num_entries + delta);
+    }
+  }
+}
+
+void BTreeManager::setEntryCount(BTreeNodeMap& node, page_size_t index, uint64_t num_entries) const {
+  const auto cell_offset = node.getCellOffsetByIndex(index);
+  const auto cell = std::get<PointersNodeCell>(node.getCell(cell_offset));
+  // The entry count is the last part of the cell.
+  const auto count_offset = static_cast<page_size_t>(cell_offset + cell.GetCellSize() - sizeof(uint64_t));
+  node.GetPage()->WriteToPage<uint64_t>(count_offset, num_entries);
+}
+
+uint64_t BTreeManager::countEntries(const BTreeNodeMap& node, uint64_t rightmost_num_entries) const {
+  if (!node.IsPointersPage()) {
+    return node.GetNumPointers();
+  }
+  auto num_entries = rightmost_num_entries;
+  for (page_size_t i = 0; i < node.GetNumPointers(); ++i) {
+    num_entries += std::get<PointersNodeCell>(node.getNthCell(i)).num_entries;
+  }
+  return num_entries;
+}
+
+std::optional<uint64_t> BTreeManager::tryCount() const {
+  // Every entry is either in the subtree of a pointer cell on the path to the rightmost leaf, or in the
+  // rightmost leaf.
+  uint64_t num_entries = 0;
+  auto node = *loadNodePage(root_page_);
+  while (node.IsPointersPage()) {
+    num_entries += countEntries(node, 0);
+    node = *loadNodePage(node.getHeader().GetAdditionalData());
+  }
+  const auto& latch = getLatch(node.GetPageNumber());
+  const auto version = latch.TryReadLock();
+  if (!version) {
+    return {};
+  }
+  num_entries += node.GetNumPointers();
+  if (!latch.Validate(*version)) {
+    return {};
+  }
+  return num_entries;
+}
+
+std::optional<uint64_t> BTreeManager::tryCountBefore(GeneralKey key, bool inclusive) const {
+  // In each interior node, the entries before the key are in the subtrees to the left of the pointer that
+  // is followed. In the leaf, they are the cells before the first key that is greater than or equal to it.
+  uint64_t num_entries = 0;
+  auto node = *loadNodePage(root_page_);
+  while (node.IsPointersPage()) {
+    const auto [next_page_number, index] = node.searchForNextPageInPointersPage(key);
+    for (page_size_t i = 0; i < std::min<page_size_t>(index, node.GetNumPointers()); ++i) {
+      num_entries += std::get<PointersNodeCell>(node.getNthCell(i)).num_entries;
+    }
+    node = *loadNodePage(next_page_number);
+  }
+
+  const auto& latch = getLatch(node.GetPageNumber());
+  const auto version = latch.TryReadLock();
+  if (!version) {
+    return {};
+  }
+  try {
+    const auto lower_bound = node.getCellLowerBoundByPK(key);
+    const auto index = lower_bound ? lower_bound->second : node.GetNumPointers();
+    num_entries += index;
+    // The key is not checked with isUniqueKey, which is noexcept, since reading a changing leaf can throw.
+    if (inclusive && index < node.GetNumPointers()
+        && node.compareToNthKey(key, index) == std::weak_ordering::equivalent)
+    {
+      ++num_entries;
+    }
+  } catch (const std::exception&) {
+    // A leaf that is read while a writer changes it can look corrupt.
+    if (latch.Validate(*version)) {
+      throw;
+    }
+    return {};
+  }
+  if (!latch.Validate(*version)) {
+    return {};
+  }
+  return num_entries;
+}
+
+std::optional<BTreeManager::Iterator> BTreeManager::trySkip(uint64_t offset, ScanDirection direction) const {
+  // Descending iteration counts from the last entry.
+  auto position = offset;
+  if (direction == ScanDirection::Descending) {
+    const auto num_entries = tryCount();
+    if (!num_entries) {
+      return {};
+    }
+    if (*num_entries <= offset) {
+      return Iterator(*this, true);
+    }
+    position = *num_entries - 1 - offset;
+  }
 
+  // Follow the pointer whose subtree holds the entry, skipping the entries in the subtrees to its left.
+  auto node = *loadNodePage(root_page_);
+  while (node.IsPointersPage()) {
+    auto next_page = node.getHeader().GetAdditionalData();
+    for (page_size_t i = 0; i < node.GetNumPointers(); ++i) {
+      const auto cell = std::get<PointersNodeCell>(node.getNthCell(i));
+      if (position < cell.num_entries) {
+        next_page = cell.page_number;
+        break;
+      }
+      position -= cell.num_entries;
+    }
+    node = *loadNodePage(next_page);
+  }
+
+  const auto& latch = getLatch(node.GetPageNumber());
+  const auto version = latch.TryReadLock();
+  if (!version) {
+    return {};
+  }
+  Iterator it(*this, true);
+  if (position < node.GetNumPointers()) {
+    try {
+      it.key_ = node.getFullKeyForNthCell(static_cast<page_size_t>(position));
+    } catch (const std::exception&) {
+      if (latch.Validate(*version)) {
+        throw;
+      }
+      return {};
+    }
+    it.page_number_ = node.GetPageNumber();
+    it.index_ = static_cast<page_size_t>(position);
+    it.version_ = *version;
+    it.direction_ = direction;
+  }
+  if (!latch.Validate(*version)) {
+    return {};
+  }
+  return it;
+}
+
+void BTreeManager::vacuum(BTreeNodeMap& node) const {
   LOG_SEV(Debug) << "Vacuuming node on page " << node.GetPageNumber() << ". Node has "
+                 << node.GetDefragmentedFreeSpace() << " bytes of defragmented free space and "
+                 << node.GetHeader().GetFragmentedFreeSpace() << " bytes of fragmented free space.";
+
+  // Rebuilding the node with the same prefix packs the cells together at the end of the page.
+  const auto prefix = node.getKeyPrefix();
+  rebuildWithPrefix(node, std::vector(prefix.begin(), prefix.end()));
+
+  LOG_SEV(Debug) << "Finished vacuuming node on page " << node.GetPageNumber() << ". Node now has "
                  << node.GetDefragmentedFreeSpace() << " bytes of defragmented free space.";
+}
 
-  // TODO: More WAL friendly version: take a snapshot of the pointers, sort them (without going through the
-  //       WAL), then submit the sorted changes all at once.
+BTreeManager::InsertHistory BTreeManager::getInsertHistory(page_number_t page_number) const {
+  auto& entry = insert_history_[page_number % INSERT_HISTORY_SIZE];
+  std::lock_guard guard(entry.lock);
+  return entry.history.page_number == page_number ? entry.history : InsertHistory {};
+}
 
-  auto&& header = node.GetHeader();
+void BTreeManager::setInsertHistory(const InsertHistory& history) {
+  auto& entry = insert_history_[history.page_number % INSERT_HISTORY_SIZE];
+  std::lock_guard guard(entry.lock);
+  entry.history = history;
+}
 
-  auto& page = node.GetPage();
+void BTreeManager::recordInsert(page_number_t page_number, page_size_t index) {
+  auto& entry = insert_history_[page_number % INSERT_HISTORY_SIZE];
+  std::lock_guard guard(entry.lock);
+  auto& history = entry.history;
+  if (history.page_number != page_number) {
+    history = {.page_number = page_number, .last_index = index, .run = 0};
+    return;
+  }
+  if (index == static_cast<page_size_t>(history.last_index + 1)) {
+    history.run = std::max(history.run, 0) + 1;
+  }
+  else if (index == history.last_index) {
+    history.run = std::min(history.run, 0) - 1;
+  }
+  else {
+    history.run = 0;
+  }
+  history.last_index = index;
+}
 
-  std::pair<page_size_t, page_size_t> offsets[256];
-  page_size_t num_pointers = node.GetNumPointers();
-  auto pointers = node.getPointers();
-  for (page_size_t i = 0; i < num_pointers; ++i) {
-    offsets[i] = {pointers[i], i};
+void BTreeManager::continueInsertRun(page_number_t split_page_number,
+                                     BTreeNodeMap& receiving_node,
+                                     GeneralKey key) {
+  const auto history = getInsertHistory(split_page_number);
+  if (history.run == 0) {
+    return;
   }
+  // Pretend that the previous insert was next to where the key will go in the receiving node.
+  const auto lower_bound = receiving_node.getCellLowerBoundByPK(key);
+  const auto index = lower_bound ? lower_bound->second : receiving_node.GetNumPointers();
+  setInsertHistory({.page_number = receiving_node.GetPageNumber(),
+                    .last_index = static_cast<page_size_t>(0 < history.run ? index - 1 : index),
+                    .run = history.run});
+}
 
-  page_size_t next_point = header.GetReservedStart();
-  std::sort(offsets, offsets + num_pointers, std::greater {});
-  for (page_size_t i = 0; i < num_pointers; ++i) {
-    auto [offset, pointer_number] = offsets[i];
-    // Move the cell to the rightmost position possible.
-    auto cell = node.getCell(offset);
-    // Get the size of the cell.
-    auto cell_size = std::visit([](auto&& cell) { return cell.GetCellSize(); }, cell);
+page_size_t BTreeManager::chooseSplitPoint(const BTreeNodeMap& node,
+                                           std::optional<GeneralKey> incoming_key) const {
+  const auto num_elements = node.GetNumPointers();
+  NOSQL_ASSERT(2 <= num_elements,
+               "cannot split node " << node.GetPageNumber() << " with fewer than two entries");
+  const auto last_split_point = static_cast<page_size_t>(num_elements - 1);
+  const auto balanced_split_point = static_cast<page_size_t>(num_elements / 2);
+
+  const auto history = getInsertHistory(node.GetPageNumber());
+  if (!incoming_key || std::abs(history.run) < SEQUENTIAL_INSERT_RUN) {
+    return balanced_split_point;
+  }
 
-    // Adjust the next point to be at the start of where the cell must be copied.
-    next_point -= cell_size;
+  // Split where the incoming key goes. The side the inserts are moving away from will not get any more
+  // inserts, so it is kept as full as the fill factor allows.
+  const auto lower_bound = node.getCellLowerBoundByPK(*incoming_key);
+  const auto insert_index = lower_bound ? lower_bound->second : num_elements;
+  const auto num_to_keep =
+      static_cast<page_size_t>(std::ceil(GetSplitFillFactor() * static_cast<double>(num_elements)));
+  const auto split_point = 0 < history.run
+      ? std::min(insert_index, num_to_keep)
+      : std::max(insert_index, static_cast<page_size_t>(num_elements - num_to_keep));
+  LOG_SEV(Trace) << "Node " << node.GetPageNumber() << " had a run of " << std::abs(history.run)
+                 << (0 < history.run ? " ascending" : " descending") << " inserts, splitting at "
+                 << split_point << " of " << num_elements << " entries.";
+  return std::clamp(split_point, page_size_t {1}, last_split_point);
+}
 
-    LOG_SEV(Trace) << "  * Moving cell " << i << " from offset " << offset << " to offset " << next_point
-                   << " (cell size " << cell_size << ").";
+std::vector<std::byte> BTreeManager::chooseSeparator(GeneralKey left_max, GeneralKey right_min) const {
+  if (!truncate_separators_) {
+    return {left_max.begin(), left_max.end()};
+  }
+  // The shortest key that is greater than or equal to left_max and less than right_min is the prefix of
+  // right_min that goes one byte past the prefix it shares with left_max. That prefix is less than right_min
+  // unless it is all of right_min, in which case left_max itself is used.
+  const auto [left_it, right_it] = std::ranges::mismatch(left_max, right_min);
+  if (right_it == right_min.end() || right_it + 1 == right_min.end()) {
+    return {left_max.begin(), left_max.end()};
+  }
+  return {right_min.begin(), right_it + 1};
+}
 
-    // Copy the cell to the new location.
-    page->MoveInPage(offset, next_point, cell_size);
+std::vector<std::byte> BTreeManager::chooseKeyPrefix(const BTreeNodeMap& node,
+                                                     page_size_t first_index,
+                                                     page_size_t num_cells,
+                                                     std::optional<GeneralKey> incoming_key) const {
+  // A node with a single key does not get a prefix, since any other key would shorten the prefix right away.
+  std::vector<std::byte> prefix;
+  if (!compress_key_prefixes_ || num_cells + (incoming_key ? 1 : 0) < 2) {
+    return prefix;
+  }
 
-    // Update the pointer.
-    page->WriteToPage(header.GetPointersStart() + (pointer_number * sizeof(page_size_t)), next_point);
+  // Since the keys are sorted, the prefix that all the keys share is the prefix shared by the smallest and
+  // largest keys, and the incoming key.
+  prefix = incoming_key ? std::vector(incoming_key->begin(), incoming_key->end())
+                        : node.getFullKeyForNthCell(first_index);
+  auto shorten_to_shared = [&prefix](GeneralKey key) {
+    const auto [it, _] = std::ranges::mismatch(prefix, key);
+    prefix.erase(it, prefix.end());
+  };
+  if (num_cells != 0) {
+    shorten_to_shared(node.getFullKeyForNthCell(first_index));
+    shorten_to_shared(node.getFullKeyForNthCell(first_index + num_cells - 1));
   }
-  // Set the updated free-end location.
-  header.SetFreeEnd(next_point);
+  return prefix;
+}
 
-  LOG_SEV(Debug) << "Finished vacuuming node on page " << node.GetPageNumber() << ". Node now has "
-                 << node.GetDefragmentedFreeSpace() << " bytes of defragmented free space.";
+std::vector<std::byte> BTreeManager::chooseSplitPrefix(const BTreeNodeMap& node,
+                                                       page_size_t first_index,
+                                                       page_size_t num_cells,
+                                                       std::optional<GeneralKey> incoming_key) const {
+  if (incoming_key && SEQUENTIAL_INSERT_RUN <= std::abs(getInsertHistory(node.GetPageNumber()).run)) {
+    return chooseKeyPrefix(node, 0, node.GetNumPointers(), incoming_key);
+  }
+  return chooseKeyPrefix(node, first_index, num_cells, incoming_key);
 }
 
-SearchResult BTreeManager::search(GeneralKey key) const {
-  SearchResult result;
+bool BTreeManager::compressKeys(BTreeNodeMap& node, std::optional<GeneralKey> incoming_key) const {
+  if (!compress_key_prefixes_) {
+    return false;
+  }
 
-  auto node = [this] {
-    auto root = loadNodePage(root_page_);
-    NOSQL_ASSERT(root, "could not find root node");
-    return std::move(*root);
-  }();
+  const auto prefix = chooseKeyPrefix(node, 0, node.GetNumPointers(), incoming_key);
+  LOG_SEV(Trace) << "Setting key prefix of page " << node.GetPageNumber() << " to " << prefix.size()
+                 << " bytes (was " << node.GetHeader().GetKeyPrefixSize() << " bytes).";
+  rebuildWithPrefix(node, prefix);
+  return true;
+}
+
+void BTreeManager::rebuildWithPrefix(BTreeNodeMap& node, GeneralKey prefix) const {
+  // Overflow pages are vacuumed too, they are guarded by the overflow lock instead of their latches.
+  if (!node.getHeader().IsOverflowPage()) {
+    checkCanChange(node.GetPageNumber());
+  }
+  copyCells(node, 0, node.GetNumPointers(), node, prefix);
+}
+
+void BTreeManager::copyCells(const BTreeNodeMap& source,
+                             page_size_t first_index,
+                             page_size_t num_cells,
+                             BTreeNodeMap& target,
+                             GeneralKey prefix) const {
+  auto&& target_header = target.GetHeader();
+  const bool key_sizes_specified = target_header.AreKeySizesSpecified();
+  NOSQL_ASSERT(prefix.empty() || key_sizes_specified,
+               "page " << target.GetPageNumber()
+                       << " cannot have a key prefix, its key sizes are not serialized");
+  NOSQL_ASSERT(key_sizes_specified == source.getHeader().AreKeySizesSpecified(),
+               "pages " << source.GetPageNumber() << " and " << target.GetPageNumber()
+                        << " must both serialize their key sizes, or both not serialize them");
+
+  const auto& source_page = source.GetPage();
+  const auto& target_page = target.GetPage();
+  const auto page_size = target_page->GetPageSize();
+  const auto old_prefix = source.getKeyPrefix();
+  const bool same_prefix = std::ranges::equal(old_prefix, prefix);
+  const auto reserved_start = target_header.GetReservedStart();
+
+  // Build the new page in a scratch page, then write it back all at once.
+  BTreeNodeMap scratch(std::make_unique<FreestandingPage>(target.GetPageNumber(), 0, page_size));
+  auto& scratch_page = *scratch.GetPage();
+  auto scratch_header = scratch.GetHeader();
+  // Copy the fixed part of the header, then set the new prefix. The cells are packed together, so the new
+  // page has no freeblocks or fragments.
+  scratch_page.WriteToPage(0, target_page->GetSpan(0, 47));
+  scratch_header.SetFirstFreeblock(0);
+  scratch_header.SetFragmentedFreeSpace(0);
+  scratch_header.SetFreeBegin(scratch_header.GetPointersStart());
+  scratch_header.SetKeyPrefix(prefix);
+
+  page_size_t free_start = scratch_header.GetPointersStart();
+  page_size_t free_end = reserved_start;
+  std::vector<std::byte> key_suffix;
+  for (auto i = first_index; i < first_index + num_cells; ++i) {
+    const auto cell_offset = source.getCellOffsetByIndex(i);
+    const auto old_cell_size =
+        std::visit([](auto&& c) { return c.GetCellSize(); }, source.getCell(cell_offset));
+    const auto old_suffix = source.getKeyForCell(cell_offset);
+
+    // If the prefix does not change, the cell is copied as is.
+    if (same_prefix) {
+      NOSQL_ASSERT(free_start + POINTER_SLOT_SIZE + old_cell_size <= free_end,
+                   "not enough space to copy cells to page " << target.GetPageNumber());
+      free_end -= old_cell_size;
+      scratch_page.WriteToPage(free_end, source_page->GetSpan(cell_offset, old_cell_size));
+      free_start = writeSlot(scratch_page, free_start, {free_end, source.getKeyHint(old_suffix)});
+      continue;
+    }
+
+    // The new suffix is the full key (old prefix + old suffix) without the first prefix.size() bytes.
+    if (old_prefix.size() <= prefix.size()) {
+      const auto suffix = old_suffix.subspan(prefix.size() - old_prefix.size());
+      key_suffix.assign(suffix.begin(), suffix.end());
+    }
+    else {
+      key_suffix.assign(old_prefix.begin() + static_cast<std::ptrdiff_t>(prefix.size()), old_prefix.end());
+      key_suffix.insert(key_suffix.end(), old_suffix.begin(), old_suffix.end());
+    }
 
-  auto current_page_number = node.GetPageNumber();
+    // Everything after the key is copied as is.
+    const auto key_end =
+        static_cast<page_size_t>(old_suffix.data() + old_suffix.size() - source_page->GetData());
+    const auto rest = source_page->GetSpan(key_end, old_cell_size - (key_end - cell_offset));
+
+    const auto cell_size = static_cast<page_size_t>(
+        sizeof(std::byte) + (key_sizes_specified ? sizeof(uint16_t) : 0) + key_suffix.size() + rest.size());
+    NOSQL_ASSERT(free_start + POINTER_SLOT_SIZE + cell_size <= free_end,
+                 "not enough space to copy cells to page " << target.GetPageNumber()
+                                                           << " with a key prefix of " << prefix.size()
+                                                           << " bytes");
+    free_end -= cell_size;
+    auto offset = scratch_page.WriteToPage(free_end, source_page->GetSpan(cell_offset, 1));
+    offset = writeKey(scratch_page, scratch_header, offset, key_suffix);
+    scratch_page.WriteToPage(offset, rest);
+    free_start = writeSlot(scratch_page, free_start, {free_end, source.getKeyHint(key_suffix)});
+  }
+  scratch_header.SetFreeBegin(free_start);
+  scratch_header.SetFreeEnd(free_end);
+
+  // Only the header and pointers, and the cells, have to be written. What is in between is free space. The
+  // reserved space is left alone, since it is not guarded by the node's latch, e.g. the root's reserved space
+  // is written by checkpoints.
+  target_page->WriteToPage(0, scratch_page.GetSpan(0, free_start));
+  if (free_end < reserved_start) {
+    target_page->WriteToPage(free_end, scratch_page.GetSpan(free_end, reserved_start - free_end));
+  }
+}
 
-  // Loop until found. Since this is a (presumably well-formed) B-tree, this should always terminate.
+SearchResult BTreeManager::search(GeneralKey key) const {
   for (;;) {
-    if (!node.IsPointersPage()) {
-      if (auto lower_bound = node.getCellLowerBoundByPK(key)) {
-        result.path.Emplace(current_page_number, lower_bound->second);
-      }
-      else {
-        result.path.Emplace(current_page_number, node.GetNumPointers());
+    if (auto result = trySearch(key)) {
+      return std::move(*result);
+    }
+    LOG_SEV(Trace) << "A node was changed during the search for " << debugKey(key) << ", restarting.";
+  }
+}
+
+SearchResult BTreeManager::searchLast() const {
+  for (;;) {
+    if (auto result = trySearch(std::nullopt)) {
+      return std::move(*result);
+    }
+    LOG_SEV(Trace) << "A node was changed during the search for the rightmost leaf, restarting.";
+  }
+}
+
+std::optional<SearchResult> BTreeManager::trySearch(std::optional<GeneralKey> key) const {
+  // Pinned nodes that are unpinned while the search runs are only given back after it is done.
+  struct SearchCount {
+    explicit SearchCount(const BTreeManager& manager)
+        : manager(manager) {
+      manager.num_searches_.fetch_add(1);
+    }
+    ~SearchCount() {
+      if (manager.num_searches_.fetch_sub(1) == 1 && manager.num_retired_nodes_.load() != 0) {
+        manager.releaseRetiredNodes();
       }
+    }
+    const BTreeManager& manager;
+  } search_count(*this);
 
-      // Elements are allocated directly in this page.
-      result.node = std::move(node);
-      break;
+  SearchResult result;
+
+  // Writers never search while they hold latches, so every search waits for nodes that are being changed.
+  auto read_lock = [&](page_number_t page_number) { return getLatch(page_number).ReadLock(); };
+  auto validate = [&](page_number_t page_number, uint64_t version) {
+    return getLatch(page_number).Validate(version);
+  };
+
+  auto current_page_number = root_page_;
+  auto version = read_lock(current_page_number);
+  bool is_rightmost = true;
+
+  // The search follows direct references between pinned interior nodes. Only nodes that are not pinned, like
+  // the leaves, are loaded through the page cache.
+  std::optional<BTreeNodeMap> loaded;
+  try {
+    // The root is pinned once it is an interior node, so unlike other references, the reference to the root
+    // does not remember that the root could not be pinned.
+    auto pinned = root_reference_.node.load(std::memory_order_acquire);
+    if (!pinned) {
+      pinned = getPinnedNode(root_reference_, root_page_, 0, loaded);
     }
 
-    auto [next_page_number, offset] = node.searchForNextPageInPointersPage(key);
+    // Loop until found. Since this is a (presumably well-formed) B-tree, this should always terminate.
+    for (;;) {
+      const auto& node = pinned ? pinned->node : *loaded;
+      if (!node.IsPointersPage()) {
+        const auto lower_bound = key ? node.getCellLowerBoundByPK(*key) : std::nullopt;
+        const auto num_pointers = node.GetNumPointers();
+        if (!validate(current_page_number, version)) {
+          return {};
+        }
+        NOSQL_ASSERT(!pinned, "leaf " << current_page_number << " is pinned, only interior nodes should be");
+
+        result.is_rightmost_leaf = is_rightmost;
+        result.path.Emplace(current_page_number, lower_bound ? lower_bound->second : num_pointers);
+        // Elements are allocated directly in this page. Leaves are never pinned.
+        result.node = std::move(loaded);
+        result.leaf_version = version;
+        return result;
+      }
+
+      // Without a key, the search follows the rightmost pointers.
+      auto [next_page_number, offset] = key ? node.searchForNextPageInPointersPage(*key)
+                                            : std::pair {node.getHeader().GetAdditionalData(),
+                                                         static_cast<page_index_t>(node.GetNumPointers())};
+      const auto is_last_pointer = offset == node.GetNumPointers();
+      if (!validate(current_page_number, version)) {
+        return {};
+      }
+      NOSQL_REQUIRE(next_page_number != current_page_number, "infinite loop detected in search");
 
-    NOSQL_REQUIRE(next_page_number != node.GetPageNumber(), "infinite loop detected in search");
+      result.path.Push({current_page_number, offset});
+      is_rightmost = is_rightmost && is_last_pointer;
 
-    result.path.Push({current_page_number, offset});
-    current_page_number = next_page_number;
+      // Lock coupling: the child's version is read before the parent is validated again, so a writer that
+      // changes the child after the pointer to it was read is always noticed.
+      const auto child_version = read_lock(next_page_number);
+      if (!validate(current_page_number, version)) {
+        return {};
+      }
+      current_page_number = next_page_number;
+      version = child_version;
 
-    auto child = loadNodePage(next_page_number);
-    node = std::move(*child);
+      if (pinned) {
+        pinned = followPointer(*pinned, offset, next_page_number, loaded);
+      }
+      else {
+        loaded = loadNodePage(next_page_number);
+      }
+    }
+  } catch (const std::exception&) {
+    // A node that is read while a writer changes it can look corrupt. Only in that case is the search
+    // restarted, otherwise, the node really is corrupt.
+    if (!validate(current_page_number, version)) {
+      return {};
+    }
+    throw;
   }
+}
 
-  return result;
+bool BTreeManager::Validate(const SearchResult& result) const noexcept {
+  return !result.node || getLatch(result.node->GetPageNumber()).Validate(result.leaf_version);
 }
 
 RetrievalResult BTreeManager::retrieve(GeneralKey key) const {
-  RetrievalResult result;
-  result.search_result = search(key);
-  if (result.search_result.IsFound()) {
-    // Get cell index.
+  for (;;) {
+    RetrievalResult result;
+    result.search_result = search(key);
+    auto& node = *result.search_result.node;
+    // The search finds where the key would be, only read the entry if the key is there.
     const auto cell_index = result.search_result.path.Top()->get().second;
-    const auto cell_offset = result.search_result.node->getCellOffsetByIndex(cell_index);
+    try {
+      if (cell_index < node.GetNumPointers()
+          && node.compareToNthKey(key, cell_index) == std::weak_ordering::equivalent)
+      {
+        result.entry_flags = node.GetPage()->Read<std::byte>(node.getCellOffsetByIndex(cell_index));
+        // The entry is copied out of the leaf, and the copy is only used if the leaf did not change.
+        auto entry = tryCopyEntry(node, cell_index, result.search_result.leaf_version);
+        if (!entry) {
+          continue;
+        }
+        result.entry = std::move(*entry);
+      }
+    } catch (const std::exception&) {
+      // A leaf that is read while a writer changes it can look corrupt. Only in that case is the retrieval
+      // restarted, otherwise, the leaf really is corrupt.
+      if (Validate(result.search_result)) {
+        throw;
+      }
+      continue;
+    }
+    if (Validate(result.search_result)) {
+      return result;
+    }
+    LOG_SEV(Trace) << "The leaf of " << debugKey(key) << " was changed while it was read, retrying.";
+  }
+}
+
+std::optional<std::unique_ptr<internal::DatabaseEntry>> BTreeManager::tryCopyEntry(const BTreeNodeMap& leaf,
+                                                                                   page_size_t index,
+                                                                                   uint64_t version) const {
+  const auto& latch = getLatch(leaf.GetPageNumber());
+  try {
+    const auto offset = leaf.getCellOffsetByIndex(index);
+    if (internal::GetIsSinglePageEntry(leaf.GetPage()->Read<std::byte>(offset))) {
+      // Have to pass in a new page handle to read entry.
+      auto entry = internal::ReadEntry(offset, leaf.GetPage()->NewHandle(), this);
+      std::unique_ptr<internal::DatabaseEntry> copy = std::make_unique<internal::CopiedEntry>(*entry);
+      if (!latch.Validate(version)) {
+        return {};
+      }
+      return copy;
+    }
+
+    // The other pages of the entry are not guarded by the leaf's latch, but by the overflow lock. The entry's
+    // header has to be read before the leaf changed, otherwise, it could lead to pages that are not the
+    // entry's.
+    std::shared_lock guard(overflow_lock_);
+    const auto cell = std::get<DataNodeCell>(leaf.getCell(offset));
+    std::array<std::byte, 16> header {};
+    std::ranges::copy(cell.data.first(header.size()), header.begin());
+    if (!latch.Validate(version)) {
+      return {};
+    }
+    std::unique_ptr<internal::DatabaseEntry> entry;
+    if (internal::GetIsBlobEntry(cell.flags)) {
+      entry = std::make_unique<internal::BlobEntry>(header, this);
+    }
+    else {
+      entry = std::make_unique<internal::OverflowEntry>(header, this);
+    }
+    std::unique_ptr<internal::DatabaseEntry> copy = std::make_unique<internal::CopiedEntry>(*entry);
+    return copy;
+  } catch (const std::exception&) {
+    // A leaf that is read while a writer changes it can look corrupt.
+    if (latch.Validate(version)) {
+      throw;
+    }
+    return {};
+  }
+}
 
-    // Have to pass in a new page handle to read entry.
-    result.entry = internal::ReadEntry(cell_offset, result.search_result.node->GetPage()->NewHandle(), this);
+internal::NormalizedKey BTreeManager::normalizeKey(GeneralKey key, bool is_complete) const {
+  if (key_type_ == DataTypeEnum::Array) {
+    // Composite keys are built already normalized, just check that they are well formed.
+    const auto num_fields = internal::CountCompositeKeyFields(key_fields_, key);
+    NOSQL_REQUIRE(!is_complete || num_fields == key_fields_.size(),
+                  "composite key has " << num_fields << " fields, the B-tree's keys have "
+                                       << key_fields_.size());
   }
-  return result;
+  return internal::NormalizedKey(key_type_, key);
 }
 
 bool BTreeManager::lte(GeneralKey key1, GeneralKey key2) const {
-  if (cmp_(key1, key2)) {
+  if (internal::CompareKeys(key1, key2)) {
     return true;
   }
   return std::ranges::equal(key1, key2);
 }
 
 std::string BTreeManager::debugKey(GeneralKey key) const {
-  if (debug_key_func_) {
-    return debug_key_func_(key);
+  if (key_type_ == DataTypeEnum::Array) {
+    return internal::PrintCompositeKey(key_fields_, key);
   }
-  // Hex dump the key.
-  return internal::HexDumpBytes(key);
+  return internal::PrintNormalizedKey(key_type_, key);
 }
 
-bool BTreeManager::isUniqueKey(BTreeNodeMap& node_map, const StoreData& data) const noexcept {
-  if (auto lower_bound = node_map.getCellLowerBoundByPK(data.key)) {
-    // If the key is already in the node, we cannot add it again.
-    auto cell = node_map.getCell(lower_bound->first);
-    if (std::visit([&data](const auto& c) { return std::ranges::equal(c.key, data.key); }, cell)) {
-      LOG_SEV(Trace) << "Key " << debugKey(data.key) << " already in node on page "
-                     << node_map.GetPageNumber() << ".";
-      return false;
-    }
+bool BTreeManager::isUniqueKey(const BTreeNodeMap& node_map,
+                               GeneralKey key,
+                               page_size_t lower_bound) const noexcept {
+  // If the key is already in the node, we cannot add it again.
+  if (lower_bound < node_map.GetNumPointers()
+      && node_map.compareToNthKey(key, lower_bound) == std::weak_ordering::equivalent)
+  {
+    LOG_SEV(Trace) << "Key " << debugKey(key) << " already in node on page " << node_map.GetPageNumber()
+                   << ".";
+    return false;
   }
   return true;
 }
@@ -927,6 +2546,11 @@ page_size_t BTreeManager::writeFlags(Page& page,
   return page.WriteToPage(offset, flags);
 }
 
+page_size_t BTreeManager::writeSlot(Page& page, page_size_t offset, Slot slot) noexcept {
+  offset = page.WriteToPage(offset, slot.cell_offset);
+  return page.WriteToPage(offset, slot.key_hint);
+}
+
 page_size_t BTreeManager::writeKey(Page& page,
                                    BTreePageHeader& header,
                                    page_size_t offset,
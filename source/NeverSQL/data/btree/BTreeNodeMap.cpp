@@ -4,10 +4,31 @@
 
 #include "NeverSQL/data/btree/BTreeNodeMap.h"
 // Other files.
+#include <array>
+#include <ranges>
+
 #include <NeverSQL/data/btree/EntryCreator.h>
 
 namespace neversql {
 
+page_size_t SlotArray::LowerBoundByHint(uint32_t hint, page_size_t first, page_size_t last) const noexcept {
+  // Branchless binary search, until the range is small enough to scan.
+  constexpr page_size_t linear_search_window = 16;
+  page_size_t length = last - first;
+  while (linear_search_window < length) {
+    const auto half = static_cast<page_size_t>(length / 2);
+    first = GetKeyHint(first + half - 1) < hint ? static_cast<page_size_t>(first + half) : first;
+    length -= half;
+  }
+  // Count the hints in the window that are less than the hint. The loop has no branches, so it can be
+  // vectorized.
+  page_size_t count = 0;
+  for (page_size_t i = first; i < first + length; ++i) {
+    count += GetKeyHint(i) < hint ? 1 : 0;
+  }
+  return first + count;
+}
+
 BTreePageHeader BTreeNodeMap::GetHeader() {
   return BTreePageHeader(page_.get());
 }
@@ -40,35 +61,49 @@ page_size_t BTreeNodeMap::GetDefragmentedFreeSpace() const {
   return getHeader().GetDefragmentedFreeSpace();
 }
 
+page_size_t BTreeNodeMap::GetTotalFreeSpace() const {
+  return getHeader().GetTotalFreeSpace();
+}
+
 SpaceRequirement BTreeNodeMap::CalculateSpaceRequirements(GeneralKey key) const {
   SpaceRequirement requirement;
 
   auto&& header = getHeader();
 
+  // Only the part of the key after the page's key prefix is stored in the cell. If the key does not start
+  // with the key prefix, the prefix has to be shortened, and every other cell has to store the bytes that
+  // were removed from the prefix.
+  const auto shared_prefix_size = getSharedPrefixSize(key);
+  const auto prefix_shrink = static_cast<page_size_t>(header.GetKeyPrefixSize() - shared_prefix_size);
+  const auto num_shrunk_keys = header.GetNumPointers() == 0 ? 0 : header.GetNumPointers() - 1;
+  const auto prefix_shrink_space = static_cast<page_size_t>(prefix_shrink * num_shrunk_keys);
+
   // Amount of space needed for the pointer.
-  auto pointer_space = static_cast<page_size_t>(sizeof(page_size_t));
+  auto pointer_space = POINTER_SLOT_SIZE;
   // Calculate amount of space for the cell.
   // [Flags: 1 byte] [Key size: 2 bytes]? [Key: 8 bytes | key-size bytes]
-  auto cell_header_space = static_cast<page_size_t>(sizeof(uint8_t) + key.size());
+  auto cell_header_space = static_cast<page_size_t>(sizeof(uint8_t) + key.size() - shared_prefix_size);
   if (header.AreKeySizesSpecified()) {
     cell_header_space += sizeof(uint16_t);
   }
 
   // Given the current free space and the space needed for the pointer and the other parts of the cell, what
   // is the maximum amount of space available for the entry (not counting any page entry space restrictions).
-  auto free_space = header.GetDefragmentedFreeSpace();
-  auto helper_space = pointer_space + cell_header_space;
+  // Space in holes counts, since the node can be vacuumed to make it contiguous.
+  auto free_space = header.GetTotalFreeSpace();
+  auto helper_space = pointer_space + cell_header_space + prefix_shrink_space;
   requirement.max_entry_space =
       helper_space < free_space ? static_cast<page_size_t>(free_space - helper_space) : 0;
   requirement.pointer_space = pointer_space;
   requirement.cell_header_space = cell_header_space;
+  requirement.prefix_shrink_space = prefix_shrink_space;
 
   return requirement;
 }
 
-std::optional<GeneralKey> BTreeNodeMap::GetLargestKey() const {
+std::optional<std::vector<std::byte>> BTreeNodeMap::GetLargestKey() const {
   if (auto&& pointers = getPointers(); !pointers.empty()) {
-    return getKeyForCell(pointers.back());
+    return getFullKeyForCell(pointers.back());
   }
   return {};
 }
@@ -105,67 +140,75 @@ BTreePageHeader BTreeNodeMap::getHeader() const {
 }
 
 std::optional<page_size_t> BTreeNodeMap::getCellByKey(GeneralKey key) const {
-  std::span<const page_size_t> pointers = getPointers();
-
-  // Note: there was an issue trying to point in the span directly as the second argument, so I am using a
-  // placeholder value (0) and just using the compare function directly, ignoring its second argument (0).
-  auto it =
-      std::ranges::lower_bound(pointers, 0 /* unused */, [this, key](page_size_t ptr, [[maybe_unused]] int) {
-        return cmp_(getKeyForCell(ptr), key);
-      });
-  if (it == pointers.end()) {
-    return std::nullopt;
-  }
-  auto cell_key = getKeyForCell(*it);
-  // Crude way to check if the keys are equal without forcing a separate == function to be defined.
-  if (!cmp_(cell_key, key) && !cmp_(key, cell_key)) {
-    return *it;
+  if (auto lower_bound = getCellLowerBoundByPK(key);
+      lower_bound && compareToNthKey(key, lower_bound->second) == std::weak_ordering::equivalent)
+  {
+    return lower_bound->first;
   }
   return {};
 }
 
 std::optional<std::pair<page_size_t, page_index_t>> BTreeNodeMap::getCellLowerBoundByPK(
     GeneralKey key) const {
-  std::span<const page_size_t> pointers = getPointers();
-  auto it = std::ranges::lower_bound(pointers, key, cmp_, [this](auto&& ptr) { return getKeyForCell(ptr); });
-  if (it == pointers.end()) {
+  const auto pointers = getPointers();
+  if (pointers.empty()) {
+    return {};
+  }
+
+  // Every key in the page starts with the key prefix. If the key does not, it is either less than all the
+  // keys in the page, or greater than all of them. Otherwise, only the suffixes have to be compared.
+  const auto prefix = getKeyPrefix();
+  if (const auto shared_prefix_size = getSharedPrefixSize(key); shared_prefix_size < prefix.size()) {
+    if (shared_prefix_size == key.size() || key[shared_prefix_size] < prefix[shared_prefix_size]) {
+      return std::make_optional(std::pair {pointers.front(), page_index_t {0}});
+    }
     return {};
   }
-  return std::make_optional(std::pair {*it, static_cast<page_index_t>(std::distance(pointers.begin(), it))});
+  const auto suffix = key.subspan(prefix.size());
+
+  // Keys of pointers with smaller hints are smaller than the key, and keys of pointers with larger hints are
+  // larger, so only the keys of pointers with the same hint have to be compared.
+  const auto hint = getKeyHint(suffix);
+  const auto num_pointers = pointers.size();
+  const auto first = pointers.LowerBoundByHint(hint, 0, num_pointers);
+  const auto last = hint == std::numeric_limits<uint32_t>::max()
+      ? num_pointers
+      : pointers.LowerBoundByHint(hint + 1, first, num_pointers);
+  const auto indices = std::views::iota(first, last);
+  const auto it = std::ranges::lower_bound(
+      indices, suffix, internal::CompareKeys, [this, &pointers](page_size_t i) {
+        return getKeyForCell(pointers[i]);
+      });
+  const auto index = it == indices.end() ? last : *it;
+  if (index == num_pointers) {
+    return {};
+  }
+  return std::make_optional(std::pair {pointers[index], static_cast<page_index_t>(index)});
 }
 
 std::pair<page_number_t, page_index_t> BTreeNodeMap::searchForNextPageInPointersPage(GeneralKey key) const {
   NOSQL_REQUIRE(getHeader().IsPointersPage(), "cannot get next page from a page that is not a pointers page");
 
-  if (GetNumPointers() == 0) {
-    auto next_page = getHeader().GetAdditionalData();
-    NOSQL_ASSERT(next_page != 0, "next page cannot be the 0 page");
-    return {next_page, 0};
-  }
-
-  auto num_pointers = GetNumPointers();
-  auto last_cell = std::get<PointersNodeCell>(getNthCell(num_pointers - 1));
-  if (cmp_(last_cell.key, key)) {
+  // Get the offset to the first key that is greater than or equal to the key. If there is no such key, the
+  // next page is the rightmost page.
+  auto offset = getCellLowerBoundByPK(key);
+  if (!offset) {
     auto next_page = getHeader().GetAdditionalData();
     NOSQL_ASSERT(next_page != 0,
                  "rightmost pointer in page " << GetPageNumber() << " set to 0, error in rightmost pointer");
-    return {next_page, num_pointers};
+    return {next_page, GetNumPointers()};
   }
-  // Get the offset to the first key that is greater
-  auto offset = getCellLowerBoundByPK(key);
-  NOSQL_ASSERT(offset.has_value(),
-               "could not find a cell with a key greater than or equal to " << debugKey(key));
 
   auto pointer_cell = std::get<PointersNodeCell>(getCell(offset->first));
   return {pointer_cell.page_number, offset->second};
 }
 
-std::span<const page_size_t> BTreeNodeMap::getPointers() const {
+SlotArray BTreeNodeMap::getPointers() const {
   auto&& header = getHeader();
   auto start_ptrs = header.GetPointersStart();
   auto num_pointers = header.GetNumPointers();
 
-  return page_->GetSpan<const page_size_t>(start_ptrs, num_pointers);
+  return SlotArray(page_->GetSpan<const std::byte>(start_ptrs, num_pointers * POINTER_SLOT_SIZE));
 }
 
 page_size_t BTreeNodeMap::getCellOffsetByIndex(page_size_t cell_index) const {
@@ -193,6 +236,52 @@ GeneralKey BTreeNodeMap::getKeyForNthCell(page_size_t cell_index) const {
   return getKeyForCell(pointers[cell_index]);
 }
 
+std::vector<std::byte> BTreeNodeMap::getFullKeyForCell(page_size_t cell_offset) const {
+  const auto prefix = getKeyPrefix();
+  const auto suffix = getKeyForCell(cell_offset);
+  std::vector<std::byte> key;
+  key.reserve(prefix.size() + suffix.size());
+  key.insert(key.end(), prefix.begin(), prefix.end());
+  key.insert(key.end(), suffix.begin(), suffix.end());
+  return key;
+}
+
+std::vector<std::byte> BTreeNodeMap::getFullKeyForNthCell(page_size_t cell_index) const {
+  return getFullKeyForCell(getCellOffsetByIndex(cell_index));
+}
+
+GeneralKey BTreeNodeMap::getKeyPrefix() const {
+  return getHeader().GetKeyPrefix();
+}
+
+page_size_t BTreeNodeMap::getSharedPrefixSize(GeneralKey key) const {
+  const auto prefix = getKeyPrefix();
+  const auto [key_it, _] = std::ranges::mismatch(key, prefix);
+  return static_cast<page_size_t>(std::distance(key.begin(), key_it));
+}
+
+std::weak_ordering BTreeNodeMap::compareToNthKey(GeneralKey key, page_size_t cell_index) const {
+  const auto prefix = getKeyPrefix();
+  if (const auto shared_prefix_size = getSharedPrefixSize(key); shared_prefix_size < prefix.size()) {
+    return shared_prefix_size == key.size() || key[shared_prefix_size] < prefix[shared_prefix_size]
+        ? std::weak_ordering::less
+        : std::weak_ordering::greater;
+  }
+  const auto suffix = key.subspan(prefix.size());
+  const auto cell_key = getKeyForNthCell(cell_index);
+  if (internal::CompareKeys(suffix, cell_key)) {
+    return std::weak_ordering::less;
+  }
+  if (internal::CompareKeys(cell_key, suffix)) {
+    return std::weak_ordering::greater;
+  }
+  return std::weak_ordering::equivalent;
+}
+
+uint32_t BTreeNodeMap::getKeyHint(GeneralKey key_suffix) const {
+  return internal::HintKey(key_suffix);
+}
+
 std::variant<DataNodeCell, PointersNodeCell> BTreeNodeMap::getCell(page_size_t cell_offset) const {
   // Single page entry.
   // [flags: 1 byte]
@@ -202,6 +291,14 @@ std::variant<DataNodeCell, PointersNodeCell> BTreeNodeMap::getCell(page_size_t c
   // [entry_size: 2 bytes]
   // [entry_data: entry_size bytes]
 
+  // Pointer cell (in an interior node).
+  // [flags: 1 byte]
+  // [key_size: 2 bytes]?
+  // [key: 8 bytes | variable]
+  // ---- Entry -------------------
+  // [page number: 8 bytes]
+  // [number of entries in the subtree: 8 bytes]
+
   // Overflow entry header.
   // [flags: 1 byte]
   // [key_size: 2 bytes]?
@@ -239,7 +336,10 @@ std::variant<DataNodeCell, PointersNodeCell> BTreeNodeMap::getCell(page_size_t c
   }
 
   if (getHeader().IsPointersPage()) {
-    return PointersNodeCell {.key = key, .page_number = page_->Read<page_number_t>(entry_offset)};
+    return PointersNodeCell {.flags = flags,
+                             .key = key,
+                             .page_number = page_->Read<page_number_t>(entry_offset),
+                             .num_entries = page_->Read<uint64_t>(entry_offset + sizeof(page_number_t))};
   }
 
   // If this is an overflow header, it is 16 bytes. Otherwise, the size of the entry is stored in the next 2
@@ -259,23 +359,129 @@ std::variant<DataNodeCell, PointersNodeCell> BTreeNodeMap::getNthCell(page_size_
   return getCell(pointers[cell_number]);
 }
 
-void BTreeNodeMap::sortKeys() {
-  auto pointers = getPointers();
+void BTreeNodeMap::insertSlot(page_size_t index, Slot slot) {
+  auto header = GetHeader();
+  const auto pointers = getPointers();
+  NOSQL_ASSERT(index <= pointers.size(),
+               "cannot insert pointer at index " << index << " in page " << GetPageNumber() << ", which has "
+                                                 << pointers.size() << " pointers");
+  NOSQL_ASSERT(header.GetFreeStart() + POINTER_SLOT_SIZE <= header.GetFreeEnd(),
+               "no space for another pointer in page " << GetPageNumber());
+
+  // Write the new slot followed by the slots that move, all at once.
+  const auto moved = pointers.GetBytes(index, static_cast<page_size_t>(pointers.size() - index));
+  std::vector<std::byte> slots(POINTER_SLOT_SIZE + moved.size());
+  std::memcpy(slots.data(), &slot.cell_offset, sizeof(page_size_t));
+  std::memcpy(slots.data() + sizeof(page_size_t), &slot.key_hint, sizeof(uint32_t));
+  std::ranges::copy(moved, slots.begin() + POINTER_SLOT_SIZE);
+  GetPage()->WriteToPage(header.GetPointersStart() + index * POINTER_SLOT_SIZE,
+                         std::span<const std::byte>(slots));
+  header.SetFreeBegin(header.GetFreeStart() + POINTER_SLOT_SIZE);
+}
+
+void BTreeNodeMap::removeSlot(page_size_t index) {
+  auto header = GetHeader();
+  const auto pointers = getPointers();
+  NOSQL_ASSERT(index < pointers.size(),
+               "cannot remove pointer " << index << " from page " << GetPageNumber() << ", which has "
+                                        << pointers.size() << " pointers");
+
+  // Write the slots that move all at once.
+  if (const auto num_moved = static_cast<page_size_t>(pointers.size() - index - 1); num_moved != 0) {
+    const auto moved = pointers.GetBytes(static_cast<page_size_t>(index + 1), num_moved);
+    const std::vector<std::byte> slots(moved.begin(), moved.end());
+    GetPage()->WriteToPage(header.GetPointersStart() + index * POINTER_SLOT_SIZE,
+                           std::span<const std::byte>(slots));
+  }
+  header.SetFreeBegin(header.GetFreeStart() - POINTER_SLOT_SIZE);
+}
+
+std::optional<page_size_t> BTreeNodeMap::allocateFromFreeblocks(page_size_t size) {
+  auto header = GetHeader();
+  // The previous freeblock, or zero if the current freeblock is the first one.
+  page_size_t previous = 0;
+  for (auto block = header.GetFirstFreeblock(); block != 0;) {
+    const auto next_block = page_->Read<page_size_t>(block);
+    const auto block_size = page_->Read<page_size_t>(block + sizeof(page_size_t));
+    if (block_size < size) {
+      previous = block;
+      block = next_block;
+      continue;
+    }
+
+    header.SetFragmentedFreeSpace(header.GetFragmentedFreeSpace() - size);
+    if (const auto remaining = static_cast<page_size_t>(block_size - size); MIN_FREEBLOCK_SIZE <= remaining) {
+      page_->WriteToPage(block + sizeof(page_size_t), remaining);
+      return static_cast<page_size_t>(block + remaining);
+    }
+    // Unlink the freeblock, anything left over becomes a fragment.
+    if (previous == 0) {
+      header.SetFirstFreeblock(next_block);
+    }
+    else {
+      page_->WriteToPage(previous, next_block);
+    }
+    return block;
+  }
+  return {};
+}
+
+void BTreeNodeMap::freeCell(page_size_t offset, page_size_t size) {
+  auto header = GetHeader();
+  NOSQL_ASSERT(header.GetFreeEnd() <= offset && offset + size <= header.GetReservedStart(),
+               "cell at offset " << offset << " with size " << size << " is not in the cells of page "
+                                 << GetPageNumber());
+
+  // A cell at the start of the cells just moves the free space end. That may make the first freeblock
+  // adjacent to the free space, in which case it is added to the free space too.
+  if (offset == header.GetFreeEnd()) {
+    auto free_end = static_cast<page_size_t>(offset + size);
+    auto first_block = header.GetFirstFreeblock();
+    while (first_block != 0 && first_block == free_end) {
+      const auto block_size = page_->Read<page_size_t>(first_block + sizeof(page_size_t));
+      header.SetFragmentedFreeSpace(header.GetFragmentedFreeSpace() - block_size);
+      free_end += block_size;
+      first_block = page_->Read<page_size_t>(first_block);
+    }
+    header.SetFirstFreeblock(first_block);
+    header.SetFreeEnd(free_end);
+    return;
+  }
 
-  std::vector<page_size_t> data {pointers.begin(), pointers.end()};
+  header.SetFragmentedFreeSpace(header.GetFragmentedFreeSpace() + size);
+  if (size < MIN_FREEBLOCK_SIZE) {
+    return;
+  }
 
-  std::ranges::sort(
-      data, [this](auto&& ptr1, auto&& ptr2) { return cmp_(getKeyForCell(ptr1), getKeyForCell(ptr2)); });
-  std::span<page_size_t> sorted_ptrs {data.data(), data.size()};
-  GetPage()->WriteToPage(getHeader().GetPointersStart(), sorted_ptrs);
+  // Find the freeblocks before and after the cell.
+  page_size_t previous = 0, next = header.GetFirstFreeblock();
+  while (next != 0 && next < offset) {
+    previous = next;
+    next = page_->Read<page_size_t>(next);
+  }
+
+  // Merge with the next freeblock if they touch.
+  if (next != 0 && offset + size == next) {
+    size += page_->Read<page_size_t>(next + sizeof(page_size_t));
+    next = page_->Read<page_size_t>(next);
+  }
+  // Merge into the previous freeblock if they touch, otherwise, link in a new freeblock.
+  if (previous != 0 && previous + page_->Read<page_size_t>(previous + sizeof(page_size_t)) == offset) {
+    // The freeblock's next offset and size are written together.
+    page_->WriteToPage(previous, std::array {next, static_cast<page_size_t>(offset + size - previous)});
+    return;
+  }
+  page_->WriteToPage(offset, std::array {next, size});
+  if (previous == 0) {
+    header.SetFirstFreeblock(offset);
+  }
+  else {
+    page_->WriteToPage(previous, offset);
+  }
 }
 
 std::string BTreeNodeMap::debugKey(GeneralKey key) const {
-  if (debug_key_func_) {
-    return debug_key_func_(key);
-  }
-  // Hex dump the key.
-  return internal::HexDumpBytes(key);
+  return internal::PrintNormalizedKey(key_type_, key);
 }
 
 }  // namespace neversql
@@ -5,6 +5,7 @@
 #include "NeverSQL/data/btree/EntryCreator.h"
 // Other files.
 #include <NeverSQL/data/btree/BTree.h>
+#include <NeverSQL/data/internals/BlobEntry.h>
 #include <NeverSQL/data/internals/Utility.h>
 
 #include "NeverSQL/data/Page.h"
@@ -20,7 +21,7 @@ page_size_t EntryCreator::GetMinimumEntrySize() const {
   return 16;
 }
 
-page_size_t EntryCreator::GetRequestedSize(page_size_t maximum_entry_size) {
+page_size_t EntryCreator::GetRequestedSize(page_size_t maximum_entry_size, std::size_t blob_size) {
   if (next_overflow_entry_size_) {
     return next_overflow_entry_size_ + sizeof(primary_key_t) + sizeof(page_size_t);
   }
@@ -30,15 +31,19 @@ page_size_t EntryCreator::GetRequestedSize(page_size_t maximum_entry_size) {
                     << maximum_entry_size << ", minimum is " << GetMinimumEntrySize()
                     << "), this should have been checked before calling this function");
 
-  auto size =
-      static_cast<page_size_t>((serialize_size_ ? sizeof(page_size_t) : 0) + payload_->GetRequiredSize());
+  auto size = GetSinglePageEntrySize();
   if (maximum_entry_size < size) {
     LOG_SEV(Trace) << "Size of entry is " << size << ", which is larger than the maximum entry size of "
                    << maximum_entry_size << ". Overflow page needed.";
     overflow_page_needed_ = true;
+    is_blob_ = blob_size <= payload_->GetRequiredSize();
     return 16;
   }
-  return size;
+  return static_cast<page_size_t>(size);
+}
+
+std::size_t EntryCreator::GetSinglePageEntrySize() const {
+  return (serialize_size_ ? sizeof(page_size_t) : 0) + payload_->GetRequiredSize();
 }
 
 std::byte EntryCreator::GenerateFlags() const {
@@ -49,6 +54,8 @@ std::byte EntryCreator::GenerateFlags() const {
       IsActive
       // The note flag is set if the entry is an overflow page entry or the entry size is serialized.
       | (serialize_size_ || overflow_page_needed_ ? NoteFlag : 0)
+      // Large entries are stored in blob pages.
+      | (is_blob_ ? IsBlobEntry : 0)
       // An entry on an overflow page should be loaded as a single page entry, since it just contains the data
       // for this part of the overflow page, plus some additional data to find the next overflow page (if
       // applicable) and the logic for traversing all the pages is handled elsewhere.
@@ -63,6 +70,11 @@ page_size_t EntryCreator::Create(page_size_t starting_offset, Page* page, BTreeM
     return createOverflowDataEntry(starting_offset, page);
   }
 
+  // Blob entry.
+  if (is_blob_) {
+    return createBlobEntry(starting_offset, page, btree_manager);
+  }
+
   // Header or single page entry.
   if (overflow_page_needed_) {
     return createOverflowEntry(starting_offset, page, btree_manager);
@@ -72,15 +84,18 @@ page_size_t EntryCreator::Create(page_size_t starting_offset, Page* page, BTreeM
   return createSinglePageEntry(starting_offset, page);
 }
 
-page_size_t EntryCreator::createOverflowEntry([[maybe_unused]] page_size_t starting_offset,
-                                              [[maybe_unused]] Page* page,
-                                              [[maybe_unused]] BTreeManager* btree_manager) {
+page_size_t EntryCreator::createOverflowEntry(page_size_t starting_offset,
+                                              Page* page,
+                                              BTreeManager* btree_manager) {
   // Create the entry in the main page.
   // Header:
   // [overflow_key: 8 bytes] [overflow page number: 8 bytes]
 
   auto offset = starting_offset;
 
+  // Overflow pages, their space map, and the overflow entry counter are shared by all the tree's writers.
+  std::lock_guard guard(btree_manager->overflow_lock_);
+
   // Get an overflow entry number.
   auto overflow_key = btree_manager->getNextOverflowEntryNumber();
   offset = page->WriteToPage(offset, overflow_key);
@@ -90,9 +105,9 @@ page_size_t EntryCreator::createOverflowEntry([[maybe_unused]] page_size_t start
   // [next overflow page number: 8 bytes]? [entry_size: 2 bytes] [entry_data: entry_size bytes]
   // If there is no next overflow page, the next overflow page number is 0.
 
-  // Get the overflow page, making sure that we go to a new page if ther would not be enough space on the
-  // current page.
-  auto overflow_page_number = loadOverflowPage(overflow_key, btree_manager);
+  // Get the overflow page whose space fits the whole entry best, or a new page.
+  const auto overflow_page_number =
+      btree_manager->acquireOverflowPage(overflow_header_size_ + payload_->GetRequiredSize());
 
   // Write the overflow page number.
   offset = page->WriteToPage(offset, overflow_page_number);
@@ -149,6 +164,35 @@ page_size_t EntryCreator::createOverflowDataEntry(page_size_t starting_offset, P
   return offset;
 }
 
+page_size_t EntryCreator::createBlobEntry(page_size_t starting_offset,
+                                          Page* page,
+                                          BTreeManager* btree_manager) {
+  // [entry_size: 8 bytes] [first blob page number: 8 bytes]
+  const uint64_t entry_size = payload_->GetRequiredSize();
+  const auto page_size = page->GetPageSize();
+  const auto num_pages = GetNumBlobPages(entry_size, page_size);
+  const auto first_page = btree_manager->page_cache_.GetNewExtent(num_pages);
+  LOG_SEV(Debug) << "Creating blob entry of " << entry_size << " bytes in " << num_pages
+                 << " pages, starting at page " << first_page << ".";
+
+  auto offset = page->WriteToPage(starting_offset, entry_size);
+  offset = page->WriteToPage(offset, first_page);
+
+  // Fill a buffer with each page's data, so each page is written (and logged) once.
+  std::vector<std::byte> buffer(page_size);
+  for (page_number_t i = 0; i < num_pages; ++i) {
+    std::size_t size = 0;
+    for (; size < page_size && payload_->HasData(); ++size) {
+      buffer[size] = payload_->GetNextByte();
+    }
+    auto blob_page = btree_manager->page_cache_.GetBlankPage(first_page + i);
+    blob_page->WriteToPage(0, std::span<const std::byte>(buffer.data(), size));
+  }
+  NOSQL_ASSERT(!payload_->HasData(), "payload had more than the " << entry_size << " bytes it required");
+
+  return offset;
+}
+
 void EntryCreator::writeOverflowData(primary_key_t overflow_key,
                                      page_number_t overflow_page_number,
                                      BTreeManager* btree_manager) {
@@ -156,111 +200,47 @@ void EntryCreator::writeOverflowData(primary_key_t overflow_key,
                  << overflow_page_number << ".";
 
   auto overflow_page = btree_manager->loadNodePage(overflow_page_number);
-  std::optional<BTreeNodeMap> next_overflow_page {};
-  page_number_t next_overflow_page_number = 0;
 
-  auto total_size = payload_->GetRequiredSize();
+  const auto total_size = payload_->GetRequiredSize();
   std::size_t serialized_size = 0;
 
-  // Convert the overflow_key, as a primary_key_t, to a GeneralKey
-  GeneralKey general_overflow_key = SpanValue(overflow_key);
-
-  // [next overflow page number: 8 bytes]? [entry_size: 2 bytes]? [entry_data: entry_size bytes]
-  constexpr page_size_t header_size = sizeof(primary_key_t) + sizeof(entry_size_t);
-
-  // Helper lambda to load the next overflow page, making sure that there is enough space in the page.
-  auto load_next_overflow_page = [&] {
-    const auto remaining_space = static_cast<page_size_t>(total_size - serialized_size);
-    for (;;) {
-      next_overflow_page_number = btree_manager->getNextOverflowPage();
-      next_overflow_page = btree_manager->loadNodePage(next_overflow_page_number);
-      const auto max_entry_space =
-          next_overflow_page->CalculateSpaceRequirements(general_overflow_key).max_entry_space;
-      if (header_size + std::min(min_overflow_entry_capacity_, remaining_space) < max_entry_space) {
-        LOG_SEV(Trace) << "Found suitable overflow page, page " << next_overflow_page_number << ".";
-        break;  // Found a suitable page.
-      }
-    }
-  };
-
-  // This here is only a check if the initial overflow page was actually not suitable. It is not responsible
-  // for loading the "next" page.
-  auto max_entry_space = overflow_page->CalculateSpaceRequirements(general_overflow_key).max_entry_space;
-  if (max_entry_space < header_size) {
-    load_next_overflow_page();
-    overflow_page = std::move(*next_overflow_page);
-    next_overflow_page_number = 0;
-    LOG_SEV(Trace) << "Initial overflow page was not suitable, loading new page.";
-  }
+  // Convert the overflow_key, as a primary_key_t, to a normalized GeneralKey
+  const auto normalized_overflow_key = NormalizePrimaryKey(overflow_key);
+  GeneralKey general_overflow_key = normalized_overflow_key;
 
-  // Keep loading pages and storing data as long as is necessary.
+  // Keep storing data, one part per page, as long as is necessary. Every page was chosen to fit the rest of
+  // the entry if any page could, otherwise it is a new page that the part fills.
   while (payload_->HasData()) {
-    // Check how much space is available in the current page. If there is not enough space in the overflow
-    // page, we will need another overflow page.
-    max_entry_space = overflow_page->CalculateSpaceRequirements(general_overflow_key).max_entry_space;
-
-    const bool needs_next_page = std::cmp_less(max_entry_space - header_size, total_size - serialized_size);
-    // If necessary, load the next overflow page.
-    if (needs_next_page) {
-      load_next_overflow_page();
-      LOG_SEV(Trace) << "Another overflow page will be needed, page will be " << next_overflow_page_number
-                     << ".";
+    const auto max_entry_space = btree_manager->getOverflowEntrySpace(*overflow_page);
+    NOSQL_ASSERT(overflow_header_size_ < max_entry_space,
+                 "overflow page " << overflow_page->GetPageNumber() << " has no space for overflow data");
+    const auto remaining_size = total_size - serialized_size;
+    next_overflow_entry_size_ = static_cast<entry_size_t>(
+        std::min<std::size_t>(max_entry_space - overflow_header_size_, remaining_size));
+
+    // If the rest of the entry does not fit, get the page for the next part.
+    next_overflow_page_ = 0;
+    if (next_overflow_entry_size_ < remaining_size) {
+      next_overflow_page_ = btree_manager->acquireOverflowPage(overflow_header_size_ + remaining_size
+                                                               - next_overflow_entry_size_);
+      LOG_SEV(Trace) << "Another overflow page will be needed, page will be " << next_overflow_page_ << ".";
     }
     LOG_SEV(Trace) << "Max entry space is " << max_entry_space << ", remaining entry data size is "
-                   << total_size - serialized_size << ".";
-
-    // We need to write the header, plus all the data we can.
-    next_overflow_entry_size_ =
-        std::min<page_size_t>(max_entry_space - header_size, total_size - serialized_size);
-    next_overflow_page_ = next_overflow_page_number;
+                   << remaining_size << ".";
 
     // Add entry.
     StoreData store_data {.key = general_overflow_key, .entry_creator = this};
-    btree_manager->addElementToNode(*overflow_page, store_data);
-
-    // Add all the data we can to the current overflow page.
+    NOSQL_ASSERT(btree_manager->addElementToNode(*overflow_page, store_data),
+                 "could not add overflow data to overflow page " << overflow_page->GetPageNumber());
+    btree_manager->updateOverflowSpace(*overflow_page);
     serialized_size += next_overflow_entry_size_;
 
-    if (needs_next_page) {
-      // Cue up the next page.
-      overflow_page = std::move(*next_overflow_page);
-      next_overflow_page_number = 0;  // As far as we know, there is no next overflow page.
+    if (next_overflow_page_ != 0) {
+      overflow_page = btree_manager->loadNodePage(next_overflow_page_);
     }
   }
 
   LOG_SEV(Debug) << "Done creating overflow entry.";
 }
 
-page_number_t EntryCreator::loadOverflowPage(primary_key_t overflow_key, BTreeManager* btree_manager) {
-  auto overflow_page_number = btree_manager->getCurrentOverflowPage();
-  auto overflow_page = btree_manager->loadNodePage(overflow_page_number);
-
-  // Convert the overflow_key, as a primary_key_t, to a GeneralKey
-  GeneralKey general_overflow_key = SpanValue(overflow_key);
-
-  // [next overflow page number: 8 bytes]? [entry_size: 2 bytes]? [entry_data: entry_size bytes]
-  constexpr page_size_t header_size = sizeof(primary_key_t) + sizeof(entry_size_t);
-
-  // Helper lambda to load the next overflow page, making sure that there is enough space in the page.
-  auto load_next_overflow_page = [&] {
-    for (;;) {
-      overflow_page_number = btree_manager->getNextOverflowPage();
-      overflow_page = btree_manager->loadNodePage(overflow_page_number);
-      const auto max_entry_space =
-          overflow_page->CalculateSpaceRequirements(general_overflow_key).max_entry_space;
-      if (header_size + min_overflow_entry_capacity_ < max_entry_space) {
-        LOG_SEV(Trace) << "Found suitable overflow page, page " << overflow_page_number << ".";
-        return;
-      }
-    }
-  };
-
-  auto max_entry_space = overflow_page->CalculateSpaceRequirements(general_overflow_key).max_entry_space;
-  if (max_entry_space < header_size) {
-    LOG_SEV(Trace) << "Initial overflow page was not suitable, loading new page.";
-    load_next_overflow_page();
-  }
-  return overflow_page_number;
-}
-
 }  // namespace neversql::internal
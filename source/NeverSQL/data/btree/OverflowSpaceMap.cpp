@@ -0,0 +1,110 @@
+//
+// Created by Nathaniel Rupprecht on 10/17/26.
+//
+
+#include "NeverSQL/data/btree/OverflowSpaceMap.h"
+// Other files.
+#include <vector>
+
+namespace neversql {
+
+namespace {
+
+//! \brief The size of the space map page header, the magic number and the number of pages.
+constexpr page_size_t SPACE_MAP_HEADER_SIZE = sizeof(uint64_t) + sizeof(page_size_t);
+
+//! \brief The size of the record of one page in the space map page.
+constexpr page_size_t SPACE_MAP_RECORD_SIZE = sizeof(page_number_t) + sizeof(page_size_t);
+
+}  // namespace
+
+OverflowSpaceMap::OverflowSpaceMap(page_size_t page_size)
+    : capacity_((page_size - SPACE_MAP_HEADER_SIZE) / SPACE_MAP_RECORD_SIZE) {}
+
+std::optional<page_number_t> OverflowSpaceMap::FindBestFit(page_size_t entry_space) const {
+  if (auto it = pages_by_space_.lower_bound({entry_space, 0}); it != pages_by_space_.end()) {
+    return it->second;
+  }
+  return {};
+}
+
+std::optional<page_number_t> OverflowSpaceMap::FindMostSpace() const {
+  if (pages_by_space_.empty()) {
+    return {};
+  }
+  return pages_by_space_.rbegin()->second;
+}
+
+std::optional<page_size_t> OverflowSpaceMap::GetEntrySpace(page_number_t page_number) const {
+  if (auto it = entry_space_.find(page_number); it != entry_space_.end()) {
+    return it->second;
+  }
+  return {};
+}
+
+void OverflowSpaceMap::Update(page_number_t page_number, page_size_t entry_space) {
+  Remove(page_number);
+  if (entry_space < MIN_TRACKED_OVERFLOW_SPACE) {
+    return;
+  }
+  if (capacity_ <= entry_space_.size()) {
+    // Make room by forgetting the page with the least space, unless this page has even less.
+    auto least = pages_by_space_.begin();
+    if (entry_space <= least->first) {
+      return;
+    }
+    entry_space_.erase(least->second);
+    pages_by_space_.erase(least);
+  }
+  entry_space_.emplace(page_number, entry_space);
+  pages_by_space_.emplace(entry_space, page_number);
+  is_dirty_ = true;
+}
+
+void OverflowSpaceMap::Remove(page_number_t page_number) {
+  if (auto it = entry_space_.find(page_number); it != entry_space_.end()) {
+    pages_by_space_.erase({it->second, page_number});
+    entry_space_.erase(it);
+    is_dirty_ = true;
+  }
+}
+
+void OverflowSpaceMap::WriteToPage(Page& page) {
+  // Serialize the whole map into a buffer, so the page is written once.
+  std::vector<std::byte> buffer(SPACE_MAP_HEADER_SIZE + entry_space_.size() * SPACE_MAP_RECORD_SIZE);
+  auto* data = buffer.data();
+  auto write = [&data](const auto& value) {
+    std::memcpy(data, &value, sizeof(value));
+    data += sizeof(value);
+  };
+  write(ToUInt64("OVFLWMAP"));
+  write(static_cast<page_size_t>(entry_space_.size()));
+  for (auto [page_number, entry_space] : entry_space_) {
+    write(page_number);
+    write(entry_space);
+  }
+  page.WriteToPage(0, std::span<const std::byte>(buffer));
+  is_dirty_ = false;
+}
+
+void OverflowSpaceMap::ReadFromPage(const Page& page) {
+  NOSQL_REQUIRE(IsSpaceMapPage(page), "page " << page.GetPageNumber() << " is not an overflow space map");
+  entry_space_.clear();
+  pages_by_space_.clear();
+
+  const auto num_pages = page.Read<page_size_t>(sizeof(uint64_t));
+  auto offset = SPACE_MAP_HEADER_SIZE;
+  for (page_size_t i = 0; i < num_pages; ++i, offset += SPACE_MAP_RECORD_SIZE) {
+    const auto page_number = page.Read<page_number_t>(offset);
+    const auto entry_space = page.Read<page_size_t>(offset + sizeof(page_number_t));
+    entry_space_.emplace(page_number, entry_space);
+    pages_by_space_.emplace(entry_space, page_number);
+  }
+  is_dirty_ = false;
+}
+
+bool OverflowSpaceMap::IsSpaceMapPage(const Page& page) {
+  return page.Read<uint64_t>(0) == ToUInt64("OVFLWMAP");
+}
+
+}  // namespace neversql
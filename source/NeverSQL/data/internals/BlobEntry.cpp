@@ -0,0 +1,53 @@
+//
+// Created by Nathaniel Rupprecht on 10/17/26.
+//
+
+#include "NeverSQL/data/internals/BlobEntry.h"
+// Other files.
+#include "NeverSQL/data/btree/BTree.h"
+
+namespace neversql::internal {
+
+BlobEntry::BlobEntry(std::span<const std::byte> entry_header, const BTreeManager* btree_manager)
+    : btree_manager_(btree_manager) {
+  // Get information from the header, the size of the entry and its first page.
+  std::memcpy(&entry_size_, entry_header.data(), sizeof(entry_size_));
+  std::memcpy(&first_page_, entry_header.data() + sizeof(entry_size_), sizeof(first_page_));
+
+  num_pages_ = GetNumBlobPages(entry_size_, btree_manager_->page_cache_.GetPageSize());
+
+  loadPage();
+}
+
+std::span<const std::byte> BlobEntry::GetData() const noexcept {
+  const auto page_size = page_->GetPageSize();
+  // Every page but the last is full.
+  const auto size = page_index_ + 1 < num_pages_ ? page_size : entry_size_ - page_index_ * page_size;
+  return page_->GetSpan(0, static_cast<page_size_t>(size));
+}
+
+bool BlobEntry::Advance() {
+  if (num_pages_ <= page_index_ + 1) {
+    return false;
+  }
+  ++page_index_;
+  loadPage();
+  return true;
+}
+
+bool BlobEntry::IsValid() const {
+  return page_ != nullptr;
+}
+
+void BlobEntry::loadPage() {
+  auto& page_cache = btree_manager_->page_cache_;
+  if (page_index_ % BLOB_READ_AHEAD_PAGES == 0) {
+    page_cache.LoadExtent(first_page_ + page_index_,
+                          std::min(BLOB_READ_AHEAD_PAGES, num_pages_ - page_index_));
+  }
+  // Release the previous page before getting the next one.
+  page_.reset();
+  page_ = page_cache.GetPage(first_page_ + page_index_);
+}
+
+}  // namespace neversql::internal
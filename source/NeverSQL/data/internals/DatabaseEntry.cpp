@@ -7,6 +7,7 @@
 #include "NeverSQL/data/Document.h"
 #include "NeverSQL/data/btree/BTree.h"
 #include "NeverSQL/data/btree/EntryCreator.h"
+#include "NeverSQL/data/internals/BlobEntry.h"
 #include "NeverSQL/data/internals/OverflowEntry.h"
 #include "NeverSQL/data/internals/SinglePageEntry.h"
 
@@ -35,6 +36,14 @@ std::unique_ptr<DatabaseEntry> ReadEntry(page_size_t starting_offset,
   // [overflow_key: 8 bytes]
   // [overflow page number: 8 bytes]
 
+  // Blob entry header.
+  // [flags: 1 byte]
+  // [key_size: 2 bytes]?
+  // [key: 8 bytes | variable]
+  // -----------------------------------
+  // [entry_size: 8 bytes]
+  // [first blob page number: 8 bytes]
+
   LOG_SEV(Trace) << "Reading entry, starting offset is " << starting_offset << ".";
 
   // Read flags to determine whether the entry is a single database entry or an overflow entry.
@@ -62,19 +71,17 @@ std::unique_ptr<DatabaseEntry> ReadEntry(page_size_t starting_offset,
   }
 
   auto header = page->ReadFromPage(entry_offset, 16);
+  if (GetIsBlobEntry(flags)) {
+    return std::make_unique<BlobEntry>(header, btree_manager);
+  }
   return std::make_unique<OverflowEntry>(header, btree_manager);
 }
 
 std::unique_ptr<Document> EntryToDocument(DatabaseEntry& entry) {
   NOSQL_REQUIRE(entry.IsValid(), "entry is not valid");
-  // TODO: Some smarter, byte-by-byte document construction, so we don't need the intermediate buffer.
-  lightning::memory::MemoryBuffer<std::byte> buffer;
-  do {
-    auto data = entry.GetData();
-    buffer.Append(data);
-  } while (entry.Advance());
-  auto view = std::span {buffer.Data(), buffer.Size()};
-  return ReadDocumentFromBuffer(view);
+  // Read the document directly from the entry's parts, without copying them into one buffer.
+  SegmentedBuffer buffer(entry);
+  return ReadDocumentFromBuffer(buffer);
 }
 
 }  // namespace neversql::internal
\ No newline at end of file
@@ -0,0 +1,224 @@
+//
+// Created by Nathaniel Rupprecht on 10/17/26.
+//
+
+#include "NeverSQL/data/internals/KeyEncoding.h"
+// Other files.
+#include "NeverSQL/data/internals/KeyPrinting.h"
+
+namespace neversql::internal {
+
+namespace {
+
+template<typename Value_t>
+Value_t ReadNative(std::span<const std::byte> native_key) noexcept {
+  Value_t value;
+  std::memcpy(&value, native_key.data(), sizeof(Value_t));
+  return value;
+}
+
+//! \brief Get the size of the normalized field at the start of a composite key, including the terminator of
+//!        variable size fields, or nullopt if the key does not start with a complete field of the type.
+std::optional<std::size_t> GetCompositeFieldSize(DataTypeEnum field_type, std::span<const std::byte> key) {
+  if (const auto fixed_size = GetFixedKeySize(field_type); fixed_size != 0) {
+    return fixed_size <= key.size() ? std::optional(fixed_size) : std::nullopt;
+  }
+  for (std::size_t i = 0; i + 1 < key.size(); ++i) {
+    if (key[i] != std::byte {0}) {
+      continue;
+    }
+    if (key[i + 1] == std::byte {0}) {
+      return i + 2;
+    }
+    if (key[i + 1] != std::byte {0xFF}) {
+      return std::nullopt;
+    }
+    // Skip the escaped zero byte.
+    ++i;
+  }
+  return std::nullopt;
+}
+
+}  // namespace
+
+std::size_t GetFixedKeySize(DataTypeEnum key_type) {
+  switch (key_type) {
+    case DataTypeEnum::UInt64:
+    case DataTypeEnum::Int64:
+    case DataTypeEnum::DateTime:
+    case DataTypeEnum::Double:
+      return sizeof(uint64_t);
+    case DataTypeEnum::Int32:
+      return sizeof(int32_t);
+    case DataTypeEnum::Boolean:
+      return sizeof(bool);
+    case DataTypeEnum::String:
+    case DataTypeEnum::BinaryData:
+    // Composite keys.
+    case DataTypeEnum::Array:
+      return 0;
+    default:
+      NOSQL_FAIL("data type " << to_string(key_type) << " cannot be used as a key type");
+  }
+}
+
+bool IsValidKeyType(DataTypeEnum key_type) noexcept {
+  switch (key_type) {
+    case DataTypeEnum::UInt64:
+    case DataTypeEnum::Int64:
+    case DataTypeEnum::DateTime:
+    case DataTypeEnum::Double:
+    case DataTypeEnum::Int32:
+    case DataTypeEnum::Boolean:
+    case DataTypeEnum::String:
+    case DataTypeEnum::BinaryData:
+      return true;
+    default:
+      return false;
+  }
+}
+
+NormalizedKey::NormalizedKey(DataTypeEnum key_type, std::span<const std::byte> native_key) {
+  const auto fixed_size = GetFixedKeySize(key_type);
+  if (fixed_size == 0) {
+    native_key_ = native_key;
+    return;
+  }
+  NOSQL_REQUIRE(native_key.size() == fixed_size,
+                "key of type " << to_string(key_type) << " must be " << fixed_size << " bytes, not "
+                               << native_key.size());
+
+  is_encoded_ = true;
+  size_ = fixed_size;
+  switch (key_type) {
+    case DataTypeEnum::UInt64:
+      StoreBigEndian(ReadNative<uint64_t>(native_key), buffer_.data());
+      break;
+    case DataTypeEnum::Int64:
+    case DataTypeEnum::DateTime:
+      StoreBigEndian(OrderedBits(ReadNative<int64_t>(native_key)), buffer_.data());
+      break;
+    case DataTypeEnum::Double:
+      StoreBigEndian(OrderedBits(ReadNative<double>(native_key)), buffer_.data());
+      break;
+    case DataTypeEnum::Int32:
+      StoreBigEndian(OrderedBits(ReadNative<int32_t>(native_key)), buffer_.data());
+      break;
+    case DataTypeEnum::Boolean:
+      buffer_[0] = native_key[0] == std::byte {0} ? std::byte {0} : std::byte {1};
+      break;
+    default:
+      NOSQL_FAIL("unexpected fixed size key type " << to_string(key_type));
+  }
+}
+
+std::string PrintNormalizedKey(DataTypeEnum key_type, std::span<const std::byte> normalized_key) {
+  using lightning::formatting::Format;
+
+  if (key_type == DataTypeEnum::String) {
+    return PrintString(normalized_key);
+  }
+  if (!IsValidKeyType(key_type) || normalized_key.size() != GetFixedKeySize(key_type)) {
+    return HexDumpBytes(normalized_key);
+  }
+  const auto* data = normalized_key.data();
+  switch (key_type) {
+    case DataTypeEnum::UInt64:
+      return Format("{}", LoadBigEndian<uint64_t>(data));
+    case DataTypeEnum::Int64:
+    case DataTypeEnum::DateTime:
+      return Format("{}", FromOrderedBits<int64_t>(LoadBigEndian<uint64_t>(data)));
+    case DataTypeEnum::Double:
+      return Format("{}", DoubleFromOrderedBits(LoadBigEndian<uint64_t>(data)));
+    case DataTypeEnum::Int32:
+      return Format("{}", FromOrderedBits<int32_t>(LoadBigEndian<uint32_t>(data)));
+    case DataTypeEnum::Boolean:
+      return normalized_key[0] == std::byte {0} ? "false" : "true";
+    default:
+      return HexDumpBytes(normalized_key);
+  }
+}
+
+bool IsValidCompositeKey(std::span<const DataTypeEnum> field_types) noexcept {
+  return !field_types.empty() && field_types.size() <= MAX_COMPOSITE_KEY_FIELDS
+      && std::ranges::all_of(field_types, IsValidKeyType);
+}
+
+void AppendCompositeKeyField(DataTypeEnum field_type,
+                             std::span<const std::byte> native_field,
+                             std::vector<std::byte>& key) {
+  if (GetFixedKeySize(field_type) != 0) {
+    const auto normalized = NormalizedKey(field_type, native_field);
+    key.insert(key.end(), normalized.Get().begin(), normalized.Get().end());
+    return;
+  }
+  for (auto byte : native_field) {
+    key.push_back(byte);
+    if (byte == std::byte {0}) {
+      key.push_back(std::byte {0xFF});
+    }
+  }
+  key.push_back(std::byte {0});
+  key.push_back(std::byte {0});
+}
+
+std::size_t CountCompositeKeyFields(std::span<const DataTypeEnum> field_types,
+                                    std::span<const std::byte> key) {
+  std::size_t num_fields = 0;
+  while (!key.empty()) {
+    NOSQL_REQUIRE(num_fields < field_types.size(),
+                  "composite key has more than " << field_types.size() << " fields");
+    const auto field_size = GetCompositeFieldSize(field_types[num_fields], key);
+    NOSQL_REQUIRE(field_size,
+                  "field " << num_fields << " of composite key is not a valid "
+                           << to_string(field_types[num_fields]));
+    key = key.subspan(*field_size);
+    ++num_fields;
+  }
+  return num_fields;
+}
+
+std::string PrintCompositeKey(std::span<const DataTypeEnum> field_types, std::span<const std::byte> key) {
+  std::string output = "(";
+  for (std::size_t i = 0; i < field_types.size() && !key.empty(); ++i) {
+    const auto field_size = GetCompositeFieldSize(field_types[i], key);
+    if (!field_size) {
+      break;
+    }
+    auto field = key.first(*field_size);
+    key = key.subspan(*field_size);
+    if (i != 0) {
+      output += ", ";
+    }
+    if (GetFixedKeySize(field_types[i]) != 0) {
+      output += PrintNormalizedKey(field_types[i], field);
+      continue;
+    }
+    // Unescape the field.
+    std::vector<std::byte> native;
+    for (std::size_t j = 0; j + 2 < field.size(); ++j) {
+      native.push_back(field[j]);
+      j += field[j] == std::byte {0} ? 1 : 0;
+    }
+    output += PrintNormalizedKey(field_types[i], native);
+  }
+  if (!key.empty()) {
+    output += " ... " + HexDumpBytes(key);
+  }
+  return output + ")";
+}
+
+std::optional<std::vector<std::byte>> PrefixSuccessor(std::span<const std::byte> prefix) {
+  std::vector<std::byte> successor(prefix.begin(), prefix.end());
+  // Drop trailing 0xFF bytes, then increment the last byte.
+  while (!successor.empty() && successor.back() == std::byte {0xFF}) {
+    successor.pop_back();
+  }
+  if (successor.empty()) {
+    return {};
+  }
+  successor.back() = static_cast<std::byte>(static_cast<uint8_t>(successor.back()) + 1);
+  return successor;
+}
+
+}  // namespace neversql::internal
@@ -26,10 +26,7 @@ OverflowEntry::OverflowEntry(std::span<const std::byte> entry_header, const BTre
 }
 
 std::span<const std::byte> OverflowEntry::GetData() const noexcept {
-  const auto entry = node_->GetEntry(SpanValue(overflow_key_), btree_manager_);
-  const auto data = entry->GetData();
-  // Bypass next page (first sizeof(page_number_t) bytes), just return the data.
-  return data.subspan(sizeof(page_number_t));
+  return data_;
 }
 
 bool OverflowEntry::Advance() {
@@ -37,7 +34,8 @@ bool OverflowEntry::Advance() {
     return false;
   }
 
-  node_ = btree_manager_->loadNodePage(next_page_number_);
+  node_ = std::move(next_node_);
+  next_node_.reset();
   setup();
 
   return true;
@@ -52,13 +50,20 @@ void OverflowEntry::setup() {
     return;
   }
 
-  const auto entry = node_->GetEntry(SpanValue(overflow_key_), btree_manager_);
+  const auto entry = node_->GetEntry(NormalizePrimaryKey(overflow_key_), btree_manager_);
   NOSQL_ASSERT(
       entry,
       "could not find entry for overflow key " << overflow_key_ << " in page " << node_->GetPageNumber());
+  // The data is in the node's page, which the node keeps in the page cache.
   const auto data = entry->GetData();
   const auto next_page_span = data.subspan(0, sizeof(primary_key_t));
   next_page_number_ = *reinterpret_cast<const page_number_t*>(next_page_span.data());
+  // Bypass next page (first sizeof(page_number_t) bytes), the rest is the data.
+  data_ = data.subspan(sizeof(page_number_t));
+
+  if (next_page_number_ != 0) {
+    next_node_ = btree_manager_->loadNodePage(next_page_number_);
+  }
 }
 
 }  // namespace neversql::internal
\ No newline at end of file
@@ -0,0 +1,53 @@
+//
+// Created by Nathaniel Rupprecht on 10/17/26.
+//
+
+#include "NeverSQL/data/internals/SegmentedBuffer.h"
+// Other files.
+#include "NeverSQL/data/internals/DatabaseEntry.h"
+
+namespace neversql::internal {
+
+SegmentedBuffer::SegmentedBuffer(DatabaseEntry& entry)
+    : segment_(entry.GetData())
+    , entry_(&entry) {}
+
+std::string SegmentedBuffer::ReadString(std::size_t size) {
+  std::string value;
+  value.reserve(size);
+  while (value.size() < size) {
+    const bool has_data = !segment_.empty() || nextSegment();
+    NOSQL_REQUIRE(has_data, "buffer ended " << size - value.size() << " bytes before the end of a string");
+    const auto piece = segment_.first(std::min(segment_.size(), size - value.size()));
+    value.append(reinterpret_cast<const char*>(piece.data()), piece.size());
+    consume(piece.size());
+  }
+  return value;
+}
+
+bool SegmentedBuffer::IsEmpty() {
+  return segment_.empty() && !nextSegment();
+}
+
+bool SegmentedBuffer::nextSegment() {
+  while (entry_ && entry_->Advance()) {
+    segment_ = entry_->GetData();
+    if (!segment_.empty()) {
+      return true;
+    }
+  }
+  return false;
+}
+
+void SegmentedBuffer::readAcrossSegments(std::span<std::byte> destination) {
+  while (!destination.empty()) {
+    const bool has_data = !segment_.empty() || nextSegment();
+    NOSQL_REQUIRE(has_data, "buffer ended " << destination.size() << " bytes before the end of a value");
+    const auto size = std::min(segment_.size(), destination.size());
+    std::ranges::copy(segment_.first(size), destination.begin());
+    consume(size);
+    destination = destination.subspan(size);
+  }
+}
+
+}  // namespace neversql::internal
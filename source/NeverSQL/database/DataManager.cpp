@@ -30,10 +30,17 @@ DataManager::DataManager(const std::filesystem::path& database_path)
 
     collection_index_ = std::make_unique<BTreeManager>(meta.GetIndexPage(), page_cache_);
     std::size_t num_collections {};
+    std::vector<std::unique_ptr<Document>> index_documents;
     for (auto entry : *collection_index_) {
       // Interpret the data as a document.
       auto document = internal::EntryToDocument(*entry);
 
+      // Secondary indexes are registered in the collection index too, see CreateIndex.
+      if (document->GetElement("field_name")) {
+        index_documents.push_back(std::move(document));
+        continue;
+      }
+
       auto collection_name = document->TryGetAs<std::string>("collection_name").value();
       auto page_number = document->TryGetAs<page_number_t>("index_page_number").value();
 
@@ -43,13 +50,43 @@ DataManager::DataManager(const std::filesystem::path& database_path)
       ++num_collections;
     }
     LOG_SEV(Debug) << "Found " << num_collections << " collections.";
+
+    for (auto& document : index_documents) {
+      IndexInfo info {.collection_name = document->TryGetAs<std::string>("collection_name").value(),
+                      .field_name = document->TryGetAs<std::string>("field_name").value(),
+                      .is_unique = document->TryGetAs<bool>("is_unique").value(),
+                      .is_multikey = document->TryGetAs<bool>("is_multikey").value_or(false)};
+      if (auto included_fields = document->GetElement("included_fields")) {
+        auto& array = dynamic_cast<const ArrayValue&>(included_fields->get());
+        for (std::size_t i = 0; i < array.GetNumElements(); ++i) {
+          info.included_fields.push_back(*array.GetElement(i).TryGetAs<std::string>());
+        }
+      }
+      auto page_number = document->TryGetAs<page_number_t>("index_page_number").value();
+
+      LOG_SEV(Debug) << "Loaded index on '" << info.collection_name << "." << info.field_name
+                     << "' with index page " << page_number << ".";
+      if (info.is_unique) {
+        unique_check_locks_.try_emplace(info.collection_name);
+      }
+      auto& indexes = indexes_[info.collection_name];
+      indexes.push_back(
+          std::make_unique<SecondaryIndex>(info, std::make_unique<BTreeManager>(page_number, page_cache_)));
+    }
   }
 }
 
 void DataManager::AddCollection(const std::string& collection_name, DataTypeEnum key_type) {
   // Create a new B-tree for the collection
-  auto btree = BTreeManager::CreateNewBTree(page_cache_, key_type);
+  addCollection(collection_name, BTreeManager::CreateNewBTree(page_cache_, key_type));
+}
+
+void DataManager::AddCollection(const std::string& collection_name,
+                                const std::vector<DataTypeEnum>& key_fields) {
+  addCollection(collection_name, BTreeManager::CreateNewBTree(page_cache_, key_fields));
+}
 
+void DataManager::addCollection(const std::string& collection_name, std::unique_ptr<BTreeManager> btree) {
   auto page_number = btree->GetRootPageNumber();
 
   auto document = std::make_unique<Document>();
@@ -64,17 +101,30 @@ void DataManager::AddCollection(const std::string& collection_name, DataTypeEnum
 }
 
 void DataManager::AddCollection(const CollectionInfo& info) {
+  if (!info.key_fields.empty()) {
+    AddCollection(info.collection_name, info.key_fields);
+    return;
+  }
   AddCollection(std::move(info.collection_name), info.key_type);
 }
 
 void DataManager::AddValue(const std::string& collection_name, GeneralKey key, const Document& document) {
+  std::shared_lock lock(index_lock_);
   // Find the collection.
-  auto it = collections_.find(collection_name);
-  // TODO: Error handling without throwing.
-  NOSQL_ASSERT(it != collections_.end(), "Collection '" << collection_name << "' does not exist.");
+  auto& btree = getCollection(collection_name);
+  // Two writers could both find that a value is not in a unique index yet, so the check and the index insert
+  // are made together.
+  const auto unique_check_lock = lockUniqueChecks(collection_name);
+  checkUniqueness(collection_name, document);
 
   auto creator = internal::MakeCreator<internal::DocumentPayloadSerializer>(document);
-  it->second->AddValue(key, creator);
+  const auto build_locks = lockIndexBuilds(collection_name);
+  btree.AddValue(key, creator);
+  if (indexes_.contains(collection_name) || !build_locks.empty()) {
+    const auto normalized_key = btree.normalizeKey(key, true);
+    addToIndexes(collection_name, document, normalized_key.Get());
+    recordWrite(collection_name, document, normalized_key.Get(), true);
+  }
 }
 
 SearchResult DataManager::Search(const std::string& collection_name, GeneralKey key) const {
@@ -82,7 +132,8 @@ SearchResult DataManager::Search(const std::string& collection_name, GeneralKey
   auto it = collections_.find(collection_name);
   // TODO: Error handling without throwing.
   NOSQL_ASSERT(it != collections_.end(), "Collection '" << collection_name << "' does not exist.");
-  return it->second->search(key);
+  const auto normalized_key = it->second->normalizeKey(key);
+  return it->second->search(normalized_key.Get());
 }
 
 RetrievalResult DataManager::Retrieve(const std::string& collection_name, GeneralKey key) const {
@@ -90,17 +141,64 @@ RetrievalResult DataManager::Retrieve(const std::string& collection_name, Genera
   auto it = collections_.find(collection_name);
   // TODO: Error handling without throwing.
   NOSQL_ASSERT(it != collections_.end(), "Collection '" << collection_name << "' does not exist.");
-  return it->second->retrieve(key);
+  const auto normalized_key = it->second->normalizeKey(key);
+  return it->second->retrieve(normalized_key.Get());
 }
 
-void DataManager::AddValue(const std::string& collection_name, const Document& document) {
+bool DataManager::Validate(const std::string& collection_name, const RetrievalResult& result) const {
   // Find the collection.
   auto it = collections_.find(collection_name);
-  // TODO: Error handling without throwing.
   NOSQL_ASSERT(it != collections_.end(), "Collection '" << collection_name << "' does not exist.");
+  return it->second->Validate(result.search_result);
+}
+
+bool DataManager::Remove(const std::string& collection_name, GeneralKey key) {
+  std::shared_lock lock(index_lock_);
+  // Find the collection.
+  auto& btree = getCollection(collection_name);
+  const auto build_locks = lockIndexBuilds(collection_name);
+  auto indexes = indexes_.find(collection_name);
+  if (indexes == indexes_.end() && build_locks.empty()) {
+    return btree.RemoveValue(key);
+  }
+
+  // The document's index entries are found from the values of its fields, so read it before removing it.
+  const auto normalized_key = btree.normalizeKey(key, true);
+  auto result = btree.retrieve(normalized_key.Get());
+  if (!result.entry) {
+    return false;
+  }
+  const auto document = internal::EntryToDocument(*result.entry);
+  result = {};
+  if (!btree.RemoveValue(key)) {
+    return false;
+  }
+  if (indexes != indexes_.end()) {
+    for (auto& index : indexes->second) {
+      index->Remove(*document, normalized_key.Get());
+    }
+  }
+  recordWrite(collection_name, *document, normalized_key.Get(), false);
+  return true;
+}
+
+void DataManager::AddValue(const std::string& collection_name, const Document& document) {
+  std::shared_lock lock(index_lock_);
+  // Find the collection.
+  auto& btree = getCollection(collection_name);
+  // Two writers could both find that a value is not in a unique index yet, so the check and the index insert
+  // are made together.
+  const auto unique_check_lock = lockUniqueChecks(collection_name);
+  checkUniqueness(collection_name, document);
 
   auto creator = internal::MakeCreator<internal::DocumentPayloadSerializer>(document);
-  it->second->AddValue(creator);
+  const auto build_locks = lockIndexBuilds(collection_name);
+  const auto primary_key = btree.AddValue(creator);
+  if (indexes_.contains(collection_name) || !build_locks.empty()) {
+    const auto normalized_key = internal::NormalizePrimaryKey(primary_key);
+    addToIndexes(collection_name, document, normalized_key);
+    recordWrite(collection_name, document, normalized_key, true);
+  }
 }
 
 SearchResult DataManager::Search(const std::string& collection_name, primary_key_t key) const {
@@ -113,6 +211,24 @@ RetrievalResult DataManager::Retrieve(const std::string& collection_name, primar
   return Retrieve(collection_name, key_span);
 }
 
+bool DataManager::Remove(const std::string& collection_name, primary_key_t key) {
+  const GeneralKey key_span = internal::SpanValue(key);
+  return Remove(collection_name, key_span);
+}
+
+void DataManager::Checkpoint() {
+  std::shared_lock lock(index_lock_);
+  collection_index_->Checkpoint();
+  for (auto& [name, btree] : collections_) {
+    btree->Checkpoint();
+  }
+  for (auto& [name, indexes] : indexes_) {
+    for (auto& index : indexes) {
+      index->GetBTree().Checkpoint();
+    }
+  }
+}
+
 std::set<std::string> DataManager::GetCollectionNames() const {
   std::set<std::string> output;
   std::ranges::for_each(collections_, [&output](const auto& pair) { output.insert(pair.first); });
@@ -131,6 +247,310 @@ BTreeManager::Iterator DataManager::End(const std::string& collection_name) cons
   return manager.end();
 }
 
+BTreeManager::Iterator DataManager::RBegin(const std::string& collection_name) const {
+  auto it = collections_.find(collection_name);
+  NOSQL_ASSERT(it != collections_.end(), "Collection '" << collection_name << "' does not exist.");
+  return it->second->rbegin();
+}
+
+BTreeManager::Iterator DataManager::Scan(const std::string& collection_name,
+                                         const KeyRange& range,
+                                         ScanDirection direction) const {
+  auto it = collections_.find(collection_name);
+  // TODO: Error handling without throwing.
+  NOSQL_ASSERT(it != collections_.end(), "Collection '" << collection_name << "' does not exist.");
+  return it->second->Scan(range, direction);
+}
+
+BTreeManager::Iterator DataManager::ScanPrefix(const std::string& collection_name,
+                                               GeneralKey prefix,
+                                               ScanDirection direction) const {
+  auto it = collections_.find(collection_name);
+  // TODO: Error handling without throwing.
+  NOSQL_ASSERT(it != collections_.end(), "Collection '" << collection_name << "' does not exist.");
+  return it->second->ScanPrefix(prefix, direction);
+}
+
+BTreeManager::Iterator DataManager::Scan(const std::string& collection_name,
+                                         std::optional<GeneralKey> lower,
+                                         std::optional<GeneralKey> upper,
+                                         bool lower_inclusive,
+                                         bool upper_inclusive,
+                                         ScanDirection direction) const {
+  return Scan(collection_name,
+              KeyRange {.lower = lower,
+                        .upper = upper,
+                        .lower_inclusive = lower_inclusive,
+                        .upper_inclusive = upper_inclusive},
+              direction);
+}
+
+BTreeManager::Iterator DataManager::Scan(const std::string& collection_name,
+                                         primary_key_t lower,
+                                         primary_key_t upper,
+                                         bool lower_inclusive,
+                                         bool upper_inclusive,
+                                         ScanDirection direction) const {
+  return Scan(collection_name,
+              internal::SpanValue(lower),
+              internal::SpanValue(upper),
+              lower_inclusive,
+              upper_inclusive,
+              direction);
+}
+
+uint64_t DataManager::Count(const std::string& collection_name) const {
+  return getCollection(collection_name).Count();
+}
+
+uint64_t DataManager::Count(const std::string& collection_name, const KeyRange& range) const {
+  return getCollection(collection_name).Count(range);
+}
+
+BTreeManager::Iterator DataManager::Skip(const std::string& collection_name,
+                                         uint64_t offset,
+                                         ScanDirection direction) const {
+  return getCollection(collection_name).Skip(offset, direction);
+}
+
+void DataManager::CreateIndex(const std::string& collection_name,
+                              const std::string& field_name,
+                              bool is_unique) {
+  CreateIndex(
+      IndexInfo {.collection_name = collection_name, .field_name = field_name, .is_unique = is_unique});
+}
+
+void DataManager::CreateIndex(const IndexInfo& info) {
+  StartIndexBuild(info);
+  const auto stats = WaitForIndexBuild(info.collection_name, info.field_name);
+  NOSQL_REQUIRE(stats.phase == IndexBuildPhase::Done,
+                "could not create index on '" << info.collection_name << "." << info.field_name
+                                               << "': " << stats.error);
+}
+
+void DataManager::StartIndexBuild(const std::string& collection_name,
+                                  const std::string& field_name,
+                                  bool is_unique) {
+  StartIndexBuild(
+      IndexInfo {.collection_name = collection_name, .field_name = field_name, .is_unique = is_unique});
+}
+
+void DataManager::StartIndexBuild(const IndexInfo& info) {
+  const auto& collection_name = info.collection_name;
+  const auto& field_name = info.field_name;
+  std::unique_lock lock(index_lock_);
+  auto& btree = getCollection(collection_name);
+  NOSQL_REQUIRE(!findIndex(collection_name, field_name),
+                "collection '" << collection_name << "' already has an index on '" << field_name << "'");
+  auto& builds = index_builds_[collection_name];
+  auto previous = std::ranges::find_if(
+      builds, [&field_name](const auto& build) { return build->GetInfo().field_name == field_name; });
+  if (previous != builds.end()) {
+    NOSQL_REQUIRE(!(*previous)->IsActive(),
+                  "index on '" << collection_name << "." << field_name << "' is already being built");
+    builds.erase(previous);
+  }
+
+  auto index = std::make_unique<SecondaryIndex>(
+      info, BTreeManager::CreateNewBTree(page_cache_, DataTypeEnum::BinaryData));
+  // Sorted runs are written to a directory named after the index's root page, which no other index has.
+  auto run_directory =
+      data_access_layer_.db_path_ / "indexbuilds" / std::to_string(index->GetBTree().GetRootPageNumber());
+  builds.push_back(std::make_shared<IndexBuilder>(
+      std::move(index), btree, std::move(run_directory), [this](IndexBuilder& builder) {
+        publishIndex(builder);
+      }));
+  builds.back()->Start();
+}
+
+std::optional<IndexBuildStats> DataManager::GetIndexBuildStats(const std::string& collection_name,
+                                                               const std::string& field_name) const {
+  std::shared_lock lock(index_lock_);
+  if (auto build = findIndexBuild(collection_name, field_name)) {
+    return build->GetStats();
+  }
+  return {};
+}
+
+IndexBuildStats DataManager::WaitForIndexBuild(const std::string& collection_name,
+                                               const std::string& field_name) {
+  std::shared_ptr<IndexBuilder> build;
+  {
+    // The build needs the lock to make its index visible, so do not hold it while waiting.
+    std::shared_lock lock(index_lock_);
+    build = findIndexBuild(collection_name, field_name);
+  }
+  NOSQL_REQUIRE(build, "index on '" << collection_name << "." << field_name << "' was not built");
+  return build->Wait();
+}
+
+bool DataManager::HasIndex(const std::string& collection_name, const std::string& field_name) const {
+  std::shared_lock lock(index_lock_);
+  return findIndex(collection_name, field_name) != nullptr;
+}
+
+query::BTreeQueryIterator DataManager::Find(const std::string& collection_name,
+                                            const query::Condition& condition) const {
+  std::shared_lock lock(index_lock_);
+  const auto& btree = getCollection(collection_name);
+  if (auto equality = condition.GetEquality()) {
+    if (auto index = findIndex(collection_name, *equality)) {
+      // Values that cannot be indexed are never in the index.
+      if (auto value = SecondaryIndex::EncodeValue(equality->type, equality->value)) {
+        return query::BTreeQueryIterator(index->Seek(*value), *index, btree);
+      }
+      return query::BTreeQueryIterator(btree.end(), *index, btree);
+    }
+  }
+  return query::BTreeQueryIterator(btree.begin(), condition.Copy());
+}
+
+query::ProjectionIterator DataManager::FindFields(const std::string& collection_name,
+                                                  const query::Condition& condition,
+                                                  std::vector<std::string> field_names) const {
+  {
+    std::shared_lock lock(index_lock_);
+    if (auto equality = condition.GetEquality()) {
+      auto index = findIndex(collection_name, *equality);
+      if (index && index->Covers(field_names)) {
+        if (auto value = SecondaryIndex::EncodeValue(equality->type, equality->value)) {
+          return query::ProjectionIterator(index->Seek(*value), *index, std::move(field_names));
+        }
+      }
+    }
+  }
+  return query::ProjectionIterator(Find(collection_name, condition), std::move(field_names));
+}
+
+BTreeManager& DataManager::getCollection(const std::string& collection_name) const {
+  auto it = collections_.find(collection_name);
+  // TODO: Error handling without throwing.
+  NOSQL_ASSERT(it != collections_.end(), "Collection '" << collection_name << "' does not exist.");
+  return *it->second;
+}
+
+const SecondaryIndex* DataManager::findIndex(const std::string& collection_name,
+                                             const std::string& field_name) const {
+  auto it = indexes_.find(collection_name);
+  if (it == indexes_.end()) {
+    return nullptr;
+  }
+  auto index = std::ranges::find_if(
+      it->second, [&field_name](const auto& index) { return index->GetInfo().field_name == field_name; });
+  return index == it->second.end() ? nullptr : index->get();
+}
+
+const SecondaryIndex* DataManager::findIndex(const std::string& collection_name,
+                                             const query::FieldEquality& equality) const {
+  // Only multikey indexes have entries for the elements of arrays, and only for them.
+  auto index = findIndex(collection_name, equality.field_name);
+  return index && index->IsMultikey() == equality.is_element ? index : nullptr;
+}
+
+void DataManager::addToIndexes(const std::string& collection_name,
+                               const Document& document,
+                               std::span<const std::byte> primary_key) {
+  if (auto it = indexes_.find(collection_name); it != indexes_.end()) {
+    for (auto& index : it->second) {
+      index->Insert(document, primary_key);
+    }
+  }
+}
+
+std::shared_ptr<IndexBuilder> DataManager::findIndexBuild(const std::string& collection_name,
+                                                          const std::string& field_name) const {
+  auto it = index_builds_.find(collection_name);
+  if (it == index_builds_.end()) {
+    return nullptr;
+  }
+  auto build = std::ranges::find_if(
+      it->second, [&field_name](const auto& build) { return build->GetInfo().field_name == field_name; });
+  return build == it->second.end() ? nullptr : *build;
+}
+
+std::vector<std::unique_lock<std::mutex>> DataManager::lockIndexBuilds(
+    const std::string& collection_name) const {
+  std::vector<std::unique_lock<std::mutex>> locks;
+  if (auto it = index_builds_.find(collection_name); it != index_builds_.end()) {
+    for (auto& build : it->second) {
+      if (build->IsActive()) {
+        locks.emplace_back(build->GetWriteLogLock());
+      }
+    }
+  }
+  return locks;
+}
+
+void DataManager::recordWrite(const std::string& collection_name,
+                              const Document& document,
+                              std::span<const std::byte> primary_key,
+                              bool is_insert) const {
+  if (auto it = index_builds_.find(collection_name); it != index_builds_.end()) {
+    for (auto& build : it->second) {
+      build->RecordWrite(document, primary_key, is_insert);
+    }
+  }
+}
+
+void DataManager::publishIndex(IndexBuilder& builder) {
+  // Writes to collections hold the lock shared, so no writes are made while the last writes are applied.
+  std::unique_lock lock(index_lock_);
+  auto index = builder.FinishCatchUp();
+  const auto& info = index->GetInfo();
+  index->GetBTree().Checkpoint();
+  registerIndex(info, index->GetBTree().GetRootPageNumber());
+  if (info.is_unique) {
+    unique_check_locks_.try_emplace(info.collection_name);
+  }
+  indexes_[info.collection_name].push_back(std::move(index));
+}
+
+void DataManager::registerIndex(const IndexInfo& info, page_number_t page_number) {
+  auto document = std::make_unique<Document>();
+  document->AddElement("collection_name", StringValue {info.collection_name});
+  document->AddElement("field_name", StringValue {info.field_name});
+  document->AddElement("is_unique", BooleanValue {info.is_unique});
+  if (info.is_multikey) {
+    document->AddElement("is_multikey", BooleanValue {info.is_multikey});
+  }
+  if (!info.included_fields.empty()) {
+    ArrayValue included_fields(DataTypeEnum::String);
+    for (auto& field_name : info.included_fields) {
+      included_fields.AddElement(StringValue {field_name});
+    }
+    document->AddElement("included_fields", std::move(included_fields));
+  }
+  document->AddElement("index_page_number", IntegralValue {page_number});
+
+  // The key sorts right after the collection's own entry.
+  const auto registry_key = info.collection_name + '\0' + info.field_name;
+  auto creator = internal::MakeCreator<internal::DocumentPayloadSerializer>(std::move(document));
+  collection_index_->AddValue(internal::SpanValue(registry_key), creator);
+
+  LOG_SEV(Debug) << "Registered index on '" << info.collection_name << "." << info.field_name
+                 << "' with index page " << page_number << ".";
+}
+
+std::unique_lock<std::mutex> DataManager::lockUniqueChecks(const std::string& collection_name) const {
+  if (auto it = unique_check_locks_.find(collection_name); it != unique_check_locks_.end()) {
+    return std::unique_lock(it->second);
+  }
+  return {};
+}
+
+void DataManager::checkUniqueness(const std::string& collection_name, const Document& document) const {
+  auto it = indexes_.find(collection_name);
+  if (it == indexes_.end()) {
+    return;
+  }
+  for (auto& index : it->second) {
+    NOSQL_REQUIRE(index->CanInsert(document),
+                  "a document in collection '" << collection_name << "' already has the same value for '"
+                                               << index->GetInfo().field_name
+                                               << "', which has a unique index");
+  }
+}
+
 bool DataManager::HexDumpPage(page_number_t page_number,
                               std::ostream& out,
                               utility::HexDumpOptions options) const {
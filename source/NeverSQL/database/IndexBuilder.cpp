@@ -0,0 +1,334 @@
+//
+// Created by Nathaniel Rupprecht on 10/17/26.
+//
+
+#include "NeverSQL/database/IndexBuilder.h"
+// Other files.
+#include <fstream>
+#include <queue>
+
+#include "NeverSQL/data/internals/SpanPayloadSerializer.h"
+
+namespace neversql {
+
+std::string to_string(IndexBuildPhase phase) {
+  // clang-format off
+  switch (phase) {
+    case IndexBuildPhase::Scanning: return "Scanning";
+    case IndexBuildPhase::Loading: return "Loading";
+    case IndexBuildPhase::CatchingUp: return "CatchingUp";
+    case IndexBuildPhase::Done: return "Done";
+    case IndexBuildPhase::Failed: return "Failed";
+    default: return lightning::formatting::Format("<unknown, value = {}>", static_cast<int>(phase));
+  }
+  // clang-format on
+}
+
+double IndexBuildStats::GetProgress() const noexcept {
+  // Scanning the collection and loading the index take about the same time, catching up is quick.
+  switch (phase) {
+    case IndexBuildPhase::Scanning:
+      return total_documents == 0
+          ? 0.
+          : 0.5 * std::min(1., static_cast<double>(documents_scanned) / static_cast<double>(total_documents));
+    case IndexBuildPhase::Loading:
+      return entries_sorted == 0 ? 0.5
+                                 : 0.5 + 0.5 * static_cast<double>(entries_loaded)
+                                         / static_cast<double>(entries_sorted);
+    case IndexBuildPhase::CatchingUp:
+    case IndexBuildPhase::Done:
+      return 1.;
+    default:
+      return 0.;
+  }
+}
+
+double IndexBuildStats::GetDocumentsPerSecond() const noexcept {
+  return elapsed.count() == 0 ? 0. : static_cast<double>(documents_scanned) / elapsed.count();
+}
+
+double IndexBuildStats::GetEntriesPerSecond() const noexcept {
+  return elapsed.count() == 0 ? 0. : static_cast<double>(entries_loaded) / elapsed.count();
+}
+
+IndexBuilder::IndexBuilder(std::unique_ptr<SecondaryIndex> index,
+                           BTreeManager& collection,
+                           std::filesystem::path run_directory,
+                           PublishCallback publish)
+    : info_(index->GetInfo())
+    , index_(std::move(index))
+    , collection_(collection)
+    , run_directory_(std::move(run_directory))
+    , publish_(std::move(publish)) {}
+
+IndexBuilder::~IndexBuilder() {
+  is_stopped_ = true;
+  if (thread_.joinable()) {
+    thread_.join();
+  }
+}
+
+void IndexBuilder::Start() {
+  start_time_ = std::chrono::steady_clock::now();
+  const auto total_documents = collection_.Count();
+  updateStats([total_documents](auto& stats) { stats.total_documents = total_documents; });
+  thread_ = std::thread([this] { run(); });
+}
+
+IndexBuildStats IndexBuilder::Wait() {
+  if (thread_.joinable()) {
+    thread_.join();
+  }
+  return GetStats();
+}
+
+IndexBuildStats IndexBuilder::GetStats() const {
+  std::lock_guard lock(stats_lock_);
+  auto stats = stats_;
+  if (stats.phase != IndexBuildPhase::Done && stats.phase != IndexBuildPhase::Failed) {
+    stats.elapsed = std::chrono::steady_clock::now() - start_time_;
+  }
+  return stats;
+}
+
+void IndexBuilder::RecordWrite(const Document& document,
+                               std::span<const std::byte> primary_key,
+                               bool is_insert) {
+  if (!is_active_) {
+    return;
+  }
+  auto values = index_->GetIndexedValues(document);
+  if (values.empty()) {
+    return;
+  }
+  const auto entry_value =
+      is_insert ? index_->MakeEntryValue(document, primary_key) : std::vector<std::byte> {};
+  for (auto& value : values) {
+    write_log_.push_back(
+        {is_insert, std::move(value), {primary_key.begin(), primary_key.end()}, entry_value});
+  }
+}
+
+std::unique_ptr<SecondaryIndex> IndexBuilder::FinishCatchUp() {
+  std::vector<RecordedWrite> writes;
+  {
+    std::lock_guard lock(write_log_lock_);
+    writes.swap(write_log_);
+    is_active_ = false;
+  }
+  applyWrites(writes);
+  return std::move(index_);
+}
+
+void IndexBuilder::run() {
+  LOG_SEV(Debug) << "Building index on '" << info_.collection_name << "." << info_.field_name << "'.";
+  try {
+    scan();
+    updateStats([](auto& stats) { stats.phase = IndexBuildPhase::Loading; });
+    load();
+    updateStats([](auto& stats) { stats.phase = IndexBuildPhase::CatchingUp; });
+    catchUp();
+    publish_(*this);
+    updateStats([this](auto& stats) {
+      stats.phase = IndexBuildPhase::Done;
+      stats.elapsed = std::chrono::steady_clock::now() - start_time_;
+    });
+    LOG_SEV(Debug) << "Built index on '" << info_.collection_name << "." << info_.field_name << "'.";
+  }
+  catch (const std::exception& ex) {
+    {
+      std::lock_guard lock(write_log_lock_);
+      is_active_ = false;
+      write_log_.clear();
+    }
+    updateStats([&](auto& stats) {
+      stats.phase = IndexBuildPhase::Failed;
+      stats.error = ex.what();
+      stats.elapsed = std::chrono::steady_clock::now() - start_time_;
+    });
+    LOG_SEV(Warning) << "Could not build index on '" << info_.collection_name << "." << info_.field_name
+                     << "': " << ex.what();
+  }
+
+  // Remove the sorted runs.
+  std::error_code error;
+  std::filesystem::remove_all(run_directory_, error);
+}
+
+void IndexBuilder::scan() {
+  std::optional<std::vector<std::byte>> last_key;
+  std::vector<std::byte> next_key;
+  for (;;) {
+    checkStopped();
+
+    uint64_t num_entries = 0;
+    const auto num_scanned = collection_.ScanBatch(
+        last_key, INDEX_BUILD_SCAN_BATCH, [&](GeneralKey key, internal::DatabaseEntry& entry) {
+          const auto document = internal::EntryToDocument(entry);
+          const auto values = index_->GetIndexedValues(*document);
+          if (!values.empty()) {
+            const auto entry_value = index_->MakeEntryValue(*document, key);
+            for (auto& value : values) {
+              SortedEntry sorted_entry {.key = SecondaryIndex::MakeKey(value, key),
+                                        .value = entry_value,
+                                        .encoded_value_size = static_cast<uint32_t>(value.size())};
+              entries_size_ += sorted_entry.key.size() + sorted_entry.value.size();
+              entries_.push_back(std::move(sorted_entry));
+              ++num_entries;
+            }
+          }
+          next_key.assign(key.begin(), key.end());
+        });
+    if (num_scanned == 0) {
+      break;
+    }
+    last_key = next_key;
+
+    updateStats([&](auto& stats) {
+      stats.documents_scanned += num_scanned;
+      stats.entries_sorted += num_entries;
+    });
+    if (INDEX_BUILD_RUN_BYTES <= entries_size_) {
+      writeRun();
+    }
+  }
+}
+
+void IndexBuilder::writeRun() {
+  std::ranges::sort(entries_, {}, &SortedEntry::key);
+
+  std::filesystem::create_directories(run_directory_);
+  auto path = run_directory_ / ("run-" + std::to_string(runs_.size()));
+  std::ofstream out(path, std::ios::binary);
+  NOSQL_REQUIRE(out, "could not open sorted run file " << path);
+  // Each entry is written as
+  //   [key size: 4 bytes][encoded value size: 4 bytes][value size: 4 bytes][key][value].
+  for (auto& entry : entries_) {
+    const auto key_size = static_cast<uint32_t>(entry.key.size());
+    const auto value_size = static_cast<uint32_t>(entry.value.size());
+    out.write(reinterpret_cast<const char*>(&key_size), sizeof(key_size));
+    out.write(reinterpret_cast<const char*>(&entry.encoded_value_size), sizeof(entry.encoded_value_size));
+    out.write(reinterpret_cast<const char*>(&value_size), sizeof(value_size));
+    out.write(reinterpret_cast<const char*>(entry.key.data()), key_size);
+    out.write(reinterpret_cast<const char*>(entry.value.data()), value_size);
+  }
+  NOSQL_REQUIRE(out, "could not write sorted run file " << path);
+
+  LOG_SEV(Debug) << "Wrote sorted run " << runs_.size() << " with " << entries_.size() << " entries.";
+  runs_.push_back(std::move(path));
+  entries_.clear();
+  entries_size_ = 0;
+  updateStats([this](auto& stats) { stats.sorted_runs = runs_.size(); });
+}
+
+void IndexBuilder::load() {
+  if (runs_.empty()) {
+    // Everything fits in memory.
+    std::ranges::sort(entries_, {}, &SortedEntry::key);
+    for (auto& entry : entries_) {
+      appendEntry(entry);
+    }
+    entries_.clear();
+    return;
+  }
+  if (!entries_.empty()) {
+    writeRun();
+  }
+
+  // Merge the runs, always appending the smallest entry at the front of a run.
+  struct Run {
+    std::ifstream in;
+    SortedEntry entry;
+
+    bool Next() {
+      uint32_t key_size {}, value_size {};
+      if (!in.read(reinterpret_cast<char*>(&key_size), sizeof(key_size))) {
+        return false;
+      }
+      in.read(reinterpret_cast<char*>(&entry.encoded_value_size), sizeof(entry.encoded_value_size));
+      in.read(reinterpret_cast<char*>(&value_size), sizeof(value_size));
+      entry.key.resize(key_size);
+      entry.value.resize(value_size);
+      in.read(reinterpret_cast<char*>(entry.key.data()), key_size);
+      in.read(reinterpret_cast<char*>(entry.value.data()), value_size);
+      return static_cast<bool>(in);
+    }
+  };
+  std::vector<Run> runs(runs_.size());
+  auto greater = [&runs](std::size_t i, std::size_t j) { return runs[j].entry.key < runs[i].entry.key; };
+  std::priority_queue<std::size_t, std::vector<std::size_t>, decltype(greater)> queue(greater);
+  for (std::size_t i = 0; i < runs_.size(); ++i) {
+    runs[i].in.open(runs_[i], std::ios::binary);
+    NOSQL_REQUIRE(runs[i].in, "could not open sorted run file " << runs_[i]);
+    if (runs[i].Next()) {
+      queue.push(i);
+    }
+  }
+  while (!queue.empty()) {
+    const auto i = queue.top();
+    queue.pop();
+    appendEntry(runs[i].entry);
+    if (runs[i].Next()) {
+      queue.push(i);
+    }
+  }
+}
+
+void IndexBuilder::appendEntry(const SortedEntry& entry) {
+  const auto value = std::span(entry.key).first(entry.encoded_value_size);
+  if (info_.is_unique) {
+    NOSQL_REQUIRE(!has_last_value_ || !std::ranges::equal(value, last_value_),
+                  "two documents have the same value for '" << info_.field_name
+                                                            << "', which should have a unique index");
+    last_value_.assign(value.begin(), value.end());
+    has_last_value_ = true;
+  }
+  auto creator = internal::MakeCreator<internal::SpanPayloadSerializer>(entry.value);
+  index_->GetBTree().AppendValue(entry.key, creator);
+
+  // Update the stats every so often.
+  if (++num_loaded_ % INDEX_BUILD_SCAN_BATCH == 0) {
+    checkStopped();
+    updateStats([this](auto& stats) { stats.entries_loaded = num_loaded_; });
+  }
+}
+
+void IndexBuilder::catchUp() {
+  updateStats([this](auto& stats) { stats.entries_loaded = num_loaded_; });
+  for (;;) {
+    checkStopped();
+    std::vector<RecordedWrite> writes;
+    {
+      std::lock_guard lock(write_log_lock_);
+      if (write_log_.size() <= INDEX_BUILD_FINAL_CATCH_UP) {
+        return;
+      }
+      writes.swap(write_log_);
+    }
+    applyWrites(writes);
+  }
+}
+
+void IndexBuilder::applyWrites(const std::vector<RecordedWrite>& writes) {
+  // Writes to documents that the scan read after the write are already in the index.
+  for (auto& write : writes) {
+    if (write.is_insert) {
+      index_->InsertEntry(write.encoded_value, write.primary_key, write.entry_value);
+    }
+    else {
+      index_->RemoveEntry(write.encoded_value, write.primary_key);
+    }
+  }
+  updateStats([&writes](auto& stats) { stats.writes_caught_up += writes.size(); });
+}
+
+void IndexBuilder::checkStopped() const {
+  NOSQL_REQUIRE(!is_stopped_, "the index build was stopped");
+}
+
+void IndexBuilder::updateStats(const std::function<void(IndexBuildStats&)>& update) {
+  std::lock_guard lock(stats_lock_);
+  update(stats_);
+}
+
+}  // namespace neversql
@@ -0,0 +1,180 @@
+//
+// Created by Nathaniel Rupprecht on 10/17/26.
+//
+
+#include "NeverSQL/database/SecondaryIndex.h"
+// Other files.
+#include "NeverSQL/data/internals/KeyEncoding.h"
+#include "NeverSQL/data/internals/SegmentedBuffer.h"
+#include "NeverSQL/data/internals/SpanPayloadSerializer.h"
+#include "NeverSQL/data/internals/Utility.h"
+
+namespace neversql {
+
+SecondaryIndex::SecondaryIndex(IndexInfo info, std::unique_ptr<BTreeManager> btree)
+    : info_(std::move(info))
+    , btree_(std::move(btree)) {
+  if (IsCovering()) {
+    stored_fields_.push_back(info_.field_name);
+    stored_fields_.insert(stored_fields_.end(), info_.included_fields.begin(), info_.included_fields.end());
+  }
+}
+
+std::optional<std::vector<std::byte>> SecondaryIndex::EncodeValue(DataTypeEnum type,
+                                                                  std::span<const std::byte> native_value) {
+  if (!internal::IsValidKeyType(type)) {
+    return {};
+  }
+  std::vector<std::byte> encoded {static_cast<std::byte>(type)};
+  internal::AppendCompositeKeyField(type, native_value, encoded);
+  return encoded;
+}
+
+std::optional<std::vector<std::byte>> SecondaryIndex::EncodeValue(const DocumentValue& value) {
+  // clang-format off
+  switch (const auto type = value.GetDataType()) {
+    case DataTypeEnum::Double: return EncodeValue(type, internal::SpanValue(*value.TryGetAs<double>()));
+    case DataTypeEnum::Boolean: return EncodeValue(type, internal::SpanValue(*value.TryGetAs<bool>()));
+    case DataTypeEnum::Int32: return EncodeValue(type, internal::SpanValue(*value.TryGetAs<int32_t>()));
+    case DataTypeEnum::Int64: return EncodeValue(type, internal::SpanValue(*value.TryGetAs<int64_t>()));
+    case DataTypeEnum::UInt64: return EncodeValue(type, internal::SpanValue(*value.TryGetAs<uint64_t>()));
+    case DataTypeEnum::String: return EncodeValue(type, internal::SpanValue(*value.TryGetAs<std::string>()));
+    default: return {};
+  }
+  // clang-format on
+}
+
+std::vector<std::vector<std::byte>> SecondaryIndex::GetIndexedValues(const Document& document) const {
+  std::vector<std::vector<std::byte>> values;
+  auto field = document.GetElement(info_.field_name);
+  if (!field) {
+    return values;
+  }
+  if (!IsMultikey()) {
+    if (auto value = EncodeValue(field->get())) {
+      values.push_back(std::move(*value));
+    }
+    return values;
+  }
+  if (field->get().GetDataType() != DataTypeEnum::Array) {
+    return values;
+  }
+  auto& array = dynamic_cast<const ArrayValue&>(field->get());
+  for (std::size_t i = 0; i < array.GetNumElements(); ++i) {
+    if (auto value = EncodeValue(array.GetElement(i))) {
+      values.push_back(std::move(*value));
+    }
+  }
+  // A document has one entry for each distinct element.
+  std::ranges::sort(values);
+  const auto [first, last] = std::ranges::unique(values);
+  values.erase(first, last);
+  return values;
+}
+
+std::vector<std::byte> SecondaryIndex::MakeEntryValue(const Document& document,
+                                                      std::span<const std::byte> primary_key) const {
+  if (!IsCovering()) {
+    return {primary_key.begin(), primary_key.end()};
+  }
+  lightning::memory::MemoryBuffer<std::byte> buffer;
+  const auto primary_key_size = static_cast<uint16_t>(primary_key.size());
+  buffer.Append(internal::SpanValue(primary_key_size));
+  buffer.Append(primary_key);
+  document.WriteFieldsToBuffer(buffer, stored_fields_);
+  return {buffer.Data(), buffer.Data() + buffer.Size()};
+}
+
+std::vector<std::byte> SecondaryIndex::ReadPrimaryKey(internal::DatabaseEntry& entry) const {
+  if (!IsCovering()) {
+    const auto data = entry.GetData();
+    return {data.begin(), data.end()};
+  }
+  internal::SegmentedBuffer buffer(entry);
+  std::vector<std::byte> primary_key(buffer.Read<uint16_t>());
+  buffer.Read(primary_key);
+  return primary_key;
+}
+
+std::unique_ptr<Document> SecondaryIndex::ReadIncludedFields(internal::DatabaseEntry& entry) const {
+  NOSQL_REQUIRE(IsCovering(),
+                "index on '" << info_.collection_name << "." << info_.field_name
+                             << "' has no included fields");
+  internal::SegmentedBuffer buffer(entry);
+  std::vector<std::byte> primary_key(buffer.Read<uint16_t>());
+  buffer.Read(primary_key);
+  return ReadDocumentFromBuffer(buffer);
+}
+
+bool SecondaryIndex::Covers(std::span<const std::string> field_names) const {
+  return IsCovering() && std::ranges::all_of(field_names, [this](const auto& field_name) {
+           return std::ranges::find(stored_fields_, field_name) != stored_fields_.end();
+         });
+}
+
+bool SecondaryIndex::CanInsert(const Document& document) const {
+  if (!info_.is_unique) {
+    return true;
+  }
+  return std::ranges::all_of(GetIndexedValues(document),
+                             [this](const auto& value) { return Seek(value).IsEnd(); });
+}
+
+void SecondaryIndex::Insert(const Document& document, std::span<const std::byte> primary_key) {
+  const auto values = GetIndexedValues(document);
+  if (values.empty()) {
+    return;
+  }
+  const auto entry_value = MakeEntryValue(document, primary_key);
+  for (auto& value : values) {
+    InsertEntry(value, primary_key, entry_value);
+  }
+}
+
+void SecondaryIndex::Remove(const Document& document, std::span<const std::byte> primary_key) {
+  for (auto& value : GetIndexedValues(document)) {
+    RemoveEntry(value, primary_key);
+  }
+}
+
+bool SecondaryIndex::InsertEntry(std::span<const std::byte> encoded_value,
+                                 std::span<const std::byte> primary_key,
+                                 std::span<const std::byte> entry_value) {
+  const auto key = MakeKey(encoded_value, primary_key);
+  if (!btree_->Scan(KeyRange {.lower = key, .upper = key}).IsEnd()) {
+    return false;
+  }
+  NOSQL_REQUIRE(!info_.is_unique || Seek(encoded_value).IsEnd(),
+                "unique index on '" << info_.collection_name << "." << info_.field_name
+                                    << "' already has an entry for the document's value");
+  auto creator = internal::MakeCreator<internal::SpanPayloadSerializer>(entry_value);
+  btree_->AddValue(key, creator);
+  return true;
+}
+
+void SecondaryIndex::RemoveEntry(std::span<const std::byte> encoded_value,
+                                 std::span<const std::byte> primary_key) {
+  btree_->RemoveValue(MakeKey(encoded_value, primary_key));
+}
+
+BTreeManager::Iterator SecondaryIndex::Seek(std::span<const std::byte> encoded_value) const {
+  return btree_->ScanPrefix(encoded_value);
+}
+
+uint64_t SecondaryIndex::Count(std::span<const std::byte> encoded_value) const {
+  const auto successor = internal::PrefixSuccessor(encoded_value);
+  KeyRange range {.lower = encoded_value, .lower_inclusive = true, .upper_inclusive = false};
+  if (successor) {
+    range.upper = *successor;
+  }
+  return btree_->Count(range);
+}
+
+std::vector<std::byte> SecondaryIndex::MakeKey(std::span<const std::byte> encoded_value,
+                                               std::span<const std::byte> primary_key) {
+  std::vector<std::byte> key(encoded_value.begin(), encoded_value.end());
+  key.insert(key.end(), primary_key.begin(), primary_key.end());
+  return key;
+}
+
+}  // namespace neversql
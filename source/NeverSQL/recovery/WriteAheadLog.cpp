@@ -17,11 +17,13 @@ WriteAheadLog::WriteAheadLog(const std::filesystem::path& log_dir_path)
 }
 
 void WriteAheadLog::BeginTransation(transaction_t transaction_id) {
+  std::lock_guard guard(log_lock_);
   addToBuffer(RecordType::BEGIN);
   addToBuffer(transaction_id);
 }
 
 void WriteAheadLog::CommitTransation(transaction_t transaction_id) {
+  std::lock_guard guard(log_lock_);
   addToBuffer(RecordType::COMMIT);
   addToBuffer(transaction_id);
 }
@@ -36,6 +38,7 @@ void WriteAheadLog::Update(transaction_t transaction_id,
   }
 
   NOSQL_REQUIRE(data_old.size() == data_new.size(), "data_old and data_new must be the same size");
+  std::lock_guard guard(log_lock_);
   NOSQL_REQUIRE(log_file_.is_open(), "WriteAheadLog is not open");
 
   auto data_size = static_cast<std::streamsize>(data_old.size());
@@ -61,6 +64,7 @@ void WriteAheadLog::Update(transaction_t transaction_id,
 }
 
 void WriteAheadLog::Flush() {
+  std::lock_guard guard(log_lock_);
   flushBuffer();
   last_flushed_sequence_number_ = next_sequence_number_ - 1;
 }
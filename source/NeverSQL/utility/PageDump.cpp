@@ -17,8 +17,9 @@ void PageInspector::NodePageDump(const BTreeNodeMap& node, std::ostream& out) {
 
   std::vector<std::size_t> numbers;
   std::vector<page_size_t> offsets;
+  std::vector<uint32_t> key_hints;
   std::vector<std::string> cell_types;
-  std::vector<GeneralKey> primary_keys;
+  std::vector<std::vector<std::byte>> primary_keys;
   std::vector<std::byte> flags;
   std::vector<entry_size_t> data_size;
   std::vector<std::string> data;
@@ -32,6 +33,7 @@ void PageInspector::NodePageDump(const BTreeNodeMap& node, std::ostream& out) {
   for (std::size_t i = 0; i < pointers.size(); ++i) {
     numbers.push_back(i);
     offsets.push_back(pointers[i]);
+    key_hints.push_back(pointers.GetKeyHint(i));
     auto cell = node.getCell(pointers[i]);
     std::visit(
         [&](auto&& cell) {
@@ -40,17 +42,18 @@ void PageInspector::NodePageDump(const BTreeNodeMap& node, std::ostream& out) {
             auto view = cell.SpanValue();
             std::string_view sv {reinterpret_cast<const char*>(view.data()), view.size()};
             cell_types.emplace_back("Data cell");
-            primary_keys.push_back(cell.key);
+            primary_keys.push_back(node.getFullKeyForCell(pointers[i]));
             flags.push_back(cell.flags);
             data_size.push_back(cell.GetDataSize());
             data.emplace_back(sv);
           }
           else if constexpr (std::is_same_v<T, PointersNodeCell>) {
             cell_types.emplace_back("Pointer cell");
-            primary_keys.push_back(cell.key);
+            primary_keys.push_back(node.getFullKeyForCell(pointers[i]));
             flags.push_back(cell.flags);
             data_size.push_back(cell.GetDataSize());
-            data.push_back(std::to_string(cell.page_number));
+            data.push_back(std::to_string(cell.page_number) + " (" + std::to_string(cell.num_entries)
+                           + " entries)");
           }
           else {
             static_assert(lightning::typetraits::always_false_v<T>, "non-exhaustive visitor!");
@@ -66,10 +69,17 @@ void PageInspector::NodePageDump(const BTreeNodeMap& node, std::ostream& out) {
   table.AddColumn(
       "Offset", offsets, [](const page_size_t& offset) { return std::to_string(offset); }, "RED", "BBLUE");
 
+  table.AddColumn(
+      "Hint", key_hints, [](const uint32_t& hint) { return std::to_string(hint); }, "BWHITE", "BBLUE");
+
   table.AddColumn("Type", cell_types, [](const std::string& type) { return type; }, "BWHITE", "BBLUE");
 
   table.AddColumn(
-      "PK", primary_keys, [](const GeneralKey& pk) { return internal::HexDumpBytes(pk); }, "BLUE", "BBLUE");
+      "PK",
+      primary_keys,
+      [](const std::vector<std::byte>& pk) { return internal::HexDumpBytes(pk); },
+      "BLUE",
+      "BBLUE");
 
   table.AddColumn(
       "Flags",
@@ -132,6 +142,16 @@ void PageInspector::NodePageDump(const BTreeNodeMap& node, std::ostream& out) {
       "|  {:<20}{@BGREEN}{}{@RESET}\n", "Page number:", header.GetPageNumber());
   out << lightning::formatting::Format(
       "|  {:<20}{@BWHITE}{}{@RESET}\n", "Additional data:", header.GetAdditionalData());
+  out << lightning::formatting::Format(
+      "|  {:<20}{@BWHITE}{}{@RESET}\n", "Left sibling:", header.GetLeftSibling());
+  out << lightning::formatting::Format(
+      "|  {:<20}{@BWHITE}{}{@RESET}\n", "Right sibling:", header.GetRightSibling());
+  out << lightning::formatting::Format(
+      "|  {:<20}{@BWHITE}{}{@RESET}\n", "First freeblock:", header.GetFirstFreeblock());
+  out << lightning::formatting::Format(
+      "|  {:<20}{@BWHITE}{}{@RESET}\n", "Fragmented free:", header.GetFragmentedFreeSpace());
+  out << lightning::formatting::Format(
+      "|  {:<20}{@BWHITE}{}{@RESET}\n", "Key prefix size:", header.GetKeyPrefixSize());
 
   out << "|\n|\n";
   out << "|  Hex dump of header:\n";
@@ -0,0 +1,1487 @@
+//
+// Created by Nathaniel Rupprecht on 10/17/26.
+//
+
+#include <algorithm>
+#include <atomic>
+#include <fstream>
+#include <functional>
+#include <limits>
+#include <map>
+#include <thread>
+
+#include <gtest/gtest.h>
+
+#include "NeverSQL/data/btree/EntryCreator.h"
+#include "NeverSQL/data/internals/SpanPayloadSerializer.h"
+#include "NeverSQL/data/internals/Utility.h"
+#include "NeverSQL/database/DataManager.h"
+
+using namespace neversql;
+using neversql::internal::SpanValue;
+
+namespace testing {
+
+namespace {
+
+//! \brief Creates a fresh database directory for a test, and removes it afterwards.
+class DataManagerTest : public Test {
+protected:
+  void SetUp() override {
+    database_path_ = std::filesystem::temp_directory_path()
+        / ("neversql-" + std::string(UnitTest::GetInstance()->current_test_info()->name()));
+    std::filesystem::remove_all(database_path_);
+  }
+
+  void TearDown() override { std::filesystem::remove_all(database_path_); }
+
+  //! \brief Add documents with auto-incrementing keys 0, ..., num_documents - 1 to a collection.
+  static void AddNumbered(DataManager& manager, const std::string& collection, int num_documents) {
+    for (int i = 0; i < num_documents; ++i) {
+      Document document;
+      document.AddElement("number", IntegralValue {i});
+      document.AddElement("name", StringValue {"entry-" + std::to_string(i)});
+      manager.AddValue(collection, document);
+    }
+  }
+
+  //! \brief Get the "number" field of an entry.
+  static int Number(neversql::internal::DatabaseEntry& entry) {
+    return neversql::internal::EntryToDocument(entry)->TryGetAs<int32_t>("number").value();
+  }
+
+  //! \brief Get the "number" field of every entry an iterator covers, in order.
+  static std::vector<int> Numbers(BTreeManager::Iterator it) {
+    std::vector<int> numbers;
+    for (; !it.IsEnd(); ++it) {
+      numbers.push_back(neversql::internal::EntryToDocument(**it)->TryGetAs<int32_t>("number").value());
+    }
+    return numbers;
+  }
+
+  static std::vector<int> Iota(int first, int last) {
+    std::vector<int> values;
+    for (int i = first; i <= last; ++i) {
+      values.push_back(i);
+    }
+    return values;
+  }
+
+  std::filesystem::path database_path_;
+};
+
+}  // namespace
+
+TEST_F(DataManagerTest, AutoIncrementKeysSurviveReopen) {
+  {
+    DataManager manager(database_path_);
+    manager.AddCollection("elements", DataTypeEnum::UInt64);
+    AddNumbered(manager, "elements", 1000);
+  }
+  DataManager manager(database_path_);
+  Document document;
+  document.AddElement("number", IntegralValue {1000});
+  manager.AddValue("elements", document);
+
+  auto result = manager.Retrieve("elements", primary_key_t {1000});
+  ASSERT_TRUE(result.IsFound());
+  EXPECT_EQ(neversql::internal::EntryToDocument(*result.entry)->TryGetAs<int32_t>("number").value(), 1000);
+  EXPECT_EQ(Numbers(manager.Begin("elements")), Iota(0, 1000));
+}
+
+TEST_F(DataManagerTest, AutoIncrementKeysSurviveReopenWithoutCheckpoint) {
+  const auto copy_path = database_path_ / "copy";
+  {
+    DataManager manager(database_path_);
+    manager.AddCollection("elements", DataTypeEnum::UInt64);
+    AddNumbered(manager, "elements", 10);
+    manager.AddCollection("filler", DataTypeEnum::UInt64);
+    AddNumbered(manager, "filler", 20000);
+  }
+  {
+    DataManager manager(database_path_);
+    // These keys are only counted in memory, the counter on disk still says that the next key is 10.
+    for (int i = 10; i < 20; ++i) {
+      Document document;
+      document.AddElement("number", IntegralValue {i});
+      manager.AddValue("elements", document);
+    }
+    // Reading the other collection fills the page cache, so the page of "elements" is written back to the
+    // disk when it is evicted. Then copy the database before the manager checkpoints the counter.
+    EXPECT_EQ(Numbers(manager.Begin("filler")).size(), 20000);
+    std::filesystem::create_directories(copy_path);
+    std::filesystem::copy_file(database_path_ / "neversql.db", copy_path / "neversql.db");
+  }
+
+  DataManager manager(copy_path);
+  ASSERT_EQ(Numbers(manager.Begin("elements")), Iota(0, 19));
+  // The counter is advanced past the largest key, so no key is reused.
+  Document document;
+  document.AddElement("number", IntegralValue {20});
+  manager.AddValue("elements", document);
+  auto result = manager.Retrieve("elements", primary_key_t {20});
+  ASSERT_TRUE(result.IsFound());
+  EXPECT_EQ(Number(*result.entry), 20);
+  EXPECT_EQ(Numbers(manager.Begin("elements")), Iota(0, 20));
+}
+
+TEST_F(DataManagerTest, MismatchedFormatVersionIsRejected) {
+  {
+    DataManager manager(database_path_);
+    manager.AddCollection("elements", DataTypeEnum::UInt64);
+    AddNumbered(manager, "elements", 10);
+  }
+  // The format version follows the magic number on the meta page.
+  {
+    std::fstream file(database_path_ / "neversql.db", std::ios::binary | std::ios::in | std::ios::out);
+    const auto format_version = Meta::FORMAT_VERSION + 1;
+    file.seekp(sizeof(uint64_t));
+    file.write(reinterpret_cast<const char*>(&format_version), sizeof(format_version));
+  }
+  EXPECT_ANY_THROW(DataManager {database_path_});
+}
+
+TEST_F(DataManagerTest, ScanPrimaryKeyRange) {
+  DataManager manager(database_path_);
+  manager.AddCollection("elements", DataTypeEnum::UInt64);
+  AddNumbered(manager, "elements", 2000);
+
+  EXPECT_EQ(Numbers(manager.Scan("elements", primary_key_t {100}, primary_key_t {1500})), Iota(100, 1500));
+  EXPECT_EQ(Numbers(manager.Scan("elements", primary_key_t {100}, primary_key_t {1500}, false, false)),
+            Iota(101, 1499));
+  EXPECT_EQ(Numbers(manager.Scan("elements", primary_key_t {1990}, primary_key_t {5000})), Iota(1990, 1999));
+  EXPECT_TRUE(Numbers(manager.Scan("elements", primary_key_t {5000}, primary_key_t {6000})).empty());
+
+  const auto upper = primary_key_t {10};
+  EXPECT_EQ(Numbers(manager.Scan("elements", {}, neversql::internal::SpanValue(upper))), Iota(0, 10));
+  const auto lower = primary_key_t {1995};
+  EXPECT_EQ(Numbers(manager.Scan("elements", neversql::internal::SpanValue(lower), {})), Iota(1995, 1999));
+}
+
+TEST_F(DataManagerTest, ScanStringKeyRange) {
+  DataManager manager(database_path_);
+  manager.AddCollection("strings", DataTypeEnum::String);
+  // Insert keys out of order.
+  for (int i = 0; i < 1000; ++i) {
+    auto number = (i * 7919) % 1000;
+    Document document;
+    document.AddElement("number", IntegralValue {number});
+    auto digits = std::to_string(number);
+    auto key = "key-" + std::string(4 - digits.size(), '0') + digits;
+    manager.AddValue("strings", neversql::internal::SpanValue(key), document);
+  }
+
+  const std::string lower = "key-0250", upper = "key-0500";
+  EXPECT_EQ(Numbers(manager.Scan("strings", SpanValue(lower), SpanValue(upper))),
+            Iota(250, 500));
+  // Bounds that are not keys in the collection.
+  const std::string lower_between = "key-0250a", upper_between = "key-05";
+  EXPECT_EQ(
+      Numbers(manager.Scan("strings", SpanValue(lower_between), SpanValue(upper_between))),
+      Iota(251, 499));
+}
+
+TEST_F(DataManagerTest, LeafSiblingsLinkLeavesInKeyOrder) {
+  constexpr primary_key_t num_documents = 20000;
+  DataManager manager(database_path_);
+  manager.AddCollection("elements", DataTypeEnum::UInt64);
+  // Insert keys out of order, so leaves are split in the middle as well as at the end, and enough of them
+  // that the root is split twice, once as a leaf and once as a pointers page.
+  for (primary_key_t i = 0; i < num_documents; ++i) {
+    auto key = (i * 7919) % num_documents;
+    Document document;
+    document.AddElement("number", IntegralValue {static_cast<int>(key)});
+    manager.AddValue("elements", SpanValue(key), document);
+  }
+
+  // Walk the leaves from the leftmost one. The right sibling of each leaf must be the leaf that holds the
+  // keys after its largest key, and must link back to it.
+  auto leaf = manager.Search("elements", primary_key_t {0});
+  ASSERT_TRUE(leaf.IsFound());
+  EXPECT_LE(3, leaf.GetSearchDepth());
+  EXPECT_EQ(leaf.node->GetHeader().GetLeftSibling(), 0);
+  primary_key_t num_keys = 0;
+  for (std::optional<primary_key_t> previous_largest;;) {
+    num_keys += leaf.node->GetNumPointers();
+    const auto largest = neversql::internal::DenormalizePrimaryKey(*leaf.node->GetLargestKey());
+    if (previous_largest) {
+      EXPECT_LT(*previous_largest, largest);
+    }
+    previous_largest = largest;
+
+    const auto right_sibling = leaf.node->GetHeader().GetRightSibling();
+    if (right_sibling == 0) {
+      EXPECT_EQ(largest, num_documents - 1);
+      break;
+    }
+    auto next_leaf = manager.Search("elements", primary_key_t {largest + 1});
+    ASSERT_EQ(next_leaf.node->GetPageNumber(), right_sibling);
+    ASSERT_EQ(next_leaf.node->GetHeader().GetLeftSibling(), leaf.node->GetPageNumber());
+    leaf = std::move(next_leaf);
+  }
+  EXPECT_EQ(num_keys, num_documents);
+}
+
+TEST_F(DataManagerTest, ReverseIteration) {
+  DataManager manager(database_path_);
+  manager.AddCollection("elements", DataTypeEnum::UInt64);
+  AddNumbered(manager, "elements", 2000);
+
+  auto expected = Iota(0, 1999);
+  std::ranges::reverse(expected);
+  EXPECT_EQ(Numbers(manager.RBegin("elements")), expected);
+
+  // Stepping backwards from the end iterator visits every entry in reverse order.
+  std::vector<int> numbers;
+  for (auto it = manager.End("elements"), begin = manager.Begin("elements"); it != begin;) {
+    --it;
+    numbers.push_back(neversql::internal::EntryToDocument(**it)->TryGetAs<int32_t>("number").value());
+  }
+  EXPECT_EQ(numbers, expected);
+}
+
+TEST_F(DataManagerTest, ScanDescending) {
+  DataManager manager(database_path_);
+  manager.AddCollection("elements", DataTypeEnum::UInt64);
+  AddNumbered(manager, "elements", 2000);
+
+  auto reversed = [](std::vector<int> values) {
+    std::ranges::reverse(values);
+    return values;
+  };
+  auto scan_descending = [&manager](primary_key_t lower, primary_key_t upper, bool inclusive) {
+    return Numbers(manager.Scan("elements", lower, upper, inclusive, inclusive, ScanDirection::Descending));
+  };
+  constexpr auto descending = ScanDirection::Descending;
+  EXPECT_EQ(scan_descending(100, 1500, true), reversed(Iota(100, 1500)));
+  EXPECT_EQ(scan_descending(100, 1500, false), reversed(Iota(101, 1499)));
+  EXPECT_EQ(scan_descending(1990, 5000, true), reversed(Iota(1990, 1999)));
+  EXPECT_TRUE(scan_descending(5000, 6000, true).empty());
+
+  // The last ten entries.
+  const auto lower = primary_key_t {1990};
+  EXPECT_EQ(Numbers(manager.Scan("elements", KeyRange {.lower = SpanValue(lower)}, descending)),
+            reversed(Iota(1990, 1999)));
+}
+
+TEST_F(DataManagerTest, SignedAndFloatingPointKeys) {
+  DataManager manager(database_path_);
+  manager.AddCollection("signed", DataTypeEnum::Int64);
+  manager.AddCollection("doubles", DataTypeEnum::Double);
+  // Insert keys out of order, half of them negative.
+  for (int i = 0; i < 2000; ++i) {
+    auto number = (i * 7919) % 2000;
+    Document document;
+    document.AddElement("number", IntegralValue {number});
+    const auto signed_key = int64_t {number - 1000};
+    manager.AddValue("signed", neversql::internal::SpanValue(signed_key), document);
+    const auto double_key = 0.25 * (number - 1000);
+    manager.AddValue("doubles", neversql::internal::SpanValue(double_key), document);
+  }
+
+  EXPECT_EQ(Numbers(manager.Begin("signed")), Iota(0, 1999));
+  EXPECT_EQ(Numbers(manager.Begin("doubles")), Iota(0, 1999));
+
+  const auto signed_key = int64_t {-1};
+  auto result = manager.Retrieve("signed", neversql::internal::SpanValue(signed_key));
+  ASSERT_TRUE(result.IsFound());
+  EXPECT_EQ(neversql::internal::EntryToDocument(*result.entry)->TryGetAs<int32_t>("number").value(), 999);
+
+  const auto lower = int64_t {-10}, upper = int64_t {10};
+  EXPECT_EQ(
+      Numbers(manager.Scan("signed", SpanValue(lower), SpanValue(upper))),
+      Iota(990, 1010));
+  // Bounds that are not keys in the collection.
+  const auto lower_double = -2.6, upper_double = 2.6;
+  const auto double_bounds = KeyRange {.lower = neversql::internal::SpanValue(lower_double),
+                                       .upper = neversql::internal::SpanValue(upper_double)};
+  EXPECT_EQ(Numbers(manager.Scan("doubles", double_bounds)), Iota(990, 1010));
+}
+
+TEST_F(DataManagerTest, KeysWithEqualHints) {
+  // The hint of a key is its first four bytes, so each group of keys below shares one hint, and the keys of
+  // the last group have the largest hint there is. The groups are stored in the same pages, so the pages'
+  // key prefixes do not remove the shared bytes.
+  constexpr primary_key_t shared_hint = 0x12345678'00000000, largest_hint = 0xFFFFFFFF'00000000;
+  constexpr primary_key_t largest_key = std::numeric_limits<primary_key_t>::max();
+  auto check_collection = [](DataManager& manager, const std::string& collection, int num_per_group) {
+    const auto n = static_cast<primary_key_t>(num_per_group);
+    manager.AddCollection(collection, DataTypeEnum::UInt64);
+    // Keys are numbered in sorted order. Insert the groups interleaved.
+    auto add = [&](primary_key_t key, int number) {
+      Document document;
+      document.AddElement("number", IntegralValue {number});
+      manager.AddValue(collection, SpanValue(key), document);
+    };
+    for (int i = num_per_group - 1; 0 <= i; --i) {
+      add(largest_hint + i, 2 * num_per_group + i);
+      add(static_cast<primary_key_t>(i), i);
+      add(shared_hint + i, num_per_group + i);
+    }
+    add(largest_key, 3 * num_per_group);
+
+    for (int i = 0; i < num_per_group; ++i) {
+      for (auto [key, number] : {std::pair {static_cast<primary_key_t>(i), i},
+                                 std::pair {shared_hint + i, num_per_group + i},
+                                 std::pair {largest_hint + i, 2 * num_per_group + i}})
+      {
+        auto result = manager.Retrieve(collection, key);
+        ASSERT_TRUE(result.entry) << "key " << key;
+        EXPECT_EQ(Number(*result.entry), number);
+      }
+    }
+    auto result = manager.Retrieve(collection, largest_key);
+    ASSERT_TRUE(result.entry);
+    EXPECT_EQ(Number(*result.entry), 3 * num_per_group);
+    for (auto key : {shared_hint + n, largest_hint + n, largest_key - 1, shared_hint - 1}) {
+      EXPECT_FALSE(manager.Retrieve(collection, key).entry) << "key " << key;
+    }
+
+    // Scans start at the lower bound of keys that are not in the collection.
+    EXPECT_EQ(Numbers(manager.Scan(collection, shared_hint - 1, shared_hint + 2)),
+              Iota(num_per_group, num_per_group + 2));
+    EXPECT_EQ(Numbers(manager.Scan(collection, shared_hint + n, largest_hint + 1)),
+              Iota(2 * num_per_group, 2 * num_per_group + 1));
+    EXPECT_EQ(Numbers(manager.Scan(collection, largest_hint + n, largest_key)),
+              std::vector {3 * num_per_group});
+    EXPECT_EQ(Numbers(manager.Scan(collection, largest_hint + 1, largest_key, false, false)),
+              Iota(2 * num_per_group + 2, 3 * num_per_group - 1));
+    EXPECT_EQ(Numbers(manager.Begin(collection)), Iota(0, 3 * num_per_group));
+  };
+
+  DataManager manager(database_path_);
+  // All keys in one leaf, then enough keys for pointers pages whose separators share hints.
+  check_collection(manager, "leaf", 20);
+  check_collection(manager, "tree", 3000);
+  EXPECT_EQ(manager.Search("leaf", primary_key_t {0}).GetSearchDepth(), 1);
+  EXPECT_LT(1, manager.Search("tree", primary_key_t {0}).GetSearchDepth());
+}
+
+TEST_F(DataManagerTest, StringKeysWithSharedPrefixes) {
+  DataManager manager(database_path_);
+  manager.AddCollection("strings", DataTypeEnum::String);
+  auto make_key = [](const std::string& prefix, int number) {
+    auto digits = std::to_string(number);
+    return prefix + std::string(5 - digits.size(), '0') + digits;
+  };
+  auto add = [&](const std::string& key, int number) {
+    Document document;
+    document.AddElement("number", IntegralValue {number});
+    manager.AddValue("strings", neversql::internal::SpanValue(key), document);
+  };
+
+  // Long keys that share a prefix, inserted out of order, so pages are split and get key prefixes.
+  const std::string prefix = "organization/department/team/member-";
+  for (int i = 0; i < 1000; ++i) {
+    auto number = (i * 7919) % 1000 + 1000;
+    add(make_key(prefix, number), number);
+  }
+  // Keys that do not share the prefix sort before and after all the others, and keys that share only part of
+  // it sort in between, so pages have to shorten their prefixes.
+  for (int i = 0; i < 100; ++i) {
+    add(make_key("a/", i), i);
+    add(make_key("organization/department/", i + 100), i + 100);
+    add(make_key("organization/department/team/member-", 9000 + i), 9000 + i);
+    add(make_key("z/", i + 10000), i + 10000);
+  }
+
+  for (auto number : Iota(1000, 1999)) {
+    auto key = make_key(prefix, number);
+    auto result = manager.Retrieve("strings", neversql::internal::SpanValue(key));
+    ASSERT_TRUE(result.IsFound()) << key;
+    EXPECT_EQ(Number(*result.entry), number);
+  }
+
+  std::vector<int> expected;
+  for (auto [first, last] : {std::pair {0, 199}, {1000, 1999}, {9000, 9099}, {10000, 10099}}) {
+    std::ranges::copy(Iota(first, last), std::back_inserter(expected));
+  }
+  EXPECT_EQ(Numbers(manager.Begin("strings")), expected);
+
+  const auto lower = make_key(prefix, 1500), upper = make_key(prefix, 1600);
+  EXPECT_EQ(
+      Numbers(manager.Scan("strings", SpanValue(lower), SpanValue(upper))),
+      Iota(1500, 1600));
+}
+
+TEST_F(DataManagerTest, SplitsChangeKeyPrefixes) {
+  // Every key is stored under its number, and the document holds the key, so content can be checked.
+  std::map<std::string, int> keys;
+  auto add = [&keys](DataManager& manager, const std::string& key) {
+    const auto number = static_cast<int>(keys.size());
+    keys.emplace(key, number);
+    Document document;
+    document.AddElement("number", IntegralValue {number});
+    document.AddElement("key", StringValue {key});
+    manager.AddValue("strings", SpanValue(key), document);
+  };
+  auto make_key = [](const std::string& prefix, int number) {
+    auto digits = std::to_string(number);
+    return prefix + std::string(5 - digits.size(), '0') + digits;
+  };
+
+  {
+    DataManager manager(database_path_);
+    manager.AddCollection("strings", DataTypeEnum::String);
+    // Leaves that hold keys of both groups have the prefix "warehouse/". Splitting them gives leaves that
+    // hold keys of one group, whose prefix is longer.
+    for (int i = 0; i < 300; ++i) {
+      add(manager, make_key("warehouse/alpha/shelf-", i));
+      add(manager, make_key("warehouse/beta/shelf-", i));
+    }
+    // Keys that share less of the prefix of the leaves that they go in.
+    for (int i = 0; i < 100; ++i) {
+      add(manager, make_key("warehouse/alpha/bin-", (i * 37) % 100));
+      add(manager, make_key("warehouse/b-", (i * 37) % 100));
+    }
+  }
+
+  DataManager manager(database_path_);
+  std::vector<int> expected;
+  for (const auto& [key, number] : keys) {
+    expected.push_back(number);
+    auto result = manager.Retrieve("strings", SpanValue(key));
+    ASSERT_TRUE(result.entry) << key;
+    const auto document = neversql::internal::EntryToDocument(*result.entry);
+    EXPECT_EQ(document->TryGetAs<std::string>("key"), key);
+    EXPECT_EQ(document->TryGetAs<int32_t>("number"), number);
+  }
+  EXPECT_EQ(Numbers(manager.Begin("strings")), expected);
+
+  // A leaf in the middle of one group has a longer prefix than the leaves it was split from.
+  auto leaf = manager.Search("strings", SpanValue(make_key("warehouse/beta/shelf-", 150)));
+  EXPECT_LT(std::string("warehouse/").size(), leaf.node->GetHeader().GetKeyPrefixSize());
+}
+
+TEST_F(DataManagerTest, OutOfOrderInsertsIntoFullLeaf) {
+  auto make_key = [](int number) {
+    auto digits = std::to_string(number);
+    return "item-" + std::string(5 - digits.size(), '0') + digits;
+  };
+  auto add = [&make_key](DataManager& manager, int number) {
+    Document document;
+    document.AddElement("number", IntegralValue {number});
+    document.AddElement("key", StringValue {make_key(number)});
+    manager.AddValue("strings", SpanValue(make_key(number)), document);
+  };
+
+  int num_even = 0;
+  {
+    DataManager manager(database_path_);
+    manager.AddCollection("strings", DataTypeEnum::String);
+    // Append the even keys until the root leaf is split. Since the keys were appended, the split leaves the
+    // left leaf nearly full.
+    for (;; num_even += 2) {
+      add(manager, num_even);
+      if (1 < manager.Search("strings", SpanValue(make_key(0))).GetSearchDepth()) {
+        break;
+      }
+    }
+    const auto num_in_left = manager.Search("strings", SpanValue(make_key(0))).node->GetNumPointers();
+    EXPECT_LT(num_even / 2 - 5, num_in_left);
+    // Insert the odd keys in between, in decreasing order, so they go in front of the cells of a full leaf.
+    for (int number = num_even - 1; 0 < number; number -= 2) {
+      add(manager, number);
+    }
+  }
+
+  DataManager manager(database_path_);
+  for (auto number : Iota(0, num_even)) {
+    auto result = manager.Retrieve("strings", SpanValue(make_key(number)));
+    ASSERT_TRUE(result.entry) << make_key(number);
+    const auto document = neversql::internal::EntryToDocument(*result.entry);
+    EXPECT_EQ(document->TryGetAs<std::string>("key"), make_key(number));
+    EXPECT_EQ(document->TryGetAs<int32_t>("number"), number);
+  }
+  EXPECT_EQ(Numbers(manager.Begin("strings")), Iota(0, num_even));
+}
+
+TEST_F(DataManagerTest, LongStringKeysKeepTreeShallow) {
+  DataManager manager(database_path_);
+  manager.AddCollection("strings", DataTypeEnum::String);
+  // Long keys that differ early on, so the keys that separate leaves in the interior nodes can be short.
+  auto make_key = [](int number) { return std::to_string(100000 + number) + std::string(150, '-'); };
+
+  constexpr int num_keys = 10000;
+  for (int i = 0; i < num_keys; ++i) {
+    auto number = (i * 7919) % num_keys;
+    Document document;
+    document.AddElement("number", IntegralValue {number});
+    manager.AddValue("strings", neversql::internal::SpanValue(make_key(number)), document);
+  }
+
+  std::size_t max_depth = 0;
+  for (auto number : Iota(0, num_keys - 1)) {
+    auto key = make_key(number);
+    auto result = manager.Retrieve("strings", neversql::internal::SpanValue(key));
+    ASSERT_TRUE(result.IsFound()) << key;
+    EXPECT_EQ(Number(*result.entry), number);
+    max_depth = std::max(max_depth, result.search_result.GetSearchDepth());
+  }
+  // A root and one level of interior nodes is enough for this many leaves.
+  EXPECT_LE(max_depth, 3u);
+  EXPECT_EQ(Numbers(manager.Begin("strings")), Iota(0, num_keys - 1));
+}
+
+TEST_F(DataManagerTest, CompositeKeyPrefixScan) {
+  constexpr int num_tenants = 5, rows_per_tenant = 400;
+  auto make_key = [](int64_t tenant, int64_t timestamp, uint64_t id) {
+    return CompositeKey {}.Add(tenant).AddDateTime(timestamp).Add(id);
+  };
+  {
+    DataManager manager(database_path_);
+    manager.AddCollection("events", {DataTypeEnum::Int64, DataTypeEnum::DateTime, DataTypeEnum::UInt64});
+    // Interleave the tenants, and insert each tenant's rows out of time order. Row n of tenant t has number
+    // t * rows_per_tenant + n, and is at time 1000 * n (with a few negative tenants and times).
+    for (int i = 0; i < rows_per_tenant; ++i) {
+      auto row = (i * 7919) % rows_per_tenant;
+      for (int tenant = 0; tenant < num_tenants; ++tenant) {
+        Document document;
+        document.AddElement("number", IntegralValue {tenant * rows_per_tenant + row});
+        manager.AddValue("events", make_key(tenant - 2, 1000 * (row - 10), 42), document);
+      }
+    }
+    // Keys must have every field.
+    Document document;
+    EXPECT_ANY_THROW(manager.AddValue("events", CompositeKey {}.Add(int64_t {0}), document));
+  }
+
+  // The key fields are stored with the collection.
+  DataManager manager(database_path_);
+  EXPECT_EQ(Numbers(manager.Begin("events")), Iota(0, num_tenants * rows_per_tenant - 1));
+
+  auto result = manager.Retrieve("events", make_key(1, 5000, 42));
+  ASSERT_TRUE(result.IsFound());
+  EXPECT_EQ(neversql::internal::EntryToDocument(*result.entry)->TryGetAs<int32_t>("number").value(),
+            3 * rows_per_tenant + 15);
+
+  // All rows for one tenant, in either direction.
+  for (int tenant = 0; tenant < num_tenants; ++tenant) {
+    const auto prefix = CompositeKey {}.Add(int64_t {tenant - 2});
+    auto expected = Iota(tenant * rows_per_tenant, (tenant + 1) * rows_per_tenant - 1);
+    EXPECT_EQ(Numbers(manager.ScanPrefix("events", prefix)), expected);
+    std::ranges::reverse(expected);
+    EXPECT_EQ(Numbers(manager.ScanPrefix("events", prefix, ScanDirection::Descending)), expected);
+  }
+
+  // A time range for one tenant. Bounds may have only the first few fields.
+  const auto lower = CompositeKey {}.Add(int64_t {0}).AddDateTime(0);
+  const auto upper = CompositeKey {}.Add(int64_t {0}).AddDateTime(20000);
+  EXPECT_EQ(Numbers(manager.Scan("events", KeyRange {.lower = lower.Get(), .upper = upper.Get()})),
+            Iota(2 * rows_per_tenant + 10, 2 * rows_per_tenant + 29));
+
+  EXPECT_TRUE(Numbers(manager.ScanPrefix("events", CompositeKey {}.Add(int64_t {100}))).empty());
+}
+
+TEST_F(DataManagerTest, StringKeyPrefixScan) {
+  DataManager manager(database_path_);
+  manager.AddCollection("strings", DataTypeEnum::String);
+  int number = 0;
+  for (std::string prefix : {"a/", "user/", "user0", "users/", "z"}) {
+    for (int i = 0; i < 100; ++i, ++number) {
+      auto digits = std::to_string(i);
+      auto key = prefix + std::string(3 - digits.size(), '0') + digits;
+      Document document;
+      document.AddElement("number", IntegralValue {number});
+      manager.AddValue("strings", neversql::internal::SpanValue(key), document);
+    }
+  }
+  const std::string prefix = "user/";
+  EXPECT_EQ(Numbers(manager.ScanPrefix("strings", neversql::internal::SpanValue(prefix))), Iota(100, 199));
+  const std::string all_users = "user";
+  EXPECT_EQ(Numbers(manager.ScanPrefix("strings", neversql::internal::SpanValue(all_users))), Iota(100, 399));
+}
+
+TEST_F(DataManagerTest, RemovedSpaceIsReused) {
+  DataManager manager(database_path_);
+  manager.AddCollection("numbers", DataTypeEnum::UInt64);
+  constexpr int num_documents = 2000;
+  AddNumbered(manager, "numbers", num_documents);
+
+  // Remove every other document.
+  std::vector<int> odd_numbers;
+  for (int i = 0; i < num_documents; ++i) {
+    if (i % 2 == 0) {
+      EXPECT_TRUE(manager.Remove("numbers", static_cast<primary_key_t>(i))) << i;
+    }
+    else {
+      odd_numbers.push_back(i);
+    }
+  }
+  EXPECT_FALSE(manager.Remove("numbers", primary_key_t {0}));
+  EXPECT_FALSE(manager.Remove("numbers", primary_key_t {num_documents}));
+  EXPECT_EQ(Numbers(manager.Begin("numbers")), odd_numbers);
+  auto result = manager.Retrieve("numbers", primary_key_t {1001});
+  ASSERT_TRUE(result.IsFound());
+  EXPECT_EQ(neversql::internal::EntryToDocument(*result.entry)->TryGetAs<int32_t>("number").value(), 1001);
+
+  // Putting the documents back reuses the space they left, so no pages have to be split.
+  const auto num_pages = manager.GetDataAccessLayer().GetNumPages();
+  for (int i = 0; i < num_documents; i += 2) {
+    Document document;
+    document.AddElement("number", IntegralValue {i});
+    document.AddElement("name", StringValue {"entry-" + std::to_string(i)});
+    manager.AddValue("numbers", neversql::internal::SpanValue(static_cast<primary_key_t>(i)), document);
+  }
+  EXPECT_EQ(manager.GetDataAccessLayer().GetNumPages(), num_pages);
+  EXPECT_EQ(Numbers(manager.Begin("numbers")), Iota(0, num_documents - 1));
+}
+
+TEST_F(DataManagerTest, RootSplitAfterRemovingFromRootLeaf) {
+  DataManager manager(database_path_);
+  manager.AddCollection("numbers", DataTypeEnum::UInt64);
+  auto add = [&manager](int number, std::size_t name_size) {
+    Document document;
+    document.AddElement("number", IntegralValue {number});
+    document.AddElement("name", StringValue {std::string(name_size, 'x')});
+    manager.AddValue("numbers", SpanValue(static_cast<primary_key_t>(number)), document);
+  };
+  auto root_free_space = [&manager] {
+    return manager.Search("numbers", primary_key_t {0}).node->GetTotalFreeSpace();
+  };
+
+  // Fill the root leaf, then remove some of its first documents, leaving freed space in the middle of it.
+  int num_documents = 0;
+  while (300 < root_free_space()) {
+    add(num_documents++, 10);
+  }
+  ASSERT_EQ(manager.Search("numbers", primary_key_t {0}).GetSearchDepth(), 1);
+  std::vector<int> expected;
+  for (int i = 0; i < num_documents; ++i) {
+    if (i < 10 && i % 3 == 0) {
+      EXPECT_TRUE(manager.Remove("numbers", static_cast<primary_key_t>(i)));
+    }
+    else {
+      expected.push_back(i);
+    }
+  }
+
+  // A document that is too large for the free space splits the root while the freed space is still there.
+  // The root becomes a pointers page, which must not keep the freed space. Then fill enough leaves that the
+  // root gets full of pointers.
+  add(num_documents, 600);
+  expected.push_back(num_documents);
+  ASSERT_EQ(manager.Search("numbers", primary_key_t {0}).GetSearchDepth(), 2);
+  for (int i = num_documents + 1; i < 20000; ++i) {
+    add(i, 100);
+    expected.push_back(i);
+  }
+  EXPECT_EQ(Numbers(manager.Begin("numbers")), expected);
+  for (auto number : {1, 2, num_documents - 1, num_documents, 10000, 19999}) {
+    auto result = manager.Retrieve("numbers", static_cast<primary_key_t>(number));
+    ASSERT_TRUE(result.entry) << number;
+    EXPECT_EQ(Number(*result.entry), number);
+  }
+}
+
+TEST_F(DataManagerTest, RemoveEverything) {
+  DataManager manager(database_path_);
+  manager.AddCollection("strings", DataTypeEnum::String);
+  auto make_key = [](int number) { return "key-" + std::to_string(100000 + number); };
+  auto add = [&](int number) {
+    Document document;
+    document.AddElement("number", IntegralValue {number});
+    manager.AddValue("strings", neversql::internal::SpanValue(make_key(number)), document);
+  };
+
+  constexpr int num_keys = 1000;
+  for (int i = 0; i < num_keys; ++i) {
+    add((i * 7919) % num_keys);
+  }
+  for (int i = 0; i < num_keys; ++i) {
+    auto key = make_key((i * 104729) % num_keys);
+    EXPECT_TRUE(manager.Remove("strings", neversql::internal::SpanValue(key))) << key;
+  }
+  EXPECT_TRUE(Numbers(manager.Begin("strings")).empty());
+  EXPECT_TRUE(Numbers(manager.RBegin("strings")).empty());
+
+  // The tree can be filled again.
+  for (int i = 0; i < num_keys; i += 3) {
+    add(i);
+  }
+  std::vector<int> expected;
+  for (int i = 0; i < num_keys; i += 3) {
+    expected.push_back(i);
+  }
+  EXPECT_EQ(Numbers(manager.Begin("strings")), expected);
+  std::ranges::reverse(expected);
+  EXPECT_EQ(Numbers(manager.RBegin("strings")), expected);
+}
+
+TEST_F(DataManagerTest, SplitsAdaptToInsertPattern) {
+  DataManager manager(database_path_);
+  constexpr int num_keys = 5000;
+
+  // Count how many pages a collection needs when the numbers 0, ..., num_keys - 1 are inserted in some order.
+  auto count_pages = [&](const std::string& collection, DataTypeEnum key_type, auto order, auto make_key) {
+    manager.AddCollection(collection, key_type);
+    const auto pages_before = manager.GetDataAccessLayer().GetNumPages();
+    for (int i = 0; i < num_keys; ++i) {
+      const auto number = order(i);
+      Document document;
+      document.AddElement("number", IntegralValue {number});
+      manager.AddValue(collection, neversql::internal::SpanValue(make_key(number)), document);
+    }
+    EXPECT_EQ(Numbers(manager.Begin(collection)), Iota(0, num_keys - 1)) << collection;
+    return manager.GetDataAccessLayer().GetNumPages() - pages_before;
+  };
+  auto ascending = [](int i) { return i; };
+  auto descending = [](int i) { return num_keys - 1 - i; };
+  auto scrambled = [](int i) { return (i * 7919) % num_keys; };
+  auto string_key = [](int number) { return "key-" + std::to_string(100000 + number); };
+  auto integer_key = [](int number) { return static_cast<uint64_t>(number); };
+
+  const auto ascending_pages = count_pages("ascending", DataTypeEnum::String, ascending, string_key);
+  const auto descending_pages = count_pages("descending", DataTypeEnum::String, descending, string_key);
+  const auto random_pages = count_pages("random", DataTypeEnum::String, scrambled, string_key);
+  const auto random_integer_pages =
+      count_pages("random-integers", DataTypeEnum::UInt64, scrambled, integer_key);
+
+  // Sequential inserts fill the pages they leave behind. Random inserts split pages in half, which leaves
+  // them about 70% full on average.
+  EXPECT_LE(descending_pages, ascending_pages + 2);
+  EXPECT_LT(ascending_pages, random_pages);
+  EXPECT_LE(random_pages, ascending_pages * 8 / 5);
+  EXPECT_LE(random_integer_pages, ascending_pages * 8 / 5);
+}
+
+TEST_F(DataManagerTest, CountAndSkipUseSubtreeCounts) {
+  constexpr int num_keys = 5000;
+  auto make_key = [](int number) { return "key-" + std::to_string(100000 + number); };
+  std::vector<int> expected;
+  {
+    DataManager manager(database_path_);
+    manager.AddCollection("strings", DataTypeEnum::String);
+    // Large enough documents that the tree has several levels of interior nodes.
+    for (int i = 0; i < num_keys; ++i) {
+      const auto number = (i * 7919) % num_keys;
+      Document document;
+      document.AddElement("number", IntegralValue {number});
+      document.AddElement("text", StringValue {std::string(200, 'a' + number % 26)});
+      manager.AddValue("strings", neversql::internal::SpanValue(make_key(number)), document);
+    }
+    for (int i = 0; i < num_keys; i += 3) {
+      EXPECT_TRUE(manager.Remove("strings", neversql::internal::SpanValue(make_key(i))));
+    }
+    EXPECT_EQ(manager.Count("strings"), num_keys - (num_keys + 2) / 3);
+  }
+  for (int i = 0; i < num_keys; ++i) {
+    if (i % 3 != 0) {
+      expected.push_back(i);
+    }
+  }
+  const auto num_expected = static_cast<uint64_t>(expected.size());
+
+  // The counts are persisted.
+  DataManager manager(database_path_);
+  EXPECT_EQ(manager.Count("strings"), num_expected);
+
+  auto first_number = [](BTreeManager::Iterator it) {
+    return neversql::internal::EntryToDocument(**it)->TryGetAs<int32_t>("number").value();
+  };
+  for (uint64_t offset : {uint64_t {0}, uint64_t {1}, uint64_t {57}, uint64_t {1000}, num_expected - 1}) {
+    EXPECT_EQ(first_number(manager.Skip("strings", offset)), expected[offset]) << offset;
+    EXPECT_EQ(first_number(manager.Skip("strings", offset, ScanDirection::Descending)),
+              expected[num_expected - 1 - offset])
+        << offset;
+  }
+  EXPECT_TRUE(manager.Skip("strings", num_expected).IsEnd());
+  EXPECT_TRUE(manager.Skip("strings", num_expected, ScanDirection::Descending).IsEnd());
+  EXPECT_EQ(Numbers(manager.Skip("strings", 2000)), std::vector(expected.begin() + 2000, expected.end()));
+
+  // Count ranges, including bounds that are and are not in the collection.
+  for (auto [lower, upper] : {std::pair {100, 2000}, std::pair {99, 2001}, std::pair {3000, 3000}}) {
+    const auto lower_key = make_key(lower), upper_key = make_key(upper);
+    for (bool lower_inclusive : {true, false}) {
+      for (bool upper_inclusive : {true, false}) {
+        const KeyRange range {.lower = neversql::internal::SpanValue(lower_key),
+                              .upper = neversql::internal::SpanValue(upper_key),
+                              .lower_inclusive = lower_inclusive,
+                              .upper_inclusive = upper_inclusive};
+        const auto count = std::ranges::count_if(expected, [&](int number) {
+          return (lower_inclusive ? lower <= number : lower < number)
+              && (upper_inclusive ? number <= upper : number < upper);
+        });
+        EXPECT_EQ(manager.Count("strings", range), count) << lower << " " << upper;
+      }
+    }
+  }
+  EXPECT_EQ(manager.Count("strings", KeyRange {.lower = neversql::internal::SpanValue(make_key(4000))}),
+            std::ranges::count_if(expected, [](int number) { return 4000 <= number; }));
+}
+
+TEST_F(DataManagerTest, EntrySizeLimitFollowsDocumentSizes) {
+  auto add_document = [](DataManager& manager, const std::string& collection, int number, std::size_t size) {
+    Document document;
+    document.AddElement("number", IntegralValue {number});
+    document.AddElement("text", StringValue {std::string(size, 'x')});
+    manager.AddValue(collection, document);
+  };
+  auto is_overflow = [](DataManager& manager, const std::string& collection, int number) {
+    auto result = manager.Retrieve(collection, static_cast<primary_key_t>(number));
+    EXPECT_TRUE(result.IsFound());
+    return !neversql::internal::GetIsSinglePageEntry(result.entry_flags)
+        && !neversql::internal::GetIsBlobEntry(result.entry_flags);
+  };
+
+  {
+    DataManager manager(database_path_);
+    manager.AddCollection("medium", DataTypeEnum::UInt64);
+    manager.AddCollection("small", DataTypeEnum::UInt64);
+
+    // Medium sized documents are stored in the leaves.
+    for (int i = 0; i < 100; ++i) {
+      add_document(manager, "medium", i, 600);
+    }
+    EXPECT_FALSE(is_overflow(manager, "medium", 0));
+    EXPECT_FALSE(is_overflow(manager, "medium", 99));
+
+    // Once a collection has seen mostly small documents, larger ones go to overflow pages, so they do not
+    // take the room of many small documents in the leaves.
+    for (int i = 0; i < 2000; ++i) {
+      add_document(manager, "small", i, 50);
+    }
+    add_document(manager, "small", 2000, 600);
+    EXPECT_TRUE(is_overflow(manager, "small", 2000));
+  }
+
+  // The limits are stored with the collections.
+  DataManager manager(database_path_);
+  add_document(manager, "medium", 100, 600);
+  add_document(manager, "small", 2001, 600);
+  EXPECT_FALSE(is_overflow(manager, "medium", 100));
+  EXPECT_TRUE(is_overflow(manager, "small", 2001));
+  EXPECT_EQ(Numbers(manager.Begin("medium")), Iota(0, 100));
+  EXPECT_EQ(Numbers(manager.Begin("small")), Iota(0, 2001));
+}
+
+TEST_F(DataManagerTest, OverflowPageSpaceIsReused) {
+  auto add_document = [](DataManager& manager, int number, std::size_t size) {
+    Document document;
+    document.AddElement("number", IntegralValue {number});
+    document.AddElement("text", StringValue {std::string(size, static_cast<char>('a' + number))});
+    manager.AddValue("medium", document);
+  };
+  auto check_document = [](DataManager& manager, int number, std::size_t size) {
+    auto result = manager.Retrieve("medium", static_cast<primary_key_t>(number));
+    ASSERT_TRUE(result.IsFound());
+    EXPECT_FALSE(neversql::internal::GetIsSinglePageEntry(result.entry_flags));
+    EXPECT_FALSE(neversql::internal::GetIsBlobEntry(result.entry_flags));
+    EXPECT_EQ(neversql::internal::EntryToDocument(*result.entry)->TryGetAs<std::string>("text").value(),
+              std::string(size, static_cast<char>('a' + number)));
+  };
+
+  {
+    DataManager manager(database_path_);
+    manager.AddCollection("medium", DataTypeEnum::UInt64);
+    add_document(manager, 0, 2400);
+  }
+
+  // The space left in the overflow page is known after the database is opened again.
+  DataManager manager(database_path_);
+  const auto num_pages = manager.GetDataAccessLayer().GetNumPages();
+  add_document(manager, 1, 1400);
+  EXPECT_EQ(manager.GetDataAccessLayer().GetNumPages(), num_pages);
+
+  // The space of a removed document is used again.
+  EXPECT_TRUE(manager.Remove("medium", primary_key_t {0}));
+  add_document(manager, 2, 2000);
+  EXPECT_EQ(manager.GetDataAccessLayer().GetNumPages(), num_pages);
+
+  check_document(manager, 1, 1400);
+  check_document(manager, 2, 2000);
+  EXPECT_FALSE(manager.Remove("medium", primary_key_t {0}));
+}
+
+TEST_F(DataManagerTest, LargeDocumentsAreStoredInBlobPages) {
+  const std::vector<std::size_t> sizes {5000, 20000, 70000, 200000};
+  auto text = [](int number, std::size_t size) {
+    std::string text(size, 'a');
+    for (std::size_t i = 0; i < size; ++i) {
+      text[i] = static_cast<char>('a' + (number + i) % 26);
+    }
+    return text;
+  };
+  auto add_documents = [&](DataManager& manager) {
+    for (int i = 0; i < static_cast<int>(sizes.size()); ++i) {
+      Document document;
+      document.AddElement("number", IntegralValue {i});
+      document.AddElement("text", StringValue {text(i, sizes[i])});
+      manager.AddValue("large", neversql::internal::SpanValue(static_cast<primary_key_t>(i)), document);
+    }
+  };
+  auto check_documents = [&](DataManager& manager) {
+    for (int i = 0; i < static_cast<int>(sizes.size()); ++i) {
+      auto result = manager.Retrieve("large", static_cast<primary_key_t>(i));
+      ASSERT_TRUE(result.IsFound());
+      EXPECT_TRUE(neversql::internal::GetIsBlobEntry(result.entry_flags));
+      auto document = neversql::internal::EntryToDocument(*result.entry);
+      EXPECT_EQ(document->TryGetAs<int32_t>("number").value(), i);
+      EXPECT_EQ(document->TryGetAs<std::string>("text").value(), text(i, sizes[i]));
+    }
+  };
+
+  {
+    DataManager manager(database_path_);
+    manager.AddCollection("large", DataTypeEnum::UInt64);
+    add_documents(manager);
+    check_documents(manager);
+  }
+
+  DataManager manager(database_path_);
+  check_documents(manager);
+
+  // The pages of removed documents are reused as whole runs when the documents are added back.
+  const auto num_pages = manager.GetDataAccessLayer().GetNumPages();
+  for (int i = 0; i < static_cast<int>(sizes.size()); ++i) {
+    EXPECT_TRUE(manager.Remove("large", static_cast<primary_key_t>(i)));
+  }
+  add_documents(manager);
+  EXPECT_EQ(manager.GetDataAccessLayer().GetNumPages(), num_pages);
+  check_documents(manager);
+}
+
+TEST_F(DataManagerTest, SecondaryIndexSeeks) {
+  constexpr int num_documents = 3000;
+  auto add_document = [](DataManager& manager, int i) {
+    Document document;
+    document.AddElement("number", IntegralValue {i});
+    document.AddElement("name", StringValue {"entry-" + std::to_string(i)});
+    document.AddElement("group", IntegralValue {i % 7});
+    manager.AddValue("elements", document);
+  };
+  auto find_numbers = [](const DataManager& manager, const query::Condition& condition) {
+    std::vector<int> numbers;
+    for (auto it = manager.Find("elements", condition); !it.IsEnd(); ++it) {
+      auto document = neversql::internal::EntryToDocument(**it);
+      numbers.push_back(document->TryGetAs<int32_t>("number").value());
+    }
+    std::ranges::sort(numbers);
+    return numbers;
+  };
+
+  {
+    DataManager manager(database_path_);
+    manager.AddCollection("elements", DataTypeEnum::UInt64);
+    // Documents added before the index is created are added to it when it is created.
+    for (int i = 0; i < num_documents / 2; ++i) {
+      add_document(manager, i);
+    }
+    manager.CreateIndex("elements", "name", true);
+    manager.CreateIndex("elements", "group");
+    for (int i = num_documents / 2; i < num_documents; ++i) {
+      add_document(manager, i);
+    }
+    EXPECT_TRUE(manager.HasIndex("elements", "name"));
+    EXPECT_FALSE(manager.HasIndex("elements", "number"));
+
+    // A unique index rejects a second document with the same value.
+    Document duplicate;
+    duplicate.AddElement("name", StringValue {"entry-5"});
+    EXPECT_ANY_THROW(manager.AddValue("elements", duplicate));
+  }
+
+  // The indexes are loaded with the database.
+  DataManager manager(database_path_);
+  EXPECT_EQ(find_numbers(manager, query::Equal<std::string>("name", "entry-1234")), std::vector {1234});
+  EXPECT_EQ(find_numbers(manager, query::Equal<std::string>("name", "entry-")), std::vector<int> {});
+  // Values of another type than the field's are not equal to it.
+  EXPECT_EQ(find_numbers(manager, query::Equal<int64_t>("group", 3)), std::vector<int> {});
+
+  std::vector<int> group_three;
+  for (int i = 3; i < num_documents; i += 7) {
+    group_three.push_back(i);
+  }
+  EXPECT_EQ(find_numbers(manager, query::Equal<int32_t>("group", 3)), group_three);
+  // Conditions that the indexes cannot answer scan the collection.
+  EXPECT_EQ(find_numbers(manager, query::Equal<int32_t>("number", 10)), std::vector {10});
+
+  // Removed documents are removed from the indexes.
+  EXPECT_TRUE(manager.Remove("elements", static_cast<primary_key_t>(1234)));
+  EXPECT_FALSE(manager.Remove("elements", static_cast<primary_key_t>(1234)));
+  EXPECT_TRUE(find_numbers(manager, query::Equal<std::string>("name", "entry-1234")).empty());
+  EXPECT_EQ(find_numbers(manager, query::Equal<int32_t>("group", 2)).size(), (num_documents - 1) / 7);
+  add_document(manager, 1234);
+  EXPECT_EQ(find_numbers(manager, query::Equal<std::string>("name", "entry-1234")), std::vector {1234});
+}
+
+TEST_F(DataManagerTest, ConcurrentWritersKeepIndexUnique) {
+  constexpr int num_threads = 4, num_values = 500;
+  DataManager manager(database_path_);
+  manager.AddCollection("elements", DataTypeEnum::UInt64);
+  manager.CreateIndex("elements", "number", true);
+
+  // Every thread tries to add a document for each value, only one of them may succeed.
+  std::atomic<int> num_added {0};
+  std::vector<std::thread> writers;
+  for (int t = 0; t < num_threads; ++t) {
+    writers.emplace_back([&] {
+      for (int i = 0; i < num_values; ++i) {
+        Document document;
+        document.AddElement("number", IntegralValue {i});
+        try {
+          manager.AddValue("elements", document);
+          ++num_added;
+        } catch (const std::exception&) {
+        }
+      }
+    });
+  }
+  for (auto& writer : writers) {
+    writer.join();
+  }
+
+  EXPECT_EQ(num_added.load(), num_values);
+  EXPECT_EQ(manager.Count("elements"), num_values);
+  auto numbers = Numbers(manager.Begin("elements"));
+  std::ranges::sort(numbers);
+  EXPECT_EQ(numbers, Iota(0, num_values - 1));
+}
+
+TEST_F(DataManagerTest, IndexBuildCatchesUpOnWrites) {
+  constexpr int num_documents = 20000;
+  auto add_document = [](DataManager& manager, int i) {
+    Document document;
+    document.AddElement("number", IntegralValue {i});
+    document.AddElement("name", StringValue {"entry-" + std::to_string(i)});
+    document.AddElement("group", IntegralValue {i % 7});
+    manager.AddValue("elements", neversql::internal::SpanValue(static_cast<primary_key_t>(i)), document);
+  };
+  auto find_number = [](const DataManager& manager, int i) -> std::optional<int> {
+    auto it = manager.Find("elements", query::Equal<std::string>("name", "entry-" + std::to_string(i)));
+    if (it.IsEnd()) {
+      return {};
+    }
+    return neversql::internal::EntryToDocument(**it)->TryGetAs<int32_t>("number");
+  };
+
+  DataManager manager(database_path_);
+  manager.AddCollection("elements", DataTypeEnum::UInt64);
+  for (int i = 0; i < num_documents; i += 2) {
+    add_document(manager, i);
+  }
+
+  // Documents are added and removed while the index is built.
+  manager.StartIndexBuild("elements", "name", true);
+  for (int i = 1; i < num_documents; i += 2) {
+    add_document(manager, i);
+  }
+  for (int i = 0; i < num_documents; i += 10) {
+    EXPECT_TRUE(manager.Remove("elements", static_cast<primary_key_t>(i)));
+  }
+
+  const auto stats = manager.WaitForIndexBuild("elements", "name");
+  EXPECT_EQ(stats.phase, IndexBuildPhase::Done) << stats.error;
+  EXPECT_EQ(stats.total_documents, num_documents / 2);
+  EXPECT_LE(stats.total_documents, stats.documents_scanned);
+  EXPECT_EQ(stats.entries_loaded, stats.entries_sorted);
+  EXPECT_EQ(stats.GetProgress(), 1.);
+  EXPECT_TRUE(manager.HasIndex("elements", "name"));
+
+  for (int i = 0; i < num_documents; ++i) {
+    if (i % 10 == 0) {
+      EXPECT_FALSE(find_number(manager, i)) << i;
+    }
+    else {
+      EXPECT_EQ(find_number(manager, i), i);
+    }
+  }
+
+  // A unique index cannot be built on a field that documents share values of.
+  EXPECT_ANY_THROW(manager.CreateIndex("elements", "group", true));
+  EXPECT_EQ(manager.GetIndexBuildStats("elements", "group")->phase, IndexBuildPhase::Failed);
+  EXPECT_FALSE(manager.HasIndex("elements", "group"));
+  manager.CreateIndex("elements", "group");
+  std::size_t num_in_group = 0;
+  for (auto it = manager.Find("elements", query::Equal<int32_t>("group", 3)); !it.IsEnd(); ++it) {
+    ++num_in_group;
+  }
+  EXPECT_EQ(num_in_group, 2571);
+}
+
+
+TEST_F(DataManagerTest, CoveringIndexAnswersFromIndex) {
+  constexpr int num_documents = 4000;
+  auto add_document = [](DataManager& manager, int i) {
+    Document document;
+    document.AddElement("number", IntegralValue {i});
+    document.AddElement("group", IntegralValue {i % 7});
+    document.AddElement("name", StringValue {"entry-" + std::to_string(i)});
+    document.AddElement("payload", StringValue(std::string(200, 'x')));
+    manager.AddValue("elements", neversql::internal::SpanValue(static_cast<primary_key_t>(i)), document);
+  };
+  auto find_numbers = [](const DataManager& manager, std::vector<std::string> fields, bool index_only) {
+    std::vector<int> numbers;
+    auto it = manager.FindFields("elements", query::Equal<int32_t>("group", 3), fields);
+    EXPECT_EQ(it.IsIndexOnly(), index_only);
+    for (; !it.IsEnd(); ++it) {
+      auto document = *it;
+      // Only the requested fields are produced.
+      EXPECT_EQ(document->GetNumFields(), fields.size());
+      EXPECT_EQ(document->TryGetAs<int32_t>("group"), 3);
+      numbers.push_back(document->TryGetAs<int32_t>("number").value());
+    }
+    std::ranges::sort(numbers);
+    return numbers;
+  };
+
+  std::vector<int> group_three;
+  for (int i = 3; i < num_documents; i += 7) {
+    group_three.push_back(i);
+  }
+  {
+    DataManager manager(database_path_);
+    manager.AddCollection("elements", DataTypeEnum::UInt64);
+    for (int i = 0; i < num_documents; i += 2) {
+      add_document(manager, i);
+    }
+    // Documents added while the index is built have their included fields stored too.
+    manager.StartIndexBuild(IndexInfo {
+        .collection_name = "elements", .field_name = "group", .included_fields = {"number", "name"}});
+    for (int i = 1; i < num_documents; i += 2) {
+      add_document(manager, i);
+    }
+    EXPECT_EQ(manager.WaitForIndexBuild("elements", "group").phase, IndexBuildPhase::Done);
+  }
+
+  // The included fields are loaded with the database.
+  DataManager manager(database_path_);
+  EXPECT_EQ(find_numbers(manager, {"group", "number"}, true), group_three);
+  // Fields that the index does not store are read from the collection.
+  EXPECT_EQ(find_numbers(manager, {"group", "number", "payload"}, false), group_three);
+
+  auto it = manager.FindFields("elements", query::Equal<int32_t>("group", 3), {"name"});
+  ASSERT_FALSE(it.IsEnd());
+  EXPECT_EQ((*it)->TryGetAs<std::string>("name"), "entry-3");
+
+  // Plain queries still find the whole documents through the index.
+  EXPECT_TRUE(manager.Remove("elements", static_cast<primary_key_t>(3)));
+  std::size_t num_in_group = 0;
+  for (auto doc_it = manager.Find("elements", query::Equal<int32_t>("group", 3)); !doc_it.IsEnd(); ++doc_it) {
+    EXPECT_TRUE(neversql::internal::EntryToDocument(**doc_it)->GetElement("payload"));
+    ++num_in_group;
+  }
+  EXPECT_EQ(num_in_group, group_three.size() - 1);
+}
+
+TEST_F(DataManagerTest, MultikeyIndexFindsArrayElements) {
+  constexpr int num_documents = 3000;
+  auto add_document = [](DataManager& manager, int i) {
+    Document document;
+    document.AddElement("number", IntegralValue {i});
+    if (i % 10 == 8) {
+      // Documents whose field is not an array do not contain anything.
+      document.AddElement("tags", StringValue {"tag-0"});
+    }
+    else {
+      // Some arrays have the same element twice.
+      ArrayValue tags(DataTypeEnum::String);
+      tags.AddElement(StringValue {"tag-" + std::to_string(i % 5)});
+      tags.AddElement(StringValue {"tag-" + std::to_string(i % 3)});
+      document.AddElement("tags", std::move(tags));
+    }
+    manager.AddValue("elements", neversql::internal::SpanValue(static_cast<primary_key_t>(i)), document);
+  };
+  auto find_numbers = [](const DataManager& manager, const query::Condition& condition) {
+    std::vector<int> numbers;
+    for (auto it = manager.Find("elements", condition); !it.IsEnd(); ++it) {
+      numbers.push_back(neversql::internal::EntryToDocument(**it)->TryGetAs<int32_t>("number").value());
+    }
+    std::ranges::sort(numbers);
+    return numbers;
+  };
+
+  std::vector<std::vector<int>> scanned;
+  {
+    DataManager manager(database_path_);
+    manager.AddCollection("elements", DataTypeEnum::UInt64);
+    for (int i = 0; i < num_documents; i += 2) {
+      add_document(manager, i);
+    }
+    // Without an index, the condition is tested on every document.
+    for (int tag = 0; tag < 6; ++tag) {
+      const auto condition = query::Contains<std::string>("tags", "tag-" + std::to_string(tag));
+      scanned.push_back(find_numbers(manager, condition));
+    }
+
+    manager.StartIndexBuild(
+        IndexInfo {.collection_name = "elements", .field_name = "tags", .is_multikey = true});
+    for (int i = 1; i < num_documents; i += 2) {
+      add_document(manager, i);
+    }
+    EXPECT_EQ(manager.WaitForIndexBuild("elements", "tags").phase, IndexBuildPhase::Done);
+    for (int i = 1; i < num_documents; i += 2) {
+      EXPECT_TRUE(manager.Remove("elements", static_cast<primary_key_t>(i)));
+    }
+  }
+
+  // The index is loaded with the database, and finds the same documents as the scans.
+  DataManager manager(database_path_);
+  for (int tag = 0; tag < 6; ++tag) {
+    EXPECT_EQ(find_numbers(manager, query::Contains<std::string>("tags", "tag-" + std::to_string(tag))),
+              scanned[tag]);
+  }
+  EXPECT_FALSE(scanned[0].empty());
+  EXPECT_TRUE(scanned[5].empty());
+  // Equalities on the field are not answered by the multikey index.
+  EXPECT_EQ(find_numbers(manager, query::Equal<std::string>("tags", "tag-0")).size(), num_documents / 10);
+
+  // A unique multikey index rejects documents whose arrays share an element.
+  Document document;
+  ArrayValue codes(DataTypeEnum::Int32);
+  codes.AddElement(IntegralValue {1});
+  codes.AddElement(IntegralValue {2});
+  codes.AddElement(IntegralValue {1});
+  document.AddElement("codes", std::move(codes));
+  manager.AddCollection("codes", DataTypeEnum::UInt64);
+  manager.CreateIndex(
+      IndexInfo {.collection_name = "codes", .field_name = "codes", .is_unique = true, .is_multikey = true});
+  manager.AddValue("codes", document);
+  EXPECT_ANY_THROW(manager.AddValue("codes", document));
+  EXPECT_EQ(manager.Count("codes"), 1);
+}
+
+TEST_F(DataManagerTest, LookupsWhileInteriorNodesChange) {
+  DataManager manager(database_path_);
+  manager.AddCollection("elements", DataTypeEnum::UInt64);
+  constexpr int num_keys = 20000;
+  auto scrambled = [](int i) { return (i * 7919) % num_keys; };
+
+  // Interior nodes are pinned by the first lookups, and then keep changing as leaves are split. Lookups must
+  // still follow the current pointers.
+  for (int i = 0; i < num_keys; ++i) {
+    const auto key = static_cast<uint64_t>(scrambled(i));
+    Document document;
+    document.AddElement("number", IntegralValue {scrambled(i)});
+    manager.AddValue("elements", neversql::internal::SpanValue(key), document);
+    if (i % 97 == 0) {
+      for (int j = 0; j <= i; j += 13) {
+        auto result = manager.Retrieve("elements", static_cast<primary_key_t>(scrambled(j)));
+        ASSERT_TRUE(result.IsFound()) << "key " << scrambled(j) << " after " << i + 1 << " inserts";
+        EXPECT_EQ(neversql::internal::EntryToDocument(*result.entry)->TryGetAs<int32_t>("number").value(),
+                  scrambled(j));
+      }
+    }
+  }
+  EXPECT_EQ(Numbers(manager.Begin("elements")), Iota(0, num_keys - 1));
+}
+
+TEST_F(DataManagerTest, ConcurrentLookupsAndInserts) {
+  DataManager manager(database_path_);
+  manager.AddCollection("elements", DataTypeEnum::UInt64);
+  constexpr int num_preloaded = 4000;
+  constexpr int num_total = 8000;
+  constexpr int num_readers = 3;
+  AddNumbered(manager, "elements", num_preloaded);
+
+  // Retrieved entries are copied out of their leaf while no writer changes it, so they can be decoded
+  // directly.
+  auto read_number = [&](int key) -> std::optional<int> {
+    auto result = manager.Retrieve("elements", static_cast<primary_key_t>(key));
+    if (!result.entry) {
+      return {};
+    }
+    return neversql::internal::EntryToDocument(*result.entry)->TryGetAs<int32_t>("number");
+  };
+
+  // One thread appends documents, while the others look up the documents that were already added.
+  std::atomic<int> num_added = num_preloaded;
+  std::atomic<int> num_wrong = 0;
+  std::thread writer([&] {
+    for (int i = num_preloaded; i < num_total; ++i) {
+      Document document;
+      document.AddElement("number", IntegralValue {i});
+      document.AddElement("name", StringValue {"entry-" + std::to_string(i)});
+      manager.AddValue("elements", document);
+      num_added.store(i + 1);
+    }
+  });
+  std::vector<std::thread> readers;
+  for (int reader = 0; reader < num_readers; ++reader) {
+    readers.emplace_back([&, reader] {
+      for (int i = reader; num_added.load() < num_total; i += 7) {
+        const auto key = i % num_added.load();
+        if (read_number(key) != key) {
+          ++num_wrong;
+        }
+      }
+    });
+  }
+  writer.join();
+  for (auto& reader : readers) {
+    reader.join();
+  }
+
+  EXPECT_EQ(num_wrong.load(), 0);
+  EXPECT_EQ(Numbers(manager.Begin("elements")), Iota(0, num_total - 1));
+}
+
+TEST_F(DataManagerTest, ScansWhileWriting) {
+  DataManager manager(database_path_);
+  manager.AddCollection("elements", DataTypeEnum::UInt64);
+  constexpr int num_preloaded = 6000;
+  AddNumbered(manager, "elements", num_preloaded);
+
+  // One thread removes the documents with odd keys and appends new documents, while the other scans the
+  // collection. The writes happen between the steps of the scans, which must still visit every document that
+  // is never removed, in order, and no document twice.
+  std::atomic<bool> is_writing = true;
+  std::thread writer([&] {
+    for (int i = 1, next = num_preloaded; i < num_preloaded; i += 2) {
+      manager.Remove("elements", static_cast<primary_key_t>(i));
+      Document document;
+      document.AddElement("number", IntegralValue {next++});
+      manager.AddValue("elements", document);
+    }
+    is_writing.store(false);
+  });
+
+  int num_scans = 0;
+  bool all_ok = true;
+  do {
+    std::vector<int> numbers;
+    for (auto it = manager.Begin("elements"); !it.IsEnd(); ++it) {
+      // The entry can be removed after the end check, then dereferencing moves past it.
+      if (auto entry = *it) {
+        numbers.push_back(Number(*entry));
+      }
+    }
+    const auto num_even =
+        std::ranges::count_if(numbers, [](int n) { return n < num_preloaded && n % 2 == 0; });
+    all_ok = all_ok && std::ranges::adjacent_find(numbers, std::greater_equal<>()) == numbers.end()
+        && num_even == num_preloaded / 2;
+    ++num_scans;
+  } while (is_writing.load());
+  writer.join();
+
+  EXPECT_TRUE(all_ok) << "in " << num_scans << " scans";
+  EXPECT_EQ(Numbers(manager.Begin("elements")).size(), std::size_t {num_preloaded});
+}
+
+TEST_F(DataManagerTest, WritersShareACollection) {
+  constexpr int num_threads = 4, num_per_thread = 2000, num_total = num_threads * num_per_thread;
+  DataManager manager(database_path_);
+  manager.AddCollection("strings", DataTypeEnum::String);
+  auto make_key = [](int number) {
+    auto digits = std::to_string(number);
+    return "member-" + std::string(5 - digits.size(), '0') + digits;
+  };
+
+  // Every thread adds its own keys, spread over the whole key range, so the threads write to the same leaves
+  // and split them while the others write. Some documents are large enough to go to overflow pages, and every
+  // thread removes some of its documents again.
+  std::vector<std::thread> writers;
+  for (int t = 0; t < num_threads; ++t) {
+    writers.emplace_back([&, t] {
+      for (int i = 0; i < num_per_thread; ++i) {
+        const auto number = ((i * 7919) % num_per_thread) * num_threads + t;
+        Document document;
+        document.AddElement("number", IntegralValue {number});
+        const auto name_size = number % 50 == 0 ? 3000 : 20;
+        document.AddElement("name", StringValue {std::string(name_size, static_cast<char>('a' + t))});
+        manager.AddValue("strings", neversql::internal::SpanValue(make_key(number)), document);
+        if (100 <= i && i % 10 == 0) {
+          const auto removed = ((i - 100) * 7919 % num_per_thread) * num_threads + t;
+          manager.Remove("strings", neversql::internal::SpanValue(make_key(removed)));
+        }
+      }
+    });
+  }
+  for (auto& writer : writers) {
+    writer.join();
+  }
+
+  std::vector<bool> is_removed(num_total);
+  for (int t = 0; t < num_threads; ++t) {
+    for (int i = 100; i < num_per_thread; i += 10) {
+      is_removed[((i - 100) * 7919 % num_per_thread) * num_threads + t] = true;
+    }
+  }
+  std::vector<int> expected;
+  for (int number = 0; number < num_total; ++number) {
+    if (!is_removed[number]) {
+      expected.push_back(number);
+    }
+  }
+  EXPECT_EQ(manager.Count("strings"), expected.size());
+  EXPECT_EQ(Numbers(manager.Begin("strings")), expected);
+  for (auto number : expected) {
+    auto key = make_key(number);
+    auto result = manager.Retrieve("strings", neversql::internal::SpanValue(key));
+    ASSERT_TRUE(result.IsFound()) << key;
+    EXPECT_EQ(Number(*result.entry), number);
+  }
+}
+
+TEST_F(DataManagerTest, FullPageCacheReportsError) {
+  DataAccessLayer data_access_layer(database_path_);
+  PageCache page_cache(database_path_ / "walfiles", 4, &data_access_layer);
+
+  // Hold on to a page in every slot of the cache, then there is no page that can be evicted.
+  std::vector<std::unique_ptr<Page>> pages;
+  for (int i = 0; i < 4; ++i) {
+    pages.push_back(page_cache.GetNewPage());
+  }
+  EXPECT_ANY_THROW(page_cache.GetNewPage());
+  EXPECT_ANY_THROW(page_cache.GetPage(pages[0]->GetPageNumber() + 10));
+
+  // Once a page is released, its slot can be reused.
+  auto page_number = pages.back()->GetPageNumber();
+  pages.pop_back();
+  pages.push_back(page_cache.GetNewPage());
+  EXPECT_NE(pages.back()->GetPageNumber(), page_number);
+  pages.clear();
+  EXPECT_EQ(page_cache.GetPage(page_number)->GetPageNumber(), page_number);
+}
+
+TEST_F(DataManagerTest, PinnedNodesAreSharedBetweenTrees) {
+  DataAccessLayer data_access_layer(database_path_);
+  PageCache page_cache(database_path_ / "walfiles", 32, &data_access_layer);
+  constexpr std::size_t max_pinned_pages = 32 / MAX_PINNED_PAGES_DIVISOR;
+  constexpr int num_entries = 3000;
+
+  // Groups of keys that only differ in their last character, so most separators are long, and the trees have
+  // many interior nodes.
+  const auto key = [](int i) {
+    return std::to_string(1000 + i / 10) + std::string(200, 'x') + std::to_string(i % 10);
+  };
+  const auto fill = [&](BTreeManager& tree) {
+    const std::string value = "value";
+    for (int i = 0; i < num_entries; ++i) {
+      const auto key_string = key(i);
+      auto creator =
+          neversql::internal::MakeCreator<neversql::internal::SpanPayloadSerializer>(SpanValue(value));
+      tree.AddValue(SpanValue(key_string), creator);
+    }
+  };
+  const auto search = [&](const BTreeManager& tree) {
+    for (int i = 0; i < num_entries; i += 10) {
+      const auto key_string = key(i);
+      EXPECT_FALSE(tree.Scan(KeyRange {.lower = SpanValue(key_string)}).IsEnd());
+    }
+  };
+
+  // While it is the only tree, a tree can pin the whole budget.
+  auto first = BTreeManager::CreateNewBTree(page_cache, DataTypeEnum::String);
+  fill(*first);
+  search(*first);
+  EXPECT_EQ(first->GetNumPinnedNodes(), max_pinned_pages);
+
+  // Once there is a second tree, the first one releases the pins over its share when the second tree needs
+  // them.
+  auto second = BTreeManager::CreateNewBTree(page_cache, DataTypeEnum::String);
+  fill(*second);
+  search(*second);
+  search(*first);
+  EXPECT_EQ(first->GetNumPinnedNodes(), max_pinned_pages / 2);
+  EXPECT_EQ(second->GetNumPinnedNodes(), max_pinned_pages / 2);
+  EXPECT_EQ(first->Count(), num_entries);
+  EXPECT_EQ(second->Count(), num_entries);
+
+  // Trees unpin their nodes when they are destroyed.
+  second.reset();
+  first.reset();
+  EXPECT_EQ(page_cache.GetNumPinnedPages(), 0);
+}
+
+}  // namespace testing
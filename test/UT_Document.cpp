@@ -5,6 +5,7 @@
 #include <gtest/gtest.h>
 
 #include "NeverSQL/data/Document.h"
+#include "NeverSQL/data/internals/DatabaseEntry.h"
 
 using namespace std::string_literals;
 using namespace std::string_view_literals;
@@ -13,6 +14,38 @@ using namespace neversql;
 
 namespace testing {
 
+namespace {
+
+//! \brief A database entry whose parts are pieces of a buffer of the same size, like an entry that is stored
+//!        across overflow pages.
+class PiecewiseEntry final : public neversql::internal::DatabaseEntry {
+public:
+  PiecewiseEntry(std::span<const std::byte> buffer, std::size_t piece_size)
+      : buffer_(buffer)
+      , piece_size_(piece_size) {}
+
+  std::span<const std::byte> GetData() const noexcept override {
+    return buffer_.subspan(offset_, std::min(piece_size_, buffer_.size() - offset_));
+  }
+
+  bool Advance() override {
+    if (buffer_.size() <= offset_ + piece_size_) {
+      return false;
+    }
+    offset_ += piece_size_;
+    return true;
+  }
+
+  bool IsValid() const override { return true; }
+
+private:
+  std::span<const std::byte> buffer_;
+  std::size_t piece_size_;
+  std::size_t offset_ {};
+};
+
+}  // namespace
+
 TEST(Document, Single_Integer) {
   Document document;
   document.AddElement("Age", IntegralValue {42});
@@ -134,4 +167,34 @@ TEST(Document, Strings) {
   EXPECT_EQ(read_document->TryGetAs<std::string>(2).value(), "World");
 }
 
-}  // namespace testing
\ No newline at end of file
+TEST(Document, ReadFromPieces) {
+  Document document;
+  document.AddElement("number", IntegralValue {42});
+  document.AddElement("text", StringValue {std::string(100, 'x')});
+  ArrayValue array(DataTypeEnum::Int64);
+  array.AddElement(IntegralValue {int64_t {1} << 40});
+  array.AddElement(IntegralValue {int64_t {-7}});
+  document.AddElement("elements", std::move(array));
+  document.AddElement("flag", BooleanValue {true});
+
+  lightning::memory::MemoryBuffer<std::byte> buffer;
+  WriteToBuffer(buffer, document);
+  std::span written_data(buffer.Data(), buffer.Size());
+
+  // Every value is split between pieces for some piece size.
+  for (std::size_t piece_size = 1; piece_size <= 16; ++piece_size) {
+    PiecewiseEntry entry(written_data, piece_size);
+    auto read_document = neversql::internal::EntryToDocument(entry);
+    ASSERT_EQ(read_document->GetNumFields(), 4) << piece_size;
+    EXPECT_EQ(read_document->TryGetAs<int32_t>("number").value(), 42);
+    EXPECT_EQ(read_document->TryGetAs<std::string>("text").value(), std::string(100, 'x'));
+    EXPECT_EQ(read_document->TryGetAs<bool>("flag").value(), true);
+    EXPECT_EQ(read_document->GetFieldType(2), DataTypeEnum::Array);
+  }
+
+  // A buffer that ends in the middle of a value cannot be read.
+  PiecewiseEntry truncated_entry(written_data.first(written_data.size() - 1), 8);
+  EXPECT_ANY_THROW(neversql::internal::EntryToDocument(truncated_entry));
+}
+
+}  // namespace testing
@@ -0,0 +1,144 @@
+//
+// Created by Nathaniel Rupprecht on 10/17/26.
+//
+
+#include <gtest/gtest.h>
+
+#include "NeverSQL/data/CompositeKey.h"
+#include "NeverSQL/data/internals/KeyComparison.h"
+#include "NeverSQL/data/internals/KeyEncoding.h"
+#include "NeverSQL/data/internals/Utility.h"
+
+using namespace neversql;
+
+namespace testing {
+
+namespace {
+
+//! \brief Check that normalizing a sorted list of values gives keys that compare in the same order.
+template<typename Value_t>
+void ExpectOrderPreserved(DataTypeEnum key_type, const std::vector<Value_t>& sorted_values) {
+  std::vector<std::vector<std::byte>> keys;
+  for (const auto& value : sorted_values) {
+    const auto normalized = neversql::internal::NormalizedKey(key_type, neversql::internal::SpanValue(value));
+    keys.emplace_back(normalized.Get().begin(), normalized.Get().end());
+  }
+  for (std::size_t i = 0; i + 1 < keys.size(); ++i) {
+    EXPECT_TRUE(neversql::internal::CompareKeys(keys[i], keys[i + 1]))
+        << sorted_values[i] << " should be less than " << sorted_values[i + 1];
+    EXPECT_FALSE(neversql::internal::CompareKeys(keys[i + 1], keys[i]));
+    // Key hints must agree with the order.
+    EXPECT_LE(neversql::internal::HintKey(keys[i]), neversql::internal::HintKey(keys[i + 1]));
+  }
+}
+
+}  // namespace
+
+TEST(KeyEncoding, UnsignedIntegersAreOrdered) {
+  ExpectOrderPreserved<uint64_t>(
+      DataTypeEnum::UInt64, {0, 1, 255, 256, 65535, 1ull << 32, (1ull << 63) - 1, 1ull << 63, ~0ull});
+}
+
+TEST(KeyEncoding, SignedIntegersAreOrdered) {
+  ExpectOrderPreserved<int64_t>(DataTypeEnum::Int64,
+                                {std::numeric_limits<int64_t>::min(), -(1ll << 40), -256, -1, 0, 1, 255, 256,
+                                 1ll << 40, std::numeric_limits<int64_t>::max()});
+  ExpectOrderPreserved<int32_t>(
+      DataTypeEnum::Int32,
+      {std::numeric_limits<int32_t>::min(), -70000, -1, 0, 1, 70000, std::numeric_limits<int32_t>::max()});
+}
+
+TEST(KeyEncoding, DoublesAreOrdered) {
+  constexpr auto infinity = std::numeric_limits<double>::infinity();
+  ExpectOrderPreserved<double>(
+      DataTypeEnum::Double,
+      {-infinity, -1e300, -2.5, -1., -1e-300, 0., 1e-300, 0.5, 1., 2.5, 1e300, infinity});
+
+  // Negative zero is the same key as zero.
+  const double zero = 0., negative_zero = -0.;
+  const auto normalized_zero =
+      neversql::internal::NormalizedKey(DataTypeEnum::Double, neversql::internal::SpanValue(zero));
+  const auto normalized_negative_zero =
+      neversql::internal::NormalizedKey(DataTypeEnum::Double, neversql::internal::SpanValue(negative_zero));
+  EXPECT_TRUE(std::ranges::equal(normalized_zero.Get(), normalized_negative_zero.Get()));
+}
+
+TEST(KeyEncoding, PrintNormalizedKeys) {
+  auto print = [](DataTypeEnum key_type, const auto& value) {
+    const auto normalized = neversql::internal::NormalizedKey(key_type, neversql::internal::SpanValue(value));
+    return neversql::internal::PrintNormalizedKey(key_type, normalized.Get());
+  };
+  EXPECT_EQ(print(DataTypeEnum::UInt64, uint64_t {12345}), "12345");
+  EXPECT_EQ(print(DataTypeEnum::Int64, int64_t {-12345}), "-12345");
+  EXPECT_EQ(print(DataTypeEnum::Int32, int32_t {-7}), "-7");
+  EXPECT_EQ(print(DataTypeEnum::Boolean, true), "true");
+}
+
+TEST(KeyEncoding, WrongKeySizeIsRejected) {
+  const int32_t value = 5;
+  EXPECT_ANY_THROW(
+      neversql::internal::NormalizedKey(DataTypeEnum::Int64, neversql::internal::SpanValue(value)));
+  EXPECT_ANY_THROW(neversql::internal::GetFixedKeySize(DataTypeEnum::Document));
+  EXPECT_FALSE(neversql::internal::IsValidKeyType(DataTypeEnum::Array));
+}
+
+TEST(KeyEncoding, CompositeKeysAreOrdered) {
+  auto key = [](int64_t tenant, std::string_view name, uint64_t id) {
+    const auto composite = CompositeKey {}.Add(tenant).Add(name).Add(id);
+    return std::vector<std::byte>(composite.Get().begin(), composite.Get().end());
+  };
+  using namespace std::string_view_literals;
+  // Sorted by tenant, then name (including names with zero bytes, and names that are prefixes of others),
+  // then id.
+  const std::vector keys {key(-5, "zebra", 1),
+                          key(-1, "", 7),
+                          key(-1, "a", 0),
+                          key(-1, "a\0"sv, 0),
+                          key(-1, "a\0\0"sv, 0),
+                          key(-1, "a\x01"sv, 0),
+                          key(-1, "ab", 0),
+                          key(-1, "ab", 1),
+                          key(0, "", 0),
+                          key(3, "a", 0)};
+  for (std::size_t i = 0; i + 1 < keys.size(); ++i) {
+    EXPECT_TRUE(neversql::internal::CompareKeys(keys[i], keys[i + 1])) << "key " << i;
+    EXPECT_FALSE(neversql::internal::CompareKeys(keys[i + 1], keys[i])) << "key " << i;
+  }
+}
+
+TEST(KeyEncoding, CompositeKeyFields) {
+  const std::vector field_types {DataTypeEnum::Int64, DataTypeEnum::String, DataTypeEnum::DateTime};
+  const auto key = CompositeKey {}.Add(int64_t {5}).Add(std::string_view("x\0y", 3)).AddDateTime(1000);
+  EXPECT_EQ(key.GetFieldTypes(), field_types);
+  EXPECT_EQ(neversql::internal::CountCompositeKeyFields(field_types, key), 3u);
+  EXPECT_EQ(neversql::internal::PrintCompositeKey(field_types, CompositeKey {}.Add(int64_t {-5}).Add("xy")),
+            "(-5, xy)");
+
+  // Keys with only the first few fields are prefixes of the full key.
+  const auto prefix = CompositeKey {}.Add(int64_t {5}).Add("x");
+  EXPECT_EQ(neversql::internal::CountCompositeKeyFields(field_types, prefix), 2u);
+  EXPECT_EQ(neversql::internal::CountCompositeKeyFields(field_types, CompositeKey {}), 0u);
+
+  // Keys that end in the middle of a field, or that have too many fields, are rejected.
+  EXPECT_ANY_THROW(neversql::internal::CountCompositeKeyFields(field_types, key.Get().first(4)));
+  EXPECT_ANY_THROW(neversql::internal::CountCompositeKeyFields(field_types, key.Get().first(10)));
+  const auto too_long = CompositeKey {key}.Add(int32_t {1});
+  EXPECT_ANY_THROW(neversql::internal::CountCompositeKeyFields(field_types, too_long));
+  EXPECT_ANY_THROW(CompositeKey {}.Add(DataTypeEnum::Document, {}));
+}
+
+TEST(KeyEncoding, PrefixSuccessor) {
+  auto bytes = [](std::initializer_list<uint8_t> values) {
+    std::vector<std::byte> output;
+    for (auto value : values) {
+      output.push_back(static_cast<std::byte>(value));
+    }
+    return output;
+  };
+  EXPECT_EQ(neversql::internal::PrefixSuccessor(bytes({1, 2, 3})), bytes({1, 2, 4}));
+  EXPECT_EQ(neversql::internal::PrefixSuccessor(bytes({1, 0xFF, 0xFF})), bytes({2}));
+  EXPECT_FALSE(neversql::internal::PrefixSuccessor(bytes({0xFF, 0xFF})));
+  EXPECT_FALSE(neversql::internal::PrefixSuccessor(bytes({})));
+}
+
+}  // namespace testing